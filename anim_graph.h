@@ -0,0 +1,423 @@
+// anim_graph.h
+//
+// The animation state machine as data. Every way out of a state is one line of
+// AnimTransitionDesc: source, target, the buttons that trigger it, the crossfade
+// that bridges the two clips, the frame data it waits for and how long it blends.
+// CompileAnimGraph turns the list into an AnimGraph: a dense table indexed by state
+// and packed buttons (PackInput) that holds the transition to take, plus each
+// state's capability bits. Stepping a player is then one table load whatever the
+// state, instead of a switch and a chain of button tests.
+//
+// The compiled graph is plain data without pointers, built once and shared read-only
+// by every match on every thread (AnimGraphTable). A batch of matches runs the same
+// code path for every player.
+//
+// Two kinds of transition:
+//   input      taken on the first tick its buttons match; starts the bridge crossfade
+//              from blend 0, or keeps the playing clips when it has none. The first
+//              matching line of a state wins.
+//   crossfade  the source state plays the bridge clips once the gate is open,
+//              blending over 'blendSeconds' of sim time, and moves to the target when
+//              the blend completes. A state has at most one, and no input transitions
+//              beside it.
+
+#pragma once
+
+#include "move_table.h"
+
+#include <iostream>
+#include <string>
+
+enum AnimState {
+	IDLE = 1,
+	IDLE_PUNCH,
+	PUNCH_IDLE,
+	IDLE_CROUCH,
+	CROUCH_IDLE,
+	IDLE_WALK,
+	WALK_IDLE,
+	WALK,
+	CROUCH,
+
+	CROUCH_HIT,
+	HIT_CROUCH,
+
+	CROUCH_BLOCK,
+	BLOCK_CROUCH,
+
+	IDLE_BLOCK,
+	BLOCK_IDLE,
+
+	IDLE_HIT,
+	HIT_IDLE,
+
+	IDLE_JUMP,
+	JUMP_IDLE,
+
+	IDLE_KICK,
+	KICK_IDLE,
+
+	ANIM_STATE_COUNT
+
+};
+
+// Clips every character provides. The render side maps these to its Animation objects.
+enum ClipId {
+	CLIP_NONE = -1,
+	CLIP_IDLE = 0,
+	CLIP_WALK,
+	CLIP_PUNCH,
+	CLIP_CROUCH,
+	CLIP_CROUCH_BLOCK,
+	CLIP_STAND_BLOCK,
+	CLIP_STAND_HIT,
+	CLIP_JUMP,
+	CLIP_JUMP_KICK,
+	CLIP_COUNT
+};
+
+// One bit per button of an InputFrame, as PackInput stores them.
+enum Button {
+	BUTTON_LEFT = 1 << 0,
+	BUTTON_RIGHT = 1 << 1,
+	BUTTON_JUMP = 1 << 2,
+	BUTTON_JUMP_KICK = 1 << 3,
+	BUTTON_PUNCH = 1 << 4,
+	BUTTON_CROUCH = 1 << 5,
+	BUTTON_STAND_BLOCK = 1 << 6,   // debug keys
+	BUTTON_CROUCH_BLOCK = 1 << 7,
+	BUTTON_HURT = 1 << 8
+};
+
+const int BUTTON_BITS = 9;
+const unsigned int DEBUG_BUTTONS = BUTTON_STAND_BLOCK | BUTTON_CROUCH_BLOCK | BUTTON_HURT;
+const int BUTTON_COMBINATIONS = 1 << BUTTON_BITS;
+
+const float CROSSFADE_SECONDS = 0.12f;   // about seven sim ticks
+const int MAX_ANIM_TRANSITIONS = 255;   // table cells are bytes, 0 = stay
+
+// what a state lets the player do
+enum StateCapability {
+	STATE_CAN_MOVE = 1 << 0,     // walking is not locked
+	STATE_CAN_ATTACK = 1 << 1,   // some transition out of the state starts a move (derived)
+	STATE_CROUCHING = 1 << 2     // crouch height and crouch hit reactions
+};
+
+// frame data a crossfade waits for before it may complete ("delay")
+enum TransitionGate {
+	GATE_NONE = 0,
+	GATE_STUN = 1 << 0,   // stunFrames has run out
+	GATE_MOVE = 1 << 1    // the move's recovery has run out
+};
+
+// stunFrames set by an input transition, from the character data
+enum TransitionStun {
+	STUN_KEEP,
+	STUN_TEST,            // testStun
+	STUN_CROUCH_BLOCK     // crouchBlockRelease
+};
+
+struct AnimStateDesc {
+	AnimState state;
+	const char* name;
+	unsigned int capabilities;   // STATE_CAN_MOVE | STATE_CROUCHING
+};
+
+struct AnimTransitionDesc {
+	AnimState from;
+	AnimState to;
+	unsigned int held;       // buttons that must all be down
+	unsigned int any;        // when non-zero, at least one of these must be down
+	unsigned int released;   // buttons that must all be up
+	ClipId bridge;           // crossfade bridge -> bridge2; CLIP_NONE keeps the playing clips
+	ClipId bridge2;
+	unsigned int gate;       // crossfade only
+	float blendSeconds;      // crossfade only; 0 for an input transition
+	MoveId move;             // started by an input transition
+	TransitionStun stun;
+};
+
+// An input transition: 'from' -> 'to' on the buttons, bridged by clip -> clip2.
+inline AnimTransitionDesc OnInput(AnimState from, AnimState to, unsigned int held, unsigned int any, unsigned int released,
+	ClipId clip, ClipId clip2, MoveId move = MOVE_NONE, TransitionStun stun = STUN_KEEP)
+{
+	return AnimTransitionDesc{ from, to, held, any, released, clip, clip2, GATE_NONE, 0.0f, move, stun };
+}
+
+// A crossfade: 'from' blends clip -> clip2 and settles in 'to' once 'gate' is open.
+inline AnimTransitionDesc AfterBlend(AnimState from, AnimState to, ClipId clip, ClipId clip2, unsigned int gate = GATE_NONE,
+	float blendSeconds = CROSSFADE_SECONDS)
+{
+	return AnimTransitionDesc{ from, to, 0, 0, 0, clip, clip2, gate, blendSeconds, MOVE_NONE, STUN_KEEP };
+}
+
+struct AnimTransition {
+	AnimState from;
+	AnimState to;
+	ClipId clip;
+	ClipId clip2;
+	unsigned int gate;
+	float blendSeconds;
+	MoveId move;
+	TransitionStun stun;
+};
+
+struct AnimGraph {
+	unsigned int capabilities[ANIM_STATE_COUNT];
+	unsigned char next[ANIM_STATE_COUNT][BUTTON_COMBINATIONS];   // 1 + index into transitions, 0 = stay
+	AnimTransition transitions[MAX_ANIM_TRANSITIONS];
+	int transitionCount;
+};
+
+inline bool ButtonsMatch(const AnimTransitionDesc& t, unsigned int buttons)
+{
+	return (buttons & t.held) == t.held && (t.any == 0 || (buttons & t.any) != 0) && (buttons & t.released) == 0;
+}
+
+// ----------------------------------------------------------------------------
+// compiler
+// ----------------------------------------------------------------------------
+
+// Builds 'graph' from the declarations. Every state has to be declared once; a
+// transition that can never be taken because earlier lines of its state cover all
+// its button combinations is an error, like a malformed one.
+inline bool CompileAnimGraph(const AnimStateDesc* states, int stateCount, const AnimTransitionDesc* transitions, int transitionCount,
+	AnimGraph& graph, std::string& error)
+{
+	graph = AnimGraph();
+	const char* names[ANIM_STATE_COUNT] = {};
+	bool declared[ANIM_STATE_COUNT] = {};
+	for (int i = 0; i < stateCount; ++i)
+	{
+		AnimState state = states[i].state;
+		if (state < IDLE || state >= ANIM_STATE_COUNT || declared[state])
+		{
+			error = std::string("state '") + states[i].name + "' is out of range or declared twice";
+			return false;
+		}
+		declared[state] = true;
+		graph.capabilities[state] = states[i].capabilities & (STATE_CAN_MOVE | STATE_CROUCHING);
+		names[state] = states[i].name;
+	}
+	for (int s = IDLE; s < ANIM_STATE_COUNT; ++s)
+	{
+		if (!declared[s])
+		{
+			error = "state " + std::to_string(s) + " is not declared";
+			return false;
+		}
+	}
+	if (transitionCount > MAX_ANIM_TRANSITIONS)
+	{
+		error = "more than " + std::to_string(MAX_ANIM_TRANSITIONS) + " transitions";
+		return false;
+	}
+
+	bool crossfades[ANIM_STATE_COUNT] = {};
+	bool inputs[ANIM_STATE_COUNT] = {};
+	for (int t = 0; t < transitionCount; ++t)
+	{
+		const AnimTransitionDesc& desc = transitions[t];
+		if (desc.from < IDLE || desc.from >= ANIM_STATE_COUNT || desc.to < IDLE || desc.to >= ANIM_STATE_COUNT)
+		{
+			error = "transition " + std::to_string(t) + " has a state out of range";
+			return false;
+		}
+		std::string name = std::string(names[desc.from]) + " -> " + names[desc.to];
+		if ((desc.bridge == CLIP_NONE) != (desc.bridge2 == CLIP_NONE) || desc.bridge >= CLIP_COUNT || desc.bridge2 >= CLIP_COUNT)
+		{
+			error = name + ": the bridge needs two clips, or none";
+			return false;
+		}
+
+		bool crossfade = desc.blendSeconds > 0.0f;
+		if (crossfade && (desc.held | desc.any | desc.released) != 0)
+		{
+			error = name + ": a crossfade can't wait for buttons";
+			return false;
+		}
+		if (crossfade && (desc.bridge == CLIP_NONE || desc.move != MOVE_NONE || desc.stun != STUN_KEEP))
+		{
+			error = name + ": a crossfade needs a bridge and can't start a move or stun";
+			return false;
+		}
+		if (!crossfade && desc.gate != GATE_NONE)
+		{
+			error = name + ": only a crossfade waits for a gate";
+			return false;
+		}
+		if (crossfades[desc.from] || (crossfade && inputs[desc.from]))
+		{
+			error = name + ": a state with a crossfade has no other transitions";
+			return false;
+		}
+		(crossfade ? crossfades : inputs)[desc.from] = true;
+
+		AnimTransition& out = graph.transitions[t];
+		out.from = desc.from;
+		out.to = desc.to;
+		out.clip = desc.bridge;
+		out.clip2 = desc.bridge2;
+		out.gate = desc.gate;
+		out.blendSeconds = desc.blendSeconds;
+		out.move = desc.move;
+		out.stun = desc.stun;
+		if (desc.move != MOVE_NONE)
+			graph.capabilities[desc.from] |= STATE_CAN_ATTACK;
+
+		// fill every combination of buttons the earlier lines of this state left open
+		int cells = 0;
+		for (unsigned int buttons = 0; buttons < (unsigned int)BUTTON_COMBINATIONS; ++buttons)
+		{
+			unsigned char& cell = graph.next[desc.from][buttons];
+			if (cell == 0 && (crossfade || ButtonsMatch(desc, buttons)))
+			{
+				cell = (unsigned char)(t + 1);
+				++cells;
+			}
+		}
+		if (cells == 0)
+		{
+			error = name + ": never taken, earlier transitions cover all its buttons";
+			return false;
+		}
+	}
+	graph.transitionCount = transitionCount;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// the fighters' graph
+// ----------------------------------------------------------------------------
+
+inline AnimGraph CompileFighterGraph()
+{
+	const AnimStateDesc states[] = {
+		{ IDLE,         "idle",         STATE_CAN_MOVE },
+		{ IDLE_PUNCH,   "idle_punch",   0 },
+		{ PUNCH_IDLE,   "punch_idle",   0 },
+		{ IDLE_CROUCH,  "idle_crouch",  STATE_CROUCHING },
+		{ CROUCH_IDLE,  "crouch_idle",  STATE_CROUCHING },
+		{ IDLE_WALK,    "idle_walk",    STATE_CAN_MOVE },
+		{ WALK_IDLE,    "walk_idle",    STATE_CAN_MOVE },
+		{ WALK,         "walk",         STATE_CAN_MOVE },
+		{ CROUCH,       "crouch",       STATE_CROUCHING },
+		{ CROUCH_HIT,   "crouch_hit",   STATE_CROUCHING },
+		{ HIT_CROUCH,   "hit_crouch",   STATE_CROUCHING },
+		{ CROUCH_BLOCK, "crouch_block", STATE_CROUCHING },
+		{ BLOCK_CROUCH, "block_crouch", STATE_CROUCHING },
+		{ IDLE_BLOCK,   "idle_block",   0 },
+		{ BLOCK_IDLE,   "block_idle",   0 },
+		{ IDLE_HIT,     "idle_hit",     0 },
+		{ HIT_IDLE,     "hit_idle",     0 },
+		{ IDLE_JUMP,    "idle_jump",    STATE_CAN_MOVE },   // no way back yet
+		{ JUMP_IDLE,    "jump_idle",    STATE_CAN_MOVE },
+		{ IDLE_KICK,    "idle_kick",    STATE_CAN_MOVE },
+		{ KICK_IDLE,    "kick_idle",    STATE_CAN_MOVE },
+	};
+
+	const unsigned int WALKING = BUTTON_LEFT | BUTTON_RIGHT;
+	const AnimTransitionDesc transitions[] = {
+		// ========================= IDLE =========================
+		// a kick wins over walking; a standing punch wins over the kick
+		OnInput(IDLE, IDLE_KICK,   BUTTON_JUMP_KICK, WALKING, 0, CLIP_IDLE, CLIP_JUMP_KICK, MOVE_JUMP_KICK),
+		OnInput(IDLE, IDLE_WALK,   0, WALKING, 0,                CLIP_IDLE, CLIP_WALK),
+		OnInput(IDLE, IDLE_PUNCH,  BUTTON_PUNCH, 0, 0,           CLIP_IDLE, CLIP_PUNCH, MOVE_PUNCH),
+		OnInput(IDLE, IDLE_KICK,   BUTTON_JUMP_KICK, 0, 0,       CLIP_IDLE, CLIP_JUMP_KICK, MOVE_JUMP_KICK),
+		OnInput(IDLE, IDLE_CROUCH, BUTTON_CROUCH, 0, 0,          CLIP_IDLE, CLIP_CROUCH),
+		OnInput(IDLE, IDLE_BLOCK,  BUTTON_STAND_BLOCK, 0, 0,     CLIP_IDLE, CLIP_STAND_BLOCK, MOVE_NONE, STUN_TEST),
+		OnInput(IDLE, IDLE_HIT,    BUTTON_HURT, 0, 0,            CLIP_IDLE, CLIP_STAND_HIT, MOVE_NONE, STUN_TEST),
+		OnInput(IDLE, IDLE_JUMP,   BUTTON_JUMP, 0, 0,            CLIP_IDLE, CLIP_JUMP),
+
+		// ========================= CROUCH =========================
+		AfterBlend(IDLE_CROUCH, CROUCH, CLIP_IDLE, CLIP_CROUCH),
+		OnInput(CROUCH, CROUCH_IDLE,  0, 0, BUTTON_CROUCH,       CLIP_CROUCH, CLIP_IDLE),
+		OnInput(CROUCH, CROUCH_BLOCK, BUTTON_CROUCH_BLOCK, 0, 0, CLIP_CROUCH, CLIP_CROUCH_BLOCK, MOVE_NONE, STUN_CROUCH_BLOCK),
+		OnInput(CROUCH, CROUCH_HIT,   BUTTON_HURT, 0, 0,         CLIP_CROUCH, CLIP_STAND_HIT, MOVE_NONE, STUN_TEST),
+		AfterBlend(CROUCH_IDLE, IDLE, CLIP_CROUCH, CLIP_IDLE),
+		AfterBlend(CROUCH_HIT, HIT_IDLE, CLIP_CROUCH, CLIP_STAND_HIT),
+		AfterBlend(HIT_CROUCH, IDLE, CLIP_STAND_HIT, CLIP_IDLE, GATE_STUN),
+		AfterBlend(CROUCH_BLOCK, BLOCK_CROUCH, CLIP_CROUCH, CLIP_CROUCH_BLOCK),
+		AfterBlend(BLOCK_CROUCH, CROUCH, CLIP_CROUCH_BLOCK, CLIP_CROUCH, GATE_STUN),
+
+		// ========================= WALK =========================
+		AfterBlend(IDLE_WALK, WALK, CLIP_IDLE, CLIP_WALK),
+		OnInput(WALK, IDLE_PUNCH,  BUTTON_PUNCH, 0, 0,  CLIP_IDLE, CLIP_PUNCH, MOVE_PUNCH),
+		OnInput(WALK, IDLE_CROUCH, BUTTON_CROUCH, 0, 0, CLIP_IDLE, CLIP_CROUCH),
+		OnInput(WALK, WALK_IDLE,   0, 0, WALKING,       CLIP_NONE, CLIP_NONE),
+		AfterBlend(WALK_IDLE, IDLE, CLIP_WALK, CLIP_IDLE),
+
+		// ========================= PUNCH =========================
+		AfterBlend(IDLE_PUNCH, PUNCH_IDLE, CLIP_IDLE, CLIP_PUNCH),
+		AfterBlend(PUNCH_IDLE, IDLE, CLIP_PUNCH, CLIP_IDLE, GATE_MOVE),
+
+		// ========================= Kick =========================
+		AfterBlend(IDLE_KICK, KICK_IDLE, CLIP_IDLE, CLIP_JUMP_KICK),
+		AfterBlend(KICK_IDLE, IDLE, CLIP_JUMP_KICK, CLIP_IDLE, GATE_MOVE),
+
+		// ========================= Hit =========================
+		AfterBlend(IDLE_HIT, HIT_IDLE, CLIP_IDLE, CLIP_STAND_HIT),
+		AfterBlend(HIT_IDLE, IDLE, CLIP_STAND_HIT, CLIP_IDLE, GATE_STUN),
+
+		// ========================= Block =========================
+		AfterBlend(IDLE_BLOCK, BLOCK_IDLE, CLIP_IDLE, CLIP_STAND_BLOCK),
+		AfterBlend(BLOCK_IDLE, IDLE, CLIP_STAND_BLOCK, CLIP_IDLE, GATE_STUN),
+	};
+
+	AnimGraph graph;
+	std::string error;
+	if (!CompileAnimGraph(states, sizeof(states) / sizeof(states[0]), transitions, sizeof(transitions) / sizeof(transitions[0]),
+		graph, error))
+		std::cout << "ERROR::ANIM_GRAPH:: " << error << std::endl;
+	return graph;
+}
+
+// compiled on first use, once for the whole process
+inline const AnimGraph& AnimGraphTable()
+{
+	static const AnimGraph graph = CompileFighterGraph();
+	return graph;
+}
+
+inline bool CanMove(AnimState state)
+{
+	return (AnimGraphTable().capabilities[state] & STATE_CAN_MOVE) != 0;
+}
+
+inline bool IsCrouching(AnimState state)
+{
+	return (AnimGraphTable().capabilities[state] & STATE_CROUCHING) != 0;
+}
+
+// ----------------------------------------------------------------------------
+// prediction
+// ----------------------------------------------------------------------------
+
+// The clips a player in 'state' may start within the next 'depth' transitions, one
+// bit per ClipId. Input transitions count if some combination of 'buttons' takes
+// them; crossfades need no buttons and always count. The asset side uses this to
+// load clips before the state machine asks for them (clip_registry.h).
+inline unsigned int PredictClips(const AnimGraph& graph, AnimState state, unsigned int buttons, int depth = 2)
+{
+	if (depth <= 0)
+		return 0;
+	unsigned int clips = 0;
+	bool seen[MAX_ANIM_TRANSITIONS] = {};
+	buttons &= BUTTON_COMBINATIONS - 1;
+	// every subset of 'buttons', down to none
+	for (unsigned int held = buttons;; held = (held - 1) & buttons)
+	{
+		int next = graph.next[state][held];
+		if (next != 0 && !seen[next - 1])
+		{
+			seen[next - 1] = true;
+			const AnimTransition& t = graph.transitions[next - 1];
+			if (t.clip != CLIP_NONE)
+				clips |= (1u << t.clip) | (1u << t.clip2);
+			clips |= PredictClips(graph, t.to, buttons, depth - 1);
+		}
+		if (held == 0)
+			break;
+	}
+	return clips;
+}
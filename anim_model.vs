@@ -14,13 +14,18 @@ uniform mat4 model;
 
 const int MAX_BONES = 100;
 const int MAX_BONE_INFLUENCE = 4;
-uniform mat4 finalBonesMatrices[MAX_BONES];
+layout(std140) uniform BonePalette
+{
+    mat4 finalBonesMatrices[MAX_BONES];
+};
 
 out vec2 TexCoords;
+out vec3 Normal;
 
 void main()
 {
     vec4 totalPosition = vec4(0.0f);
+    vec3 totalNormal = vec3(0.0f);
     for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
     {
         if(boneIds[i] == -1) 
@@ -28,14 +33,17 @@ void main()
         if(boneIds[i] >=MAX_BONES) 
         {
             totalPosition = vec4(pos,1.0f);
+            totalNormal = norm;
             break;
         }
         vec4 localPosition = finalBonesMatrices[boneIds[i]] * vec4(pos,1.0f);
         totalPosition += localPosition * weights[i];
         vec3 localNormal = mat3(finalBonesMatrices[boneIds[i]]) * norm;
+        totalNormal += localNormal * weights[i];
    }
 	
     mat4 viewModel = view * model;
     gl_Position =  projection * viewModel * totalPosition;
+    Normal = normalize(mat3(model) * totalNormal);
 	TexCoords = tex;
 }
@@ -0,0 +1,50 @@
+#version 330 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec2 tex;
+layout(location = 3) in vec3 tangent;
+layout(location = 4) in vec3 bitangent;
+layout(location = 5) in ivec4 boneIds;
+layout(location = 6) in vec4 weights;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+const int MAX_BONES = 100;
+const int MAX_BONE_INFLUENCE = 4;
+
+// three rows of each bone's affine matrix (skinning.h, SKIN_AFFINE3X4)
+layout(std140) uniform BonePalette
+{
+    vec4 boneRows[MAX_BONES * 3];
+};
+
+out vec2 TexCoords;
+out vec3 Normal;
+
+void main()
+{
+    // blend the matrices once instead of transforming by each bone; unused
+    // slots have id -1 and weight 0, so they add nothing
+    vec4 row0 = vec4(0.0);
+    vec4 row1 = vec4(0.0);
+    vec4 row2 = vec4(0.0);
+    for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
+    {
+        int b = clamp(boneIds[i], 0, MAX_BONES - 1) * 3;
+        row0 += boneRows[b] * weights[i];
+        row1 += boneRows[b + 1] * weights[i];
+        row2 += boneRows[b + 2] * weights[i];
+    }
+
+    vec4 p = vec4(pos, 1.0);
+    vec3 skinnedPos = vec3(dot(row0, p), dot(row1, p), dot(row2, p));
+    // bones are rigid or uniformly scaled, so the linear part is fine for normals
+    vec3 skinnedNormal = vec3(dot(row0.xyz, norm), dot(row1.xyz, norm), dot(row2.xyz, norm));
+
+    gl_Position = projection * view * model * vec4(skinnedPos, 1.0);
+    Normal = normalize(mat3(model) * skinnedNormal);
+	TexCoords = tex;
+}
@@ -0,0 +1,60 @@
+#version 330 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec2 tex;
+layout(location = 3) in vec3 tangent;
+layout(location = 4) in vec3 bitangent;
+layout(location = 5) in ivec4 boneIds;
+layout(location = 6) in vec4 weights;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+const int MAX_BONES = 100;
+const int MAX_BONE_INFLUENCE = 4;
+
+// real and dual quaternion of each bone, both (x, y, z, w) (skinning.h, SKIN_DUALQUAT)
+layout(std140) uniform BonePalette
+{
+    vec4 boneDQ[MAX_BONES * 2];
+};
+
+out vec2 TexCoords;
+out vec3 Normal;
+
+vec3 Rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    // dual quaternion linear blending; flip bones in the other hemisphere from
+    // the first one so the blend takes the short way round
+    vec4 pivot = boneDQ[clamp(boneIds[0], 0, MAX_BONES - 1) * 2];
+    vec4 real = vec4(0.0);
+    vec4 dual = vec4(0.0);
+    for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
+    {
+        int b = clamp(boneIds[i], 0, MAX_BONES - 1) * 2;
+        vec4 r = boneDQ[b];
+        float w = dot(r, pivot) < 0.0 ? -weights[i] : weights[i];
+        real += r * w;
+        dual += boneDQ[b + 1] * w;
+    }
+
+    // unweighted vertices end up with real == 0 and stay in bind pose
+    float len = max(length(real), 1e-6);
+    real /= len;
+    dual /= len;
+
+    vec3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+    vec3 skinnedPos = Rotate(real, pos) + translation;
+    vec3 skinnedNormal = Rotate(real, norm);
+
+    gl_Position = projection * view * model * vec4(skinnedPos, 1.0);
+    Normal = normalize(mat3(model) * skinnedNormal);
+	TexCoords = tex;
+}
@@ -0,0 +1,45 @@
+#version 330 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec2 tex;
+layout(location = 3) in vec3 tangent;
+layout(location = 4) in vec3 bitangent;
+layout(location = 5) in ivec4 boneIds;
+layout(location = 6) in vec4 weights;
+layout(location = 7) in mat4 instanceModel;   // locations 7-10, one per instance
+
+uniform mat4 projection;
+uniform mat4 view;
+
+const int MAX_BONE_INFLUENCE = 4;
+
+// every instance's bones as three rows of the affine matrix (instanced_skinning.h)
+uniform samplerBuffer bonePalettes;
+uniform int bonesPerInstance;
+
+out vec2 TexCoords;
+out vec3 Normal;
+
+void main()
+{
+    int first = gl_InstanceID * bonesPerInstance;
+    vec4 row0 = vec4(0.0);
+    vec4 row1 = vec4(0.0);
+    vec4 row2 = vec4(0.0);
+    for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
+    {
+        int b = (first + clamp(boneIds[i], 0, bonesPerInstance - 1)) * 3;
+        row0 += texelFetch(bonePalettes, b) * weights[i];
+        row1 += texelFetch(bonePalettes, b + 1) * weights[i];
+        row2 += texelFetch(bonePalettes, b + 2) * weights[i];
+    }
+
+    vec4 p = vec4(pos, 1.0);
+    vec3 skinnedPos = vec3(dot(row0, p), dot(row1, p), dot(row2, p));
+    vec3 skinnedNormal = vec3(dot(row0.xyz, norm), dot(row1.xyz, norm), dot(row2.xyz, norm));
+
+    gl_Position = projection * view * instanceModel * vec4(skinnedPos, 1.0);
+    Normal = normalize(mat3(instanceModel) * skinnedNormal);
+	TexCoords = tex;
+}
@@ -0,0 +1,11 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 Normal;
+
+// the skinned normal as a color, for comparing the skinning shaders (tools/instancing_check.cpp)
+void main()
+{
+    FragColor = vec4(normalize(Normal) * 0.5 + 0.5, 1.0);
+}
@@ -0,0 +1,626 @@
+// asset_cache.h
+//
+// Versioned binary cache for the character .dae files. Next to every source file
+// we keep "<file>.lhfc" holding exactly what asset_import.h extracts: mesh vertex
+// and index blobs, the bone map and the clip's node hierarchy and keyframe tracks.
+// The asset loader maps the cache and uses the blobs in place (MapAsset): the
+// vertices and indices are uploaded straight from the mapping and the keys are
+// compressed from it, then the file is unmapped. ReadAssetCache copies them out
+// instead, for callers that keep ModelData / ClipData. Assimp only runs when the
+// cache is missing, from an older format version, or was built from a source
+// file whose size or modification time has changed since. The
+// header also keeps a hash of the source file's contents, so telling whether two
+// characters were exported from the same files only reads the headers.
+//
+// Layout (little endian, native struct layout, no padding between fields):
+//   CacheHeader
+//   [model]  u32 meshCount, per mesh { u32 vertexCount, u32 indexCount, str texture,
+//                                      SkinVertex[vertexCount], u32[indexCount] }
+//            u32 boneCount, per bone { str name, i32 id, mat4 offset }
+//   [clip]   f32 duration, f32 ticksPerSecond
+//            u32 nodeCount,  per node  { str name, i32 parent, mat4 transformation }
+//            u32 trackCount, per track { i32 node, u32 nPos, u32 nRot, u32 nScale,
+//                                        KeyPos[nPos], KeyRot[nRot], KeyScale[nScale] }
+//   str = u32 length + bytes
+//   Every array starts at a multiple of CACHE_ARRAY_ALIGNMENT from the start of the
+//   file, zero-padded up to it, so it can be read where it is mapped.
+
+#pragma once
+
+#include "asset_data.h"
+#include "asset_import.h"
+#include "match_sim.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// bump whenever the layout above or the import rules in asset_import.h change
+const uint32_t ASSET_CACHE_VERSION = 3;
+
+const size_t CACHE_ARRAY_ALIGNMENT = 16;
+
+const uint32_t CACHE_HAS_MODEL = 1u << 0;
+const uint32_t CACHE_HAS_CLIP = 1u << 1;
+
+struct CacheHeader {
+	char magic[4];          // "LHFC"
+	uint32_t version;
+	uint32_t vertexSize;    // sizeof(SkinVertex) of the writer
+	uint32_t contents;      // CACHE_HAS_* bits
+	uint64_t sourceSize;
+	int64_t sourceMTime;
+	uint64_t sourceHash;    // ContentHash() of the source file
+};
+
+// 64-bit FNV-1a taken 8 bytes at a time, with the high half folded back in after
+// each word so every bit reaches the low ones. Tells files apart, nothing more: it
+// is not meant to stand up to anyone crafting a collision.
+inline uint64_t ContentHash(const unsigned char* data, size_t size)
+{
+	const uint64_t prime = 1099511628211ull;
+	uint64_t hash = 14695981039346656037ull ^ size;
+	size_t words = size / 8;
+	for (size_t w = 0; w < words; ++w)
+	{
+		uint64_t word;
+		memcpy(&word, data + w * 8, 8);
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 32;
+	}
+	for (size_t b = words * 8; b < size; ++b)
+		hash = (hash ^ data[b]) * prime;
+	return hash;
+}
+
+// ----------------------------------------------------------------------------
+// read-only file mapping
+// ----------------------------------------------------------------------------
+
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile() { Close(); }
+
+	bool Open(const std::string& path)
+	{
+		Close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+		{
+			Close();
+			return false;
+		}
+		data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		size = (size_t)fileSize.QuadPart;
+#else
+		fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			Close();
+			return false;
+		}
+		void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		data = view == MAP_FAILED ? NULL : (const unsigned char*)view;
+		size = (size_t)info.st_size;
+#endif
+		if (!data)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data)
+			munmap((void*)data, size);
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+	const unsigned char* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const unsigned char* data = NULL;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int fd = -1;
+#endif
+};
+
+// ----------------------------------------------------------------------------
+// reading
+// ----------------------------------------------------------------------------
+
+// bounds-checked cursor over the mapping; any overrun flips 'ok' and reads zeros
+struct CacheReader {
+	const unsigned char* base;   // start of the file, for the array alignment
+	const unsigned char* cursor;
+	const unsigned char* end;
+	bool ok;
+
+	bool Bytes(void* dst, size_t count)
+	{
+		if (!ok || (size_t)(end - cursor) < count)
+		{
+			ok = false;
+			memset(dst, 0, count);
+			return false;
+		}
+		memcpy(dst, cursor, count);
+		cursor += count;
+		return true;
+	}
+
+	template <typename T>
+	T Value()
+	{
+		T value;
+		Bytes(&value, sizeof(T));
+		return value;
+	}
+
+	// an array where it lies in the mapping; NULL on an overrun
+	template <typename T>
+	const T* Array(uint32_t count)
+	{
+		size_t padding = (CACHE_ARRAY_ALIGNMENT - (size_t)(cursor - base) % CACHE_ARRAY_ALIGNMENT) % CACHE_ARRAY_ALIGNMENT;
+		if (!ok || (size_t)(end - cursor) < padding || (size_t)(end - cursor - padding) / sizeof(T) < count)
+		{
+			ok = false;
+			return NULL;
+		}
+		const T* values = (const T*)(cursor + padding);
+		cursor += padding + (size_t)count * sizeof(T);
+		return values;
+	}
+
+	std::string String()
+	{
+		uint32_t length = Value<uint32_t>();
+		if (!ok || (size_t)(end - cursor) < length)
+		{
+			ok = false;
+			return std::string();
+		}
+		std::string s((const char*)cursor, length);
+		cursor += length;
+		return s;
+	}
+};
+
+// Everything but the vertex and index arrays goes into 'model'; those are left in
+// the mapping and appended to 'meshes'.
+inline void ReadModel(CacheReader& in, ModelData& model, std::vector<MeshView>& meshes)
+{
+	model.meshes.resize(in.Value<uint32_t>());
+	for (size_t m = 0; m < model.meshes.size() && in.ok; ++m)
+	{
+		MeshData& mesh = model.meshes[m];
+		MeshView view;
+		view.vertexCount = in.Value<uint32_t>();
+		view.indexCount = in.Value<uint32_t>();
+		mesh.diffuseTexture = in.String();
+		view.diffuseTexture = &mesh.diffuseTexture;
+		view.vertices = in.Array<SkinVertex>((uint32_t)view.vertexCount);
+		view.indices = in.Array<unsigned int>((uint32_t)view.indexCount);
+		meshes.push_back(view);
+	}
+
+	model.bones.clear();
+	uint32_t boneCount = in.Value<uint32_t>();
+	for (uint32_t b = 0; b < boneCount && in.ok; ++b)
+	{
+		std::string name = in.String();
+		BoneData bone;
+		bone.id = in.Value<int32_t>();
+		bone.offset = in.Value<glm::mat4>();
+		model.bones[name] = bone;
+	}
+}
+
+// The timing and nodes go into 'clip'; the tracks are left in the mapping and
+// appended to 'tracks'.
+inline void ReadClip(CacheReader& in, ClipData& clip, std::vector<TrackView>& tracks)
+{
+	clip.duration = in.Value<float>();
+	clip.ticksPerSecond = in.Value<float>();
+
+	clip.nodes.resize(in.Value<uint32_t>());
+	for (size_t n = 0; n < clip.nodes.size() && in.ok; ++n)
+	{
+		clip.nodes[n].name = in.String();
+		clip.nodes[n].parent = in.Value<int32_t>();
+		clip.nodes[n].transformation = in.Value<glm::mat4>();
+	}
+
+	clip.tracks.clear();
+	uint32_t trackCount = in.Value<uint32_t>();
+	for (uint32_t t = 0; t < trackCount && in.ok; ++t)
+	{
+		TrackView track;
+		track.node = in.Value<int32_t>();
+		track.positionCount = in.Value<uint32_t>();
+		track.rotationCount = in.Value<uint32_t>();
+		track.scaleCount = in.Value<uint32_t>();
+		track.positions = in.Array<KeyPos>((uint32_t)track.positionCount);
+		track.rotations = in.Array<KeyRot>((uint32_t)track.rotationCount);
+		track.scales = in.Array<KeyScale>((uint32_t)track.scaleCount);
+		if (track.node < 0 || track.node >= (int)clip.nodes.size())
+			in.ok = false;
+		tracks.push_back(track);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// writing
+// ----------------------------------------------------------------------------
+
+struct CacheWriter {
+	FILE* file;
+	size_t offset;   // bytes written so far
+
+	void Bytes(const void* src, size_t count)
+	{
+		if (count)
+			fwrite(src, 1, count, file);
+		offset += count;
+	}
+
+	template <typename T>
+	void Value(const T& value) { Bytes(&value, sizeof(T)); }
+
+	// padded to CACHE_ARRAY_ALIGNMENT first, see CacheReader::Array
+	template <typename T>
+	void Array(const std::vector<T>& values)
+	{
+		static const unsigned char zeros[CACHE_ARRAY_ALIGNMENT] = {};
+		Bytes(zeros, (CACHE_ARRAY_ALIGNMENT - offset % CACHE_ARRAY_ALIGNMENT) % CACHE_ARRAY_ALIGNMENT);
+		Bytes(values.data(), values.size() * sizeof(T));
+	}
+
+	void String(const std::string& s)
+	{
+		Value((uint32_t)s.size());
+		Bytes(s.data(), s.size());
+	}
+};
+
+inline void WriteModel(CacheWriter& out, const ModelData& model)
+{
+	out.Value((uint32_t)model.meshes.size());
+	for (const MeshData& mesh : model.meshes)
+	{
+		out.Value((uint32_t)mesh.vertices.size());
+		out.Value((uint32_t)mesh.indices.size());
+		out.String(mesh.diffuseTexture);
+		out.Array(mesh.vertices);
+		out.Array(mesh.indices);
+	}
+
+	out.Value((uint32_t)model.bones.size());
+	for (const auto& entry : model.bones)
+	{
+		out.String(entry.first);
+		out.Value((int32_t)entry.second.id);
+		out.Value(entry.second.offset);
+	}
+}
+
+inline void WriteClip(CacheWriter& out, const ClipData& clip)
+{
+	out.Value(clip.duration);
+	out.Value(clip.ticksPerSecond);
+
+	out.Value((uint32_t)clip.nodes.size());
+	for (const NodeData& node : clip.nodes)
+	{
+		out.String(node.name);
+		out.Value((int32_t)node.parent);
+		out.Value(node.transformation);
+	}
+
+	out.Value((uint32_t)clip.tracks.size());
+	for (const TrackData& track : clip.tracks)
+	{
+		out.Value((int32_t)track.node);
+		out.Value((uint32_t)track.positions.size());
+		out.Value((uint32_t)track.rotations.size());
+		out.Value((uint32_t)track.scales.size());
+		out.Array(track.positions);
+		out.Array(track.rotations);
+		out.Array(track.scales);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// cache front end
+// ----------------------------------------------------------------------------
+
+inline bool StatSource(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return false;
+	size = (uint64_t)info.st_size;
+	mtime = (int64_t)info.st_mtime;
+	return true;
+}
+
+inline std::string CachePath(const std::string& sourcePath)
+{
+	return sourcePath + ".lhfc";
+}
+
+inline CacheHeader MakeCacheHeader(uint32_t contents, uint64_t sourceSize, int64_t sourceMTime, uint64_t sourceHash)
+{
+	CacheHeader header;
+	memcpy(header.magic, "LHFC", 4);
+	header.version = ASSET_CACHE_VERSION;
+	header.vertexSize = (uint32_t)sizeof(SkinVertex);
+	header.contents = contents;
+	header.sourceSize = sourceSize;
+	header.sourceMTime = sourceMTime;
+	header.sourceHash = sourceHash;
+	return header;
+}
+
+// Maps the cache of 'sourcePath' and reads its header. False if the cache is
+// missing, from another version or build, or stale against the source.
+inline bool OpenAssetCache(const std::string& sourcePath, MappedFile& file, CacheReader& in, CacheHeader& header)
+{
+	uint64_t sourceSize = 0;
+	int64_t sourceMTime = 0;
+	bool haveSource = StatSource(sourcePath, sourceSize, sourceMTime);
+
+	if (!file.Open(CachePath(sourcePath)))
+		return false;
+
+	in = CacheReader{ file.Data(), file.Data(), file.Data() + file.Size(), true };
+	header = in.Value<CacheHeader>();
+	if (!in.ok || memcmp(header.magic, "LHFC", 4) != 0 || header.version != ASSET_CACHE_VERSION
+		|| header.vertexSize != sizeof(SkinVertex))
+		return false;
+
+	// without the source (shipping only the caches) any valid cache is good enough
+	return !haveSource || (header.sourceSize == sourceSize && header.sourceMTime == sourceMTime);
+}
+
+// A character file's vertex, index and key arrays, read where they are (MapAsset).
+// They stay valid as long as this does; destroying it unmaps the cache.
+struct MappedAsset {
+	MappedFile file;                  // not open when the arrays came from an import
+	std::vector<MeshView> meshes;
+	std::vector<TrackView> tracks;
+};
+
+// Maps the cache into 'mapped' and fills whichever of model / clip is non-NULL
+// with everything but the arrays, which 'mapped' points at. False if the cache is
+// missing, stale, truncated, or doesn't contain what was asked for.
+inline bool MapAssetCache(const std::string& sourcePath, ModelData* model, ClipData* clip, MappedAsset& mapped)
+{
+	CacheReader in;
+	CacheHeader header;
+	mapped.meshes.clear();
+	mapped.tracks.clear();
+	if (!OpenAssetCache(sourcePath, mapped.file, in, header))
+		return false;
+
+	if ((model && !(header.contents & CACHE_HAS_MODEL)) || (clip && !(header.contents & CACHE_HAS_CLIP)))
+		return false;
+
+	// sections are in a fixed order, so a model section we don't want still has to be walked past
+	ModelData skipped;
+	std::vector<MeshView> skippedMeshes;
+	if (header.contents & CACHE_HAS_MODEL)
+		ReadModel(in, model ? *model : skipped, model ? mapped.meshes : skippedMeshes);
+	if (clip)
+		ReadClip(in, *clip, mapped.tracks);
+	return in.ok;
+}
+
+// Fills whichever of model / clip is non-NULL from the cache, arrays included, and
+// unmaps it. False if the cache is missing, stale, truncated, or doesn't contain
+// what was asked for.
+inline bool ReadAssetCache(const std::string& sourcePath, ModelData* model, ClipData* clip)
+{
+	MappedAsset mapped;
+	if (!MapAssetCache(sourcePath, model, clip, mapped))
+		return false;
+
+	for (size_t m = 0; m < mapped.meshes.size(); ++m)
+	{
+		const MeshView& view = mapped.meshes[m];
+		model->meshes[m].vertices.assign(view.vertices, view.vertices + view.vertexCount);
+		model->meshes[m].indices.assign(view.indices, view.indices + view.indexCount);
+	}
+	if (clip)
+	{
+		clip->tracks.resize(mapped.tracks.size());
+		for (size_t t = 0; t < mapped.tracks.size(); ++t)
+		{
+			const TrackView& view = mapped.tracks[t];
+			TrackData& track = clip->tracks[t];
+			track.node = view.node;
+			track.positions.assign(view.positions, view.positions + view.positionCount);
+			track.rotations.assign(view.rotations, view.rotations + view.rotationCount);
+			track.scales.assign(view.scales, view.scales + view.scaleCount);
+		}
+	}
+	return true;
+}
+
+inline bool WriteAssetCache(const std::string& sourcePath, const ModelData* model, const ClipData* clip)
+{
+	uint64_t sourceSize = 0;
+	int64_t sourceMTime = 0;
+	if (!StatSource(sourcePath, sourceSize, sourceMTime))
+		return false;
+	MappedFile source;
+	if (!source.Open(sourcePath))
+		return false;
+	uint64_t sourceHash = ContentHash(source.Data(), source.Size());
+
+	// write next to the final name and rename, so a crash never leaves half a cache behind
+	std::string path = CachePath(sourcePath);
+	std::string temp = path + ".tmp";
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file)
+		return false;
+
+	CacheWriter out = { file, 0 };
+	uint32_t contents = (model ? CACHE_HAS_MODEL : 0) | (clip ? CACHE_HAS_CLIP : 0);
+	out.Value(MakeCacheHeader(contents, sourceSize, sourceMTime, sourceHash));
+	if (model)
+		WriteModel(out, *model);
+	if (clip)
+		WriteClip(out, *clip);
+
+	bool ok = ferror(file) == 0;
+	ok = fclose(file) == 0 && ok;
+	remove(path.c_str());
+	if (!ok || rename(temp.c_str(), path.c_str()) != 0)
+	{
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Assimp, then a fresh cache with what was asked for; failing to write it
+// (read-only install) is not an error.
+inline bool ImportAndCache(const std::string& sourcePath, ModelData* model, ClipData* clip)
+{
+	if (!ImportAsset(sourcePath, model, clip))
+		return false;
+
+	if (!WriteAssetCache(sourcePath, model, clip))
+		std::cout << "WARNING::ASSET_CACHE:: could not write " << CachePath(sourcePath) << std::endl;
+	return true;
+}
+
+// Cache first, Assimp when stale.
+inline bool LoadAsset(const std::string& sourcePath, ModelData* model, ClipData* clip)
+{
+	return ReadAssetCache(sourcePath, model, clip) || ImportAndCache(sourcePath, model, clip);
+}
+
+// LoadAsset without the copy: a fresh cache stays mapped in 'mapped', which then
+// holds the only vertex, index and key arrays. After an import 'mapped' points at
+// the arrays in model / clip instead, so either way they are read through it.
+inline bool MapAsset(const std::string& sourcePath, ModelData* model, ClipData* clip, MappedAsset& mapped)
+{
+	if (MapAssetCache(sourcePath, model, clip, mapped))
+		return true;
+
+	mapped.file.Close();
+	mapped.meshes.clear();
+	mapped.tracks.clear();
+	if (!ImportAndCache(sourcePath, model, clip))
+		return false;
+	if (model)
+		for (const MeshData& mesh : model->meshes)
+			mapped.meshes.push_back(ViewMesh(mesh));
+	if (clip)
+		for (const TrackData& track : clip->tracks)
+			mapped.tracks.push_back(ViewTrack(track));
+	return true;
+}
+
+// ContentHash() of a source file: from its cache's header when that is fresh,
+// otherwise by reading the file. False if there is neither.
+inline bool SourceHash(const std::string& sourcePath, uint64_t& hash)
+{
+	MappedFile file;
+	CacheReader in;
+	CacheHeader header;
+	if (OpenAssetCache(sourcePath, file, in, header))
+	{
+		hash = header.sourceHash;
+		return true;
+	}
+	if (!file.Open(sourcePath))
+		return false;
+	hash = ContentHash(file.Data(), file.Size());
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// characters
+// ----------------------------------------------------------------------------
+
+// file suffix per ClipId, in the order of the ClipId enum
+static const char* const CLIP_FILES[CLIP_COUNT] = {
+	"Idle", "Walk", "Punch", "Crouch", "Crouch_Block", "Stand_Block", "Stand_Hit", "Jumping", "TopKick"
+};
+
+// Loads "<dir>/<prefix>_<clip>.dae" for every clip. The idle file also carries the
+// skinned mesh, so model and idle clip come out of a single read.
+inline bool LoadCharacter(const std::string& dir, const std::string& prefix, ModelData& model, ClipData clips[CLIP_COUNT])
+{
+	bool ok = true;
+	for (int c = 0; c < CLIP_COUNT; ++c)
+	{
+		std::string path = dir + "/" + prefix + "_" + CLIP_FILES[c] + ".dae";
+		if (!LoadAsset(path, c == CLIP_IDLE ? &model : NULL, &clips[c]))
+		{
+			std::cout << "ERROR::ASSET_CACHE:: failed to load " << path << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
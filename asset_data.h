@@ -0,0 +1,178 @@
+// asset_data.h
+//
+// Plain in-memory form of a character: skinned meshes + bone map (ModelData) and
+// keyframe tracks over a flattened node hierarchy (ClipData). Filled either from
+// the binary asset cache or, when that is stale, from Assimp (asset_import.h).
+// No GL and no Assimp in here, so the headless tools can bake poses from it.
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+const int MAX_BONE_WEIGHTS = 4;
+
+// same layout as learnopengl's Vertex, so the attribute setup is unchanged
+struct SkinVertex {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texCoords;
+	glm::vec3 tangent;
+	glm::vec3 bitangent;
+	int boneIds[MAX_BONE_WEIGHTS];
+	float weights[MAX_BONE_WEIGHTS];
+};
+
+struct MeshData {
+	std::vector<SkinVertex> vertices;
+	std::vector<unsigned int> indices;
+	std::string diffuseTexture;   // file name relative to the model's directory, may be empty
+};
+
+struct BoneData {
+	int id;
+	glm::mat4 offset;
+};
+
+struct ModelData {
+	std::vector<MeshData> meshes;
+	std::map<std::string, BoneData> bones;
+};
+
+// a node of the scene hierarchy; parents always come before their children
+struct NodeData {
+	std::string name;
+	int parent;
+	glm::mat4 transformation;
+};
+
+struct KeyPos {
+	float time;
+	glm::vec3 value;
+};
+
+struct KeyRot {
+	float time;
+	glm::quat value;
+};
+
+struct KeyScale {
+	float time;
+	glm::vec3 value;
+};
+
+struct TrackData {
+	int node;   // index into ClipData::nodes
+	std::vector<KeyPos> positions;
+	std::vector<KeyRot> rotations;
+	std::vector<KeyScale> scales;
+};
+
+struct ClipData {
+	float duration = 0.0f;        // ticks
+	float ticksPerSecond = 1.0f;
+	std::vector<NodeData> nodes;
+	std::vector<TrackData> tracks;
+};
+
+// A mesh's or a track's arrays without owning them: either a MeshData / TrackData's
+// vectors or the blobs of a mapped asset cache (asset_cache.h), which the GL upload
+// and the clip compressor read in place.
+struct MeshView {
+	const SkinVertex* vertices;
+	size_t vertexCount;
+	const unsigned int* indices;
+	size_t indexCount;
+	const std::string* diffuseTexture;
+};
+
+struct TrackView {
+	int node;
+	const KeyPos* positions;
+	size_t positionCount;
+	const KeyRot* rotations;
+	size_t rotationCount;
+	const KeyScale* scales;
+	size_t scaleCount;
+};
+
+inline MeshView ViewMesh(const MeshData& mesh)
+{
+	MeshView view = { mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), &mesh.diffuseTexture };
+	return view;
+}
+
+inline TrackView ViewTrack(const TrackData& track)
+{
+	TrackView view = { track.node, track.positions.data(), track.positions.size(), track.rotations.data(), track.rotations.size(),
+		track.scales.data(), track.scales.size() };
+	return view;
+}
+
+// ----------------------------------------------------------------------------
+// track sampling (same interpolation as learnopengl's Bone::Update)
+// ----------------------------------------------------------------------------
+
+// index of the key at or before 'time', clamped so that index + 1 is valid
+template <typename Key>
+inline size_t FindKey(const std::vector<Key>& keys, float time)
+{
+	size_t hi = std::upper_bound(keys.begin(), keys.end(), time,
+		[](float t, const Key& key) { return t < key.time; }) - keys.begin();
+	if (hi == 0)
+		return 0;
+	if (hi >= keys.size())
+		return keys.size() - 2;
+	return hi - 1;
+}
+
+template <typename Key>
+inline float KeyFactor(const Key& a, const Key& b, float time)
+{
+	float span = b.time - a.time;
+	if (span <= 0.0f)
+		return 0.0f;
+	return glm::clamp((time - a.time) / span, 0.0f, 1.0f);
+}
+
+inline glm::vec3 SamplePosition(const std::vector<KeyPos>& keys, float time)
+{
+	if (keys.size() == 1)
+		return keys[0].value;
+	size_t i = FindKey(keys, time);
+	return glm::mix(keys[i].value, keys[i + 1].value, KeyFactor(keys[i], keys[i + 1], time));
+}
+
+inline glm::quat SampleRotation(const std::vector<KeyRot>& keys, float time)
+{
+	if (keys.size() == 1)
+		return glm::normalize(keys[0].value);
+	size_t i = FindKey(keys, time);
+	return glm::normalize(glm::slerp(keys[i].value, keys[i + 1].value, KeyFactor(keys[i], keys[i + 1], time)));
+}
+
+inline glm::vec3 SampleScale(const std::vector<KeyScale>& keys, float time)
+{
+	if (keys.size() == 1)
+		return keys[0].value;
+	size_t i = FindKey(keys, time);
+	return glm::mix(keys[i].value, keys[i + 1].value, KeyFactor(keys[i], keys[i + 1], time));
+}
+
+inline glm::mat4 SampleTrack(const TrackData& track, float time)
+{
+	glm::mat4 transform(1.0f);
+	if (!track.positions.empty())
+		transform = glm::translate(transform, SamplePosition(track.positions, time));
+	if (!track.rotations.empty())
+		transform = transform * glm::mat4_cast(SampleRotation(track.rotations, time));
+	if (!track.scales.empty())
+		transform = glm::scale(transform, SampleScale(track.scales, time));
+	return transform;
+}
@@ -0,0 +1,203 @@
+// asset_import.h
+//
+// The slow path: parse a .dae through Assimp into ModelData / ClipData. Only used
+// when the binary cache for a file is missing or stale (see asset_cache.h). One
+// Assimp read yields both the mesh and the clip, so a file like P1_Idle.dae that
+// serves as model *and* idle animation is parsed once instead of twice.
+//
+// Extraction mirrors learnopengl's Model / Animation loaders so the result draws
+// and animates identically.
+
+#pragma once
+
+#include "asset_data.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <learnopengl/assimp_glm_helpers.h>
+
+#include <iostream>
+#include <string>
+
+inline void ImportMesh(const aiMesh* mesh, const aiScene* scene, ModelData& model)
+{
+	MeshData data;
+	data.vertices.resize(mesh->mNumVertices);
+
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+	{
+		SkinVertex& vertex = data.vertices[i];
+		for (int w = 0; w < MAX_BONE_WEIGHTS; w++)
+		{
+			vertex.boneIds[w] = -1;
+			vertex.weights[w] = 0.0f;
+		}
+
+		vertex.position = AssimpGLMHelpers::GetGLMVec(mesh->mVertices[i]);
+		vertex.normal = mesh->HasNormals() ? AssimpGLMHelpers::GetGLMVec(mesh->mNormals[i]) : glm::vec3(0.0f);
+
+		if (mesh->mTextureCoords[0])
+		{
+			vertex.texCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+			vertex.tangent = AssimpGLMHelpers::GetGLMVec(mesh->mTangents[i]);
+			vertex.bitangent = AssimpGLMHelpers::GetGLMVec(mesh->mBitangents[i]);
+		}
+		else
+		{
+			vertex.texCoords = glm::vec2(0.0f, 0.0f);
+			vertex.tangent = glm::vec3(0.0f);
+			vertex.bitangent = glm::vec3(0.0f);
+		}
+	}
+
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+	{
+		const aiFace& face = mesh->mFaces[i];
+		for (unsigned int j = 0; j < face.mNumIndices; j++)
+			data.indices.push_back(face.mIndices[j]);
+	}
+
+	const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+	if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+	{
+		aiString path;
+		material->GetTexture(aiTextureType_DIFFUSE, 0, &path);
+		data.diffuseTexture = path.C_Str();
+	}
+
+	// bone weights, at most MAX_BONE_WEIGHTS per vertex (extra influences are dropped)
+	for (unsigned int b = 0; b < mesh->mNumBones; ++b)
+	{
+		const aiBone* bone = mesh->mBones[b];
+		std::string boneName = bone->mName.C_Str();
+
+		int boneId;
+		auto it = model.bones.find(boneName);
+		if (it == model.bones.end())
+		{
+			BoneData info;
+			info.id = (int)model.bones.size();
+			info.offset = AssimpGLMHelpers::ConvertMatrixToGLMFormat(bone->mOffsetMatrix);
+			model.bones[boneName] = info;
+			boneId = info.id;
+		}
+		else
+		{
+			boneId = it->second.id;
+		}
+
+		for (unsigned int w = 0; w < bone->mNumWeights; ++w)
+		{
+			unsigned int vertexId = bone->mWeights[w].mVertexId;
+			if (vertexId >= data.vertices.size())
+				continue;
+
+			SkinVertex& vertex = data.vertices[vertexId];
+			for (int i = 0; i < MAX_BONE_WEIGHTS; ++i)
+			{
+				if (vertex.boneIds[i] < 0)
+				{
+					vertex.boneIds[i] = boneId;
+					vertex.weights[i] = bone->mWeights[w].mWeight;
+					break;
+				}
+			}
+		}
+	}
+
+	model.meshes.push_back(data);
+}
+
+inline void ImportMeshes(const aiNode* node, const aiScene* scene, ModelData& model)
+{
+	for (unsigned int i = 0; i < node->mNumMeshes; i++)
+		ImportMesh(scene->mMeshes[node->mMeshes[i]], scene, model);
+	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		ImportMeshes(node->mChildren[i], scene, model);
+}
+
+inline void ImportNodes(const aiNode* node, int parent, ClipData& clip)
+{
+	NodeData data;
+	data.name = node->mName.C_Str();
+	data.parent = parent;
+	data.transformation = AssimpGLMHelpers::ConvertMatrixToGLMFormat(node->mTransformation);
+
+	int index = (int)clip.nodes.size();
+	clip.nodes.push_back(data);
+	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		ImportNodes(node->mChildren[i], index, clip);
+}
+
+inline void ImportClip(const aiScene* scene, ClipData& clip)
+{
+	const aiAnimation* animation = scene->mAnimations[0];
+	clip.duration = (float)animation->mDuration;
+	// Assimp reports 0 when the file doesn't say; its documented default is 25
+	clip.ticksPerSecond = animation->mTicksPerSecond != 0.0 ? (float)animation->mTicksPerSecond : 25.0f;
+
+	clip.nodes.clear();
+	ImportNodes(scene->mRootNode, -1, clip);
+
+	clip.tracks.clear();
+	for (unsigned int c = 0; c < animation->mNumChannels; c++)
+	{
+		const aiNodeAnim* channel = animation->mChannels[c];
+
+		int node = -1;
+		for (size_t n = 0; n < clip.nodes.size(); ++n)
+		{
+			if (clip.nodes[n].name == channel->mNodeName.C_Str())
+			{
+				node = (int)n;
+				break;
+			}
+		}
+		if (node < 0)
+			continue;
+
+		TrackData track;
+		track.node = node;
+		for (unsigned int k = 0; k < channel->mNumPositionKeys; ++k)
+		{
+			KeyPos key = { (float)channel->mPositionKeys[k].mTime, AssimpGLMHelpers::GetGLMVec(channel->mPositionKeys[k].mValue) };
+			track.positions.push_back(key);
+		}
+		for (unsigned int k = 0; k < channel->mNumRotationKeys; ++k)
+		{
+			KeyRot key = { (float)channel->mRotationKeys[k].mTime, AssimpGLMHelpers::GetGLMQuat(channel->mRotationKeys[k].mValue) };
+			track.rotations.push_back(key);
+		}
+		for (unsigned int k = 0; k < channel->mNumScalingKeys; ++k)
+		{
+			KeyScale key = { (float)channel->mScalingKeys[k].mTime, AssimpGLMHelpers::GetGLMVec(channel->mScalingKeys[k].mValue) };
+			track.scales.push_back(key);
+		}
+		clip.tracks.push_back(track);
+	}
+}
+
+// Reads one .dae. Either output may be NULL. Returns false if Assimp couldn't load the file.
+inline bool ImportAsset(const std::string& path, ModelData* model, ClipData* clip)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+	if (!scene || !scene->mRootNode)
+	{
+		std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+		return false;
+	}
+
+	if (model)
+	{
+		model->meshes.clear();
+		model->bones.clear();
+		if (!(scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE))
+			ImportMeshes(scene->mRootNode, scene, *model);
+	}
+	if (clip && scene->mNumAnimations > 0)
+		ImportClip(scene, *clip);
+
+	return true;
+}
@@ -0,0 +1,349 @@
+// asset_loader.h
+//
+// Loads everything the match needs on a JobSystem instead of one file after another
+// on the main thread. Cache reads / Assimp imports, pose baking and image decodes
+// run on the workers; only the GL uploads (model buffers, textures, the skybox
+// cubemap) are posted back to the context thread through RunOnMain().
+//
+// A character whose files have the same contents as one already loaded (the same
+// fighter on both sides) isn't loaded again: both players get the one CharacterAssets.
+// Everything in it stays the same once loaded, apart from the pose samples the
+// ClipRegistry streams in and out, and each fighter's playback state lives in the
+// match (PlayerState::anim), so nothing in it belongs to one player.
+//
+// stb_image's vertical flip is a process-wide switch, so it can't differ between
+// jobs that run at the same time. Images are always decoded unflipped and the
+// model textures are flipped in the decode job instead.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "asset_cache.h"
+#include "blend_tree.h"
+#include "job_system.h"
+#include "pose_bake.h"
+#include "skinned_model.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+struct DecodedImage {
+	int width = 0, height = 0, channels = 0;
+	unsigned char* pixels = NULL;
+};
+
+inline DecodedImage DecodeImage(const std::string& path, bool flipVertically)
+{
+	DecodedImage image;
+	image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+	if (image.pixels && flipVertically)
+	{
+		const size_t rowSize = (size_t)image.width * image.channels;
+		std::vector<unsigned char> row(rowSize);
+		for (int y = 0; y < image.height / 2; ++y)
+		{
+			unsigned char* top = image.pixels + (size_t)y * rowSize;
+			unsigned char* bottom = image.pixels + (size_t)(image.height - 1 - y) * rowSize;
+			memcpy(row.data(), top, rowSize);
+			memcpy(top, bottom, rowSize);
+			memcpy(bottom, row.data(), rowSize);
+		}
+	}
+	return image;
+}
+
+// same parameters as learnopengl's TextureFromFile
+inline unsigned int UploadTexture2D(const DecodedImage& image)
+{
+	GLenum format = GL_RGB;
+	if (image.channels == 1)
+		format = GL_RED;
+	else if (image.channels == 4)
+		format = GL_RGBA;
+
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return textureID;
+}
+
+// faces in GL order: +X, -X, +Y, -Y, +Z, -Z
+inline unsigned int UploadCubemap(const DecodedImage faces[6])
+{
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		if (faces[i].pixels)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+				0, GL_RGB, faces[i].width, faces[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, faces[i].pixels);
+	}
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	return textureID;
+}
+
+// Everything one character needs, filled in by AssetLoader::LoadCharacter and owned
+// by the loader; fighters using the same character share it.
+struct CharacterAssets {
+	ModelData model;
+	ClipData clips[CLIP_COUNT];            // nodes and timing; the tracks are freed once compressed
+	CompressedClip compressed[CLIP_COUNT];
+	PoseCache poses;
+	JointTable joints;                     // hurtbox joints for the sim, baked with the poses
+	BoneMask upperBody;                    // layer mask for upper-body clips (blend_tree.h)
+	SkinnedModel gpu;
+	std::map<std::string, unsigned int> textures;
+	std::unique_ptr<MappedAsset> meshFile;   // the idle file, mapped until its meshes are uploaded
+
+	unsigned int residentClips = ALL_CLIPS;   // clips baked at load, the rest stream (clip_registry.h)
+
+	std::string dir, prefix;    // where it was loaded from first
+	uint64_t contentHash = 0;   // of all its files together, 0 if one couldn't be hashed
+
+	std::atomic<int> clipsLeft{ 0 };
+	int texturesLeft = 0;   // only touched on the main thread
+};
+
+class AssetLoader
+{
+public:
+	explicit AssetLoader(JobSystem& jobSystem, const ClipCompression& clipCompression = ClipCompression())
+		: jobs(jobSystem), compression(clipCompression) {}
+
+	// One job per clip file (the idle file also brings the mesh), which maps its cache
+	// and compresses the clip's tracks straight from the mapping. When the last clip
+	// lands: bake the pose cache, decode the textures, then upload the meshes on main,
+	// again from the mapping, and unmap it. Only the clips in 'residentClips' get their pose
+	// samples baked; every clip gets its timing and hurtbox joints.
+	//
+	// If every file has the same contents as those of a character already asked for,
+	// in the same directory (the textures are looked up there), that character is
+	// returned instead and 'residentClips' is added to its bake. The files are told
+	// apart by the content hash in their cache headers (asset_cache.h), so this reads
+	// no more than the headers unless a cache is stale.
+	//
+	// The jobs only start in Wait(), so every request for a character is in before
+	// it is baked. Once a character has started, a request for clips it doesn't bake
+	// loads the files again as a character of its own.
+	CharacterAssets& LoadCharacter(const std::string& dir, const std::string& prefix, unsigned int residentClips = ALL_CLIPS)
+	{
+		uint64_t contentHash = CharacterHash(dir, prefix);
+		for (const std::unique_ptr<CharacterAssets>& loaded : characters)
+		{
+			if (contentHash == 0 || loaded->contentHash != contentHash || loaded->dir != dir)
+				continue;
+			bool started = std::find(queued.begin(), queued.end(), loaded.get()) == queued.end();
+			if (started && (loaded->residentClips | residentClips) != loaded->residentClips)
+				continue;
+			loaded->residentClips |= residentClips;
+			std::cout << prefix << " has the same files as " << loaded->prefix << ", sharing its assets" << std::endl;
+			return *loaded;
+		}
+
+		characters.emplace_back(new CharacterAssets);
+		CharacterAssets& out = *characters.back();
+		out.dir = dir;
+		out.prefix = prefix;
+		out.contentHash = contentHash;
+		out.residentClips = residentClips | (1u << CLIP_IDLE);
+		queued.push_back(&out);
+		return out;
+	}
+
+	// 'texture' is written on the main thread once all six faces are decoded and uploaded
+	void LoadCubemap(const std::vector<std::string>& faces, unsigned int& texture)
+	{
+		struct Pending {
+			DecodedImage faces[6];
+			std::atomic<int> left{ 6 };
+		};
+		std::shared_ptr<Pending> pending = std::make_shared<Pending>();
+
+		for (int i = 0; i < 6 && i < (int)faces.size(); ++i)
+		{
+			std::string path = faces[i];
+			Worker([this, path, i, pending, &texture]
+			{
+				pending->faces[i] = DecodeImage(path, false);
+				if (!pending->faces[i].pixels)
+					std::cout << "Cubemap failed to load at: " << path << std::endl;
+				if (--pending->left == 0)
+				{
+					Main([pending, &texture]
+					{
+						texture = UploadCubemap(pending->faces);
+						for (int f = 0; f < 6; ++f)
+							stbi_image_free(pending->faces[f].pixels);
+					});
+				}
+			});
+		}
+	}
+
+	// Starts the characters asked for, then pumps main-thread uploads until
+	// everything queued is done, calling onProgress(0..1) between pumps so the
+	// caller can draw a loading screen. Returns false if any asset failed to load.
+	bool Wait(const std::function<void(float)>& onProgress)
+	{
+		for (CharacterAssets* character : queued)
+			StartCharacter(*character);
+		queued.clear();
+
+		while (!jobs.Idle())
+		{
+			jobs.PumpMain(std::chrono::milliseconds(16));
+			if (onProgress)
+				onProgress(Progress());
+		}
+		jobs.PumpMain();
+		return !failed;
+	}
+
+	float Progress() const
+	{
+		int all = total;
+		return all > 0 ? (float)done / all : 1.0f;
+	}
+
+private:
+	void StartCharacter(CharacterAssets& out)
+	{
+		const std::string& dir = out.dir;
+		const std::string& prefix = out.prefix;
+		out.clipsLeft = CLIP_COUNT;
+		for (int c = 0; c < CLIP_COUNT; ++c)
+		{
+			std::string path = dir + "/" + prefix + "_" + CLIP_FILES[c] + ".dae";
+			Worker([this, path, c, dir, prefix, &out]
+			{
+				std::unique_ptr<MappedAsset> file(new MappedAsset);
+				if (!MapAsset(path, c == CLIP_IDLE ? &out.model : NULL, &out.clips[c], *file))
+				{
+					std::cout << "ERROR::ASSET_LOADER:: failed to load " << path << std::endl;
+					failed = true;
+				}
+				else
+				{
+					ClipCompressionStats stats = CompressClip(out.clips[c], file->tracks.data(), file->tracks.size(),
+						compression, out.compressed[c]);
+					file->tracks.clear();
+					std::vector<TrackData>().swap(out.clips[c].tracks);   // only there after an import
+					PrintCompressionStats((prefix + "_" + CLIP_FILES[c]).c_str(), stats);
+					if (c == CLIP_IDLE)
+						out.meshFile = std::move(file);
+				}
+				if (--out.clipsLeft == 0)
+					ClipsLoaded(dir, out);
+			});
+		}
+	}
+
+	void Worker(const JobSystem::Job& job)
+	{
+		total++;
+		jobs.Run([this, job] { job(); done++; });
+	}
+
+	void Main(const JobSystem::Job& job)
+	{
+		total++;
+		jobs.RunOnMain([this, job] { job(); done++; });
+	}
+
+	// ContentHash() of every clip file of the character together
+	static uint64_t CharacterHash(const std::string& dir, const std::string& prefix)
+	{
+		uint64_t hashes[CLIP_COUNT];
+		for (int c = 0; c < CLIP_COUNT; ++c)
+			if (!SourceHash(dir + "/" + prefix + "_" + CLIP_FILES[c] + ".dae", hashes[c]))
+				return 0;
+		uint64_t hash = ContentHash((const unsigned char*)hashes, sizeof(hashes));
+		return hash != 0 ? hash : 1;
+	}
+
+	// main thread; the mapping isn't needed once the buffers hold the meshes
+	static void UploadMeshes(CharacterAssets& out)
+	{
+		if (out.meshFile)
+			out.gpu.Init(out.meshFile->meshes, out.textures);
+		out.meshFile.reset();
+	}
+
+	// runs on whichever worker finished the character's last clip
+	void ClipsLoaded(const std::string& dir, CharacterAssets& out)
+	{
+		Worker([&out]
+		{
+			BakePoseCache(out.poses, out.model, out.compressed, &out.joints, out.residentClips);
+			std::vector<float> weights;
+			UpperBodyWeights(out.model, out.compressed[CLIP_IDLE].nodes, weights);
+			BuildBoneMask(weights, out.upperBody);
+		});
+
+		std::set<std::string> names;
+		for (const MeshData& mesh : out.model.meshes)
+			if (!mesh.diffuseTexture.empty())
+				names.insert(mesh.diffuseTexture);
+
+		if (names.empty())
+		{
+			Main([&out] { UploadMeshes(out); });
+			return;
+		}
+
+		out.texturesLeft = (int)names.size();
+		for (const std::string& name : names)
+		{
+			Worker([this, dir, name, &out]
+			{
+				// model textures are authored for a flipped load, as with learnopengl's Model
+				std::shared_ptr<DecodedImage> image = std::make_shared<DecodedImage>(DecodeImage(dir + "/" + name, true));
+				if (!image->pixels)
+					std::cout << "Texture failed to load at path: " << dir + "/" + name << std::endl;
+
+				Main([image, name, &out]
+				{
+					if (image->pixels)
+					{
+						out.textures[name] = UploadTexture2D(*image);
+						stbi_image_free(image->pixels);
+					}
+					if (--out.texturesLeft == 0)
+						UploadMeshes(out);
+				});
+			});
+		}
+	}
+
+	JobSystem& jobs;
+	ClipCompression compression;
+	std::vector<std::unique_ptr<CharacterAssets>> characters;
+	std::vector<CharacterAssets*> queued;   // asked for, started by Wait()
+	std::atomic<int> total{ 0 };
+	std::atomic<int> done{ 0 };
+	std::atomic<bool> failed{ false };
+};
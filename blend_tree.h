@@ -0,0 +1,188 @@
+// blend_tree.h
+//
+// Render-side pose blending on top of the pose cache (pose_cache.h). The sim decides
+// which clips play and when a transition starts; this decides how the palettes of
+// those clips are combined into what is drawn.
+//
+//   crossfade         EvaluatePose: during a transition both clips are sampled and
+//                     lerped by the sim's blend weight
+//   inertialization   on a transition the pose that was on screen is kept as an offset
+//                     from the new clip and decayed to zero over the crossfade time.
+//                     Only the new clip is sampled, so a transition costs no more than
+//                     a single clip
+//   layers            more clips over the result, each with a weight and a per-bone
+//                     mask: an upper-body attack over lower-body legs
+//
+// All timing is in seconds. The inertial decay and layer weights are advanced by the
+// caller's frame time, so they take as long at 30 Hz as at 240 Hz.
+//
+// Palettes are final skinning matrices in model space, so a layer replaces the masked
+// bones' model-space transforms. That holds up as long as the clips agree on where the
+// hips are, which Mixamo's in-place clips do.
+
+#pragma once
+
+#include "pose_cache.h"
+#include "pose_simd.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <vector>
+
+enum BlendMode {
+	BLEND_CROSSFADE,
+	BLEND_INERTIAL
+};
+
+inline const char* BlendModeName(BlendMode mode)
+{
+	return mode == BLEND_INERTIAL ? "inertial" : "crossfade";
+}
+
+// ----------------------------------------------------------------------------
+// inertialization
+// ----------------------------------------------------------------------------
+
+// Offset weight 'x' of the way through the decay: 1 at the start, 0 at the end, with
+// zero slope at both ends so neither end of the transition shows a kink.
+inline float InertialWeight(float x)
+{
+	if (x >= 1.0f)
+		return 0.0f;
+	return 1.0f - x * x * x * (x * (x * 6.0f - 15.0f) + 10.0f);
+}
+
+// One character's transition state. The offset is a whole palette of floats, the
+// pose on screen minus the new clip's pose when the transition started.
+struct Inertializer {
+	ClipId target = CLIP_NONE;   // the clip being decayed into
+	float elapsed = 0.0f;
+	float duration = CROSSFADE_SECONDS;
+	bool active = false;
+	std::vector<float> offset;
+};
+
+// Sizes the offset up front, so the first transition of a match doesn't allocate.
+inline void InitInertializer(Inertializer& inert, int boneCount)
+{
+	inert.offset.resize((size_t)boneCount * 16);
+}
+
+// The pose for a sim clip clock with inertialized transitions. A transition starts
+// when the clip the clock is heading to (clip2 while crossfading, else clip) changes.
+// 'out' must still hold the pose drawn last for this character, it is the source of
+// the offset. 'dt' advances the decay; pass 0 while the match is frozen.
+inline void EvaluateInertial(const PoseCache& cache, const AnimClock& anim, float dt, Inertializer& inert, glm::mat4* out)
+{
+	const size_t floats = (size_t)cache.boneCount * 16;
+	ClipId target = anim.clip2 != CLIP_NONE ? anim.clip2 : anim.clip;
+	float time = anim.clip2 != CLIP_NONE ? anim.time2 : anim.time;
+
+	int s0, s1;
+	float frac;
+	FindSamples(cache.clips[target], time, s0, s1, frac);
+	const float* a = glm::value_ptr(*cache.Sample(target, s0));
+	const float* b = glm::value_ptr(*cache.Sample(target, s1));
+	float* pose = glm::value_ptr(*out);
+
+	if (target != inert.target)
+	{
+		// the first pose a character ever gets has nothing on screen to start from
+		if (inert.target != CLIP_NONE)
+		{
+			inert.offset.resize(floats);
+			LerpPalette(a, b, frac, inert.offset.data(), floats);
+			for (size_t i = 0; i < floats; ++i)
+				inert.offset[i] = pose[i] - inert.offset[i];
+			inert.elapsed = 0.0f;
+			inert.active = true;
+		}
+		inert.target = target;
+	}
+
+	if (!inert.active)
+	{
+		LerpPalette(a, b, frac, pose, floats);
+		return;
+	}
+
+	OffsetPalette(a, b, frac, inert.offset.data(), InertialWeight(inert.elapsed / inert.duration), pose, floats);
+	inert.elapsed += dt;
+	inert.active = inert.elapsed < inert.duration;
+}
+
+// EvaluatePose or EvaluateInertial, by mode.
+inline void EvaluateBlend(BlendMode mode, const PoseCache& cache, const AnimClock& anim, float dt, Inertializer& inert, glm::mat4* out)
+{
+	if (mode == BLEND_INERTIAL)
+		EvaluateInertial(cache, anim, dt, inert, out);
+	else
+		EvaluatePose(cache, anim, out);
+}
+
+// ----------------------------------------------------------------------------
+// layers
+// ----------------------------------------------------------------------------
+
+// Per-bone layer weights stored as runs of neighbouring bones with the same weight,
+// so a layer is blended a run at a time instead of a bone at a time. Bones with
+// weight 0 are not stored.
+struct BoneMaskRun {
+	int first;
+	int count;
+	float weight;
+};
+
+struct BoneMask {
+	std::vector<BoneMaskRun> runs;
+};
+
+inline void BuildBoneMask(const std::vector<float>& weights, BoneMask& mask)
+{
+	mask.runs.clear();
+	for (int bone = 0; bone < (int)weights.size(); ++bone)
+	{
+		float weight = weights[bone];
+		if (weight <= 0.0f)
+			continue;
+		if (!mask.runs.empty() && mask.runs.back().first + mask.runs.back().count == bone && mask.runs.back().weight == weight)
+			mask.runs.back().count++;
+		else
+			mask.runs.push_back(BoneMaskRun{ bone, 1, weight });
+	}
+}
+
+struct PoseLayer {
+	ClipId clip;
+	float time;            // in ticks, like AnimClock::time
+	float weight;          // 0 = off, 1 = the masked bones follow the layer completely
+	const BoneMask* mask;
+};
+
+// Blends each layer over 'out' in order, bone runs only.
+inline void ApplyLayers(const PoseCache& cache, const PoseLayer* layers, int count, glm::mat4* out)
+{
+	for (int l = 0; l < count; ++l)
+	{
+		const PoseLayer& layer = layers[l];
+		if (layer.clip == CLIP_NONE || layer.weight <= 0.0f || !layer.mask)
+			continue;
+
+		int s0, s1;
+		float frac;
+		FindSamples(cache.clips[layer.clip], layer.time, s0, s1, frac);
+		const float* a = glm::value_ptr(*cache.Sample(layer.clip, s0));
+		const float* b = glm::value_ptr(*cache.Sample(layer.clip, s1));
+		float* pose = glm::value_ptr(*out);
+		for (const BoneMaskRun& run : layer.mask->runs)
+		{
+			if (run.first + run.count > cache.boneCount)
+				continue;
+			// the base pose is both of BlendPalette's first pair, so it passes through unchanged
+			size_t begin = (size_t)run.first * 16;
+			BlendPalette(pose + begin, pose + begin, 0.0f, a + begin, b + begin, frac, layer.weight * run.weight, pose + begin,
+				(size_t)run.count * 16);
+		}
+	}
+}
@@ -0,0 +1,115 @@
+// bone_palette.h
+//
+// All characters' skinning palettes in one std140 uniform buffer. The pose is
+// evaluated straight into a CPU staging copy (Palette(i)), the whole thing goes
+// to the GPU with one glBufferSubData per frame, and each draw just rebinds its
+// slice with glBindBufferRange - no per-bone glGetUniformLocation or strings.
+//
+// anim_model.vs declares the matching block:
+//   layout(std140) uniform BonePalette { mat4 finalBonesMatrices[MAX_BONES]; };
+// In the 3x4 and dual quaternion modes (skinning.h) the poses are still written as
+// mat4, and Upload() packs them into the smaller GPU format first.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader_m.h>
+
+#include "pose_cache.h"
+#include "skinning.h"
+
+#include <vector>
+
+class BonePaletteBuffer
+{
+public:
+	static const GLuint BINDING_POINT = 0;
+
+	void Init(int characterCount, SkinningMode skinningMode = SKIN_MAT4)
+	{
+		count = characterCount;
+		mode = skinningMode;
+
+		// each character's slice must start on the uniform buffer offset alignment
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		paletteSize = MAX_BONES * SkinningVec4sPerBone(mode) * sizeof(glm::vec4);
+		stride = ((paletteSize + alignment - 1) / alignment) * alignment;
+
+		// mat4 mode evaluates straight into the upload buffer; the packed modes need a separate pose
+		staging.assign((size_t)(stride * count), 0);
+		if (mode != SKIN_MAT4)
+			poses.assign((size_t)MAX_BONES * count, glm::mat4(1.0f));
+		for (int c = 0; c < count; ++c)
+		{
+			glm::mat4* palette = Palette(c);
+			for (int i = 0; i < MAX_BONES; ++i)
+				palette[i] = glm::mat4(1.0f);
+		}
+		PackAll();
+
+		glGenBuffers(1, &ubo);
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+		glBufferData(GL_UNIFORM_BUFFER, stride * count, staging.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	// point a shader's BonePalette block at our binding point (once, after linking)
+	void Attach(const Shader& shader) const
+	{
+		GLuint blockIndex = glGetUniformBlockIndex(shader.ID, "BonePalette");
+		if (blockIndex != GL_INVALID_INDEX)
+			glUniformBlockBinding(shader.ID, blockIndex, BINDING_POINT);
+	}
+
+	// CPU-side palette of one character; write the frame's pose here before Upload()
+	glm::mat4* Palette(int character)
+	{
+		if (mode != SKIN_MAT4)
+			return &poses[(size_t)MAX_BONES * character];
+		return (glm::mat4*)&staging[(size_t)(stride * character)];
+	}
+
+	SkinningMode Mode() const { return mode; }
+
+	// one upload for every character; orphan first so we never wait on last frame's draws
+	void Upload()
+	{
+		PackAll();
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+		glBufferData(GL_UNIFORM_BUFFER, stride * count, NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, stride * count, staging.data());
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	// make the next draws skin with this character's palette
+	void Select(int character) const
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, BINDING_POINT, ubo, stride * character, paletteSize);
+	}
+
+	void Release()
+	{
+		if (ubo)
+			glDeleteBuffers(1, &ubo);
+		ubo = 0;
+	}
+
+private:
+	void PackAll()
+	{
+		if (mode == SKIN_MAT4)
+			return;
+		for (int c = 0; c < count; ++c)
+			PackPalette(mode, &poses[(size_t)MAX_BONES * c], MAX_BONES, (glm::vec4*)&staging[(size_t)(stride * c)]);
+	}
+
+	GLuint ubo = 0;
+	GLsizeiptr stride = 0;
+	GLsizeiptr paletteSize = 0;
+	int count = 0;
+	SkinningMode mode = SKIN_MAT4;
+	std::vector<unsigned char> staging;   // exactly what goes to the GPU
+	std::vector<glm::mat4> poses;         // packed modes only: the mat4 poses Palette() hands out
+};
@@ -0,0 +1,483 @@
+// clip_compression.h
+//
+// Compact in-memory form of a clip's keyframe tracks (ClipData::tracks), built once
+// at load time:
+//
+//   constant channels   collapsed to a single key, or dropped entirely when they hold
+//                       the identity (zero offset, no rotation, unit scale). A track
+//                       whose constant transform equals the node's bind transformation
+//                       is dropped too; the node then keeps its bind pose
+//   rotations           smallest-three, 48 bits a key: the index of the largest
+//                       component and the other three in 15 bits each
+//   positions, scales   16 bits per component over the channel's bounding box, then
+//                       every key that linear interpolation of its neighbours already
+//                       reproduces within the error threshold is removed
+//   key times           16 bits, as a fraction of the clip duration
+//
+// A raw key is 16 (position, scale) or 20 (rotation) bytes; a compressed one is 8.
+//
+// Playback goes through ClipCursor. It remembers the key pair each channel was last
+// between, already decoded, so moving forward in time costs a compare per channel
+// and a decode only when a key is crossed. Seeking backwards restarts the channel
+// from its first key.
+//
+// Nothing here needs GL or Assimp; tools/clip_compression_check.cpp measures the
+// error against the raw tracks on synthetic clips.
+
+#pragma once
+
+#include "asset_data.h"
+#include "pose_simd.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+const float CLIP_TIME_STEPS = 65535.0f;
+
+struct ClipCompression {
+	float positionError = 0.001f;   // largest allowed position error, in model units
+	float scaleError = 0.0005f;     // largest allowed scale error
+	float rotationError = 0.001f;   // radians under which rotation keys count as equal
+};
+
+// One channel. values holds 3 uint16 per key: the quantized x, y, z of a vector
+// channel, or the smallest-three words of a rotation. No keys = channel absent.
+struct CompressedChannel {
+	std::vector<uint16_t> times;
+	std::vector<uint16_t> values;
+	glm::vec3 origin = glm::vec3(0.0f);   // vector channels: value = origin + q * step
+	glm::vec3 step = glm::vec3(0.0f);
+};
+
+struct CompressedTrack {
+	int node;
+	CompressedChannel positions, rotations, scales;
+};
+
+struct CompressedClip {
+	float duration = 0.0f;
+	float ticksPerSecond = 1.0f;
+	std::vector<NodeData> nodes;
+	std::vector<CompressedTrack> tracks;
+};
+
+struct ClipCompressionStats {
+	size_t rawBytes = 0;          // tracks and keys only; nodes are the same in both
+	size_t compressedBytes = 0;
+	int tracks = 0;
+	int droppedTracks = 0;
+	int constantChannels = 0;
+	int positionKeys = 0, positionKeysKept = 0;
+	int scaleKeys = 0, scaleKeysKept = 0;
+	float maxPositionError = 0.0f;
+	float maxScaleError = 0.0f;
+};
+
+// ----------------------------------------------------------------------------
+// quantization
+// ----------------------------------------------------------------------------
+
+inline uint16_t QuantizeTime(float time, float duration)
+{
+	if (duration <= 0.0f)
+		return 0;
+	float t = time / duration;
+	t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+	return (uint16_t)lrintf(t * CLIP_TIME_STEPS);
+}
+
+// 2 bits: which component was dropped (the largest, made positive)
+// 3 x 15 bits: the others, scaled from [-1/sqrt(2), 1/sqrt(2)]
+inline void QuantizeRotation(glm::quat q, uint16_t out[3])
+{
+	q = glm::normalize(q);
+	float c[4] = { q.x, q.y, q.z, q.w };
+	int largest = 0;
+	for (int i = 1; i < 4; ++i)
+		if (fabsf(c[i]) > fabsf(c[largest]))
+			largest = i;
+	float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+	uint64_t bits = (uint64_t)largest << 45;
+	int shift = 30;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i == largest)
+			continue;
+		float v = c[i] * sign * 0.70710678f + 0.5f;   // [-1/sqrt(2), 1/sqrt(2)] -> [0, 1]
+		v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+		bits |= (uint64_t)lrintf(v * 32767.0f) << shift;
+		shift -= 15;
+	}
+	out[0] = (uint16_t)(bits >> 32);
+	out[1] = (uint16_t)(bits >> 16);
+	out[2] = (uint16_t)bits;
+}
+
+inline glm::quat DequantizeRotation(const uint16_t in[3])
+{
+	uint64_t bits = (uint64_t)in[0] << 32 | (uint64_t)in[1] << 16 | in[2];
+	int largest = (int)(bits >> 45) & 3;
+	float c[4];
+	float sum = 0.0f;
+	int shift = 30;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i == largest)
+			continue;
+		float v = ((bits >> shift) & 0x7FFF) / 32767.0f;
+		c[i] = (v - 0.5f) * 1.41421356f;
+		sum += c[i] * c[i];
+		shift -= 15;
+	}
+	c[largest] = sqrtf(sum < 1.0f ? 1.0f - sum : 0.0f);
+	return glm::quat(c[3], c[0], c[1], c[2]);
+}
+
+inline glm::vec3 DequantizeVector(const CompressedChannel& channel, size_t key)
+{
+	const uint16_t* q = &channel.values[key * 3];
+	return channel.origin + glm::vec3(q[0], q[1], q[2]) * channel.step;
+}
+
+inline size_t ChannelBytes(const CompressedChannel& channel)
+{
+	return (channel.times.size() + channel.values.size()) * sizeof(uint16_t);
+}
+
+// ----------------------------------------------------------------------------
+// compression
+// ----------------------------------------------------------------------------
+
+inline float MaxComponentError(const glm::vec3& a, const glm::vec3& b)
+{
+	glm::vec3 d = glm::abs(a - b);
+	return d.x > d.y ? (d.x > d.z ? d.x : d.z) : (d.y > d.z ? d.y : d.z);
+}
+
+// Positions or scales. 'identity' is the value an absent channel stands for.
+template <typename Key>
+inline void CompressVectorChannel(const Key* keys, size_t count, float duration, float maxError, const glm::vec3& identity,
+	CompressedChannel& out, int& keysKept, float& worstError, int& constantChannels)
+{
+	out = CompressedChannel();
+	if (count == 0)
+		return;
+
+	glm::vec3 lo = keys[0].value, hi = keys[0].value;
+	for (size_t k = 0; k < count; ++k)
+	{
+		lo = glm::min(lo, keys[k].value);
+		hi = glm::max(hi, keys[k].value);
+	}
+
+	if (MaxComponentError(lo, hi) <= maxError)
+	{
+		constantChannels++;
+		glm::vec3 mid = (lo + hi) * 0.5f;
+		if (MaxComponentError(mid, identity) <= maxError)
+			return;
+		out.origin = mid;
+		out.times.push_back(0);
+		out.values.insert(out.values.end(), 3, 0);
+		keysKept++;
+		return;
+	}
+
+	out.origin = lo;
+	out.step = (hi - lo) / 65535.0f;
+	std::vector<uint16_t> q(count * 3);
+	std::vector<glm::vec3> decoded(count);
+	for (size_t k = 0; k < count; ++k)
+	{
+		for (int c = 0; c < 3; ++c)
+			q[k * 3 + c] = out.step[c] > 0.0f ? (uint16_t)lrintf((keys[k].value[c] - lo[c]) / out.step[c]) : 0;
+		decoded[k] = out.origin + glm::vec3(q[k * 3], q[k * 3 + 1], q[k * 3 + 2]) * out.step;
+	}
+
+	// Greedy fit: from the last kept key, reach as far as possible while every key
+	// skipped is still within maxError of the line between the two kept ones.
+	auto push = [&](size_t k) {
+		out.times.push_back(QuantizeTime(keys[k].time, duration));
+		out.values.insert(out.values.end(), &q[k * 3], &q[k * 3] + 3);
+		keysKept++;
+	};
+	auto spanError = [&](size_t from, size_t to) {
+		float worst = 0.0f;
+		float span = keys[to].time - keys[from].time;
+		for (size_t k = from + 1; k < to; ++k)
+		{
+			float t = span > 0.0f ? (keys[k].time - keys[from].time) / span : 0.0f;
+			worst = fmaxf(worst, MaxComponentError(decoded[from] + (decoded[to] - decoded[from]) * t, keys[k].value));
+		}
+		return worst;
+	};
+
+	size_t anchor = 0;
+	push(0);
+	worstError = fmaxf(worstError, MaxComponentError(decoded[0], keys[0].value));
+	while (anchor + 1 < count)
+	{
+		size_t end = anchor + 1;
+		while (end + 1 < count && spanError(anchor, end + 1) <= maxError)
+			++end;
+		worstError = fmaxf(worstError, fmaxf(spanError(anchor, end), MaxComponentError(decoded[end], keys[end].value)));
+		push(end);
+		anchor = end;
+	}
+}
+
+inline void CompressRotationChannel(const KeyRot* keys, size_t keyCount, float duration, float maxError,
+	CompressedChannel& out, int& constantChannels)
+{
+	out = CompressedChannel();
+	if (keyCount == 0)
+		return;
+
+	// angle between two rotations: 2 acos |dot|
+	const float minDot = cosf(maxError * 0.5f);
+	bool constant = true;
+	glm::quat first = glm::normalize(keys[0].value);
+	for (size_t k = 0; k < keyCount; ++k)
+		constant = constant && fabsf(glm::dot(first, glm::normalize(keys[k].value))) >= minDot;
+
+	size_t count = constant ? 1 : keyCount;
+	if (constant)
+	{
+		constantChannels++;
+		if (fabsf(first.w) >= minDot)
+			return;
+	}
+	out.times.resize(count);
+	out.values.resize(count * 3);
+	for (size_t k = 0; k < count; ++k)
+	{
+		out.times[k] = constant ? 0 : QuantizeTime(keys[k].time, duration);
+		QuantizeRotation(keys[k].value, &out.values[k * 3]);
+	}
+}
+
+// The transform a track with only single-key channels stands for.
+inline glm::mat4 ConstantTrackTransform(const CompressedTrack& track)
+{
+	glm::mat4 transform(1.0f);
+	if (!track.positions.times.empty())
+		transform = glm::translate(transform, DequantizeVector(track.positions, 0));
+	if (!track.rotations.times.empty())
+		transform = transform * glm::mat4_cast(DequantizeRotation(&track.rotations.values[0]));
+	if (!track.scales.times.empty())
+		transform = glm::scale(transform, DequantizeVector(track.scales, 0));
+	return transform;
+}
+
+// Compresses 'tracks' of a clip whose nodes and timing are those of 'clip'; its own
+// tracks are not looked at. The keys are only read, so they may sit in a mapped
+// asset cache (MappedAsset).
+inline ClipCompressionStats CompressClip(const ClipData& clip, const TrackView* tracks, size_t trackCount,
+	const ClipCompression& settings, CompressedClip& out)
+{
+	ClipCompressionStats stats;
+	out = CompressedClip();
+	out.duration = clip.duration;
+	out.ticksPerSecond = clip.ticksPerSecond;
+	out.nodes = clip.nodes;
+
+	for (size_t t = 0; t < trackCount; ++t)
+	{
+		const TrackView& track = tracks[t];
+		stats.tracks++;
+		stats.rawBytes += sizeof(TrackData) + track.positionCount * sizeof(KeyPos)
+			+ track.rotationCount * sizeof(KeyRot) + track.scaleCount * sizeof(KeyScale);
+		stats.positionKeys += (int)track.positionCount;
+		stats.scaleKeys += (int)track.scaleCount;
+
+		CompressedTrack packed;
+		packed.node = track.node;
+		CompressVectorChannel(track.positions, track.positionCount, clip.duration, settings.positionError, glm::vec3(0.0f),
+			packed.positions, stats.positionKeysKept, stats.maxPositionError, stats.constantChannels);
+		CompressRotationChannel(track.rotations, track.rotationCount, clip.duration, settings.rotationError, packed.rotations,
+			stats.constantChannels);
+		CompressVectorChannel(track.scales, track.scaleCount, clip.duration, settings.scaleError, glm::vec3(1.0f),
+			packed.scales, stats.scaleKeysKept, stats.maxScaleError, stats.constantChannels);
+
+		// a constant track that reproduces the bind pose adds nothing
+		if (packed.positions.times.size() <= 1 && packed.rotations.times.size() <= 1 && packed.scales.times.size() <= 1)
+		{
+			glm::mat4 constant = ConstantTrackTransform(packed);
+			const glm::mat4& bind = clip.nodes[track.node].transformation;
+			float basisError = 0.0f;
+			for (int c = 0; c < 3; ++c)
+				basisError = fmaxf(basisError, MaxComponentError(glm::vec3(constant[c]), glm::vec3(bind[c])));
+			if (basisError <= settings.scaleError &&
+				MaxComponentError(glm::vec3(constant[3]), glm::vec3(bind[3])) <= settings.positionError)
+			{
+				stats.droppedTracks++;
+				continue;
+			}
+		}
+
+		stats.compressedBytes += sizeof(CompressedTrack) + ChannelBytes(packed.positions)
+			+ ChannelBytes(packed.rotations) + ChannelBytes(packed.scales);
+		out.tracks.push_back(std::move(packed));
+	}
+	return stats;
+}
+
+inline ClipCompressionStats CompressClip(const ClipData& clip, const ClipCompression& settings, CompressedClip& out)
+{
+	std::vector<TrackView> tracks;
+	tracks.reserve(clip.tracks.size());
+	for (const TrackData& track : clip.tracks)
+		tracks.push_back(ViewTrack(track));
+	return CompressClip(clip, tracks.data(), tracks.size(), settings, out);
+}
+
+// One line per clip, in a single printf so loader threads don't interleave.
+inline void PrintCompressionStats(const char* name, const ClipCompressionStats& stats)
+{
+	printf("clip %-24s %7.1f KB -> %6.1f KB (%4.1fx)  tracks %d (-%d)  constant channels %d  "
+		"position keys %d -> %d (max error %.2g)  scale keys %d -> %d\n",
+		name, stats.rawBytes / 1024.0, stats.compressedBytes / 1024.0,
+		stats.compressedBytes ? (double)stats.rawBytes / stats.compressedBytes : 0.0,
+		stats.tracks, stats.droppedTracks, stats.constantChannels,
+		stats.positionKeys, stats.positionKeysKept, stats.maxPositionError, stats.scaleKeys, stats.scaleKeysKept);
+}
+
+// ----------------------------------------------------------------------------
+// sequential decoding
+// ----------------------------------------------------------------------------
+
+// The decoded key pair a channel was last sampled between.
+struct ChannelCursor {
+	int key = -1;
+	float t0 = 0.0f, t1 = 0.0f;   // in CLIP_TIME_STEPS units
+	float a[4], b[4];
+};
+
+struct ClipCursor {
+	std::vector<int> nodeTrack;             // track index per node, -1 = none
+	std::vector<ChannelCursor> channels;    // 3 per track: positions, rotations, scales
+
+	void Reset(const CompressedClip& clip)
+	{
+		nodeTrack.assign(clip.nodes.size(), -1);
+		for (size_t t = 0; t < clip.tracks.size(); ++t)
+			nodeTrack[clip.tracks[t].node] = (int)t;
+		channels.assign(clip.tracks.size() * 3, ChannelCursor());
+	}
+};
+
+inline void DecodeKey(const CompressedChannel& channel, bool rotation, size_t key, float out[4])
+{
+	if (rotation)
+	{
+		glm::quat q = DequantizeRotation(&channel.values[key * 3]);
+		out[0] = q.x; out[1] = q.y; out[2] = q.z; out[3] = q.w;
+	}
+	else
+	{
+		glm::vec3 v = DequantizeVector(channel, key);
+		out[0] = v.x; out[1] = v.y; out[2] = v.z; out[3] = 0.0f;
+	}
+}
+
+// Moves 'cursor' to the key pair around 'time' (CLIP_TIME_STEPS units) and returns the
+// factor between them, with FindKey / KeyFactor's clamping at both ends.
+inline float AdvanceChannel(const CompressedChannel& channel, bool rotation, ChannelCursor& cursor, float time)
+{
+	const int count = (int)channel.times.size();
+	if (count == 1)
+	{
+		if (cursor.key != 0)
+		{
+			cursor.key = 0;
+			DecodeKey(channel, rotation, 0, cursor.a);
+			for (int i = 0; i < 4; ++i)
+				cursor.b[i] = cursor.a[i];
+		}
+		return 0.0f;
+	}
+
+	int key = cursor.key;
+	if (key < 0 || time < cursor.t0)
+		key = 0;
+	while (key + 2 < count && channel.times[key + 1] <= time)
+		++key;
+	if (key != cursor.key)
+	{
+		cursor.key = key;
+		cursor.t0 = channel.times[key];
+		cursor.t1 = channel.times[key + 1];
+		DecodeKey(channel, rotation, key, cursor.a);
+		DecodeKey(channel, rotation, key + 1, cursor.b);
+	}
+	float span = cursor.t1 - cursor.t0;
+	if (span <= 0.0f)
+		return 0.0f;
+	float f = (time - cursor.t0) / span;
+	return f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+}
+
+// GatherLocalKeys (pose_bake.h) for a compressed clip: fills the key pairs of every
+// node for 'time' (ticks) through the cursor.
+inline void GatherCompressedKeys(PoseLocalsSoA& soa, const CompressedClip& clip, ClipCursor& cursor, float time)
+{
+	float* f[PF_M00];
+	for (int i = 0; i < PF_M00; ++i)
+		f[i] = soa.Field((PoseField)i);
+	const float at = clip.duration > 0.0f ? time / clip.duration * CLIP_TIME_STEPS : 0.0f;
+
+	for (int n = 0; n < soa.count; ++n)
+	{
+		int t = cursor.nodeTrack[n];
+		soa.animated[n] = t >= 0;
+		if (t < 0)
+			continue;
+		const CompressedTrack& track = clip.tracks[t];
+
+		// an absent channel is the identity held still
+		static const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		static const float one[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+		static const float unit[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		const float *pa = zero, *pb = zero, *qa = unit, *qb = unit, *sa = one, *sb = one;
+		float pt = 0.0f, qt = 0.0f, st = 0.0f;
+
+		ChannelCursor* c = &cursor.channels[t * 3];
+		if (!track.positions.times.empty())
+		{
+			pt = AdvanceChannel(track.positions, false, c[0], at);
+			pa = c[0].a;
+			pb = c[0].b;
+		}
+		if (!track.rotations.times.empty())
+		{
+			qt = AdvanceChannel(track.rotations, true, c[1], at);
+			qa = c[1].a;
+			qb = c[1].b;
+		}
+		if (!track.scales.times.empty())
+		{
+			st = AdvanceChannel(track.scales, false, c[2], at);
+			sa = c[2].a;
+			sb = c[2].b;
+		}
+
+		for (int i = 0; i < 3; ++i)
+		{
+			f[PF_POS_A_X + i][n] = pa[i];
+			f[PF_POS_B_X + i][n] = pb[i];
+			f[PF_SCALE_A_X + i][n] = sa[i];
+			f[PF_SCALE_B_X + i][n] = sb[i];
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			f[PF_ROT_A_X + i][n] = qa[i];
+			f[PF_ROT_B_X + i][n] = qb[i];
+		}
+		f[PF_POS_T][n] = pt;
+		f[PF_ROT_T][n] = qt;
+		f[PF_SCALE_T][n] = st;
+	}
+}
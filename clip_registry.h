@@ -0,0 +1,360 @@
+// clip_registry.h
+//
+// Streams the characters' pose samples (PoseCache) in and out of memory. At load
+// only the clips a round starts with are baked (STARTUP_CLIPS); the rest stay as
+// their compressed tracks until something asks for them:
+//
+//   ClipHandle   one clip of one registered character
+//   Prefetch()   the clip may be wanted soon: bake it on a worker if it isn't
+//                resident, and count it as used this frame
+//   Use()        the clip is wanted now. True if it is resident; otherwise the same
+//                as Prefetch() and counted as a miss, and ResidentClock() stands
+//                in for it until it lands
+//   Pin()        never evicted once streamed in
+//   Update()     once a frame, before posing: moves finished bakes into their caches
+//
+// The sim never sees any of this. Clip timing and hurtbox joints are baked for
+// every clip at load, since they must be the same on every peer and in every
+// replay from the first tick. Only the palettes the renderer poses from stream.
+// A worker bakes into a block of its own, and the cache is only changed in
+// Update(), on the thread that poses.
+//
+// Streamed clips live in a fixed set of blocks, each big enough for the largest
+// clip that streams: as many as the budget holds, and at least MIN_CLIP_BLOCKS.
+// The blocks and the workers' scratch are allocated by the first bake, so every
+// character is registered before that, and from then on streaming doesn't touch
+// the heap (tools/alloc_check.cpp). A bake takes a free block, or the block of the
+// least recently used streamed clip that wasn't wanted this frame or the last; a
+// clip being posed may also take one that was only prefetched. With no block to
+// take the bake waits, and is asked for again next frame. Clips baked at load keep
+// their cache's own memory and are never evicted.
+//
+//   ClipRegistry registry(jobs, 4 << 20);
+//   int p1 = registry.AddCharacter(P1.poses, P1.model, P1.compressed);
+//   registry.Pin(registry.Handle(p1, CLIP_IDLE));
+//   registry.Update();                                           // every frame
+//   registry.Prefetch(p1, PredictPlayerClips(match, 0));
+//   registry.Use(registry.Handle(p1, match.p[0].anim.clip));
+
+#pragma once
+
+#include "anim_graph.h"
+#include "job_system.h"
+#include "match_sim.h"
+#include "pose_bake.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// what a round starts with: everyone idles, and walking is the first thing anyone does
+const unsigned int STARTUP_CLIPS = (1u << CLIP_IDLE) | (1u << CLIP_WALK);
+const int MAX_CLIP_CHARACTERS = 4;
+const size_t DEFAULT_CLIP_BUDGET = 4u << 20;   // bytes of streamed pose samples, all characters together
+const int MIN_CLIP_BLOCKS = 8;                  // two fighters' crossfades, this frame and the last
+
+// What player i may play soon: where its own buttons can take it and, while the
+// opponent has a move out, the hit and block reactions. The debug buttons are left
+// out; their clips load when they are pressed.
+inline unsigned int PredictPlayerClips(const MatchState& match, int i)
+{
+	const AnimGraph& graph = AnimGraphTable();
+	unsigned int clips = PredictClips(graph, match.p[i].charState, ~DEBUG_BUTTONS);
+	if (match.p[1 - i].move != MOVE_NONE)
+		clips |= PredictClips(graph, IDLE_BLOCK, 0) | PredictClips(graph, IDLE_HIT, 0) | PredictClips(graph, CROUCH_HIT, 0);
+	return clips;
+}
+
+struct ClipHandle {
+	int character;
+	ClipId clip;
+};
+
+class ClipRegistry
+{
+public:
+	ClipRegistry(JobSystem& jobSystem, size_t budgetBytes) : jobs(jobSystem), budget(budgetBytes) {}
+
+	~ClipRegistry() { Drain(); }
+
+	ClipRegistry(const ClipRegistry&) = delete;
+	ClipRegistry& operator=(const ClipRegistry&) = delete;
+
+	// 'cache' is laid out (BakePoseCache) with some clips resident; it, 'model' and
+	// 'clips' must outlive the registry. Returns the character's index, -1 when full
+	// or once clips have started streaming.
+	// A cache that is already registered (fighters sharing a character, asset_loader.h)
+	// gets the index it has.
+	int AddCharacter(PoseCache& cache, const ModelData& model, const CompressedClip clips[CLIP_COUNT])
+	{
+		for (int ch = 0; ch < characterCount; ++ch)
+			if (characters[ch].cache == &cache)
+				return ch;
+		if (characterCount == MAX_CLIP_CHARACTERS || !blocks.empty())
+			return -1;
+		Character& character = characters[characterCount];
+		character.cache = &cache;
+		character.model = &model;
+		character.clips = clips;
+		for (int c = 0; c < CLIP_COUNT; ++c)
+		{
+			Entry& entry = character.entries[c];
+			entry.state = cache.Resident((ClipId)c) ? RESIDENT : UNLOADED;
+			if (entry.state == RESIDENT)
+				residentBytes += cache.ClipBytes((ClipId)c);
+			totalBytes += cache.ClipBytes((ClipId)c);
+		}
+		if (residentBytes > peakBytes)
+			peakBytes = residentBytes;
+		return characterCount++;
+	}
+
+	ClipHandle Handle(int character, ClipId clip) const { return ClipHandle{ character, clip }; }
+
+	void Pin(ClipHandle handle)
+	{
+		if (handle.clip == CLIP_NONE)
+			return;
+		At(handle).pinned = true;
+		Prefetch(handle);
+	}
+
+	void Prefetch(ClipHandle handle)
+	{
+		if (handle.clip == CLIP_NONE)
+			return;
+		Entry& entry = At(handle);
+		entry.lastUsed = frame;
+		if (entry.state.load(std::memory_order_relaxed) == UNLOADED)
+			StartBake(handle, false);
+	}
+
+	// every clip of 'character' set in 'clips' (one bit per ClipId)
+	void Prefetch(int character, unsigned int clips)
+	{
+		for (int c = 0; c < CLIP_COUNT; ++c)
+			if (clips & (1u << c))
+				Prefetch(Handle(character, (ClipId)c));
+	}
+
+	bool Use(ClipHandle handle)
+	{
+		if (handle.clip == CLIP_NONE)
+			return true;
+		Entry& entry = At(handle);
+		entry.lastUsed = entry.lastPosed = frame;
+		if (entry.state.load(std::memory_order_relaxed) == UNLOADED)
+			StartBake(handle, true);
+		if (entry.state.load(std::memory_order_relaxed) == RESIDENT)
+			return true;
+		misses++;
+		return false;
+	}
+
+	void Update()
+	{
+		frame++;
+		for (int ch = 0; ch < characterCount; ++ch)
+		{
+			Character& character = characters[ch];
+			for (int c = 0; c < CLIP_COUNT; ++c)
+			{
+				Entry& entry = character.entries[c];
+				if (entry.state.load(std::memory_order_acquire) != BAKED)
+					continue;
+				character.cache->clips[c].matrices.swap(blocks[entry.block].samples);
+				entry.state.store(RESIDENT, std::memory_order_relaxed);
+				residentBytes += character.cache->ClipBytes((ClipId)c);
+				loads++;
+			}
+		}
+		if (residentBytes > peakBytes)
+			peakBytes = residentBytes;
+	}
+
+	bool Resident(ClipHandle handle) const
+	{
+		return handle.clip != CLIP_NONE && characters[handle.character].entries[handle.clip].state.load(std::memory_order_relaxed) == RESIDENT;
+	}
+
+	size_t ResidentBytes() const { return residentBytes; }
+	int Loads() const { return loads; }
+	int Evictions() const { return evictions; }
+	int Misses() const { return misses; }
+	int Waits() const { return waits; }
+	int Blocks() const { return (int)blocks.size(); }
+
+	// waits for the bakes in flight; their results are published by the next Update()
+	void Drain()
+	{
+		while (inFlight.load(std::memory_order_acquire) > 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	void PrintSummary() const
+	{
+		printf("clips: %d streamed in, %d evicted, %d missed, %d waited for a block; %d blocks of %zu KB, %zu KB resident at most, %zu KB for every clip\n",
+			loads, evictions, misses, waits, (int)blocks.size(), blockBytes / 1024, peakBytes / 1024, totalBytes / 1024);
+	}
+
+private:
+	enum Residency {
+		UNLOADED,
+		BAKING,    // a worker owns the entry's block
+		BAKED,     // done, waiting for Update()
+		RESIDENT
+	};
+
+	struct Entry {
+		std::atomic<int> state{ UNLOADED };
+		int block = -1;                    // while streamed in or on the way
+		unsigned long long lastUsed = 0;   // prefetched or posed
+		unsigned long long lastPosed = 0;
+		bool pinned = false;
+	};
+
+	// Room for one streamed clip. A bake fills 'samples' and Update() swaps it with
+	// the cache's empty vector; eviction swaps them back, so neither ever frees.
+	struct Block {
+		std::vector<glm::mat4> samples;
+		BakeScratch scratch;
+	};
+
+	struct Character {
+		PoseCache* cache = NULL;
+		const ModelData* model = NULL;
+		const CompressedClip* clips = NULL;
+		Entry entries[CLIP_COUNT];
+	};
+
+	Entry& At(ClipHandle handle) { return characters[handle.character].entries[handle.clip]; }
+
+	void StartBake(ClipHandle handle, bool posing)
+	{
+		if (blocks.empty())
+			CreateBlocks();
+		int block = TakeBlock(posing);
+		if (block < 0)
+		{
+			waits++;
+			return;
+		}
+		At(handle).block = block;
+		At(handle).state.store(BAKING, std::memory_order_relaxed);
+		inFlight++;
+		// two words of captures, so the job fits in std::function without allocating
+		jobs.Run([this, handle]
+		{
+			Character& character = characters[handle.character];
+			Entry& entry = character.entries[handle.clip];
+			Block& block = blocks[entry.block];
+			const PoseCache& cache = *character.cache;
+			block.samples.resize((size_t)cache.clips[handle.clip].sampleCount * cache.boneCount);
+			BakeCompressedClip(cache, *character.model, character.clips[handle.clip], handle.clip, block.samples.data(), NULL, block.scratch);
+			entry.state.store(BAKED, std::memory_order_release);
+			inFlight--;
+		});
+	}
+
+	// Sized for every clip the registered characters don't have resident. There is
+	// never a point in more blocks than clips that stream.
+	void CreateBlocks()
+	{
+		size_t blockSamples = 0;
+		int streamed = 0;
+		for (int ch = 0; ch < characterCount; ++ch)
+		{
+			for (int c = 0; c < CLIP_COUNT; ++c)
+			{
+				if (characters[ch].entries[c].state.load(std::memory_order_relaxed) != UNLOADED)
+					continue;
+				const PoseCache& cache = *characters[ch].cache;
+				size_t samples = (size_t)cache.clips[c].sampleCount * cache.boneCount;
+				if (samples > blockSamples)
+					blockSamples = samples;
+				streamed++;
+			}
+		}
+		blockBytes = blockSamples * sizeof(glm::mat4);
+		int count = blockBytes ? (int)(budget / blockBytes) : 0;
+		if (count < MIN_CLIP_BLOCKS)
+			count = MIN_CLIP_BLOCKS;
+		if (count > streamed)
+			count = streamed;
+
+		blocks.resize(count);
+		freeBlocks.reserve(count);
+		for (int b = count - 1; b >= 0; --b)
+		{
+			blocks[b].samples.reserve(blockSamples);
+			for (int ch = 0; ch < characterCount; ++ch)
+				for (int c = 0; c < CLIP_COUNT; ++c)
+					if (characters[ch].entries[c].state.load(std::memory_order_relaxed) == UNLOADED)
+						blocks[b].scratch.Reserve(characters[ch].clips[c]);
+			freeBlocks.push_back(b);
+		}
+		// every bake holds a block, so no more are ever queued at once
+		jobs.Reserve(count);
+	}
+
+	// A free block, or the one of the least recently used streamed clip that wasn't
+	// wanted this frame or the last (for a clip being posed: posed). -1 if none.
+	int TakeBlock(bool posing)
+	{
+		if (!freeBlocks.empty())
+		{
+			int block = freeBlocks.back();
+			freeBlocks.pop_back();
+			return block;
+		}
+
+		Character* oldestCharacter = NULL;
+		int oldestClip = -1;
+		for (int ch = 0; ch < characterCount; ++ch)
+		{
+			for (int c = 0; c < CLIP_COUNT; ++c)
+			{
+				const Entry& entry = characters[ch].entries[c];
+				unsigned long long wanted = posing ? entry.lastPosed : entry.lastUsed;
+				if (entry.block < 0 || entry.pinned || entry.state.load(std::memory_order_relaxed) != RESIDENT || wanted + 1 >= frame)
+					continue;
+				if (!oldestCharacter || entry.lastUsed < oldestCharacter->entries[oldestClip].lastUsed)
+				{
+					oldestCharacter = &characters[ch];
+					oldestClip = c;
+				}
+			}
+		}
+		if (!oldestCharacter)
+			return -1;
+
+		Entry& entry = oldestCharacter->entries[oldestClip];
+		int block = entry.block;
+		blocks[block].samples.swap(oldestCharacter->cache->clips[oldestClip].matrices);
+		entry.block = -1;
+		entry.state.store(UNLOADED, std::memory_order_relaxed);
+		residentBytes -= oldestCharacter->cache->ClipBytes((ClipId)oldestClip);
+		evictions++;
+		return block;
+	}
+
+	JobSystem& jobs;
+	size_t budget;
+	Character characters[MAX_CLIP_CHARACTERS];
+	int characterCount = 0;
+	std::vector<Block> blocks;
+	std::vector<int> freeBlocks;
+	size_t blockBytes = 0;
+	unsigned long long frame = 0;
+	std::atomic<int> inFlight{ 0 };
+
+	size_t residentBytes = 0;
+	size_t peakBytes = 0;
+	size_t totalBytes = 0;
+	int loads = 0;
+	int evictions = 0;
+	int misses = 0;
+	int waits = 0;
+};
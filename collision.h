@@ -0,0 +1,367 @@
+// collision.h
+//
+// Capsule contacts for the sim: hurtboxes, hitboxes and anything else that is a
+// segment with a radius (a sphere is a capsule with both ends in one place, a
+// projectile one from last tick's position to this one's). Glm only, and nothing is
+// allocated; a CollisionWorld is a fixed array refilled every tick.
+//
+//   broadphase    sweep and prune along z, the fight axis: colliders sorted by the
+//                 near end of their bounds, each tested only against the ones that
+//                 start before it ends, and only when layers and teams allow a contact
+//   narrowphase   closest distance between the two segments against the sum of the
+//                 radii, four candidate pairs at a time with SSE (pose_simd.h decides
+//                 whether it is available)
+//
+// SegmentDistanceSq is the scalar twin of the SSE kernel: the same operations in the
+// same order, so both builds give bit-identical contacts and a match replays the same
+// on either. tools/collision_check.cpp checks that, the kernel against a brute force
+// search, and the broadphase against testing every pair.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "pose_simd.h"
+
+#include <cmath>
+
+const int MAX_COLLIDERS = 64;
+const int MAX_COLLISION_CANDIDATES = 512;   // broadphase pairs per FindContacts, the rest are dropped
+
+// below this a segment is a point, or two segments are parallel
+const float SEGMENT_EPSILON = 1e-8f;
+
+enum CollisionLayer {
+	COLLIDE_PUSH = 1 << 0,
+	COLLIDE_HURT = 1 << 1,
+	COLLIDE_HIT  = 1 << 2
+};
+
+struct Capsule {
+	glm::vec3 a;
+	glm::vec3 b;
+	float radius;
+};
+
+struct Collider {
+	Capsule shape;
+	int owner;            // body it belongs to: a player, a projectile
+	int team;             // colliders of one team never touch
+	unsigned int layer;   // one CollisionLayer bit
+	unsigned int hits;    // layers this collider reports contacts with
+};
+
+// 'collider' touches 'other' and has other's layer in its 'hits'. Two colliders
+// that hit each other's layers give two contacts.
+struct Contact {
+	int collider;
+	int other;
+};
+
+// ----------------------------------------------------------------------------
+// narrowphase
+// ----------------------------------------------------------------------------
+
+// written like _mm_max_ps / _mm_min_ps pick, so the scalar and SSE paths agree on every input
+inline float Clamp01(float x)
+{
+	x = x > 0.0f ? x : 0.0f;
+	return x < 1.0f ? x : 1.0f;
+}
+
+// Squared distance between segments p1-q1 and p2-q2 (Ericson, "Real-Time Collision
+// Detection" 5.1.9), without branches on the data: s from the infinite lines, t from
+// s, then s again from the clamped t. The last step only ever moves closer, so it is
+// exact where Ericson's version re-solves s only when t was clamped. The three
+// divisions are taken up front as reciprocals, so they overlap instead of chaining.
+inline float SegmentDistanceSq(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2, const glm::vec3& q2)
+{
+	float d1x = q1.x - p1.x, d1y = q1.y - p1.y, d1z = q1.z - p1.z;
+	float d2x = q2.x - p2.x, d2y = q2.y - p2.y, d2z = q2.z - p2.z;
+	float rx = p1.x - p2.x, ry = p1.y - p2.y, rz = p1.z - p2.z;
+
+	float a = d1x * d1x + d1y * d1y + d1z * d1z;
+	float e = d2x * d2x + d2y * d2y + d2z * d2z;
+	float b = d1x * d2x + d1y * d2y + d1z * d2z;
+	float c = d1x * rx + d1y * ry + d1z * rz;
+	float f = d2x * rx + d2y * ry + d2z * rz;
+	float denom = a * e - b * b;
+	float invDenom = denom > SEGMENT_EPSILON ? 1.0f / denom : 0.0f;
+	float invE = e > SEGMENT_EPSILON ? 1.0f / e : 0.0f;
+	float invA = a > SEGMENT_EPSILON ? 1.0f / a : 0.0f;
+
+	float s = Clamp01((b * f - c * e) * invDenom);
+	float t = Clamp01((b * s + f) * invE);
+	s = Clamp01((b * t - c) * invA);
+
+	float dx = (p1.x + d1x * s) - (p2.x + d2x * t);
+	float dy = (p1.y + d1y * s) - (p2.y + d2y * t);
+	float dz = (p1.z + d1z * s) - (p2.z + d2z * t);
+	return dx * dx + dy * dy + dz * dz;
+}
+
+inline bool CapsulesTouch(const Capsule& a, const Capsule& b)
+{
+	float reach = a.radius + b.radius;
+	return SegmentDistanceSq(a.a, a.b, b.a, b.b) <= reach * reach;
+}
+
+// Four segment pairs struct-of-arrays: p1[axis][pair] and so on.
+struct SegmentPairs4 {
+	float p1[3][4];
+	float q1[3][4];
+	float p2[3][4];
+	float q2[3][4];
+};
+
+inline void SegmentDistanceSq4Scalar(const SegmentPairs4& in, float out[4])
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		out[i] = SegmentDistanceSq(
+			glm::vec3(in.p1[0][i], in.p1[1][i], in.p1[2][i]), glm::vec3(in.q1[0][i], in.q1[1][i], in.q1[2][i]),
+			glm::vec3(in.p2[0][i], in.p2[1][i], in.p2[2][i]), glm::vec3(in.q2[0][i], in.q2[1][i], in.q2[2][i]));
+	}
+}
+
+#if defined(POSE_SIMD_SSE)
+inline __m128 Dot3SSE(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+inline __m128 Clamp01SSE(__m128 x)
+{
+	return _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+inline void SegmentDistanceSq4SSE(const SegmentPairs4& in, float out[4])
+{
+	__m128 d1[3], d2[3], r[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		__m128 p1 = _mm_loadu_ps(in.p1[k]);
+		__m128 p2 = _mm_loadu_ps(in.p2[k]);
+		d1[k] = _mm_sub_ps(_mm_loadu_ps(in.q1[k]), p1);
+		d2[k] = _mm_sub_ps(_mm_loadu_ps(in.q2[k]), p2);
+		r[k] = _mm_sub_ps(p1, p2);
+	}
+
+	__m128 a = Dot3SSE(d1[0], d1[1], d1[2], d1[0], d1[1], d1[2]);
+	__m128 e = Dot3SSE(d2[0], d2[1], d2[2], d2[0], d2[1], d2[2]);
+	__m128 b = Dot3SSE(d1[0], d1[1], d1[2], d2[0], d2[1], d2[2]);
+	__m128 c = Dot3SSE(d1[0], d1[1], d1[2], r[0], r[1], r[2]);
+	__m128 f = Dot3SSE(d2[0], d2[1], d2[2], r[0], r[1], r[2]);
+	__m128 denom = _mm_sub_ps(_mm_mul_ps(a, e), _mm_mul_ps(b, b));
+
+	// the masked lanes may divide by zero; their reciprocal is thrown away
+	const __m128 epsilon = _mm_set1_ps(SEGMENT_EPSILON);
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128 invDenom = _mm_and_ps(_mm_cmpgt_ps(denom, epsilon), _mm_div_ps(one, denom));
+	__m128 invE = _mm_and_ps(_mm_cmpgt_ps(e, epsilon), _mm_div_ps(one, e));
+	__m128 invA = _mm_and_ps(_mm_cmpgt_ps(a, epsilon), _mm_div_ps(one, a));
+
+	__m128 s = Clamp01SSE(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(b, f), _mm_mul_ps(c, e)), invDenom));
+	__m128 t = Clamp01SSE(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(b, s), f), invE));
+	s = Clamp01SSE(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(b, t), c), invA));
+
+	__m128 distance = _mm_setzero_ps();
+	for (int k = 0; k < 3; ++k)
+	{
+		__m128 onFirst = _mm_add_ps(_mm_loadu_ps(in.p1[k]), _mm_mul_ps(d1[k], s));
+		__m128 onSecond = _mm_add_ps(_mm_loadu_ps(in.p2[k]), _mm_mul_ps(d2[k], t));
+		__m128 d = _mm_sub_ps(onFirst, onSecond);
+		distance = k == 0 ? _mm_mul_ps(d, d) : _mm_add_ps(distance, _mm_mul_ps(d, d));
+	}
+	_mm_storeu_ps(out, distance);
+}
+#endif
+
+inline void SegmentDistanceSq4(const SegmentPairs4& in, float out[4])
+{
+#if defined(POSE_SIMD_SSE)
+	SegmentDistanceSq4SSE(in, out);
+#else
+	SegmentDistanceSq4Scalar(in, out);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// world
+// ----------------------------------------------------------------------------
+
+struct CollisionWorld {
+	int count = 0;
+	Collider colliders[MAX_COLLIDERS];
+
+	// broadphase scratch, filled by FindContacts: x y z bounds (the fourth float is
+	// padding) and the sweep order
+	float lo[MAX_COLLIDERS][4];
+	float hi[MAX_COLLIDERS][4];
+	int order[MAX_COLLIDERS];
+
+	void Clear() { count = 0; }
+
+	// index of the new collider, -1 when the world is full
+	int Add(const Collider& collider)
+	{
+		if (count >= MAX_COLLIDERS)
+			return -1;
+		colliders[count] = collider;
+		return count++;
+	}
+};
+
+inline bool LayersMeet(const Collider& a, const Collider& b)
+{
+	return a.team != b.team && ((a.hits & b.layer) != 0 || (b.hits & a.layer) != 0);
+}
+
+// rows[axis][i] = capsules[i]->*end[axis]. The SSE version loads each end as four
+// floats (the fourth is the next member, ignored) and transposes them.
+inline void GatherSegments4(const Capsule* const capsules[4], glm::vec3 Capsule::*end, float rows[3][4])
+{
+#if defined(POSE_SIMD_SSE)
+	__m128 r0 = _mm_loadu_ps(&(capsules[0]->*end).x);
+	__m128 r1 = _mm_loadu_ps(&(capsules[1]->*end).x);
+	__m128 r2 = _mm_loadu_ps(&(capsules[2]->*end).x);
+	__m128 r3 = _mm_loadu_ps(&(capsules[3]->*end).x);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(rows[0], r0);
+	_mm_storeu_ps(rows[1], r1);
+	_mm_storeu_ps(rows[2], r2);
+#else
+	for (int i = 0; i < 4; ++i)
+		for (int k = 0; k < 3; ++k)
+			rows[k][i] = (capsules[i]->*end)[k];
+#endif
+}
+
+// Narrowphase of up to four candidates; appends their contacts.
+inline int ResolveCandidates(const CollisionWorld& world, const int (*pairs)[2], int pairCount,
+	Contact* contacts, int contactCount, int maxContacts)
+{
+	// the unused lanes repeat the first pair
+	const Capsule* first[4];
+	const Capsule* second[4];
+	float reach[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		first[i] = &world.colliders[pairs[i < pairCount ? i : 0][0]].shape;
+		second[i] = &world.colliders[pairs[i < pairCount ? i : 0][1]].shape;
+		reach[i] = first[i]->radius + second[i]->radius;
+	}
+
+	SegmentPairs4 batch;
+	GatherSegments4(first, &Capsule::a, batch.p1);
+	GatherSegments4(first, &Capsule::b, batch.q1);
+	GatherSegments4(second, &Capsule::a, batch.p2);
+	GatherSegments4(second, &Capsule::b, batch.q2);
+
+	float distance[4];
+	SegmentDistanceSq4(batch, distance);
+	for (int i = 0; i < pairCount; ++i)
+	{
+		if (distance[i] > reach[i] * reach[i])
+			continue;
+		int a = pairs[i][0], b = pairs[i][1];
+		if ((world.colliders[a].hits & world.colliders[b].layer) != 0 && contactCount < maxContacts)
+			contacts[contactCount++] = Contact{ a, b };
+		if ((world.colliders[b].hits & world.colliders[a].layer) != 0 && contactCount < maxContacts)
+			contacts[contactCount++] = Contact{ b, a };
+	}
+	return contactCount;
+}
+
+// Every contact in the world, at most 'maxContacts'. The order depends only on the
+// colliders and the order they were added in.
+//
+// The sweep keeps two active lists: colliders that report contacts (hitboxes,
+// projectiles) and passive ones (hurtboxes). A passive collider entering the sweep
+// is only tested against the active reporters, so the overlaps between the many
+// hurtboxes of a crowded stage cost nothing.
+inline int FindContacts(CollisionWorld& world, Contact* contacts, int maxContacts)
+{
+	const int n = world.count;
+	for (int i = 0; i < n; ++i)
+	{
+		const Capsule& shape = world.colliders[i].shape;
+#if defined(POSE_SIMD_SSE)
+		__m128 a = _mm_loadu_ps(&shape.a.x);
+		__m128 b = _mm_loadu_ps(&shape.b.x);
+		__m128 r = _mm_set1_ps(shape.radius);
+		_mm_storeu_ps(world.lo[i], _mm_sub_ps(_mm_min_ps(a, b), r));
+		_mm_storeu_ps(world.hi[i], _mm_add_ps(_mm_max_ps(a, b), r));
+#else
+		for (int k = 0; k < 3; ++k)
+		{
+			float a = shape.a[k], b = shape.b[k];
+			world.lo[i][k] = (a < b ? a : b) - shape.radius;
+			world.hi[i][k] = (a < b ? b : a) + shape.radius;
+		}
+#endif
+	}
+
+	// insertion sort on the near z; stable, so ties keep the order of Add()
+	for (int i = 0; i < n; ++i)
+	{
+		const float z = world.lo[i][2];
+		int j = i;
+		while (j > 0 && world.lo[world.order[j - 1]][2] > z)
+		{
+			world.order[j] = world.order[j - 1];
+			--j;
+		}
+		world.order[j] = i;
+	}
+
+	int reporters[MAX_COLLIDERS], passive[MAX_COLLIDERS];
+	int reporterCount = 0, passiveCount = 0;
+	int candidates[MAX_COLLISION_CANDIDATES][2];
+	int candidateCount = 0;
+
+	// tests 'a' against every collider still open in 'list', dropping the ones that
+	// ended before 'a' starts
+	auto sweep = [&](int a, int* list, int& count) {
+		for (int k = 0; k < count;)
+		{
+			const int b = list[k];
+			if (world.hi[b][2] < world.lo[a][2])
+			{
+				list[k] = list[--count];
+				continue;
+			}
+			++k;
+			if (!LayersMeet(world.colliders[a], world.colliders[b]) ||
+				world.lo[b][0] > world.hi[a][0] || world.lo[a][0] > world.hi[b][0] ||
+				world.lo[b][1] > world.hi[a][1] || world.lo[a][1] > world.hi[b][1])
+				continue;
+
+			if (candidateCount < MAX_COLLISION_CANDIDATES)
+			{
+				candidates[candidateCount][0] = a < b ? a : b;
+				candidates[candidateCount][1] = a < b ? b : a;
+				++candidateCount;
+			}
+		}
+	};
+
+	for (int i = 0; i < n; ++i)
+	{
+		const int a = world.order[i];
+		sweep(a, reporters, reporterCount);
+		if (world.colliders[a].hits != 0)
+		{
+			sweep(a, passive, passiveCount);
+			reporters[reporterCount++] = a;
+		}
+		else
+		{
+			passive[passiveCount++] = a;
+		}
+	}
+	int contactCount = 0;
+	for (int c = 0; c < candidateCount; c += 4)
+		contactCount = ResolveCandidates(world, candidates + c, candidateCount - c < 4 ? candidateCount - c : 4, contacts, contactCount, maxContacts);
+	return contactCount;
+}
@@ -0,0 +1,146 @@
+// crowd.h
+//
+// Spectators for the instanced skinning path (instanced_skinning.h): rows of
+// characters on bleachers behind the stage, facing the camera, each looping one
+// clip from its own phase. Cheering members idle on their legs with the punch
+// layered over the upper body (blend_tree.h). Members alternate between the two
+// fighters' models, so a crowd of N is two instanced batches of about N / 2.
+//
+//   skeletal_animation --crowd 256
+
+#pragma once
+
+#include "blend_tree.h"
+#include "instanced_skinning.h"
+#include "pose_cache.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <vector>
+
+const int CROWD_ROW_LENGTH = 32;
+const float CROWD_SPACING = 0.9f;     // between neighbours in a row
+const float CROWD_ROW_DEPTH = 1.2f;   // between rows
+const float CROWD_ROW_RISE = 0.6f;    // each row stands this much higher
+
+struct CrowdMember {
+	int character;     // 0 = P1's model, 1 = P2's
+	int slot;          // instance index in that character's batch
+	ClipId clip;
+	ClipId upperBody;  // layered over the spine and up, CLIP_NONE for none
+	float phase;       // 0..1 of the clip
+	glm::mat4 model;
+};
+
+inline void BuildCrowd(int count, std::vector<CrowdMember>& crowd)
+{
+	// mostly idling, some cheering
+	static const ClipId clips[] = { CLIP_IDLE, CLIP_IDLE, CLIP_IDLE, CLIP_PUNCH, CLIP_JUMP, CLIP_STAND_HIT };
+	unsigned int rng = 12345;
+	int slots[2] = { 0, 0 };
+
+	crowd.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		rng = rng * 1664525u + 1013904223u;
+		CrowdMember& member = crowd[i];
+		member.character = i & 1;
+		member.slot = slots[member.character]++;
+		member.clip = clips[(rng >> 16) % (sizeof(clips) / sizeof(clips[0]))];
+		member.phase = ((rng >> 8) & 0xFF) / 256.0f;
+		// the punch is a cheer: thrown from the waist up while the legs idle
+		member.upperBody = CLIP_NONE;
+		if (member.clip == CLIP_PUNCH)
+		{
+			member.clip = CLIP_IDLE;
+			member.upperBody = CLIP_PUNCH;
+		}
+
+		int row = i / CROWD_ROW_LENGTH;
+		int column = i % CROWD_ROW_LENGTH;
+		glm::vec3 position(4.0f + row * CROWD_ROW_DEPTH, row * CROWD_ROW_RISE,
+			(column - (CROWD_ROW_LENGTH - 1) * 0.5f) * CROWD_SPACING);
+		// Mixamo characters face +z; turn them towards the camera on -x
+		member.model = glm::rotate(glm::translate(glm::mat4(1.0f), position), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+}
+
+// Members per character, for sizing the two InstancedSkinning batches.
+inline int CrowdCount(const std::vector<CrowdMember>& crowd, int character)
+{
+	int count = 0;
+	for (const CrowdMember& member : crowd)
+		count += member.character == character;
+	return count;
+}
+
+// The clips one character's members play, one bit per ClipId. The loader bakes
+// these up front (clip_registry.h), spectators never change clips.
+inline unsigned int CrowdClips(const std::vector<CrowdMember>& crowd, int character)
+{
+	unsigned int clips = 0;
+	for (const CrowdMember& member : crowd)
+	{
+		if (member.character != character)
+			continue;
+		clips |= 1u << member.clip;
+		if (member.upperBody != CLIP_NONE)
+			clips |= 1u << member.upperBody;
+	}
+	return clips;
+}
+
+// A looping clip's time in ticks at 'seconds', started 'phase' (0..1) of the way in.
+inline float CrowdClipTime(const BakedClip& clip, float seconds, float phase)
+{
+	if (clip.duration <= 0.0f)
+		return 0.0f;
+	return fmodf(seconds * clip.ticksPerSecond + phase * clip.duration, clip.duration);
+}
+
+// Where PoseCrowd writes one character's poses: member slot i's bones start at
+// poses + i * bonesPerInstance. InstancedSkinning::Upload() takes the same layout.
+struct CrowdPoses {
+	glm::mat4* poses;
+	int capacity;          // slots
+	int bonesPerInstance;
+};
+
+// Every member's placement into its batch. Members don't move, so this is done once.
+inline void PlaceCrowd(const std::vector<CrowdMember>& crowd, InstancedSkinning* const batches[2])
+{
+	for (const CrowdMember& member : crowd)
+	{
+		InstancedSkinning& batch = *batches[member.character];
+		if (member.slot < batch.Capacity())
+			batch.Model(member.slot) = member.model;
+	}
+}
+
+// Writes every member's pose at 'seconds'. 'masks' are the characters' upper-body
+// masks for the cheering layer. A clip that isn't resident is stood in for, and a
+// layer that isn't is left off.
+inline void PoseCrowd(const std::vector<CrowdMember>& crowd, const PoseCache* const caches[2], const BoneMask* const masks[2],
+	const CrowdPoses targets[2], float seconds)
+{
+	for (const CrowdMember& member : crowd)
+	{
+		const CrowdPoses& target = targets[member.character];
+		if (member.slot >= target.capacity)
+			continue;
+		const PoseCache& cache = *caches[member.character];
+
+		AnimClock clock = { member.clip, CLIP_NONE, 0.0f, 0.0f, 0.0f };
+		clock.time = CrowdClipTime(cache.clips[member.clip], seconds, member.phase);
+		glm::mat4* palette = target.poses + (size_t)member.slot * target.bonesPerInstance;
+		EvaluatePose(cache, ResidentClock(cache, clock), palette);
+		if (cache.Resident(member.upperBody))
+		{
+			PoseLayer layer = { member.upperBody, CrowdClipTime(cache.clips[member.upperBody], seconds, member.phase), 1.0f,
+				masks[member.character] };
+			ApplyLayers(cache, &layer, 1, palette);
+		}
+	}
+}
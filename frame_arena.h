@@ -0,0 +1,250 @@
+// frame_arena.h
+//
+// Keeping the frame loop off the heap:
+//
+//   FrameArena       a linear allocator for data that lives for one frame. Alloc() is a
+//                    pointer bump, Reset() at the top of the frame frees everything at
+//                    once. A frame that runs out spills to the heap and the next Reset()
+//                    grows the block past the high-water mark, so the arena settles after
+//                    the first few frames and never allocates again
+//   heap tracking    build with -DTRACK_ALLOCATIONS and every operator new in the
+//                    program is counted; HeapAllocationCount() reads the count.
+//                    AllocationWatch turns it into allocations per frame
+//
+//   AllocationWatch watch(120);       // the first 120 frames are warm-up
+//   frameArena.Reset();
+//   watch.BeginFrame();
+//   ...
+//   watch.EndFrame();
+//   watch.PrintSummary();             // frames that allocated after warm-up
+//
+// TRACK_ALLOCATIONS replaces the global operator new and delete, so define it in one
+// translation unit only (every program here is one). Allocations that skip operator
+// new, like a driver calling malloc, are not seen.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// heap tracking
+// ----------------------------------------------------------------------------
+
+inline std::atomic<unsigned long long> heapAllocations(0);
+
+#ifdef TRACK_ALLOCATIONS
+
+static void* TrackedAlloc(std::size_t size)
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+static void* TrackedAlignedAlloc(std::size_t size, std::align_val_t align)
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	std::size_t alignment = (std::size_t)align;
+#ifdef _WIN32
+	// the CRT has no aligned_alloc; its aligned blocks go back through _aligned_free
+	void* p = _aligned_malloc(size ? size : 1, alignment);
+#else
+	// aligned_alloc wants a multiple of the alignment
+	void* p = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+static void TrackedAlignedFree(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+void* operator new(std::size_t size) { return TrackedAlloc(size); }
+void* operator new[](std::size_t size) { return TrackedAlloc(size); }
+void* operator new(std::size_t size, std::align_val_t align) { return TrackedAlignedAlloc(size, align); }
+void* operator new[](std::size_t size, std::align_val_t align) { return TrackedAlignedAlloc(size, align); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, std::size_t) noexcept { free(p); }
+void operator delete[](void* p, std::size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { TrackedAlignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { TrackedAlignedFree(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { TrackedAlignedFree(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { TrackedAlignedFree(p); }
+
+const bool HEAP_TRACKING = true;
+
+#else
+
+const bool HEAP_TRACKING = false;
+
+#endif
+
+// operator new calls so far, from every thread. Always 0 without TRACK_ALLOCATIONS.
+inline unsigned long long HeapAllocationCount()
+{
+	return heapAllocations.load(std::memory_order_relaxed);
+}
+
+// Heap allocations per frame, ignoring the first 'warmupFrames' while caches,
+// pools and the arena reach their working size.
+class AllocationWatch
+{
+public:
+	explicit AllocationWatch(int warmupFrames = 0) : warmup(warmupFrames) {}
+
+	void BeginFrame()
+	{
+		frameStart = HeapAllocationCount();
+	}
+
+	// allocations since BeginFrame()
+	unsigned long long EndFrame()
+	{
+		unsigned long long count = HeapAllocationCount() - frameStart;
+		if (frames++ < warmup)
+			return count;
+		steadyFrames++;
+		if (count > 0)
+		{
+			allocatingFrames++;
+			total += count;
+			if (count > worst)
+				worst = count;
+		}
+		return count;
+	}
+
+	int SteadyFrames() const { return steadyFrames; }
+	int AllocatingFrames() const { return allocatingFrames; }
+	unsigned long long Worst() const { return worst; }
+
+	void PrintSummary() const
+	{
+		if (!HEAP_TRACKING)
+			return;
+		printf("heap: %d of %d frames after warm-up allocated (%llu allocations, at most %llu in one frame)\n",
+			allocatingFrames, steadyFrames, total, worst);
+	}
+
+private:
+	int warmup;
+	int frames = 0;
+	int steadyFrames = 0;
+	int allocatingFrames = 0;
+	unsigned long long frameStart = 0;
+	unsigned long long total = 0;
+	unsigned long long worst = 0;
+};
+
+// ----------------------------------------------------------------------------
+// frame arena
+// ----------------------------------------------------------------------------
+
+class FrameArena
+{
+public:
+	static const size_t ALIGNMENT = 16;   // enough for glm::mat4 and SSE loads
+
+	explicit FrameArena(size_t capacity = 0)
+	{
+		Grow(capacity);
+	}
+
+	~FrameArena()
+	{
+		ReleaseSpills();
+		Free(block);
+	}
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// Uninitialized room for 'count' T, 16 byte aligned, valid until the next Reset().
+	// Only for types that need no destructor.
+	template <typename T>
+	T* Alloc(size_t count = 1)
+	{
+		return (T*)AllocBytes(count * sizeof(T));
+	}
+
+	void* AllocBytes(size_t bytes)
+	{
+		bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		size_t at = used;
+		used += bytes;
+		if (used > highWater)
+			highWater = used;
+		if (used <= capacity)
+			return block + at;
+
+		// over the block: served from the heap until Reset() makes the block big enough
+		void* spill = ::operator new(bytes, std::align_val_t(ALIGNMENT));
+		spills.push_back(spill);
+		return spill;
+	}
+
+	// Frees the last frame's allocations. Grows the block first if the frame spilled.
+	void Reset()
+	{
+		if (!spills.empty())
+		{
+			ReleaseSpills();
+			Grow(highWater + highWater / 2);
+		}
+		used = 0;
+	}
+
+	size_t Capacity() const { return capacity; }
+	size_t Used() const { return used; }
+	size_t HighWater() const { return highWater; }
+
+private:
+	unsigned char* block = NULL;
+	size_t capacity = 0;
+	size_t used = 0;
+	size_t highWater = 0;
+	std::vector<void*> spills;
+
+	void Grow(size_t bytes)
+	{
+		bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		if (bytes <= capacity)
+			return;
+		Free(block);
+		block = (unsigned char*)::operator new(bytes, std::align_val_t(ALIGNMENT));
+		capacity = bytes;
+	}
+
+	// through operator new, so heap tracking sees the arena grow and spill
+	static void Free(void* p)
+	{
+		if (p)
+			::operator delete(p, std::align_val_t(ALIGNMENT));
+	}
+
+	void ReleaseSpills()
+	{
+		for (void* spill : spills)
+			Free(spill);
+		spills.clear();
+	}
+};
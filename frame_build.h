@@ -0,0 +1,110 @@
+// frame_build.h
+//
+// The part of a frame between the sim and the draw. BuildRenderPacket places and
+// poses both fighters from the match, streaming their clips through the
+// ClipRegistry, poses the crowd into the packet's arena and adds the HP bars. It
+// touches neither GL nor the window, so tools/alloc_check.cpp runs it exactly as
+// the game does. The camera and viewport stay with the loop, which owns the input
+// that moves them.
+//
+//   packet.Reset(frameIndex++);
+//   ... sim ticks ...
+//   BuildRenderPacket(sources, previousMatch, match, renderAlpha, deltaTime, seconds, packet);
+
+#pragma once
+
+#include "blend_tree.h"
+#include "clip_registry.h"
+#include "crowd.h"
+#include "render_packet.h"
+#include "ui_batch.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+
+// What a packet is built from besides the match. All of it belongs to the loop and
+// lives as long as the match.
+struct PacketSources {
+	const PoseCache* poses[2];          // the fighters'; crowd members use their character's
+	ClipRegistry* clips;
+	int clipCharacters[2];              // each fighter's character in 'clips'
+	Inertializer* inertial[2];
+	glm::mat4* fighterPoses;            // 2 * MAX_BONES: the poses built last, inertialization starts from them
+	BlendMode blendMode;
+
+	const std::vector<CrowdMember>* crowd;   // NULL or empty for none
+	const BoneMask* crowdMasks[2];
+	int crowdCapacity[2];               // instances and bones per instance of
+	int crowdBonesPerInstance[2];       // each character's batch (InstancedSkinning)
+
+	float hudWidth;                     // the HP bars are laid out across this many pixels
+};
+
+// Everything of 'packet' but the camera, the viewport and the profiler flag.
+// 'renderAlpha' is how far the frame is from 'previous' to 'match'; 'seconds' is
+// the wall clock the crowd loops on.
+inline void BuildRenderPacket(PacketSources& sources, const MatchState& previous, const MatchState& match,
+	float renderAlpha, float deltaTime, float seconds, RenderPacket& packet)
+{
+	// place both fighters, P2 turned to face P1
+	for (int i = 0; i < 2; ++i)
+	{
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::mix(previous.p[i].position, match.p[i].position, renderAlpha));
+		packet.fighterModels[i] = i == 0 ? model : glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+
+	// pose both from the simulated clip clocks; hit-stop holds an inertialized
+	// transition where it is, like the clocks
+	AnimClock clocks[2];
+	for (int i = 0; i < 2; ++i)
+		clocks[i] = InterpolateClock(*sources.poses[i], previous.p[i].anim, match.p[i].anim, renderAlpha);
+
+	// bake ahead what the state machines may play next; a clip wanted now that is
+	// still baking is stood in for (ResidentClock)
+	ClipRegistry& registry = *sources.clips;
+	registry.Update();
+	for (int i = 0; i < 2; ++i)
+		registry.Prefetch(sources.clipCharacters[i], PredictPlayerClips(match, i));
+	for (int i = 0; i < 2; ++i)
+	{
+		registry.Use(registry.Handle(sources.clipCharacters[i], clocks[i].clip));
+		registry.Use(registry.Handle(sources.clipCharacters[i], clocks[i].clip2));
+	}
+
+	float poseDelta = match.hitStopFrames > 0 ? 0.0f : deltaTime;
+	for (int i = 0; i < 2; ++i)
+	{
+		const PoseCache& cache = *sources.poses[i];
+		glm::mat4* pose = sources.fighterPoses + i * MAX_BONES;
+		EvaluateBlend(sources.blendMode, cache, ResidentClock(cache, clocks[i]), poseDelta, *sources.inertial[i], pose);
+		packet.SetFighterPose(i, pose, cache.boneCount);
+	}
+
+	if (sources.crowd && !sources.crowd->empty())
+	{
+		// every spectator's pose goes straight into the packet
+		CrowdPoses targets[2];
+		for (int c = 0; c < 2; ++c)
+		{
+			targets[c].capacity = sources.crowdCapacity[c];
+			targets[c].bonesPerInstance = sources.crowdBonesPerInstance[c];
+			targets[c].poses = packet.arena.Alloc<glm::mat4>((size_t)targets[c].capacity * targets[c].bonesPerInstance);
+			packet.crowdPoses[c] = targets[c].poses;
+			packet.crowdCount[c] = CrowdCount(*sources.crowd, c);
+		}
+		PoseCrowd(*sources.crowd, sources.poses, sources.crowdMasks, targets, seconds);
+	}
+
+	// HP bars: the max HP in dark grey, and over it what is left, green for P1 and red for P2
+	const float barWidth = 300.0f;
+	const float barHeight = 25.0f;
+	const float barX[2] = { 50.0f, sources.hudWidth - barWidth - 50.0f };
+	const glm::vec3 barColor[2] = { glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f) };
+	for (int i = 0; i < 2; ++i)
+	{
+		packet.AddHud(BarQuad(barX[i], 750, barWidth, barHeight, 1.0f, glm::vec3(0.2f, 0.2f, 0.2f)));
+		packet.AddHud(BarQuad(barX[i], 750, barWidth, barHeight, match.p[i].HP / match.p[i].maxHP, barColor[i]));
+	}
+}
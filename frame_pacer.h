@@ -0,0 +1,144 @@
+// frame_pacer.h
+//
+// Decides when a frame starts and how it is presented. The sim runs at a fixed
+// 60 Hz no matter what (see the accumulator in the render loop), so these only
+// change smoothness and input-to-photon latency, never game speed.
+//
+//   vsync          swap interval 1, the old behaviour
+//   uncapped       swap interval 0, render as fast as possible (tearing)
+//   limit:<hz>     swap interval 0, sleep after each frame to hold <hz>
+//   late:<hz>      swap interval 1, wait-until-late: after a swap returns (~vblank)
+//                  sleep until just enough time is left to build the next frame,
+//                  then read input. <hz> is the display refresh rate.
+//
+// late removes most of a refresh period of latency. It predicts the next frame's
+// work as the worst of the last PACER_HISTORY frames plus a margin; frames that
+// run longer than that miss the vblank, so it suits machines with steady frame times.
+
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+enum PresentMode {
+	PRESENT_VSYNC,
+	PRESENT_UNCAPPED,
+	PRESENT_LIMITED,
+	PRESENT_LATE
+};
+
+const int PACER_HISTORY = 30;
+const double PACER_LATE_MARGIN = 0.0015;   // seconds kept spare before the vblank
+
+class FramePacer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// "vsync", "uncapped", "limit:<hz>" or "late:<hz>"; false leaves the pacer unchanged
+	bool Parse(const char* arg)
+	{
+		if (strcmp(arg, "vsync") == 0)
+		{
+			mode = PRESENT_VSYNC;
+			return true;
+		}
+		if (strcmp(arg, "uncapped") == 0)
+		{
+			mode = PRESENT_UNCAPPED;
+			return true;
+		}
+		PresentMode timed;
+		const char* rate;
+		if (strncmp(arg, "limit:", 6) == 0)
+		{
+			timed = PRESENT_LIMITED;
+			rate = arg + 6;
+		}
+		else if (strncmp(arg, "late:", 5) == 0)
+		{
+			timed = PRESENT_LATE;
+			rate = arg + 5;
+		}
+		else
+		{
+			return false;
+		}
+		double hz = atof(rate);
+		if (hz < 1.0)
+			return false;
+		mode = timed;
+		period = 1.0 / hz;
+		return true;
+	}
+
+	PresentMode Mode() const { return mode; }
+
+	// for glfwSwapInterval once the context is current
+	int SwapInterval() const { return mode == PRESENT_VSYNC || mode == PRESENT_LATE ? 1 : 0; }
+
+	// Call at the top of the frame, before reading input.
+	void BeginFrame()
+	{
+		if (mode == PRESENT_LATE && haveSwap)
+		{
+			double predicted = 0.0;
+			for (int i = 0; i < PACER_HISTORY; ++i)
+				predicted = work[i] > predicted ? work[i] : predicted;
+			double slack = period - predicted - PACER_LATE_MARGIN;
+			if (slack > 0.0)
+				SleepUntil(lastSwap + ToDuration(slack));
+		}
+		workStart = Clock::now();
+	}
+
+	// Call right before glfwSwapBuffers.
+	void BeforeSwap()
+	{
+		work[workIndex] = std::chrono::duration<double>(Clock::now() - workStart).count();
+		workIndex = (workIndex + 1) % PACER_HISTORY;
+	}
+
+	// Call right after glfwSwapBuffers.
+	void AfterSwap()
+	{
+		Clock::time_point now = Clock::now();
+		if (mode == PRESENT_LIMITED)
+		{
+			// fixed deadlines so the rate doesn't drift; after a long stall start over
+			nextDeadline = haveSwap ? nextDeadline + ToDuration(period) : now + ToDuration(period);
+			if (nextDeadline < now)
+				nextDeadline = now;
+			else
+				SleepUntil(nextDeadline);
+		}
+		lastSwap = Clock::now();
+		haveSwap = true;
+	}
+
+private:
+	static Clock::duration ToDuration(double seconds)
+	{
+		return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+	}
+
+	// sleep_for overshoots by up to a scheduler tick, so sleep short and spin the rest
+	static void SleepUntil(Clock::time_point target)
+	{
+		const Clock::duration spin = std::chrono::milliseconds(2);
+		Clock::time_point now = Clock::now();
+		if (target - now > spin)
+			std::this_thread::sleep_for(target - now - spin);
+		while (Clock::now() < target)
+			std::this_thread::yield();
+	}
+
+	PresentMode mode = PRESENT_VSYNC;
+	double period = 1.0 / 60.0;
+	Clock::time_point workStart, lastSwap, nextDeadline;
+	bool haveSwap = false;
+	double work[PACER_HISTORY] = {};
+	int workIndex = 0;
+};
@@ -0,0 +1,142 @@
+// instanced_skinning.h
+//
+// Draws many copies of one SkinnedModel, each with its own pose and placement, in
+// one glDrawElementsInstanced per mesh:
+//
+//   palettes   every instance's bones as 3x4 rows (skinning.h, SKIN_AFFINE3X4) in one
+//              RGBA32F texture buffer; anim_model_instanced.vs fetches bone b of
+//              instance i at texel (i * bonesPerInstance + b) * 3
+//   models     one mat4 per instance in a vertex buffer, attribute locations 7-10
+//              with divisor 1 (SkinnedModel::AttachInstances). Draw() attaches it to
+//              the model's meshes whenever another batch's buffer is attached, so
+//              two batches can draw one shared model
+//
+// The fighters keep their own path (bone_palette.h); this is for crowds and for
+// several matches drawn at once. Write poses into Palette(i) and placements into
+// Model(i), Upload() the first 'count', then Draw().
+//
+// GL 3.3 only guarantees 65536 texels per texture buffer, which is 256 instances of
+// an 85 bone rig. Init() clamps the capacity to what the driver reports.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "pose_cache.h"
+#include "render_state.h"
+#include "skinned_model.h"
+#include "skinning.h"
+
+#include <iostream>
+#include <vector>
+
+class InstancedSkinning
+{
+public:
+	static const int PALETTE_TEXTURE_UNIT = 1;   // unit 0 is the diffuse texture
+
+	void Init(int instanceCapacity, int boneCount)
+	{
+		bonesPerInstance = boneCount > 0 ? boneCount : 1;
+
+		GLint maxTexels = 65536;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+		int fit = maxTexels / (bonesPerInstance * 3);
+		if (instanceCapacity > fit)
+		{
+			std::cout << "Instanced skinning: " << instanceCapacity << " instances of " << bonesPerInstance
+				<< " bones don't fit a texture buffer, drawing " << fit << std::endl;
+			instanceCapacity = fit;
+		}
+		capacity = instanceCapacity;
+
+		poses.assign((size_t)capacity * bonesPerInstance, glm::mat4(1.0f));
+		rows.assign((size_t)capacity * bonesPerInstance * 3, glm::vec4(0.0f));
+		models.assign(capacity, glm::mat4(1.0f));
+
+		glGenBuffers(1, &paletteBuffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, rows.size() * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+		glGenTextures(1, &paletteTexture);
+		glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, paletteBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glGenBuffers(1, &modelBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, modelBuffer);
+		glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	int Capacity() const { return capacity; }
+	int BonesPerInstance() const { return bonesPerInstance; }
+
+	// CPU-side pose of one instance, BonesPerInstance() matrices
+	glm::mat4* Palette(int instance) { return &poses[(size_t)instance * bonesPerInstance]; }
+	glm::mat4& Model(int instance) { return models[instance]; }
+
+	// packs and uploads the first 'count' instances; orphans both buffers so a frame
+	// never waits on the previous one's draws
+	void Upload(int count)
+	{
+		Upload(count, poses.data());
+	}
+
+	// the same with the poses from elsewhere, BonesPerInstance() mat4s per instance
+	void Upload(int count, const glm::mat4* instancePoses)
+	{
+		drawCount = count < capacity ? count : capacity;
+		if (drawCount <= 0)
+			return;
+		const int bones = drawCount * bonesPerInstance;
+		PackPalette(SKIN_AFFINE3X4, instancePoses, bones, rows.data());
+
+		glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, rows.size() * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)bones * 3 * sizeof(glm::vec4), rows.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glBindBuffer(GL_ARRAY_BUFFER, modelBuffer);
+		glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)drawCount * sizeof(glm::mat4), models.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// every uploaded instance of 'model' with the anim_model_instanced.vs program of
+	// 'uniforms'
+	void Draw(RenderState& state, ShaderUniforms& uniforms, SkinnedModel& model) const
+	{
+		if (drawCount <= 0)
+			return;
+		model.AttachInstances(state, modelBuffer);
+		state.UseProgram(uniforms.Program());
+		uniforms.SetInt(state, UNIFORM_BONE_PALETTES, PALETTE_TEXTURE_UNIT);
+		uniforms.SetInt(state, UNIFORM_BONES_PER_INSTANCE, bonesPerInstance);
+		state.BindTexture(PALETTE_TEXTURE_UNIT, GL_TEXTURE_BUFFER, paletteTexture);
+		model.DrawInstanced(state, drawCount);
+	}
+
+	void Release()
+	{
+		if (paletteTexture)
+			glDeleteTextures(1, &paletteTexture);
+		if (paletteBuffer)
+			glDeleteBuffers(1, &paletteBuffer);
+		if (modelBuffer)
+			glDeleteBuffers(1, &modelBuffer);
+		paletteTexture = paletteBuffer = modelBuffer = 0;
+	}
+
+private:
+	GLuint paletteBuffer = 0;
+	GLuint paletteTexture = 0;
+	GLuint modelBuffer = 0;
+	int capacity = 0;
+	int bonesPerInstance = 1;
+	int drawCount = 0;
+	std::vector<glm::mat4> poses;   // what Palette() hands out
+	std::vector<glm::vec4> rows;    // exactly what goes to the texture buffer
+	std::vector<glm::mat4> models;
+};
@@ -0,0 +1,183 @@
+// job_system.h
+//
+// Small fixed-size worker pool for load-time work. Jobs queued with Run() execute
+// on any worker; jobs queued with RunOnMain() wait until the thread that owns the
+// GL context calls PumpMain(). That is how decode/import work hands its results
+// back for the GL upload: a worker finishes, then posts the upload to main.
+//
+// clip_registry.h also bakes on the workers during the match, so Run() must not
+// allocate once the game is up: the worker queue is a ring that only grows, and
+// Reserve() sizes it up front. A job whose captures fit std::function's own
+// storage (two pointers) isn't allocated either.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class JobSystem
+{
+public:
+	typedef std::function<void()> Job;
+
+	// threadCount 0 = one worker per hardware thread, minus the main thread
+	explicit JobSystem(int threadCount = 0)
+	{
+		if (threadCount <= 0)
+			threadCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+		for (int i = 0; i < threadCount; ++i)
+			workers.push_back(std::thread(&JobSystem::WorkerLoop, this));
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		workAvailable.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	void Run(Job job)
+	{
+		pending++;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			work.Push(std::move(job));
+		}
+		workAvailable.notify_one();
+	}
+
+	// room for 'count' worker jobs queued at once without allocating
+	void Reserve(int count)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		work.Reserve(count);
+	}
+
+	// for anything that needs the GL context; runs inside PumpMain()
+	void RunOnMain(Job job)
+	{
+		pending++;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			mainWork.push_back(job);
+		}
+		mainAvailable.notify_one();
+	}
+
+	// Runs every main-thread job queued so far. If there are none, waits up to
+	// 'timeout' for one to arrive (or for all work to finish) so the caller can
+	// redraw a loading screen at a steady rate. Returns the number of jobs run.
+	int PumpMain(std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+	{
+		std::deque<Job> jobs;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (mainWork.empty() && timeout.count() > 0)
+				mainAvailable.wait_for(lock, timeout, [this] { return !mainWork.empty() || pending == 0; });
+			jobs.swap(mainWork);
+		}
+		for (Job& job : jobs)
+		{
+			job();
+			Finish();
+		}
+		return (int)jobs.size();
+	}
+
+	// true once every queued job, worker or main, has completed
+	bool Idle() const { return pending == 0; }
+
+	int ThreadCount() const { return (int)workers.size(); }
+
+private:
+	// first in, first out over a vector that doubles when full
+	class JobRing
+	{
+	public:
+		bool Empty() const { return count == 0; }
+
+		void Push(Job job)
+		{
+			if (count == (int)slots.size())
+				Reserve(count ? count * 2 : 16);
+			slots[(first + count) % slots.size()] = std::move(job);
+			count++;
+		}
+
+		Job Pop()
+		{
+			Job job = std::move(slots[first]);
+			slots[first] = nullptr;
+			first = (first + 1) % (int)slots.size();
+			count--;
+			return job;
+		}
+
+		void Reserve(int capacity)
+		{
+			if (capacity <= (int)slots.size())
+				return;
+			std::vector<Job> grown(capacity);
+			for (int i = 0; i < count; ++i)
+				grown[i] = std::move(slots[(first + i) % slots.size()]);
+			slots.swap(grown);
+			first = 0;
+		}
+
+	private:
+		std::vector<Job> slots;
+		int first = 0;
+		int count = 0;
+	};
+
+	JobSystem(const JobSystem&);
+	JobSystem& operator=(const JobSystem&);
+
+	void WorkerLoop()
+	{
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				workAvailable.wait(lock, [this] { return quit || !work.Empty(); });
+				if (work.Empty())
+					return;
+				job = work.Pop();
+			}
+			job();
+			Finish();
+		}
+	}
+
+	void Finish()
+	{
+		if (--pending == 0)
+		{
+			// take the lock so a PumpMain that just checked 'pending' can't miss the wakeup
+			std::lock_guard<std::mutex> lock(mutex);
+			mainAvailable.notify_all();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	JobRing work;
+	std::deque<Job> mainWork;
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable mainAvailable;
+	std::atomic<int> pending{ 0 };
+	bool quit = false;
+};
@@ -0,0 +1,721 @@
+// match_sim.h
+//
+// Headless gameplay core. Everything that used to live in processInput /
+// UpdatePlayerAnimation / BridgeAnimation and read glfwGetKey directly is
+// expressed here as a pure Step(MatchState&, InputFrame, InputFrame) that
+// advances the match by exactly one fixed 60 Hz tick. No GL, no GLFW - only
+// glm - so it can be stepped millions of times per second without a window.
+//
+// Attack timing, damage and hitboxes come from a MoveTable (move_table.h) and are
+// evaluated by integer frame index. Hurtboxes are capsules between body joints that
+// follow the playing clips (JointTable); hits and pushes are capsule tests
+// (collision.h). The animation state machine is the transition table compiled
+// from the declarations in anim_graph.h.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "anim_graph.h"
+#include "collision.h"
+#include "move_table.h"
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// fixed simulation rate
+// ---------------------
+const float SIM_TICK_RATE = 60.0f;
+const float SIM_DT = 1.0f / SIM_TICK_RATE;
+
+// movement
+const float charSpeed = 2.5f;
+const float gravity = -10.0f;
+const float jumpForce = 6.0f;
+const float groundHeight = 0.0f; // your ground Y
+
+// Hit Distance
+const float MIN_Z = -5.0f;
+const float MAX_Z = 5.0f;
+
+// Timing of each clip, in the same units Animation::GetTicksPerSecond / GetDuration report.
+struct ClipTable {
+	float ticksPerSecond[CLIP_COUNT];
+	float duration[CLIP_COUNT];
+};
+
+// Used when no .dae has been loaded (headless). The GL build overwrites it with the real values.
+// idle 3.3, walk 2.06, run 0.83, punch 1.03, kick 1.6
+inline const ClipTable& DefaultClipTable()
+{
+	static const ClipTable table = {
+		//  idle  walk  punch crouch cblock sblock hit   jump  topkick
+		{ 1.0f, 1.0f, 1.0f, 1.0f,  1.0f,  1.0f,  1.0f, 1.0f, 1.0f },
+		{ 3.3f, 2.06f, 1.03f, 1.2f, 1.2f,  1.2f,  1.3f, 1.6f, 2.4f }
+	};
+	return table;
+}
+
+// Where the body's joints (move_table.h) are, in character space: feet at the
+// origin, +y up, +z the way the character faces.
+struct JointPose {
+	glm::vec3 joints[JOINT_COUNT];
+};
+
+// Every clip's joints sampled at the pose cache rate (one sample per sim tick of
+// clip time) from the skeleton the renderer skins; BakePoseCache fills it. A clip
+// with no samples uses DefaultJointPose.
+struct JointTable {
+	int sampleCount[CLIP_COUNT];
+	int firstSample[CLIP_COUNT];
+	std::vector<JointPose> samples;   // clip after clip
+};
+
+// One tick of buttons for one player, already resolved from whatever device produced it.
+struct InputFrame {
+	bool moveLeft;
+	bool moveRight;
+	bool jump;
+	bool jumpKick;
+	bool punch;
+	bool crouch;
+	bool testStandBlock;
+	bool testCrouchBlock;
+	bool testHurt;
+};
+
+// wire/storage form of an InputFrame, one bit per button (anim_graph.h)
+inline unsigned short PackInput(const InputFrame& input)
+{
+	return (unsigned short)(
+		(input.moveLeft        ? BUTTON_LEFT : 0) |
+		(input.moveRight       ? BUTTON_RIGHT : 0) |
+		(input.jump            ? BUTTON_JUMP : 0) |
+		(input.jumpKick        ? BUTTON_JUMP_KICK : 0) |
+		(input.punch           ? BUTTON_PUNCH : 0) |
+		(input.crouch          ? BUTTON_CROUCH : 0) |
+		(input.testStandBlock  ? BUTTON_STAND_BLOCK : 0) |
+		(input.testCrouchBlock ? BUTTON_CROUCH_BLOCK : 0) |
+		(input.testHurt        ? BUTTON_HURT : 0));
+}
+
+inline InputFrame UnpackInput(unsigned short bits)
+{
+	InputFrame input;
+	input.moveLeft = (bits & BUTTON_LEFT) != 0;
+	input.moveRight = (bits & BUTTON_RIGHT) != 0;
+	input.jump = (bits & BUTTON_JUMP) != 0;
+	input.jumpKick = (bits & BUTTON_JUMP_KICK) != 0;
+	input.punch = (bits & BUTTON_PUNCH) != 0;
+	input.crouch = (bits & BUTTON_CROUCH) != 0;
+	input.testStandBlock = (bits & BUTTON_STAND_BLOCK) != 0;
+	input.testCrouchBlock = (bits & BUTTON_CROUCH_BLOCK) != 0;
+	input.testHurt = (bits & BUTTON_HURT) != 0;
+	return input;
+}
+
+// What Animator::PlayAnimation(start, end, t1, t2, blend) was last told, plus its running clocks.
+struct AnimClock {
+	ClipId clip;
+	ClipId clip2;
+	float time;
+	float time2;
+	float blend;
+};
+
+struct PlayerState {
+	glm::vec3 position;
+	glm::vec3 frontTarget;
+	float verticalVelocity;
+	bool isGrounded;
+
+	AnimState charState;
+	float blendAmount;
+
+	MoveId move;          // attack in progress, MOVE_NONE if none
+	int moveFrame;        // frames since the attack started
+	bool moveConnected;   // the attack already hit or was blocked; one hit per move
+	int stunFrames;       // hit/block reaction frames left before the state machine may leave it
+
+	float HP;
+	float maxHP;
+
+	AnimClock anim;
+};
+
+struct MatchState {
+	PlayerState p[2];
+	int hitStopFrames;       // remaining freeze frames
+	float cameraShakeTimer;  // read by the renderer, never fed back into gameplay
+	unsigned int frame;
+	const ClipTable* clips[2];
+	const MoveTable* moves;
+	const JointTable* joints[2];   // NULL: every clip uses DefaultJointPose
+};
+
+inline void InitMatch(MatchState& s, const ClipTable* p1Clips = &DefaultClipTable(), const ClipTable* p2Clips = &DefaultClipTable(),
+	const MoveTable* moves = &DefaultMoveTable(), const JointTable* p1Joints = NULL, const JointTable* p2Joints = NULL)
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		PlayerState& p = s.p[i];
+		p.position = glm::vec3(0.0f, 0.0f, i == 0 ? -2.0f : 2.0f);
+		p.frontTarget = glm::vec3(0.0f, 0.0f, 1.0f); // initial forward
+		p.verticalVelocity = 0.0f;
+		p.isGrounded = true;
+		p.charState = IDLE;
+		p.blendAmount = 0.0f;
+		p.move = MOVE_NONE;
+		p.moveFrame = 0;
+		p.moveConnected = false;
+		p.stunFrames = 0;
+		p.HP = 100.0f;
+		p.maxHP = 100.0f;
+		p.anim.clip = CLIP_IDLE;
+		p.anim.clip2 = CLIP_NONE;
+		p.anim.time = 0.0f;
+		p.anim.time2 = 0.0f;
+		p.anim.blend = 0.0f;
+	}
+	s.hitStopFrames = 0;
+	s.cameraShakeTimer = 1.0f;
+	s.frame = 0;
+	s.clips[0] = p1Clips;
+	s.clips[1] = p2Clips;
+	s.moves = moves;
+	s.joints[0] = p1Joints;
+	s.joints[1] = p2Joints;
+}
+
+// ----------------------------------------------------------------------------
+// save / load
+// ----------------------------------------------------------------------------
+
+// MatchState is plain data: a snapshot is a copy. The clip, move and joint tables it points to
+// are immutable for the lifetime of a match, so sharing them is safe.
+inline void SaveState(const MatchState& s, MatchState& snapshot)
+{
+	snapshot = s;
+}
+
+inline void LoadState(MatchState& s, const MatchState& snapshot)
+{
+	s = snapshot;
+}
+
+// FNV-1a over the gameplay fields only (never over raw struct bytes, padding is undefined)
+inline void HashBytes(unsigned int& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+}
+
+inline unsigned int ChecksumMatch(const MatchState& s)
+{
+	unsigned int hash = 2166136261u;
+	for (int i = 0; i < 2; ++i)
+	{
+		const PlayerState& p = s.p[i];
+		unsigned char grounded = p.isGrounded ? 1 : 0;
+		HashBytes(hash, &p.position.x, sizeof(float) * 3);
+		HashBytes(hash, &p.frontTarget.x, sizeof(float) * 3);
+		HashBytes(hash, &p.verticalVelocity, sizeof(float));
+		HashBytes(hash, &grounded, 1);
+		HashBytes(hash, &p.charState, sizeof(p.charState));
+		HashBytes(hash, &p.blendAmount, sizeof(float));
+		HashBytes(hash, &p.move, sizeof(p.move));
+		HashBytes(hash, &p.moveFrame, sizeof(p.moveFrame));
+		HashBytes(hash, &p.moveConnected, sizeof(p.moveConnected));
+		HashBytes(hash, &p.stunFrames, sizeof(p.stunFrames));
+		HashBytes(hash, &p.HP, sizeof(float));
+		HashBytes(hash, &p.anim.clip, sizeof(p.anim.clip));
+		HashBytes(hash, &p.anim.clip2, sizeof(p.anim.clip2));
+		HashBytes(hash, &p.anim.time, sizeof(float));
+		HashBytes(hash, &p.anim.time2, sizeof(float));
+	}
+	HashBytes(hash, &s.hitStopFrames, sizeof(s.hitStopFrames));
+	HashBytes(hash, &s.frame, sizeof(s.frame));
+	return hash;
+}
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+// +1 when 'self' faces +z, towards an opponent further along z
+inline float Facing(const PlayerState& self, const PlayerState& other)
+{
+	return other.position.z >= self.position.z ? 1.0f : -1.0f;
+}
+
+// Standing guard with the feet at the origin, built for a body DEFAULT_POSE_HEIGHT
+// tall and stretched to 'height'. Used without a JointTable.
+const float DEFAULT_POSE_HEIGHT = 1.8f;
+
+inline void DefaultJointPose(float height, JointPose& pose)
+{
+	static const glm::vec3 guard[JOINT_COUNT] = {
+		glm::vec3(0.0f, 0.95f, 0.0f),     // hips
+		glm::vec3(0.0f, 1.5f, 0.0f),      // neck
+		glm::vec3(0.0f, 1.7f, 0.0f),      // head
+		glm::vec3(0.2f, 1.45f, 0.0f),     // left shoulder
+		glm::vec3(0.25f, 1.15f, 0.1f),    // left elbow
+		glm::vec3(0.15f, 1.35f, 0.25f),   // left hand
+		glm::vec3(-0.2f, 1.45f, 0.0f),
+		glm::vec3(-0.25f, 1.15f, 0.1f),
+		glm::vec3(-0.15f, 1.35f, 0.25f),
+		glm::vec3(0.12f, 0.5f, 0.05f),    // left knee
+		glm::vec3(0.12f, 0.08f, 0.0f),    // left foot
+		glm::vec3(-0.12f, 0.5f, 0.05f),
+		glm::vec3(-0.12f, 0.08f, 0.0f)
+	};
+	float stretch = height / DEFAULT_POSE_HEIGHT;
+	for (int j = 0; j < JOINT_COUNT; ++j)
+		pose.joints[j] = glm::vec3(guard[j].x, guard[j].y * stretch, guard[j].z);
+}
+
+// The two samples around 'time', looked up like FindSamples does the pose cache
+// (pose_cache.h).
+inline void FindJointSamples(const JointTable& table, const ClipTable& clips, ClipId clip, float time, int& s0, int& s1, float& frac)
+{
+	const int count = table.sampleCount[clip];
+	float s = time / clips.ticksPerSecond[clip] * SIM_TICK_RATE;
+	if (s < 0.0f)
+		s = 0.0f;
+	s0 = (int)s;
+	frac = s - (float)s0;
+	if (s0 >= count)
+	{
+		s0 = count - 1;
+		frac = 0.0f;
+	}
+	s1 = s0 + 1 < count ? s0 + 1 : 0;
+	s0 += table.firstSample[clip];
+	s1 += table.firstSample[clip];
+}
+
+// Player i's joints for its current clip clock. A JointPose is plain floats like a
+// bone palette, so the sampling and the crossfade are the palette kernels
+// (pose_simd.h), exactly as EvaluatePose uses them.
+inline void PoseJoints(const MatchState& s, int i, JointPose& pose)
+{
+	const PlayerState& p = s.p[i];
+	const JointTable* table = s.joints[i];
+	if (!table || p.anim.clip == CLIP_NONE || table->sampleCount[p.anim.clip] == 0)
+	{
+		const CharacterData& body = s.moves->character;
+		DefaultJointPose(IsCrouching(p.charState) ? body.crouchHeight : body.standHeight, pose);
+		return;
+	}
+
+	const size_t floats = JOINT_COUNT * 3;
+	const JointPose* samples = table->samples.data();
+	int a0, a1;
+	float fa;
+	FindJointSamples(*table, *s.clips[i], p.anim.clip, p.anim.time, a0, a1, fa);
+	if (p.anim.clip2 == CLIP_NONE || p.anim.blend <= 0.0f || table->sampleCount[p.anim.clip2] == 0)
+	{
+		LerpPalette(&samples[a0].joints[0].x, &samples[a1].joints[0].x, fa, &pose.joints[0].x, floats);
+		return;
+	}
+
+	int b0, b1;
+	float fb;
+	FindJointSamples(*table, *s.clips[i], p.anim.clip2, p.anim.time2, b0, b1, fb);
+	BlendPalette(&samples[a0].joints[0].x, &samples[a1].joints[0].x, fa, &samples[b0].joints[0].x, &samples[b1].joints[0].x, fb,
+		p.anim.blend, &pose.joints[0].x, floats);
+}
+
+// character space -> world, turned to face the opponent
+inline glm::vec3 JointToWorld(const PlayerState& self, float facing, const glm::vec3& joint)
+{
+	return self.position + glm::vec3(joint.x * facing, joint.y, joint.z * facing);
+}
+
+// The vertical capsule that keeps the two players apart, standing at 'feet'.
+inline Capsule PushCapsule(const PlayerState& p, const glm::vec3& feet, const CharacterData& body)
+{
+	float height = IsCrouching(p.charState) ? body.crouchHeight : body.standHeight;
+	return Capsule{ feet, feet + glm::vec3(0.0f, height, 0.0f), body.pushRadius };
+}
+
+// Adds player i's hurtboxes, posed by its clip clock, to 'world'. Team and owner
+// are the player index.
+inline void AddHurtboxes(const MatchState& s, int i, CollisionWorld& world)
+{
+	const PlayerState& self = s.p[i];
+	const CharacterData& body = s.moves->character;
+	float facing = Facing(self, s.p[1 - i]);
+
+	JointPose pose;
+	PoseJoints(s, i, pose);
+	for (int h = 0; h < body.hurtboxCount; ++h)
+	{
+		const HurtCapsule& hurt = body.hurtboxes[h];
+		Collider collider;
+		collider.shape = Capsule{ JointToWorld(self, facing, pose.joints[hurt.from]), JointToWorld(self, facing, pose.joints[hurt.to]), hurt.radius };
+		collider.owner = i;
+		collider.team = i;
+		collider.layer = COLLIDE_HURT;
+		collider.hits = 0;
+		world.Add(collider);
+	}
+}
+
+// The hitbox of player i's current active frame, NULL outside the active frames
+// or once the move has connected.
+inline const HitSphere* ActiveHitbox(const MatchState& s, int i)
+{
+	const PlayerState& attacker = s.p[i];
+	if (attacker.move == MOVE_NONE || attacker.moveConnected)
+		return NULL;
+
+	const MoveData& move = s.moves->moves[attacker.move];
+	int activeFrame = attacker.moveFrame - move.startup;
+	if (activeFrame < 0 || activeFrame >= move.active)
+		return NULL;
+	return &move.hitboxes[activeFrame];
+}
+
+inline void AddHitbox(const MatchState& s, int i, const HitSphere& box, CollisionWorld& world)
+{
+	const PlayerState& attacker = s.p[i];
+	float facing = Facing(attacker, s.p[1 - i]);
+	glm::vec3 origin = attacker.position;
+	if (box.joint != JOINT_NONE)
+	{
+		JointPose pose;
+		PoseJoints(s, i, pose);
+		origin = JointToWorld(attacker, facing, pose.joints[box.joint]);
+	}
+	glm::vec3 center = origin + glm::vec3(0.0f, box.up, box.forward * facing);
+
+	Collider collider;
+	collider.shape = Capsule{ center, center, box.radius };
+	collider.owner = i;
+	collider.team = i;
+	collider.layer = COLLIDE_HIT;
+	collider.hits = COLLIDE_HURT;
+	world.Add(collider);
+}
+
+// Which players' active hitboxes touch the other's hurtboxes this tick. A player's
+// hurtboxes are only posed while the opponent has a hitbox out.
+inline void FindHits(const MatchState& s, bool connects[2])
+{
+	connects[0] = connects[1] = false;
+	const HitSphere* boxes[2] = { ActiveHitbox(s, 0), ActiveHitbox(s, 1) };
+	if (!boxes[0] && !boxes[1])
+		return;
+
+	CollisionWorld world;
+	for (int i = 0; i < 2; ++i)
+	{
+		if (boxes[i])
+			AddHitbox(s, i, *boxes[i], world);
+	}
+	for (int i = 0; i < 2; ++i)
+	{
+		if (boxes[1 - i])
+			AddHurtboxes(s, i, world);
+	}
+
+	Contact contacts[MAX_COLLIDERS];
+	int count = FindContacts(world, contacts, MAX_COLLIDERS);
+	for (int c = 0; c < count; ++c)
+	{
+		const Collider& collider = world.colliders[contacts[c].collider];
+		if (collider.layer == COLLIDE_HIT)
+			connects[collider.owner] = true;
+	}
+}
+
+inline bool IsHoldingBack(const InputFrame& input, const glm::vec3& selfPos, const glm::vec3& enemyPos)
+{
+	float dz = enemyPos.z - selfPos.z;
+
+	if (dz > 0)
+	{
+		return input.moveLeft;
+	}
+	else
+	{
+		return input.moveRight;
+	}
+}
+
+inline void PlayClip(AnimClock& anim, ClipId clip, ClipId clip2, float time, float time2, float blend)
+{
+	anim.clip = clip;
+	anim.clip2 = clip2;
+	anim.time = time;
+	anim.time2 = time2;
+	anim.blend = blend;
+}
+
+inline void AdvanceClock(AnimClock& anim, const ClipTable& clips, float dt)
+{
+	if (anim.clip != CLIP_NONE)
+	{
+		anim.time += clips.ticksPerSecond[anim.clip] * dt;
+		anim.time = fmod(anim.time, clips.duration[anim.clip]);
+	}
+	if (anim.clip2 != CLIP_NONE)
+	{
+		anim.time2 += clips.ticksPerSecond[anim.clip2] * dt;
+		anim.time2 = fmod(anim.time2, clips.duration[anim.clip2]);
+	}
+}
+
+// Crossfades start -> end over 'seconds' of sim time and switches to endState once
+// the blend completes. 'ready' holds the blend back until the state's frame data
+// (recovery, stun) has run out. The blend completes on the tick nearest to
+// 'seconds', so a crossfade takes the same time whatever the tick rate.
+inline void BridgeAnimation(PlayerState& p, ClipId startClip, ClipId endClip, AnimState endState, bool ready,
+	float seconds = CROSSFADE_SECONDS, float dt = SIM_DT)
+{
+	AnimClock& anim = p.anim;
+	if (ready)
+	{
+		float step = dt / seconds;
+		p.blendAmount += step;
+		PlayClip(anim, startClip, endClip, anim.time, anim.time2, p.blendAmount);
+		if (p.blendAmount > 1.0f - 0.5f * step) {
+			p.blendAmount = 0.0f;
+			float startTime = anim.time2;
+			PlayClip(anim, endClip, CLIP_NONE, startTime, 0.0f, p.blendAmount);
+			p.charState = endState;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+// movement & jumping (was processInput)
+// ----------------------------------------------------------------------------
+
+inline void StepMovement(MatchState& s, const InputFrame input[2], float dt)
+{
+	const CharacterData& body = s.moves->character;
+	for (int i = 0; i < 2; ++i)
+	{
+		PlayerState& self = s.p[i];
+		PlayerState& other = s.p[1 - i];
+
+		glm::vec3 moveDir(0.0f);
+		if (CanMove(self.charState))
+		{
+			if (input[i].moveLeft)
+				moveDir += glm::vec3(0.0f, 0.0f, -1.0f);
+			if (input[i].moveRight)
+				moveDir += glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+
+		if (self.isGrounded && input[i].jump)
+		{
+			self.verticalVelocity = jumpForce;
+			self.isGrounded = false;
+		}
+
+		if (!self.isGrounded)
+			self.verticalVelocity += gravity * dt;
+
+		if (glm::length(moveDir) > 0.0f)
+		{
+			moveDir = glm::normalize(moveDir);
+
+			glm::vec3 newPos = self.position + moveDir * charSpeed * dt;
+			if (!CapsulesTouch(PushCapsule(self, newPos, body), PushCapsule(other, other.position, body)))
+			{
+				// Apply boundary limit
+				newPos.z = glm::clamp(newPos.z, MIN_Z, MAX_Z);
+
+				self.position = newPos;
+				self.frontTarget = moveDir;
+			}
+		}
+	}
+
+	// vertical integration runs after both players moved, same as before
+	for (int i = 0; i < 2; ++i)
+	{
+		PlayerState& self = s.p[i];
+		self.position.y += self.verticalVelocity * dt;
+
+		if (self.position.y <= groundHeight)
+		{
+			self.position.y = groundHeight;
+			self.verticalVelocity = 0.0f;
+			self.isGrounded = true;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+// attacks & animation state machine (was UpdatePlayerAnimation)
+// ----------------------------------------------------------------------------
+
+inline void StartMove(PlayerState& p, MoveId move)
+{
+	p.move = move;
+	p.moveFrame = 0;
+	p.moveConnected = false;
+}
+
+// Lands 'move' on 'victim'. Getting hit cancels whatever the victim was doing.
+inline void ApplyHit(MatchState& s, PlayerState& victim, const MoveData& move, bool blocking, bool crouching)
+{
+	// crouch-blocking is not possible, it still lands as a crouch hit
+	if (blocking && !crouching)
+	{
+		victim.charState = IDLE_BLOCK;
+
+		// block hit-stop + reduced shake
+		s.hitStopFrames = move.blockStop;
+		s.cameraShakeTimer = move.blockShake;
+
+		victim.HP -= move.chipDamage;
+		victim.stunFrames = move.blockStun;
+	}
+	else
+	{
+		victim.charState = crouching ? CROUCH_HIT : IDLE_HIT;
+
+		// normal hit-stop + full shake
+		s.hitStopFrames = move.hitStop;
+		s.cameraShakeTimer = move.hitShake;
+
+		victim.HP -= move.damage;
+		victim.stunFrames = move.hitStun;
+	}
+
+	victim.blendAmount = 0.0f;
+	victim.move = MOVE_NONE;
+}
+
+// Advances both players' attacks by one frame and lands the ones whose active
+// hitbox touches the opponent. Nothing advances while the match is frozen.
+inline void StepMoves(MatchState& s, const InputFrame input[2], bool frozen)
+{
+	if (frozen)
+		return;
+
+	const MoveTable& table = *s.moves;
+	for (int i = 0; i < 2; ++i)
+	{
+		if (s.p[i].stunFrames > 0)
+			s.p[i].stunFrames--;
+	}
+
+	// test both attackers before applying anything, so simultaneous hits trade
+	bool connects[2];
+	FindHits(s, connects);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		PlayerState& attacker = s.p[i];
+		PlayerState& victim = s.p[1 - i];
+		if (attacker.move == MOVE_NONE)
+			continue;
+
+		const MoveData& move = table.moves[attacker.move];
+		if (connects[i])
+		{
+			attacker.moveConnected = true;
+			ApplyHit(s, victim, move, IsHoldingBack(input[1 - i], victim.position, attacker.position), IsCrouching(victim.charState));
+		}
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		PlayerState& p = s.p[i];
+		if (p.move != MOVE_NONE && ++p.moveFrame >= table.moves[p.move].TotalFrames())
+			p.move = MOVE_NONE;
+	}
+}
+
+// Whether the frame data a crossfade waits for (TransitionGate) has run out.
+inline bool GateOpen(const PlayerState& p, unsigned int gate)
+{
+	unsigned int open = (p.stunFrames == 0 ? (unsigned int)GATE_STUN : 0u) | (p.move == MOVE_NONE ? (unsigned int)GATE_MOVE : 0u);
+	return (gate & ~open) == 0;
+}
+
+inline void TakeTransition(PlayerState& p, const AnimTransition& t, const CharacterData& body)
+{
+	if (t.move != MOVE_NONE)
+		StartMove(p, t.move);
+	if (t.stun == STUN_TEST)
+		p.stunFrames = body.testStun;
+	else if (t.stun == STUN_CROUCH_BLOCK)
+		p.stunFrames = body.crouchBlockRelease;
+	if (t.clip != CLIP_NONE)
+	{
+		p.blendAmount = 0.0f;
+		PlayClip(p.anim, t.clip, t.clip2, p.anim.time, 0.0f, p.blendAmount);
+	}
+	p.charState = t.to;
+}
+
+// One tick of the state machine for one player: a single lookup by state and
+// packed buttons in the compiled graph (anim_graph.h). Players of any number of
+// matches can be stepped from the same table.
+inline void StepAnimState(const AnimGraph& graph, PlayerState& p, unsigned short buttons, const CharacterData& body, float dt)
+{
+	int next = graph.next[p.charState][buttons & (BUTTON_COMBINATIONS - 1)];
+	if (next == 0)
+		return;
+
+	const AnimTransition& t = graph.transitions[next - 1];
+	if (t.blendSeconds > 0.0f)
+		BridgeAnimation(p, t.clip, t.clip2, t.to, GateOpen(p, t.gate), t.blendSeconds, dt);
+	else
+		TakeTransition(p, t, body);
+}
+
+inline void StepPlayer(MatchState& s, int self_i, const InputFrame& input)
+{
+	StepAnimState(AnimGraphTable(), s.p[self_i], PackInput(input), s.moves->character, SIM_DT);
+}
+
+// ----------------------------------------------------------------------------
+// Step: advance the whole match by one fixed tick
+// ----------------------------------------------------------------------------
+
+inline void Step(MatchState& s, InputFrame p1, InputFrame p2)
+{
+	const float dt = SIM_DT;
+	const InputFrame input[2] = { p1, p2 };
+
+	float gameplayDelta = dt;
+	bool frozen = s.hitStopFrames > 0;
+	if (frozen) {
+		s.hitStopFrames--;
+		gameplayDelta = 0.0f;   // freeze animation & gameplay
+	}
+
+	// hit-stop freezes everything that affects gameplay: movement and jumps, frame
+	// data, the state machine and its blends, and the clip clocks. Only the camera
+	// shake keeps running, it is what sells the impact.
+	if (!frozen)
+		StepMovement(s, input, dt);
+	StepMoves(s, input, frozen);
+
+	if (!frozen)
+	{
+		StepPlayer(s, 0, p1);
+		StepPlayer(s, 1, p2);
+	}
+
+	AdvanceClock(s.p[0].anim, *s.clips[0], gameplayDelta);
+	AdvanceClock(s.p[1].anim, *s.clips[1], gameplayDelta);
+
+	if (s.cameraShakeTimer > 0.0f)
+		s.cameraShakeTimer -= dt;
+
+	++s.frame;
+}
@@ -0,0 +1,352 @@
+// move_table.h
+//
+// Frame data for every attack, plus the hurtbox sizes and reaction lengths the
+// state machine needs. All timings are integer sim frames (60 per second); the
+// sim indexes straight into these arrays with the attacker's current frame.
+//
+// DefaultMoveTable() is the built-in balance. LoadMoveTable() reads the same thing
+// from a text file (moves.txt next to the executable) so it can be tuned without
+// recompiling:
+//
+//   # comment
+//   move punch            # punch | jumpkick
+//       startup 21        # frames before the first active frame
+//       active 3
+//       recovery 18
+//       hitbox 0  1.3 1.4 0.8     # <active frame> <forward> <up> <radius> [joint], later frames repeat the last one
+//       damage 5
+//       chip 2            # damage through a block
+//       hitstop 14        # frames the whole match freezes on hit
+//       blockstop 7
+//       hitstun 60        # frames the victim can't leave its hit reaction
+//       blockstun 30
+//       shake 0.5         # seconds of camera shake (render only)
+//       blockshake 0.3
+//   end
+//   character
+//       hurtbox hips neck 0.4     # <joint> <joint> <radius>; the first one replaces the default set
+//       push_radius 0.75
+//       stand_height 1.8
+//       crouch_height 1.1
+//       crouch_block_release 12
+//       test_stun 40
+//   end
+
+#pragma once
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+enum MoveId {
+	MOVE_NONE = -1,
+	MOVE_PUNCH = 0,
+	MOVE_JUMP_KICK,
+	MOVE_COUNT
+};
+
+const int MAX_ACTIVE_FRAMES = 16;
+const int MAX_HURT_CAPSULES = 12;
+
+// Points of the body the sim tracks, baked from the skeleton's bones. Capsules
+// (collision.h) are spanned between two of them and posed by match_sim.h.
+enum Joint {
+	JOINT_NONE = -1,
+	JOINT_HIPS = 0,
+	JOINT_NECK,
+	JOINT_HEAD,
+	JOINT_L_SHOULDER,
+	JOINT_L_ELBOW,
+	JOINT_L_HAND,
+	JOINT_R_SHOULDER,
+	JOINT_R_ELBOW,
+	JOINT_R_HAND,
+	JOINT_L_KNEE,
+	JOINT_L_FOOT,
+	JOINT_R_KNEE,
+	JOINT_R_FOOT,
+	JOINT_COUNT
+};
+
+// sphere relative to the attacker's feet, or to one of its joints: 'forward' along
+// the direction to the opponent
+struct HitSphere {
+	float forward;
+	float up;
+	float radius;
+	int joint;      // a Joint, JOINT_NONE for the feet
+};
+
+// capsule between two joints of the victim
+struct HurtCapsule {
+	int from;       // Joint
+	int to;
+	float radius;
+};
+
+struct MoveData {
+	int startup;
+	int active;
+	int recovery;
+	HitSphere hitboxes[MAX_ACTIVE_FRAMES];   // indexed by active frame
+
+	float damage;
+	float chipDamage;
+	int hitStop;
+	int blockStop;
+	int hitStun;
+	int blockStun;
+	float hitShake;
+	float blockShake;
+
+	int TotalFrames() const { return startup + active + recovery; }
+};
+
+// Hurtboxes follow the joints. Pushing is a vertical capsule from the feet up, one
+// stand or crouch height tall.
+struct CharacterData {
+	HurtCapsule hurtboxes[MAX_HURT_CAPSULES];
+	int hurtboxCount;
+	float pushRadius;
+	float standHeight;
+	float crouchHeight;
+	int crouchBlockRelease;   // frames a crouch block is held before returning to crouch
+	int testStun;             // stun for the debug hurt / block keys
+};
+
+struct MoveTable {
+	MoveData moves[MOVE_COUNT];
+	CharacterData character;
+};
+
+inline const char* MoveName(MoveId move)
+{
+	switch (move)
+	{
+	case MOVE_PUNCH:     return "punch";
+	case MOVE_JUMP_KICK: return "jumpkick";
+	default:             return "none";
+	}
+}
+
+inline const char* JointName(int joint)
+{
+	static const char* const names[JOINT_COUNT] = {
+		"hips", "neck", "head",
+		"l_shoulder", "l_elbow", "l_hand", "r_shoulder", "r_elbow", "r_hand",
+		"l_knee", "l_foot", "r_knee", "r_foot"
+	};
+	return joint >= 0 && joint < JOINT_COUNT ? names[joint] : "none";
+}
+
+inline int FindJoint(const std::string& name)
+{
+	for (int j = 0; j < JOINT_COUNT; ++j)
+	{
+		if (name == JointName(j))
+			return j;
+	}
+	return JOINT_NONE;
+}
+
+inline void FillHitboxes(MoveData& move, int fromFrame, const HitSphere& box)
+{
+	for (int f = fromFrame; f < MAX_ACTIVE_FRAMES; ++f)
+		move.hitboxes[f] = box;
+}
+
+// The original hard-coded balance expressed as frames. The hitboxes reach exactly
+// the old 2.5 unit CheckHit distance against a standing opponent's torso.
+inline MoveTable BuildDefaultMoveTable()
+{
+	MoveTable table;
+	MoveData& punch = table.moves[MOVE_PUNCH];
+	punch.startup = 21;     // PUNCH_HIT_DELAY 0.35 s
+	punch.active = 3;
+	punch.recovery = 18;
+	FillHitboxes(punch, 0, HitSphere{ 1.3f, 1.4f, 0.8f, JOINT_NONE });
+	punch.damage = 5.0f;
+	punch.chipDamage = 2.0f;
+	punch.hitStop = 14;     // 0.24 s
+	punch.blockStop = 7;    // 0.12 s
+	punch.hitStun = 60;
+	punch.blockStun = 30;
+	punch.hitShake = 0.5f;
+	punch.blockShake = 0.3f;
+
+	MoveData& kick = table.moves[MOVE_JUMP_KICK];
+	kick = punch;
+	kick.startup = 78;      // JUMPKICK_HIT_DELAY 1.3 s
+	kick.recovery = 39;
+	FillHitboxes(kick, 0, HitSphere{ 1.3f, 1.6f, 0.8f, JOINT_NONE });
+
+	// the torso is as wide as the old whole-body capsule, the limbs are thin
+	static const HurtCapsule body[] = {
+		{ JOINT_HIPS, JOINT_NECK, 0.4f },
+		{ JOINT_NECK, JOINT_HEAD, 0.15f },
+		{ JOINT_L_SHOULDER, JOINT_L_ELBOW, 0.1f },
+		{ JOINT_L_ELBOW, JOINT_L_HAND, 0.1f },
+		{ JOINT_R_SHOULDER, JOINT_R_ELBOW, 0.1f },
+		{ JOINT_R_ELBOW, JOINT_R_HAND, 0.1f },
+		{ JOINT_HIPS, JOINT_L_KNEE, 0.15f },
+		{ JOINT_L_KNEE, JOINT_L_FOOT, 0.12f },
+		{ JOINT_HIPS, JOINT_R_KNEE, 0.15f },
+		{ JOINT_R_KNEE, JOINT_R_FOOT, 0.12f },
+	};
+	table.character.hurtboxCount = (int)(sizeof(body) / sizeof(body[0]));
+	for (int i = 0; i < table.character.hurtboxCount; ++i)
+		table.character.hurtboxes[i] = body[i];
+	table.character.pushRadius = 0.75f;   // two of them are the old 1.5 unit push distance
+	table.character.standHeight = 1.8f;
+	table.character.crouchHeight = 1.1f;
+	table.character.crouchBlockRelease = 12;
+	table.character.testStun = 40;
+	return table;
+}
+
+// built once, on first use, from whichever thread gets there first (selfplay runs
+// matches on several workers)
+inline const MoveTable& DefaultMoveTable()
+{
+	static const MoveTable table = BuildDefaultMoveTable();
+	return table;
+}
+
+// ----------------------------------------------------------------------------
+// text format
+// ----------------------------------------------------------------------------
+
+// Parses 'path' on top of the defaults (anything not mentioned keeps its default).
+// On any error prints the offending line and leaves 'table' untouched.
+inline bool LoadMoveTable(const std::string& path, MoveTable& table)
+{
+	std::ifstream file(path.c_str());
+	if (!file)
+	{
+		std::cout << "ERROR::MOVE_TABLE:: could not open " << path << std::endl;
+		return false;
+	}
+
+	MoveTable parsed = DefaultMoveTable();
+	MoveData* move = NULL;
+	bool inCharacter = false;
+	bool customHurtboxes = false;
+	int lastHitbox = -1;
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		++lineNumber;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream in(line);
+		std::string key;
+		if (!(in >> key))
+			continue;
+
+		bool ok = true;
+		if (key == "move" && !move && !inCharacter)
+		{
+			std::string name;
+			in >> name;
+			ok = false;
+			for (int m = 0; m < MOVE_COUNT; ++m)
+			{
+				if (name == MoveName((MoveId)m))
+				{
+					move = &parsed.moves[m];
+					lastHitbox = -1;
+					ok = true;
+				}
+			}
+		}
+		else if (key == "character" && !move && !inCharacter)
+		{
+			inCharacter = true;
+		}
+		else if (key == "end" && (move || inCharacter))
+		{
+			if (move && (move->active < 1 || move->active > MAX_ACTIVE_FRAMES || move->startup < 0 || move->recovery < 0))
+				ok = false;
+			move = NULL;
+			inCharacter = false;
+		}
+		else if (move)
+		{
+			if (key == "startup") ok = (bool)(in >> move->startup);
+			else if (key == "active") ok = (bool)(in >> move->active);
+			else if (key == "recovery") ok = (bool)(in >> move->recovery);
+			else if (key == "damage") ok = (bool)(in >> move->damage);
+			else if (key == "chip") ok = (bool)(in >> move->chipDamage);
+			else if (key == "hitstop") ok = (bool)(in >> move->hitStop);
+			else if (key == "blockstop") ok = (bool)(in >> move->blockStop);
+			else if (key == "hitstun") ok = (bool)(in >> move->hitStun);
+			else if (key == "blockstun") ok = (bool)(in >> move->blockStun);
+			else if (key == "shake") ok = (bool)(in >> move->hitShake);
+			else if (key == "blockshake") ok = (bool)(in >> move->blockShake);
+			else if (key == "hitbox")
+			{
+				int frame;
+				HitSphere box;
+				std::string joint;
+				ok = (bool)(in >> frame >> box.forward >> box.up >> box.radius) &&
+					frame > lastHitbox && frame < MAX_ACTIVE_FRAMES;
+				box.joint = in >> joint ? FindJoint(joint) : JOINT_NONE;
+				ok = ok && (joint.empty() || box.joint != JOINT_NONE);
+				if (ok)
+				{
+					FillHitboxes(*move, frame, box);
+					lastHitbox = frame;
+				}
+			}
+			else ok = false;
+		}
+		else if (inCharacter)
+		{
+			CharacterData& c = parsed.character;
+			if (key == "hurtbox")
+			{
+				if (!customHurtboxes)
+					c.hurtboxCount = 0;
+				customHurtboxes = true;
+				std::string from, to;
+				HurtCapsule capsule;
+				ok = (bool)(in >> from >> to >> capsule.radius) && c.hurtboxCount < MAX_HURT_CAPSULES;
+				capsule.from = FindJoint(from);
+				capsule.to = FindJoint(to);
+				ok = ok && capsule.from != JOINT_NONE && capsule.to != JOINT_NONE;
+				if (ok)
+					c.hurtboxes[c.hurtboxCount++] = capsule;
+			}
+			else if (key == "push_radius") ok = (bool)(in >> c.pushRadius);
+			else if (key == "stand_height") ok = (bool)(in >> c.standHeight);
+			else if (key == "crouch_height") ok = (bool)(in >> c.crouchHeight);
+			else if (key == "crouch_block_release") ok = (bool)(in >> c.crouchBlockRelease);
+			else if (key == "test_stun") ok = (bool)(in >> c.testStun);
+			else ok = false;
+		}
+		else
+		{
+			ok = false;
+		}
+
+		if (!ok)
+		{
+			std::cout << "ERROR::MOVE_TABLE:: " << path << ":" << lineNumber << ": can't use '" << line << "'" << std::endl;
+			return false;
+		}
+	}
+
+	if (move || inCharacter)
+	{
+		std::cout << "ERROR::MOVE_TABLE:: " << path << ": missing 'end'" << std::endl;
+		return false;
+	}
+
+	table = parsed;
+	return true;
+}
@@ -0,0 +1,389 @@
+// pose_bake.h
+//
+// Load-time baker that fills a PoseCache from ClipData, or from the CompressedClip
+// form in clip_compression.h that the game keeps after loading. Clip nodes are already
+// stored flattened (parent before child), so each sample is a straight loop:
+// local transform from the node's track (or its bind transformation), times the
+// parent's global, times the bone offset for nodes that skin vertices.
+//
+// The baker uses PoseHierarchySoA, which interpolates the local transforms of all
+// nodes struct-of-arrays with the kernels in pose_simd.h. PoseHierarchy is the plain
+// glm version it is checked against (tools/pose_simd_check.cpp).
+//
+// The compressed bake can also fill the sim's JointTable (match_sim.h): the hurtbox
+// joints are read off the same global transforms the palette is made from.
+
+#pragma once
+
+#include "pose_cache.h"
+#include "pose_simd.h"
+#include "clip_compression.h"
+#include "asset_data.h"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// One sample of the hierarchy walk: 'globals' is scratch with one entry per node,
+// 'palette' receives globals * offset for every node that is a bone.
+inline void PoseHierarchy(const ClipData& clip, const TrackData* const* nodeTracks, const BoneData* const* nodeBones,
+	float time, glm::mat4* globals, glm::mat4* palette)
+{
+	const size_t nodeCount = clip.nodes.size();
+	for (size_t n = 0; n < nodeCount; ++n)
+	{
+		const NodeData& node = clip.nodes[n];
+		glm::mat4 nodeTransform = nodeTracks[n] ? SampleTrack(*nodeTracks[n], time) : node.transformation;
+
+		globals[n] = node.parent < 0 ? nodeTransform : globals[node.parent] * nodeTransform;
+
+		if (nodeBones[n])
+			palette[nodeBones[n]->id] = globals[n] * nodeBones[n]->offset;
+	}
+}
+
+// Fills the key pairs for 'time' (the per-track key search stays scalar).
+inline void GatherLocalKeys(PoseLocalsSoA& soa, const TrackData* const* nodeTracks, float time)
+{
+	float* f[PF_M00];
+	for (int i = 0; i < PF_M00; ++i)
+		f[i] = soa.Field((PoseField)i);
+
+	for (int n = 0; n < soa.count; ++n)
+	{
+		const TrackData* track = nodeTracks[n];
+		soa.animated[n] = track != NULL;
+		if (!track)
+			continue;
+
+		// a missing channel is the identity held still
+		glm::vec3 pa(0.0f), pb(0.0f), sa(1.0f), sb(1.0f);
+		glm::quat qa(1.0f, 0.0f, 0.0f, 0.0f), qb = qa;
+		float pt = 0.0f, qt = 0.0f, st = 0.0f;
+
+		if (track->positions.size() == 1)
+			pa = pb = track->positions[0].value;
+		else if (!track->positions.empty())
+		{
+			size_t k = FindKey(track->positions, time);
+			pa = track->positions[k].value;
+			pb = track->positions[k + 1].value;
+			pt = KeyFactor(track->positions[k], track->positions[k + 1], time);
+		}
+		if (track->rotations.size() == 1)
+			qa = qb = track->rotations[0].value;
+		else if (!track->rotations.empty())
+		{
+			size_t k = FindKey(track->rotations, time);
+			qa = track->rotations[k].value;
+			qb = track->rotations[k + 1].value;
+			qt = KeyFactor(track->rotations[k], track->rotations[k + 1], time);
+		}
+		if (track->scales.size() == 1)
+			sa = sb = track->scales[0].value;
+		else if (!track->scales.empty())
+		{
+			size_t k = FindKey(track->scales, time);
+			sa = track->scales[k].value;
+			sb = track->scales[k + 1].value;
+			st = KeyFactor(track->scales[k], track->scales[k + 1], time);
+		}
+
+		f[PF_POS_A_X][n] = pa.x; f[PF_POS_A_Y][n] = pa.y; f[PF_POS_A_Z][n] = pa.z;
+		f[PF_POS_B_X][n] = pb.x; f[PF_POS_B_Y][n] = pb.y; f[PF_POS_B_Z][n] = pb.z;
+		f[PF_POS_T][n] = pt;
+		f[PF_ROT_A_X][n] = qa.x; f[PF_ROT_A_Y][n] = qa.y; f[PF_ROT_A_Z][n] = qa.z; f[PF_ROT_A_W][n] = qa.w;
+		f[PF_ROT_B_X][n] = qb.x; f[PF_ROT_B_Y][n] = qb.y; f[PF_ROT_B_Z][n] = qb.z; f[PF_ROT_B_W][n] = qb.w;
+		f[PF_ROT_T][n] = qt;
+		f[PF_SCALE_A_X][n] = sa.x; f[PF_SCALE_A_Y][n] = sa.y; f[PF_SCALE_A_Z][n] = sa.z;
+		f[PF_SCALE_B_X][n] = sb.x; f[PF_SCALE_B_Y][n] = sb.y; f[PF_SCALE_B_Z][n] = sb.z;
+		f[PF_SCALE_T][n] = st;
+	}
+}
+
+// Composes the local transforms gathered in 'soa' and walks the hierarchy in
+// parent order, like PoseHierarchy does with glm. A NULL 'palette' only fills
+// 'globals'.
+inline void PoseWalkSoA(const std::vector<NodeData>& nodes, const BoneData* const* nodeBones, PoseLocalsSoA& soa,
+	glm::mat4* globals, glm::mat4* palette)
+{
+	ComposeLocals(soa);
+
+	const float* m[12];
+	for (int i = 0; i < 12; ++i)
+		m[i] = soa.Field((PoseField)(PF_M00 + i));
+
+	for (int n = 0; n < soa.count; ++n)
+	{
+		const NodeData& node = nodes[n];
+		glm::mat4 local;
+		if (soa.animated[n])
+		{
+			for (int c = 0; c < 4; ++c)
+				local[c] = glm::vec4(m[c * 3][n], m[c * 3 + 1][n], m[c * 3 + 2][n], c == 3 ? 1.0f : 0.0f);
+		}
+		else
+		{
+			local = node.transformation;
+		}
+
+		if (node.parent < 0)
+			globals[n] = local;
+		else
+			MulMat4(glm::value_ptr(globals[node.parent]), glm::value_ptr(local), glm::value_ptr(globals[n]));
+
+		if (palette && nodeBones[n])
+			MulMat4(glm::value_ptr(globals[n]), glm::value_ptr(nodeBones[n]->offset), glm::value_ptr(palette[nodeBones[n]->id]));
+	}
+}
+
+// Same result as PoseHierarchy (to the slerp approximation), with the
+// local transforms computed struct-of-arrays. 'soa' is scratch, sized by the caller
+// with Resize(clip.nodes.size()).
+inline void PoseHierarchySoA(const ClipData& clip, const TrackData* const* nodeTracks, const BoneData* const* nodeBones,
+	float time, PoseLocalsSoA& soa, glm::mat4* globals, glm::mat4* palette)
+{
+	GatherLocalKeys(soa, nodeTracks, time);
+	PoseWalkSoA(clip.nodes, nodeBones, soa, globals, palette);
+}
+
+// The same for a compressed clip. 'cursor' must have been Reset() for this clip;
+// sampling with increasing times is the fast path.
+inline void PoseHierarchyCompressed(const CompressedClip& clip, ClipCursor& cursor, const BoneData* const* nodeBones,
+	float time, PoseLocalsSoA& soa, glm::mat4* globals, glm::mat4* palette)
+{
+	GatherCompressedKeys(soa, clip, cursor, time);
+	PoseWalkSoA(clip.nodes, nodeBones, soa, globals, palette);
+}
+
+// Sizes the cache for one rig and a set of clips (ClipData or CompressedClip).
+// Only the clips in 'residentClips' get room for their samples.
+template <typename Clip>
+inline void LayoutPoseCache(PoseCache& cache, const ModelData& model, const Clip clips[CLIP_COUNT], unsigned int residentClips = ALL_CLIPS)
+{
+	cache.boneCount = 0;
+	for (const auto& entry : model.bones)
+		if (entry.second.id + 1 > cache.boneCount)
+			cache.boneCount = entry.second.id + 1;
+	if (cache.boneCount > MAX_BONES)
+		cache.boneCount = MAX_BONES;
+
+	for (int c = 0; c < CLIP_COUNT; ++c)
+	{
+		BakedClip& baked = cache.clips[c];
+		baked.ticksPerSecond = clips[c].ticksPerSecond;
+		baked.duration = clips[c].duration;
+		baked.sampleCount = (int)ceil(baked.duration / baked.ticksPerSecond * POSE_SAMPLE_RATE);
+		if (baked.sampleCount < 1)
+			baked.sampleCount = 1;
+		if (residentClips & (1u << c))
+			baked.matrices.assign((size_t)baked.sampleCount * cache.boneCount, glm::mat4(1.0f));
+		else
+			std::vector<glm::mat4>().swap(baked.matrices);
+	}
+}
+
+// Bones are matched by name against the model's bone map.
+inline void ResolveNodeBones(const PoseCache& cache, const ModelData& model, const std::vector<NodeData>& nodes,
+	std::vector<const BoneData*>& nodeBones)
+{
+	nodeBones.assign(nodes.size(), NULL);
+	for (size_t n = 0; n < nodes.size(); ++n)
+	{
+		auto it = model.bones.find(nodes[n].name);
+		if (it != model.bones.end() && it->second.id < cache.boneCount)
+			nodeBones[n] = &it->second;
+	}
+}
+
+// Bakes every clip against one rig.
+inline void BakePoseCache(PoseCache& cache, const ModelData& model, const ClipData clips[CLIP_COUNT])
+{
+	LayoutPoseCache(cache, model, clips);
+
+	std::vector<const TrackData*> nodeTracks;
+	std::vector<const BoneData*> nodeBones;
+	std::vector<glm::mat4> globals;
+	PoseLocalsSoA locals;
+	for (int c = 0; c < CLIP_COUNT; ++c)
+	{
+		const ClipData& clip = clips[c];
+		const size_t nodeCount = clip.nodes.size();
+
+		// resolve track and bone per node once, not per sample
+		nodeTracks.assign(nodeCount, NULL);
+		for (const TrackData& track : clip.tracks)
+			nodeTracks[track.node] = &track;
+		ResolveNodeBones(cache, model, clip.nodes, nodeBones);
+		globals.resize(nodeCount);
+		locals.Resize((int)nodeCount);
+
+		const BakedClip& baked = cache.clips[c];
+		for (int s = 0; s < baked.sampleCount; ++s)
+		{
+			float time = s * baked.ticksPerSecond / POSE_SAMPLE_RATE;
+			glm::mat4* palette = &cache.clips[c].matrices[(size_t)s * cache.boneCount];
+			PoseHierarchySoA(clip, nodeTracks.data(), nodeBones.data(), time, locals, globals.data(), palette);
+		}
+	}
+}
+
+// a node name without the "mixamorig:" (or any other) prefix
+inline std::string MixamoName(const std::string& node)
+{
+	size_t colon = node.rfind(':');
+	return colon == std::string::npos ? node : node.substr(colon + 1);
+}
+
+// Mixamo bone names of the sim's joints (move_table.h), with or without the
+// "mixamorig:" prefix. The first name a clip has wins.
+inline void ResolveJointNodes(const std::vector<NodeData>& nodes, int jointNodes[JOINT_COUNT])
+{
+	static const char* const names[JOINT_COUNT][2] = {
+		{ "Hips", "" }, { "Neck", "" }, { "HeadTop_End", "Head" },
+		{ "LeftArm", "" }, { "LeftForeArm", "" }, { "LeftHand", "" },
+		{ "RightArm", "" }, { "RightForeArm", "" }, { "RightHand", "" },
+		{ "LeftLeg", "" }, { "LeftFoot", "" }, { "RightLeg", "" }, { "RightFoot", "" }
+	};
+	for (int j = 0; j < JOINT_COUNT; ++j)
+	{
+		jointNodes[j] = -1;
+		for (int k = 0; k < 2 && jointNodes[j] < 0 && names[j][k][0]; ++k)
+		{
+			const std::string name = names[j][k];
+			for (size_t n = 0; n < nodes.size() && jointNodes[j] < 0; ++n)
+			{
+				if (MixamoName(nodes[n].name) == name)
+					jointNodes[j] = (int)n;
+			}
+		}
+	}
+}
+
+// Layer weights (blend_tree.h) for everything from the spine up, indexed by bone id:
+// 1 for the chest, arms and head, half for the first spine bone so the seam at the
+// waist bends with both layers, 0 for the hips and legs. Empty when the rig has no
+// Mixamo spine.
+inline void UpperBodyWeights(const ModelData& model, const std::vector<NodeData>& nodes, std::vector<float>& weights)
+{
+	weights.clear();
+	std::vector<float> nodeWeights(nodes.size(), 0.0f);
+	bool found = false;
+	for (size_t n = 0; n < nodes.size(); ++n)
+	{
+		int parent = nodes[n].parent;
+		if (MixamoName(nodes[n].name) == "Spine")
+		{
+			nodeWeights[n] = 0.5f;
+			found = true;
+		}
+		else if (parent >= 0 && nodeWeights[parent] > 0.0f)
+			nodeWeights[n] = 1.0f;
+	}
+	if (!found)
+		return;
+
+	for (size_t n = 0; n < nodes.size(); ++n)
+	{
+		auto bone = model.bones.find(nodes[n].name);
+		if (bone == model.bones.end())
+			continue;
+		if (bone->second.id >= (int)weights.size())
+			weights.resize(bone->second.id + 1, 0.0f);
+		weights[bone->second.id] = nodeWeights[n];
+	}
+}
+
+// What baking one compressed clip works in. Kept from one bake to the next it
+// stops allocating once it has seen the largest clip; Reserve() gets it there
+// up front (clip_registry.h bakes during the match).
+struct BakeScratch {
+	std::vector<const BoneData*> nodeBones;
+	std::vector<glm::mat4> globals;
+	PoseLocalsSoA locals;
+	ClipCursor cursor;
+
+	void Reserve(const CompressedClip& clip)
+	{
+		nodeBones.reserve(clip.nodes.size());
+		if (globals.size() < clip.nodes.size())
+			globals.resize(clip.nodes.size());
+		if (locals.count < (int)clip.nodes.size())
+			locals.Resize((int)clip.nodes.size());
+		cursor.Reset(clip);
+	}
+};
+
+// Bakes one compressed clip, laid out in 'cache', into 'palettes' (sampleCount *
+// boneCount matrices), 'joints' or both; either may be NULL. Only reads 'cache', so
+// a worker can bake a clip while the frame poses from the others.
+inline void BakeCompressedClip(const PoseCache& cache, const ModelData& model, const CompressedClip& clip, ClipId c,
+	glm::mat4* palettes, JointTable* joints, BakeScratch& scratch)
+{
+	std::vector<const BoneData*>& nodeBones = scratch.nodeBones;
+	ResolveNodeBones(cache, model, clip.nodes, nodeBones);
+	if (scratch.globals.size() < clip.nodes.size())
+		scratch.globals.resize(clip.nodes.size());
+	glm::mat4* globals = scratch.globals.data();
+	PoseLocalsSoA& locals = scratch.locals;
+	locals.Resize((int)clip.nodes.size());
+	ClipCursor& cursor = scratch.cursor;
+	cursor.Reset(clip);
+
+	const BakedClip& baked = cache.clips[c];
+	int jointNodes[JOINT_COUNT];
+	bool withJoints = joints != NULL;
+	if (joints)
+	{
+		ResolveJointNodes(clip.nodes, jointNodes);
+		for (int j = 0; j < JOINT_COUNT; ++j)
+			withJoints = withJoints && jointNodes[j] >= 0;
+		joints->firstSample[c] = (int)joints->samples.size();
+		joints->sampleCount[c] = withJoints ? baked.sampleCount : 0;
+		if (!withJoints)
+			std::cout << "Clip " << c << " has no bone for some hurtbox joint, it uses the default pose" << std::endl;
+	}
+	if (!palettes && !withJoints)
+		return;
+
+	for (int s = 0; s < baked.sampleCount; ++s)
+	{
+		float time = s * baked.ticksPerSecond / POSE_SAMPLE_RATE;
+		glm::mat4* palette = palettes ? palettes + (size_t)s * cache.boneCount : NULL;
+		PoseHierarchyCompressed(clip, cursor, nodeBones.data(), time, locals, globals, palette);
+
+		if (withJoints)
+		{
+			JointPose pose;
+			for (int j = 0; j < JOINT_COUNT; ++j)
+				pose.joints[j] = glm::vec3(globals[jointNodes[j]][3]);
+			joints->samples.push_back(pose);
+		}
+	}
+}
+
+inline void BakeCompressedClip(const PoseCache& cache, const ModelData& model, const CompressedClip& clip, ClipId c,
+	glm::mat4* palettes, JointTable* joints)
+{
+	BakeScratch scratch;
+	BakeCompressedClip(cache, model, clip, c, palettes, joints, scratch);
+}
+
+// Bakes from compressed clips. Samples run forward in time, so every channel is
+// decoded through its cursor without a key search. With 'joints' the same walk
+// also records the sim's joint positions for every clip; a clip missing any joint
+// bone gets no joint samples. Clips outside 'residentClips' get no pose samples,
+// clip_registry.h bakes those when they are wanted.
+inline void BakePoseCache(PoseCache& cache, const ModelData& model, const CompressedClip clips[CLIP_COUNT],
+	JointTable* joints = NULL, unsigned int residentClips = ALL_CLIPS)
+{
+	LayoutPoseCache(cache, model, clips, residentClips);
+	if (joints)
+		joints->samples.clear();
+	for (int c = 0; c < CLIP_COUNT; ++c)
+	{
+		glm::mat4* palettes = cache.Resident((ClipId)c) ? cache.clips[c].matrices.data() : NULL;
+		BakeCompressedClip(cache, model, clips[c], (ClipId)c, palettes, joints);
+	}
+}
@@ -0,0 +1,160 @@
+// pose_cache.h
+//
+// Every clip of a character sampled at the sim rate into one flat array of final
+// bone matrices (the skinning palette the shader wants). At runtime a pose is an
+// indexed fetch of the two nearest samples plus a lerp, and a crossfade is one
+// more lerp against the second clip - no keyframe searches, no hierarchy walk.
+//
+// Each clip keeps its samples in its own block, so a clip can be baked later or
+// dropped again (clip_registry.h) while the others stay. Timing is always there.
+//
+// Baking from learnopengl Animation objects lives in pose_bake.h; this header
+// only needs glm so the headless tools can use it too.
+
+#pragma once
+
+#include "match_sim.h"
+#include "pose_simd.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <vector>
+
+const int MAX_BONES = 100;
+const unsigned int ALL_CLIPS = (1u << CLIP_COUNT) - 1;   // one bit per ClipId
+const float POSE_SAMPLE_RATE = SIM_TICK_RATE;
+
+struct BakedClip {
+	int sampleCount;
+	float ticksPerSecond;
+	float duration;                    // in ticks, like Animation::GetDuration
+	std::vector<glm::mat4> matrices;   // sample after sample, bone after bone; empty while not resident
+};
+
+struct PoseCache {
+	int boneCount = 0;                 // palette entries per sample, same for every clip of the rig
+	BakedClip clips[CLIP_COUNT];
+
+	const glm::mat4* Sample(ClipId clip, int sample) const
+	{
+		return &clips[clip].matrices[(size_t)sample * boneCount];
+	}
+
+	bool Resident(ClipId clip) const { return clip != CLIP_NONE && !clips[clip].matrices.empty(); }
+
+	// what one clip's samples take once baked
+	size_t ClipBytes(ClipId clip) const { return (size_t)clips[clip].sampleCount * boneCount * sizeof(glm::mat4); }
+};
+
+inline glm::mat4 LerpMatrix(const glm::mat4& a, const glm::mat4& b, float t)
+{
+	return a + (b - a) * t;
+}
+
+// the two samples around 'time' and how far we are between them; clips loop, so
+// the sample after the last one is the first one
+inline void FindSamples(const BakedClip& clip, float time, int& s0, int& s1, float& frac)
+{
+	float s = time / clip.ticksPerSecond * POSE_SAMPLE_RATE;
+	if (s < 0.0f)
+		s = 0.0f;
+	s0 = (int)s;
+	frac = s - (float)s0;
+	if (s0 >= clip.sampleCount)
+	{
+		s0 = clip.sampleCount - 1;
+		frac = 0.0f;
+	}
+	s1 = s0 + 1 < clip.sampleCount ? s0 + 1 : 0;
+}
+
+// Writes cache.boneCount matrices to 'out'. Entries past boneCount are left untouched.
+inline void SampleClip(const PoseCache& cache, ClipId clip, float time, glm::mat4* out)
+{
+	int s0, s1;
+	float frac;
+	FindSamples(cache.clips[clip], time, s0, s1, frac);
+
+	LerpPalette(glm::value_ptr(*cache.Sample(clip, s0)), glm::value_ptr(*cache.Sample(clip, s1)), frac,
+		glm::value_ptr(*out), (size_t)cache.boneCount * 16);
+}
+
+// The pose for a sim clip clock: one clip, or two crossfaded by anim.blend.
+inline void EvaluatePose(const PoseCache& cache, const AnimClock& anim, glm::mat4* out)
+{
+	if (anim.clip2 == CLIP_NONE || anim.blend <= 0.0f)
+	{
+		SampleClip(cache, anim.clip, anim.time, out);
+		return;
+	}
+
+	int a0, a1, b0, b1;
+	float fa, fb;
+	FindSamples(cache.clips[anim.clip], anim.time, a0, a1, fa);
+	FindSamples(cache.clips[anim.clip2], anim.time2, b0, b1, fb);
+
+	// palettes are plain float arrays, so both clips and the crossfade are one pass
+	BlendPalette(glm::value_ptr(*cache.Sample(anim.clip, a0)), glm::value_ptr(*cache.Sample(anim.clip, a1)), fa,
+		glm::value_ptr(*cache.Sample(anim.clip2, b0)), glm::value_ptr(*cache.Sample(anim.clip2, b1)), fb,
+		anim.blend, glm::value_ptr(*out), (size_t)cache.boneCount * 16);
+}
+
+// 'anim' reduced to clips that are resident, for posing while others still load.
+// A crossfade toward a missing clip holds the clip it comes from; a missing clip
+// with a resident one to fade to shows that one; otherwise idle stands in, which
+// the loader always keeps.
+inline AnimClock ResidentClock(const PoseCache& cache, const AnimClock& anim)
+{
+	AnimClock out = anim;
+	if (out.clip2 != CLIP_NONE && !cache.Resident(out.clip2))
+	{
+		out.clip2 = CLIP_NONE;
+		out.blend = 0.0f;
+	}
+	if (out.clip != CLIP_NONE && !cache.Resident(out.clip))
+	{
+		if (out.clip2 != CLIP_NONE)
+		{
+			out.clip = out.clip2;
+			out.time = out.time2;
+		}
+		else
+		{
+			out.clip = CLIP_IDLE;
+			out.time = 0.0f;
+		}
+		out.clip2 = CLIP_NONE;
+		out.blend = 0.0f;
+	}
+	return out;
+}
+
+// Render-side clock between two consecutive sim ticks, 'alpha' of the way from
+// 'previous' to 'current'. Times only interpolate while both ticks play the same
+// clips (looping clips wrap forward); across a clip change the newer tick is used.
+inline AnimClock InterpolateClock(const PoseCache& cache, const AnimClock& previous, const AnimClock& current, float alpha)
+{
+	if (previous.clip != current.clip || previous.clip2 != current.clip2 || current.clip == CLIP_NONE)
+		return current;
+
+	AnimClock out = current;
+	float duration = cache.clips[current.clip].duration;
+	float delta = current.time - previous.time;
+	if (delta < 0.0f)
+		delta += duration;
+	out.time = fmod(previous.time + delta * alpha, duration);
+
+	if (current.clip2 != CLIP_NONE)
+	{
+		float duration2 = cache.clips[current.clip2].duration;
+		float delta2 = current.time2 - previous.time2;
+		if (delta2 < 0.0f)
+			delta2 += duration2;
+		out.time2 = fmod(previous.time2 + delta2 * alpha, duration2);
+		// a blend that just restarted from 0 is a new crossfade, not a step back
+		if (current.blend >= previous.blend)
+			out.blend = previous.blend + (current.blend - previous.blend) * alpha;
+	}
+	return out;
+}
@@ -0,0 +1,357 @@
+// pose_simd.h
+//
+// Vectorized pose math, with a plain C++ fallback for every kernel.
+//
+//   BlendPalette / LerpPalette   the runtime crossfade in EvaluatePose: a palette is
+//                                just floats, so two clips are sampled and blended in
+//                                one pass, 4 (SSE) or 8 (AVX2) floats at a time
+//   OffsetPalette                one clip sampled plus a weighted offset palette, the
+//                                inertialized transition of blend_tree.h
+//   PoseLocalsSoA                the bake-time local transforms of every node, stored
+//                                struct-of-arrays so 4 / 8 nodes are interpolated at
+//                                once (translation and scale lerp, rotation slerp)
+//   MulMat4                      the parent * local step of the hierarchy walk
+//
+// The rotation interpolation is an nlerp with a corrected parameter (Kapoulkine,
+// "Approximating slerp"). It needs no trig, so it vectorizes, and it stays within
+// about 1e-4 of a true slerp for the angles between neighbouring keys.
+//
+// AVX2 is used when the compiler targets it (-mavx2), otherwise SSE2 (always on for
+// x86-64), otherwise the scalar code. Define POSE_SIMD_SCALAR to force the fallback.
+// Key search and the hierarchy walk around these kernels are PoseHierarchySoA in
+// pose_bake.h. tools/pose_simd_check.cpp checks every SIMD kernel against its scalar
+// twin and the SoA walk against the glm one.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if !defined(POSE_SIMD_SCALAR) && defined(__AVX2__)
+#define POSE_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+#if !defined(POSE_SIMD_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define POSE_SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+inline const char* PoseSimdName()
+{
+#if defined(POSE_SIMD_AVX2)
+	return "avx2";
+#elif defined(POSE_SIMD_SSE)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// palette blending
+// ----------------------------------------------------------------------------
+
+// out = a + (b - a) * t, over 'count' floats
+inline void LerpPaletteScalar(const float* a, const float* b, float t, float* out, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		out[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+// out = lerp(lerp(a0, a1, fa), lerp(b0, b1, fb), blend), over 'count' floats
+inline void BlendPaletteScalar(const float* a0, const float* a1, float fa, const float* b0, const float* b1, float fb,
+	float blend, float* out, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		float a = a0[i] + (a1[i] - a0[i]) * fa;
+		float b = b0[i] + (b1[i] - b0[i]) * fb;
+		out[i] = a + (b - a) * blend;
+	}
+}
+
+// out = lerp(a, b, t) + offset * w, over 'count' floats
+inline void OffsetPaletteScalar(const float* a, const float* b, float t, const float* offset, float w, float* out, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		out[i] = (a[i] + (b[i] - a[i]) * t) + offset[i] * w;
+}
+
+inline void LerpPalette(const float* a, const float* b, float t, float* out, size_t count)
+{
+	size_t i = 0;
+#if defined(POSE_SIMD_AVX2)
+	__m256 t8 = _mm256_set1_ps(t);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 va = _mm256_loadu_ps(a + i);
+		__m256 vb = _mm256_loadu_ps(b + i);
+		_mm256_storeu_ps(out + i, _mm256_add_ps(va, _mm256_mul_ps(_mm256_sub_ps(vb, va), t8)));
+	}
+#endif
+#if defined(POSE_SIMD_SSE)
+	__m128 t4 = _mm_set1_ps(t);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 va = _mm_loadu_ps(a + i);
+		__m128 vb = _mm_loadu_ps(b + i);
+		_mm_storeu_ps(out + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), t4)));
+	}
+#endif
+	LerpPaletteScalar(a + i, b + i, t, out + i, count - i);
+}
+
+inline void BlendPalette(const float* a0, const float* a1, float fa, const float* b0, const float* b1, float fb,
+	float blend, float* out, size_t count)
+{
+	size_t i = 0;
+#if defined(POSE_SIMD_AVX2)
+	__m256 fa8 = _mm256_set1_ps(fa), fb8 = _mm256_set1_ps(fb), w8 = _mm256_set1_ps(blend);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 va0 = _mm256_loadu_ps(a0 + i), va1 = _mm256_loadu_ps(a1 + i);
+		__m256 vb0 = _mm256_loadu_ps(b0 + i), vb1 = _mm256_loadu_ps(b1 + i);
+		__m256 a = _mm256_add_ps(va0, _mm256_mul_ps(_mm256_sub_ps(va1, va0), fa8));
+		__m256 b = _mm256_add_ps(vb0, _mm256_mul_ps(_mm256_sub_ps(vb1, vb0), fb8));
+		_mm256_storeu_ps(out + i, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), w8)));
+	}
+#endif
+#if defined(POSE_SIMD_SSE)
+	__m128 fa4 = _mm_set1_ps(fa), fb4 = _mm_set1_ps(fb), w4 = _mm_set1_ps(blend);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 va0 = _mm_loadu_ps(a0 + i), va1 = _mm_loadu_ps(a1 + i);
+		__m128 vb0 = _mm_loadu_ps(b0 + i), vb1 = _mm_loadu_ps(b1 + i);
+		__m128 a = _mm_add_ps(va0, _mm_mul_ps(_mm_sub_ps(va1, va0), fa4));
+		__m128 b = _mm_add_ps(vb0, _mm_mul_ps(_mm_sub_ps(vb1, vb0), fb4));
+		_mm_storeu_ps(out + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), w4)));
+	}
+#endif
+	BlendPaletteScalar(a0 + i, a1 + i, fa, b0 + i, b1 + i, fb, blend, out + i, count - i);
+}
+
+inline void OffsetPalette(const float* a, const float* b, float t, const float* offset, float w, float* out, size_t count)
+{
+	size_t i = 0;
+#if defined(POSE_SIMD_AVX2)
+	__m256 t8 = _mm256_set1_ps(t), w8 = _mm256_set1_ps(w);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 va = _mm256_loadu_ps(a + i);
+		__m256 vb = _mm256_loadu_ps(b + i);
+		__m256 sample = _mm256_add_ps(va, _mm256_mul_ps(_mm256_sub_ps(vb, va), t8));
+		_mm256_storeu_ps(out + i, _mm256_add_ps(sample, _mm256_mul_ps(_mm256_loadu_ps(offset + i), w8)));
+	}
+#endif
+#if defined(POSE_SIMD_SSE)
+	__m128 t4 = _mm_set1_ps(t), w4 = _mm_set1_ps(w);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 va = _mm_loadu_ps(a + i);
+		__m128 vb = _mm_loadu_ps(b + i);
+		__m128 sample = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), t4));
+		_mm_storeu_ps(out + i, _mm_add_ps(sample, _mm_mul_ps(_mm_loadu_ps(offset + i), w4)));
+	}
+#endif
+	OffsetPaletteScalar(a + i, b + i, t, offset + i, w, out + i, count - i);
+}
+
+// ----------------------------------------------------------------------------
+// struct-of-arrays local transforms
+// ----------------------------------------------------------------------------
+
+// One array per field, each PoseLocalsSoA::stride floats long (the node count rounded
+// up to 8). Inputs are the two keys around the sample time and the factor between
+// them; outputs are the upper 3x4 of the local matrix, element m[column][row].
+enum PoseField {
+	PF_POS_A_X, PF_POS_A_Y, PF_POS_A_Z, PF_POS_B_X, PF_POS_B_Y, PF_POS_B_Z, PF_POS_T,
+	PF_ROT_A_X, PF_ROT_A_Y, PF_ROT_A_Z, PF_ROT_A_W, PF_ROT_B_X, PF_ROT_B_Y, PF_ROT_B_Z, PF_ROT_B_W, PF_ROT_T,
+	PF_SCALE_A_X, PF_SCALE_A_Y, PF_SCALE_A_Z, PF_SCALE_B_X, PF_SCALE_B_Y, PF_SCALE_B_Z, PF_SCALE_T,
+	PF_M00, PF_M01, PF_M02, PF_M10, PF_M11, PF_M12, PF_M20, PF_M21, PF_M22, PF_M30, PF_M31, PF_M32,
+	PF_FIELD_COUNT
+};
+
+struct PoseLocalsSoA {
+	int count = 0;
+	int stride = 0;
+	std::vector<float> data;
+	std::vector<unsigned char> animated;   // 0 = no track, the node keeps its bind transformation
+
+	void Resize(int nodeCount)
+	{
+		count = nodeCount;
+		stride = (nodeCount + 7) & ~7;
+		data.assign((size_t)stride * PF_FIELD_COUNT, 0.0f);
+		animated.assign(nodeCount, 0);
+	}
+
+	float* Field(PoseField f) { return &data[(size_t)f * stride]; }
+	const float* Field(PoseField f) const { return &data[(size_t)f * stride]; }
+};
+
+// Nodes [begin, end): interpolate translation, rotation and scale and build the 3x4.
+// Every SIMD kernel below is this loop body, lane for lane.
+inline void ComposeLocalsScalar(PoseLocalsSoA& soa, int begin, int end)
+{
+	float* f[PF_FIELD_COUNT];
+	for (int i = 0; i < PF_FIELD_COUNT; ++i)
+		f[i] = soa.Field((PoseField)i);
+
+	for (int n = begin; n < end; ++n)
+	{
+		float pt = f[PF_POS_T][n];
+		float px = f[PF_POS_A_X][n] + (f[PF_POS_B_X][n] - f[PF_POS_A_X][n]) * pt;
+		float py = f[PF_POS_A_Y][n] + (f[PF_POS_B_Y][n] - f[PF_POS_A_Y][n]) * pt;
+		float pz = f[PF_POS_A_Z][n] + (f[PF_POS_B_Z][n] - f[PF_POS_A_Z][n]) * pt;
+		float st = f[PF_SCALE_T][n];
+		float sx = f[PF_SCALE_A_X][n] + (f[PF_SCALE_B_X][n] - f[PF_SCALE_A_X][n]) * st;
+		float sy = f[PF_SCALE_A_Y][n] + (f[PF_SCALE_B_Y][n] - f[PF_SCALE_A_Y][n]) * st;
+		float sz = f[PF_SCALE_A_Z][n] + (f[PF_SCALE_B_Z][n] - f[PF_SCALE_A_Z][n]) * st;
+
+		// short way round, then nlerp with the corrected parameter
+		float ax = f[PF_ROT_A_X][n], ay = f[PF_ROT_A_Y][n], az = f[PF_ROT_A_Z][n], aw = f[PF_ROT_A_W][n];
+		float bx = f[PF_ROT_B_X][n], by = f[PF_ROT_B_Y][n], bz = f[PF_ROT_B_Z][n], bw = f[PF_ROT_B_W][n];
+		float t = f[PF_ROT_T][n];
+		float ca = ax * bx + ay * by + az * bz + aw * bw;
+		float sign = ca < 0.0f ? -1.0f : 1.0f;
+		float d = ca * sign;
+		float A = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+		float B = 0.848013f + d * (-1.06021f + d * 0.215638f);
+		float k = A * (t - 0.5f) * (t - 0.5f) + B;
+		float ot = t + t * (t - 0.5f) * (t - 1.0f) * k;
+		float qx = ax + (bx * sign - ax) * ot;
+		float qy = ay + (by * sign - ay) * ot;
+		float qz = az + (bz * sign - az) * ot;
+		float qw = aw + (bw * sign - aw) * ot;
+		float inv = 1.0f / sqrtf(qx * qx + qy * qy + qz * qz + qw * qw);
+		qx *= inv; qy *= inv; qz *= inv; qw *= inv;
+
+		// translate * mat4_cast(q) * scale
+		f[PF_M00][n] = (1.0f - 2.0f * (qy * qy + qz * qz)) * sx;
+		f[PF_M01][n] = 2.0f * (qx * qy + qw * qz) * sx;
+		f[PF_M02][n] = 2.0f * (qx * qz - qw * qy) * sx;
+		f[PF_M10][n] = 2.0f * (qx * qy - qw * qz) * sy;
+		f[PF_M11][n] = (1.0f - 2.0f * (qx * qx + qz * qz)) * sy;
+		f[PF_M12][n] = 2.0f * (qy * qz + qw * qx) * sy;
+		f[PF_M20][n] = 2.0f * (qx * qz + qw * qy) * sz;
+		f[PF_M21][n] = 2.0f * (qy * qz - qw * qx) * sz;
+		f[PF_M22][n] = (1.0f - 2.0f * (qx * qx + qy * qy)) * sz;
+		f[PF_M30][n] = px;
+		f[PF_M31][n] = py;
+		f[PF_M32][n] = pz;
+	}
+}
+
+#if defined(POSE_SIMD_SSE) || defined(POSE_SIMD_AVX2)
+
+// The SIMD kernels share one body, written against these few wrappers.
+#define POSE_SIMD_KERNEL(NAME, V, WIDTH, LOAD, STORE, SET1, ADD, SUB, MUL, DIV, SQRT, LESS, BLEND)            \
+inline void NAME(PoseLocalsSoA& soa, int begin, int end)                                                   \
+{                                                                                                          \
+	float* f[PF_FIELD_COUNT];                                                                              \
+	for (int i = 0; i < PF_FIELD_COUNT; ++i)                                                               \
+		f[i] = soa.Field((PoseField)i);                                                                    \
+	const V one = SET1(1.0f), two = SET1(2.0f), half = SET1(0.5f), zero = SET1(0.0f);                      \
+	int n = begin;                                                                                         \
+	for (; n + WIDTH <= end; n += WIDTH)                                                                   \
+	{                                                                                                      \
+		V pt = LOAD(f[PF_POS_T] + n);                                                                      \
+		V pax = LOAD(f[PF_POS_A_X] + n), pay = LOAD(f[PF_POS_A_Y] + n), paz = LOAD(f[PF_POS_A_Z] + n);     \
+		V px = ADD(pax, MUL(SUB(LOAD(f[PF_POS_B_X] + n), pax), pt));                                       \
+		V py = ADD(pay, MUL(SUB(LOAD(f[PF_POS_B_Y] + n), pay), pt));                                       \
+		V pz = ADD(paz, MUL(SUB(LOAD(f[PF_POS_B_Z] + n), paz), pt));                                       \
+		V st = LOAD(f[PF_SCALE_T] + n);                                                                    \
+		V sax = LOAD(f[PF_SCALE_A_X] + n), say = LOAD(f[PF_SCALE_A_Y] + n), saz = LOAD(f[PF_SCALE_A_Z] + n); \
+		V sx = ADD(sax, MUL(SUB(LOAD(f[PF_SCALE_B_X] + n), sax), st));                                     \
+		V sy = ADD(say, MUL(SUB(LOAD(f[PF_SCALE_B_Y] + n), say), st));                                     \
+		V sz = ADD(saz, MUL(SUB(LOAD(f[PF_SCALE_B_Z] + n), saz), st));                                     \
+                                                                                                           \
+		V ax = LOAD(f[PF_ROT_A_X] + n), ay = LOAD(f[PF_ROT_A_Y] + n);                                      \
+		V az = LOAD(f[PF_ROT_A_Z] + n), aw = LOAD(f[PF_ROT_A_W] + n);                                      \
+		V bx = LOAD(f[PF_ROT_B_X] + n), by = LOAD(f[PF_ROT_B_Y] + n);                                      \
+		V bz = LOAD(f[PF_ROT_B_Z] + n), bw = LOAD(f[PF_ROT_B_W] + n);                                      \
+		V t = LOAD(f[PF_ROT_T] + n);                                                                       \
+		V ca = ADD(ADD(ADD(MUL(ax, bx), MUL(ay, by)), MUL(az, bz)), MUL(aw, bw));                          \
+		V sign = BLEND(one, SET1(-1.0f), LESS(ca, zero));                                                  \
+		V d = MUL(ca, sign);                                                                               \
+		V A = ADD(SET1(1.0904f), MUL(d, ADD(SET1(-3.2452f), MUL(d, SUB(SET1(3.55645f), MUL(d, SET1(1.43519f))))))); \
+		V B = ADD(SET1(0.848013f), MUL(d, ADD(SET1(-1.06021f), MUL(d, SET1(0.215638f)))));                 \
+		V th = SUB(t, half);                                                                               \
+		V k = ADD(MUL(MUL(A, th), th), B);                                                                 \
+		V ot = ADD(t, MUL(MUL(MUL(t, th), SUB(t, one)), k));                                               \
+		V qx = ADD(ax, MUL(SUB(MUL(bx, sign), ax), ot));                                                   \
+		V qy = ADD(ay, MUL(SUB(MUL(by, sign), ay), ot));                                                   \
+		V qz = ADD(az, MUL(SUB(MUL(bz, sign), az), ot));                                                   \
+		V qw = ADD(aw, MUL(SUB(MUL(bw, sign), aw), ot));                                                   \
+		V inv = DIV(one, SQRT(ADD(ADD(ADD(MUL(qx, qx), MUL(qy, qy)), MUL(qz, qz)), MUL(qw, qw))));         \
+		qx = MUL(qx, inv); qy = MUL(qy, inv); qz = MUL(qz, inv); qw = MUL(qw, inv);                        \
+                                                                                                           \
+		STORE(f[PF_M00] + n, MUL(SUB(one, MUL(two, ADD(MUL(qy, qy), MUL(qz, qz)))), sx));                  \
+		STORE(f[PF_M01] + n, MUL(MUL(two, ADD(MUL(qx, qy), MUL(qw, qz))), sx));                            \
+		STORE(f[PF_M02] + n, MUL(MUL(two, SUB(MUL(qx, qz), MUL(qw, qy))), sx));                            \
+		STORE(f[PF_M10] + n, MUL(MUL(two, SUB(MUL(qx, qy), MUL(qw, qz))), sy));                            \
+		STORE(f[PF_M11] + n, MUL(SUB(one, MUL(two, ADD(MUL(qx, qx), MUL(qz, qz)))), sy));                  \
+		STORE(f[PF_M12] + n, MUL(MUL(two, ADD(MUL(qy, qz), MUL(qw, qx))), sy));                            \
+		STORE(f[PF_M20] + n, MUL(MUL(two, ADD(MUL(qx, qz), MUL(qw, qy))), sz));                            \
+		STORE(f[PF_M21] + n, MUL(MUL(two, SUB(MUL(qy, qz), MUL(qw, qx))), sz));                            \
+		STORE(f[PF_M22] + n, MUL(SUB(one, MUL(two, ADD(MUL(qx, qx), MUL(qy, qy)))), sz));                  \
+		STORE(f[PF_M30] + n, px);                                                                          \
+		STORE(f[PF_M31] + n, py);                                                                          \
+		STORE(f[PF_M32] + n, pz);                                                                          \
+	}                                                                                                      \
+	ComposeLocalsScalar(soa, n, end);                                                                      \
+}
+
+#endif
+
+#if defined(POSE_SIMD_SSE)
+// (mask & b) | (~mask & a), SSE2 has no blendv
+inline __m128 PoseSelectSSE(__m128 a, __m128 b, __m128 mask) { return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a)); }
+POSE_SIMD_KERNEL(ComposeLocalsSSE, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_add_ps, _mm_sub_ps,
+	_mm_mul_ps, _mm_div_ps, _mm_sqrt_ps, _mm_cmplt_ps, PoseSelectSSE)
+#endif
+
+#if defined(POSE_SIMD_AVX2)
+inline __m256 PoseLessAVX(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+POSE_SIMD_KERNEL(ComposeLocalsAVX2, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_add_ps, _mm256_sub_ps,
+	_mm256_mul_ps, _mm256_div_ps, _mm256_sqrt_ps, PoseLessAVX, _mm256_blendv_ps)
+#endif
+
+// the widest kernel compiled in
+inline void ComposeLocals(PoseLocalsSoA& soa)
+{
+#if defined(POSE_SIMD_AVX2)
+	ComposeLocalsAVX2(soa, 0, soa.count);
+#elif defined(POSE_SIMD_SSE)
+	ComposeLocalsSSE(soa, 0, soa.count);
+#else
+	ComposeLocalsScalar(soa, 0, soa.count);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// hierarchy
+// ----------------------------------------------------------------------------
+
+// out = a * b, column-major 4x4
+inline void MulMat4(const float* a, const float* b, float* out)
+{
+#if defined(POSE_SIMD_SSE)
+	__m128 c0 = _mm_loadu_ps(a), c1 = _mm_loadu_ps(a + 4), c2 = _mm_loadu_ps(a + 8), c3 = _mm_loadu_ps(a + 12);
+	for (int j = 0; j < 4; ++j)
+	{
+		const float* bj = b + 4 * j;
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(bj[0])), _mm_mul_ps(c1, _mm_set1_ps(bj[1]))),
+			_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(bj[2])), _mm_mul_ps(c3, _mm_set1_ps(bj[3]))));
+		_mm_storeu_ps(out + 4 * j, r);
+	}
+#else
+	float r[16];
+	for (int j = 0; j < 4; ++j)
+		for (int i = 0; i < 4; ++i)
+			r[4 * j + i] = (a[i] * b[4 * j] + a[4 + i] * b[4 * j + 1]) + (a[8 + i] * b[4 * j + 2] + a[12 + i] * b[4 * j + 3]);
+	for (int i = 0; i < 16; ++i)
+		out[i] = r[i];
+#endif
+}
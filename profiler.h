@@ -0,0 +1,385 @@
+// profiler.h
+//
+// Frame profiler for the render loop. Every frame records, per zone, the CPU time
+// spent in it and, for the GPU passes, the GPU time from a GL_TIME_ELAPSED query.
+// The last PROFILE_HISTORY frames are kept in a ring. From there they can be drawn
+// as a HUD (through UIBatch), printed as a summary, or written as a Chrome trace
+// (chrome://tracing or https://ui.perfetto.dev).
+//
+//   profiler.BeginFrame();
+//   { ProfileScope scope(profiler, PROF_SIM); ... }
+//   { ProfileScope scope(profiler, PROF_DRAW_P1, true); ... }   // also timed on the GPU
+//   profiler.EndFrame();
+//
+// CPU zones may nest and may be entered several times a frame (times add up).
+// GL_TIME_ELAPSED queries can't nest, so a GPU zone opened inside another one is
+// only timed on the CPU. Query results are read PROFILE_GPU_LATENCY frames later,
+// when they are ready, so reading them never stalls the pipeline.
+
+#pragma once
+
+#include "ui_batch.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cstdio>
+
+enum ProfileZone {
+	PROF_FRAME,
+	PROF_PACING,
+	PROF_INPUT,
+	PROF_SIM,
+	PROF_POSE,
+	PROF_BONE_UPLOAD,
+	PROF_DRAW_P1,
+	PROF_DRAW_P2,
+	PROF_DRAW_CROWD,
+	PROF_DRAW_STAGE,
+	PROF_DRAW_SKYBOX,
+	PROF_UI,
+	PROF_SWAP,
+	PROF_ZONE_COUNT
+};
+
+const int PROFILE_HISTORY = 600;      // 10 s at 60 fps
+const int PROFILE_GPU_LATENCY = 4;    // frames between issuing a query and reading it
+const float PROFILE_BUDGET_MS = 1000.0f / 60.0f;
+
+inline const char* ProfileZoneName(ProfileZone zone)
+{
+	switch (zone)
+	{
+	case PROF_FRAME:        return "frame";
+	case PROF_PACING:       return "pacing";
+	case PROF_INPUT:        return "input";
+	case PROF_SIM:          return "sim";
+	case PROF_POSE:         return "pose";
+	case PROF_BONE_UPLOAD:  return "bone upload";
+	case PROF_DRAW_P1:      return "draw P1";
+	case PROF_DRAW_P2:      return "draw P2";
+	case PROF_DRAW_CROWD:   return "draw crowd";
+	case PROF_DRAW_STAGE:   return "draw stage";
+	case PROF_DRAW_SKYBOX:  return "draw skybox";
+	case PROF_UI:           return "ui";
+	case PROF_SWAP:         return "swap";
+	default:                return "?";
+	}
+}
+
+// HUD colors, also listed in the README
+inline glm::vec3 ProfileZoneColor(ProfileZone zone)
+{
+	switch (zone)
+	{
+	case PROF_PACING:       return glm::vec3(0.1f, 0.1f, 0.4f);
+	case PROF_INPUT:        return glm::vec3(0.6f, 0.6f, 0.6f);
+	case PROF_SIM:          return glm::vec3(1.0f, 0.5f, 0.0f);
+	case PROF_POSE:         return glm::vec3(1.0f, 1.0f, 0.0f);
+	case PROF_BONE_UPLOAD:  return glm::vec3(1.0f, 0.0f, 1.0f);
+	case PROF_DRAW_P1:      return glm::vec3(0.0f, 0.8f, 0.0f);
+	case PROF_DRAW_P2:      return glm::vec3(0.9f, 0.1f, 0.1f);
+	case PROF_DRAW_CROWD:   return glm::vec3(0.0f, 0.8f, 0.8f);
+	case PROF_DRAW_STAGE:   return glm::vec3(0.6f, 0.4f, 0.1f);
+	case PROF_DRAW_SKYBOX:  return glm::vec3(0.2f, 0.5f, 1.0f);
+	case PROF_UI:           return glm::vec3(1.0f, 1.0f, 1.0f);
+	case PROF_SWAP:         return glm::vec3(0.3f, 0.3f, 0.3f);
+	default:                return glm::vec3(0.5f);
+	}
+}
+
+struct ProfileFrame {
+	unsigned long long index;
+	double start;                       // microseconds since Init()
+	float cpuStart[PROF_ZONE_COUNT];    // microseconds from the frame start, -1 = not entered
+	float cpuTime[PROF_ZONE_COUNT];     // microseconds
+	float gpuTime[PROF_ZONE_COUNT];     // microseconds, -1 = not timed (yet)
+};
+
+class Profiler
+{
+public:
+	// gpuTimers needs a current GL 3.3 context. A profiler on another thread of the
+	// same frame passes the first one as 'sameClock', so their traces line up.
+	void Init(bool gpuTimers, const Profiler* sameClock = NULL)
+	{
+		origin = sameClock ? sameClock->origin : std::chrono::steady_clock::now();
+		gpu = gpuTimers;
+		if (gpu)
+		{
+			glGenQueries(PROFILE_GPU_LATENCY * PROF_ZONE_COUNT, &queries[0][0]);
+			for (int slot = 0; slot < PROFILE_GPU_LATENCY; ++slot)
+				for (int z = 0; z < PROF_ZONE_COUNT; ++z)
+					issued[slot][z] = false;
+		}
+	}
+
+	void Release()
+	{
+		if (gpu)
+			glDeleteQueries(PROFILE_GPU_LATENCY * PROF_ZONE_COUNT, &queries[0][0]);
+		gpu = false;
+	}
+
+	void BeginFrame()
+	{
+		ProfileFrame& f = frames[frameCount % PROFILE_HISTORY];
+		f.index = frameCount;
+		f.start = Now();
+		for (int z = 0; z < PROF_ZONE_COUNT; ++z)
+		{
+			f.cpuStart[z] = -1.0f;
+			f.cpuTime[z] = 0.0f;
+			f.gpuTime[z] = -1.0f;
+		}
+		zoneStart[PROF_FRAME] = f.start;
+		f.cpuStart[PROF_FRAME] = 0.0f;
+
+		if (gpu)
+			CollectQueries(frameCount % PROFILE_GPU_LATENCY);
+	}
+
+	void EndFrame()
+	{
+		ProfileFrame& f = Current();
+		f.cpuTime[PROF_FRAME] = (float)(Now() - zoneStart[PROF_FRAME]);
+		++frameCount;
+	}
+
+	void BeginZone(ProfileZone zone, bool gpuZone)
+	{
+		ProfileFrame& f = Current();
+		double now = Now();
+		zoneStart[zone] = now;
+		if (f.cpuStart[zone] < 0.0f)
+			f.cpuStart[zone] = (float)(now - f.start);
+
+		if (gpu && gpuZone && activeGpuZone < 0)
+		{
+			int slot = (int)(frameCount % PROFILE_GPU_LATENCY);
+			if (!issued[slot][zone])
+			{
+				glBeginQuery(GL_TIME_ELAPSED, queries[slot][zone]);
+				issued[slot][zone] = true;
+				activeGpuZone = zone;
+			}
+		}
+	}
+
+	void EndZone(ProfileZone zone)
+	{
+		if (activeGpuZone == zone)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			activeGpuZone = -1;
+		}
+		Current().cpuTime[zone] += (float)(Now() - zoneStart[zone]);
+	}
+
+	// frames recorded so far, capped at PROFILE_HISTORY
+	int FrameCount() const { return frameCount < PROFILE_HISTORY ? (int)frameCount : PROFILE_HISTORY; }
+
+	// 0 = the last finished frame
+	const ProfileFrame& Frame(int ago) const { return frames[(frameCount - 1 - ago) % PROFILE_HISTORY]; }
+
+	// ----------------------------------------------------------------------------
+	// output
+	// ----------------------------------------------------------------------------
+
+	// Frame time history and a per-zone breakdown, bottom-left in screen pixels.
+	// Top bar: CPU of the last frame, one colored segment per zone. Bar below: GPU
+	// of the newest frame whose queries are back. Both are scaled so the thin white
+	// marker is the 16.6 ms budget. Under them, one column per frame for the last
+	// 'columns' frames, red when a frame went over budget.
+	void DrawHud(UIBatch& ui, float x, float y, int columns) const
+	{
+		const float budgetWidth = 400.0f;
+		const float pxPerUs = budgetWidth / (PROFILE_BUDGET_MS * 1000.0f);
+		const float barHeight = 10.0f;
+		const float graphHeight = 60.0f;
+		if (FrameCount() == 0)
+			return;
+
+		// backdrop
+		ui.AddQuad(x - 5.0f, y - 5.0f, budgetWidth * 1.5f + 10.0f, graphHeight + 2.0f * barHeight + 25.0f, glm::vec3(0.0f));
+
+		float barY = y + graphHeight + 10.0f;
+		const ProfileFrame& last = Frame(0);
+		float cx = x;
+		for (int z = PROF_FRAME + 1; z < PROF_ZONE_COUNT; ++z)
+		{
+			float w = last.cpuTime[z] * pxPerUs;
+			ui.AddQuad(cx, barY + barHeight + 2.0f, w, barHeight, ProfileZoneColor((ProfileZone)z));
+			cx += w;
+		}
+
+		for (int ago = 0; ago < FrameCount(); ++ago)
+		{
+			const ProfileFrame& f = Frame(ago);
+			if (f.gpuTime[PROF_DRAW_P1] < 0.0f && f.gpuTime[PROF_UI] < 0.0f)
+				continue;
+			float gx = x;
+			for (int z = PROF_FRAME + 1; z < PROF_ZONE_COUNT; ++z)
+			{
+				if (f.gpuTime[z] <= 0.0f)
+					continue;
+				float w = f.gpuTime[z] * pxPerUs;
+				ui.AddQuad(gx, barY, w, barHeight, ProfileZoneColor((ProfileZone)z));
+				gx += w;
+			}
+			break;
+		}
+
+		// budget marker through both bars
+		ui.AddQuad(x + budgetWidth, barY - 2.0f, 2.0f, 2.0f * barHeight + 6.0f, glm::vec3(1.0f));
+
+		// history graph, newest on the right; the budget is at 2/3 of its height
+		int count = columns < FrameCount() ? columns : FrameCount();
+		float columnWidth = budgetWidth * 1.5f / columns;
+		float pxPerUsGraph = graphHeight * (2.0f / 3.0f) / (PROFILE_BUDGET_MS * 1000.0f);
+		for (int ago = 0; ago < count; ++ago)
+		{
+			const ProfileFrame& f = Frame(ago);
+			float h = glm::min(f.cpuTime[PROF_FRAME] * pxPerUsGraph, graphHeight);
+			bool over = f.cpuTime[PROF_FRAME] > PROFILE_BUDGET_MS * 1000.0f;
+			ui.AddQuad(x + (columns - 1 - ago) * columnWidth, y, columnWidth - 1.0f, h,
+				over ? glm::vec3(1.0f, 0.2f, 0.2f) : glm::vec3(0.2f, 0.8f, 0.2f));
+		}
+		ui.AddQuad(x, y + graphHeight * (2.0f / 3.0f), budgetWidth * 1.5f, 1.0f, glm::vec3(1.0f));
+	}
+
+	// average / worst per zone over the frames in the ring
+	void PrintSummary() const
+	{
+		int count = FrameCount();
+		if (count == 0)
+			return;
+		printf("profile of the last %d frames (ms)   cpu avg   cpu max   gpu avg   gpu max\n", count);
+		for (int z = 0; z < PROF_ZONE_COUNT; ++z)
+		{
+			double cpuSum = 0.0, gpuSum = 0.0;
+			float cpuMax = 0.0f, gpuMax = 0.0f;
+			int gpuCount = 0;
+			for (int ago = 0; ago < count; ++ago)
+			{
+				const ProfileFrame& f = Frame(ago);
+				cpuSum += f.cpuTime[z];
+				cpuMax = glm::max(cpuMax, f.cpuTime[z]);
+				if (f.gpuTime[z] >= 0.0f)
+				{
+					gpuSum += f.gpuTime[z];
+					gpuMax = glm::max(gpuMax, f.gpuTime[z]);
+					++gpuCount;
+				}
+			}
+			printf("  %-32s %9.3f %9.3f", ProfileZoneName((ProfileZone)z), cpuSum / count / 1000.0, cpuMax / 1000.0f);
+			if (gpuCount)
+				printf(" %9.3f %9.3f", gpuSum / gpuCount / 1000.0, gpuMax / 1000.0f);
+			printf("\n");
+		}
+	}
+
+	// Chrome trace event format, one complete ("X") event per zone per frame. CPU zones
+	// are thread 1. GPU zones are thread 2, placed at the time they were submitted
+	// (GL_TIME_ELAPSED gives a duration, not a GPU timestamp). 'renderThread', the
+	// profiler of a separate render thread sharing this one's clock, adds its CPU
+	// zones as thread 3 and its GPU zones to thread 2.
+	bool WriteChromeTrace(const char* path, const Profiler* renderThread = NULL) const
+	{
+		FILE* file = fopen(path, "w");
+		if (!file)
+		{
+			printf("ERROR::PROFILER:: could not write %s\n", path);
+			return false;
+		}
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+		if (renderThread)
+			fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"render thread\"}}");
+		WriteTraceEvents(file, 1);
+		if (renderThread)
+			renderThread->WriteTraceEvents(file, 3);
+		fprintf(file, "\n]}\n");
+		return fclose(file) == 0;
+	}
+
+private:
+	// this profiler's zones, CPU ones as thread 'cpuThread'
+	void WriteTraceEvents(FILE* file, int cpuThread) const
+	{
+		for (int ago = FrameCount() - 1; ago >= 0; --ago)
+		{
+			const ProfileFrame& f = Frame(ago);
+			for (int z = 0; z < PROF_ZONE_COUNT; ++z)
+			{
+				if (f.cpuStart[z] < 0.0f)
+					continue;
+				double ts = f.start + f.cpuStart[z];
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+					ProfileZoneName((ProfileZone)z), cpuThread, ts, f.cpuTime[z], f.index);
+				if (f.gpuTime[z] >= 0.0f)
+					fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+						ProfileZoneName((ProfileZone)z), ts, f.gpuTime[z], f.index);
+			}
+		}
+	}
+
+	ProfileFrame& Current() { return frames[frameCount % PROFILE_HISTORY]; }
+
+	double Now() const
+	{
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	// reads the queries issued PROFILE_GPU_LATENCY frames ago into that frame's record
+	void CollectQueries(int slot)
+	{
+		unsigned long long issuedFrame = frameCount - PROFILE_GPU_LATENCY;
+		bool inRing = frameCount >= PROFILE_GPU_LATENCY;
+		for (int z = 0; z < PROF_ZONE_COUNT; ++z)
+		{
+			if (!issued[slot][z])
+				continue;
+			issued[slot][z] = false;
+
+			GLint available = 0;
+			glGetQueryObjectiv(queries[slot][z], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available || !inRing)
+				continue;   // still not back after several frames: drop it rather than wait
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(queries[slot][z], GL_QUERY_RESULT, &ns);
+			frames[issuedFrame % PROFILE_HISTORY].gpuTime[z] = (float)(ns / 1000.0);
+		}
+	}
+
+	std::chrono::steady_clock::time_point origin;
+	ProfileFrame frames[PROFILE_HISTORY];
+	unsigned long long frameCount = 0;
+	double zoneStart[PROF_ZONE_COUNT];
+
+	bool gpu = false;
+	GLuint queries[PROFILE_GPU_LATENCY][PROF_ZONE_COUNT];
+	bool issued[PROFILE_GPU_LATENCY][PROF_ZONE_COUNT];
+	int activeGpuZone = -1;
+};
+
+// times the enclosing block; gpuZone also times it with a GL query
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler& profiler, ProfileZone zone, bool gpuZone = false) : profiler(profiler), zone(zone)
+	{
+		profiler.BeginZone(zone, gpuZone);
+	}
+
+	~ProfileScope() { profiler.EndZone(zone); }
+
+private:
+	ProfileScope(const ProfileScope&);
+	ProfileScope& operator=(const ProfileScope&);
+
+	Profiler& profiler;
+	ProfileZone zone;
+};
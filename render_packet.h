@@ -0,0 +1,70 @@
+// render_packet.h
+//
+// Everything one frame draws, built by the sim side of the loop and drawn by the
+// render side, on another thread with --render-thread (render_queue.h). Once
+// submitted the builder doesn't touch it again, so the render side reads it with
+// no locks:
+//
+//   camera     viewport, projection and view
+//   fighters   each one's model matrix and skinning palette
+//   crowd      every spectator's pose, carved from the packet's FrameArena
+//   HUD        the HP bar quads. The profiler overlay is added by the render side,
+//              which owns the profiler it shows
+//
+// The fighters' palettes are copies: blend_tree.h's inertialization reads the pose
+// it drew last, so the sim side keeps its own and copies it in.
+
+#pragma once
+
+#include "frame_arena.h"
+#include "pose_cache.h"
+#include "ui_batch.h"
+
+#include <glm/glm.hpp>
+
+#include <cstring>
+
+const int MAX_HUD_QUADS = 16;
+
+struct RenderPacket {
+	unsigned long long frame = 0;
+	int viewportWidth = 0;
+	int viewportHeight = 0;
+	glm::mat4 projection;
+	glm::mat4 view;
+
+	glm::mat4 fighterModels[2];
+	glm::mat4 fighterPoses[2][MAX_BONES];
+	int fighterBones[2] = { 0, 0 };
+
+	const glm::mat4* crowdPoses[2] = { NULL, NULL };   // CrowdPoses layout, in 'arena'
+	int crowdCount[2] = { 0, 0 };
+
+	UIQuad hud[MAX_HUD_QUADS];
+	int hudCount = 0;
+	bool showProfiler = false;
+
+	FrameArena arena;
+
+	// starts a new frame in this slot
+	void Reset(unsigned long long frameIndex)
+	{
+		frame = frameIndex;
+		arena.Reset();
+		crowdPoses[0] = crowdPoses[1] = NULL;
+		crowdCount[0] = crowdCount[1] = 0;
+		hudCount = 0;
+	}
+
+	void SetFighterPose(int fighter, const glm::mat4* pose, int bones)
+	{
+		fighterBones[fighter] = bones < MAX_BONES ? bones : MAX_BONES;
+		memcpy(fighterPoses[fighter], pose, sizeof(glm::mat4) * fighterBones[fighter]);
+	}
+
+	void AddHud(const UIQuad& quad)
+	{
+		if (hudCount < MAX_HUD_QUADS)
+			hud[hudCount++] = quad;
+	}
+};
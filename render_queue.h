@@ -0,0 +1,125 @@
+// render_queue.h
+//
+// Hands whole frames from the thread that builds them to the thread that draws
+// them:
+//
+//   TripleBuffer<T>   three slots: the producer writes the back one, the consumer
+//                     reads the front one, and the middle one is the latest finished
+//                     frame. Publishing and taking are each one atomic exchange of the
+//                     middle index, so neither side ever waits on the other or sees a
+//                     half-written slot. A frame published before the last one was
+//                     taken replaces it: the consumer always gets the newest
+//   FrameQueue<T>     a TripleBuffer plus the waiting around it. Begin() holds the
+//                     producer until the consumer has taken the previous frame, so it
+//                     runs at most one frame ahead instead of building frames nobody
+//                     draws. Take() sleeps until there is a frame or Stop() is called.
+//                     The waits use a mutex and condition variable. The frames
+//                     themselves never pass through the lock
+//
+//   producer                          consumer
+//   T& frame = queue.Begin();         while (queue.Take())
+//   ...fill frame...                      Draw(queue.Front());
+//   queue.Submit();
+//
+// With one thread, Submit() and then Take() run the same path with no waits.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+	// producer side
+	T& Back() { return slots[back]; }
+
+	// makes Back() the latest frame and hands the producer a free slot
+	void Publish()
+	{
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// consumer side: true if a frame was published since the last Acquire(); Front()
+	// is then that frame
+	bool Acquire()
+	{
+		if (!(middle.load(std::memory_order_acquire) & FRESH))
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	const T& Front() const { return slots[front]; }
+
+	// a published frame the consumer hasn't taken yet
+	bool Pending() const { return (middle.load(std::memory_order_acquire) & FRESH) != 0; }
+
+private:
+	static const int INDEX = 3;
+	static const int FRESH = 4;
+
+	T slots[3];
+	int back = 0;
+	int front = 1;
+	std::atomic<int> middle{ 2 };
+};
+
+template <typename T>
+class FrameQueue
+{
+public:
+	// The slot to build the next frame in. Waits while the consumer still hasn't
+	// taken the last one; returns at once after Stop().
+	T& Begin()
+	{
+		if (buffer.Pending() && !stopped.load(std::memory_order_acquire))
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taken.wait(lock, [this] { return !buffer.Pending() || stopped.load(std::memory_order_acquire); });
+		}
+		return buffer.Back();
+	}
+
+	void Submit()
+	{
+		buffer.Publish();
+		std::lock_guard<std::mutex> lock(mutex);
+		published.notify_one();
+	}
+
+	// Waits for a frame and makes it Front(). False once Stop() has been called.
+	bool Take()
+	{
+		if (!buffer.Acquire())
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			published.wait(lock, [this] { return buffer.Pending() || stopped.load(std::memory_order_acquire); });
+			if (!buffer.Acquire())
+				return false;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		taken.notify_one();
+		return true;
+	}
+
+	const T& Front() const { return buffer.Front(); }
+
+	// wakes both sides for good
+	void Stop()
+	{
+		stopped.store(true, std::memory_order_release);
+		std::lock_guard<std::mutex> lock(mutex);
+		published.notify_all();
+		taken.notify_all();
+	}
+
+private:
+	TripleBuffer<T> buffer;
+	std::mutex mutex;
+	std::condition_variable published;
+	std::condition_variable taken;
+	std::atomic<bool> stopped{ false };
+};
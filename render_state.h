@@ -0,0 +1,292 @@
+// render_state.h
+//
+// A shadow copy of the GL state the frame loop changes, so a call that would set
+// what is already set never reaches the driver:
+//
+//   RenderState      glUseProgram, glEnable / glDisable, glDepthFunc, glBindVertexArray
+//                    and glActiveTexture + glBindTexture. Counts, per kind, the calls
+//                    issued and the ones elided
+//   ShaderUniforms   one program's uniform locations, looked up once after linking
+//                    instead of by name on every set. Remembers the last value set at
+//                    each, so setting the same projection every frame is elided too
+//
+//   RenderState state;
+//   ShaderUniforms uniforms;
+//   uniforms.Init(shader.ID);
+//   uniforms.SetMat4(state, UNIFORM_VIEW, view);    // binds the program if needed
+//   state.BindVertexArray(vao);
+//   state.EndFrame();
+//   state.PrintSummary();                           // issued / elided per frame
+//
+// The shadow starts out unknown, so every first call is issued. Code that changes
+// tracked state behind the tracker's back (asset uploads, Init() functions) must be
+// followed by Invalidate(). Draws don't unbind their vertex array or textures
+// afterwards: the next bind is what counts, and an unbind is one more call per draw.
+
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+enum RenderCall {
+	CALL_USE_PROGRAM,
+	CALL_CAPABILITY,        // glEnable / glDisable
+	CALL_DEPTH_FUNC,
+	CALL_BIND_VERTEX_ARRAY,
+	CALL_ACTIVE_TEXTURE,
+	CALL_BIND_TEXTURE,
+	CALL_UNIFORM,
+	CALL_KIND_COUNT
+};
+
+inline const char* RenderCallName(RenderCall call)
+{
+	switch (call)
+	{
+	case CALL_USE_PROGRAM:        return "glUseProgram";
+	case CALL_CAPABILITY:         return "glEnable/glDisable";
+	case CALL_DEPTH_FUNC:         return "glDepthFunc";
+	case CALL_BIND_VERTEX_ARRAY:  return "glBindVertexArray";
+	case CALL_ACTIVE_TEXTURE:     return "glActiveTexture";
+	case CALL_BIND_TEXTURE:       return "glBindTexture";
+	case CALL_UNIFORM:            return "glUniform*";
+	default:                      return "?";
+	}
+}
+
+class RenderState
+{
+public:
+	static const int TEXTURE_UNITS = 4;   // units past this are passed straight through
+
+	RenderState()
+	{
+		Invalidate();
+		memset(issued, 0, sizeof(issued));
+		memset(elided, 0, sizeof(elided));
+	}
+
+	// forget everything; the next call of each kind is issued
+	void Invalidate()
+	{
+		program = UNKNOWN;
+		vertexArray = UNKNOWN;
+		depthFunc = UNKNOWN;
+		activeUnit = UNKNOWN;
+		for (int c = 0; c < CAPABILITY_COUNT; ++c)
+			enabled[c] = -1;
+		for (int u = 0; u < TEXTURE_UNITS; ++u)
+			for (int t = 0; t < TARGET_COUNT; ++t)
+				textures[u][t] = UNKNOWN;
+	}
+
+	void UseProgram(GLuint id)
+	{
+		if (Elide(CALL_USE_PROGRAM, program == id))
+			return;
+		glUseProgram(id);
+		program = id;
+	}
+
+	GLuint Program() const { return program; }
+
+	void SetEnabled(GLenum capability, bool on)
+	{
+		int c = CapabilityIndex(capability);
+		if (Elide(CALL_CAPABILITY, c >= 0 && enabled[c] == (int)on))
+			return;
+		if (on)
+			glEnable(capability);
+		else
+			glDisable(capability);
+		if (c >= 0)
+			enabled[c] = on;
+	}
+
+	void DepthFunc(GLenum func)
+	{
+		if (Elide(CALL_DEPTH_FUNC, depthFunc == func))
+			return;
+		glDepthFunc(func);
+		depthFunc = func;
+	}
+
+	void BindVertexArray(GLuint vao)
+	{
+		if (Elide(CALL_BIND_VERTEX_ARRAY, vertexArray == vao))
+			return;
+		glBindVertexArray(vao);
+		vertexArray = vao;
+	}
+
+	// glBindTexture on 'unit', with the glActiveTexture it needs only when it needs it
+	void BindTexture(int unit, GLenum target, GLuint texture)
+	{
+		int t = TargetIndex(target);
+		bool tracked = unit >= 0 && unit < TEXTURE_UNITS && t >= 0;
+		if (Elide(CALL_BIND_TEXTURE, tracked && textures[unit][t] == texture))
+			return;
+		if (!Elide(CALL_ACTIVE_TEXTURE, activeUnit == (GLuint)unit))
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			activeUnit = unit;
+		}
+		glBindTexture(target, texture);
+		if (tracked)
+			textures[unit][t] = texture;
+	}
+
+	// counted for ShaderUniforms, which issues the glUniform calls itself
+	bool ElideUniform(bool same) { return Elide(CALL_UNIFORM, same); }
+
+	void EndFrame() { ++frames; }
+
+	unsigned long long Issued(RenderCall call) const { return issued[call]; }
+	unsigned long long Elided(RenderCall call) const { return elided[call]; }
+
+	void PrintSummary() const
+	{
+		if (frames == 0)
+			return;
+		printf("GL state calls over %llu frames (per frame)   issued    elided\n", frames);
+		for (int k = 0; k < CALL_KIND_COUNT; ++k)
+			printf("  %-36s %9.1f %9.1f\n", RenderCallName((RenderCall)k), (double)issued[k] / frames, (double)elided[k] / frames);
+	}
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+	static const int CAPABILITY_COUNT = 3;
+	static const int TARGET_COUNT = 3;
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint depthFunc;
+	GLuint activeUnit;
+	int enabled[CAPABILITY_COUNT];   // -1 = unknown
+	GLuint textures[TEXTURE_UNITS][TARGET_COUNT];
+	unsigned long long issued[CALL_KIND_COUNT];
+	unsigned long long elided[CALL_KIND_COUNT];
+	unsigned long long frames = 0;
+
+	bool Elide(RenderCall call, bool same)
+	{
+		if (same)
+			++elided[call];
+		else
+			++issued[call];
+		return same;
+	}
+
+	static int CapabilityIndex(GLenum capability)
+	{
+		switch (capability)
+		{
+		case GL_DEPTH_TEST:  return 0;
+		case GL_BLEND:       return 1;
+		case GL_CULL_FACE:   return 2;
+		default:             return -1;
+		}
+	}
+
+	static int TargetIndex(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_TEXTURE_2D:        return 0;
+		case GL_TEXTURE_CUBE_MAP:  return 1;
+		case GL_TEXTURE_BUFFER:    return 2;
+		default:                   return -1;
+		}
+	}
+};
+
+// ----------------------------------------------------------------------------
+// uniforms
+// ----------------------------------------------------------------------------
+
+// Every plain uniform the game's shaders declare. A program that lacks one gets
+// location -1 for it, and sets to it are elided.
+enum UniformId {
+	UNIFORM_PROJECTION,
+	UNIFORM_VIEW,
+	UNIFORM_MODEL,
+	UNIFORM_COLOR_TINT,
+	UNIFORM_BONE_PALETTES,
+	UNIFORM_BONES_PER_INSTANCE,
+	UNIFORM_COUNT
+};
+
+inline const char* UniformName(UniformId id)
+{
+	switch (id)
+	{
+	case UNIFORM_PROJECTION:          return "projection";
+	case UNIFORM_VIEW:                return "view";
+	case UNIFORM_MODEL:               return "model";
+	case UNIFORM_COLOR_TINT:          return "colorTint";
+	case UNIFORM_BONE_PALETTES:       return "bonePalettes";
+	case UNIFORM_BONES_PER_INSTANCE:  return "bonesPerInstance";
+	default:                          return "?";
+	}
+}
+
+class ShaderUniforms
+{
+public:
+	// 'program' must be linked
+	void Init(GLuint program)
+	{
+		id = program;
+		for (int u = 0; u < UNIFORM_COUNT; ++u)
+		{
+			locations[u] = glGetUniformLocation(program, UniformName((UniformId)u));
+			known[u] = false;
+		}
+	}
+
+	GLuint Program() const { return id; }
+	bool Has(UniformId u) const { return locations[u] >= 0; }
+
+	void SetMat4(RenderState& state, UniformId u, const glm::mat4& value)
+	{
+		if (Same(state, u, glm::value_ptr(value), sizeof(value)))
+			return;
+		glUniformMatrix4fv(locations[u], 1, GL_FALSE, glm::value_ptr(value));
+	}
+
+	void SetVec3(RenderState& state, UniformId u, const glm::vec3& value)
+	{
+		if (Same(state, u, glm::value_ptr(value), sizeof(value)))
+			return;
+		glUniform3fv(locations[u], 1, glm::value_ptr(value));
+	}
+
+	void SetInt(RenderState& state, UniformId u, int value)
+	{
+		if (Same(state, u, &value, sizeof(value)))
+			return;
+		glUniform1i(locations[u], value);
+	}
+
+private:
+	GLuint id = 0;
+	GLint locations[UNIFORM_COUNT];
+	bool known[UNIFORM_COUNT];
+	float values[UNIFORM_COUNT][16];   // the last value set, as raw bytes
+
+	// true when the set can be skipped; otherwise binds the program and records the value
+	bool Same(RenderState& state, UniformId u, const void* value, size_t size)
+	{
+		bool same = locations[u] < 0 || (known[u] && memcmp(values[u], value, size) == 0);
+		if (state.ElideUniform(same))
+			return true;
+		state.UseProgram(id);
+		memcpy(values[u], value, size);
+		known[u] = true;
+		return false;
+	}
+};
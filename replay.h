@@ -0,0 +1,280 @@
+// replay.h
+//
+// Match recordings. The sim is deterministic, so a match is fully described by
+// the tables it ran with and both players' packed inputs (PackInput, 9 bits each)
+// for every tick since InitMatch(). Buttons are held for many ticks at a time, so
+// the ticks are stored run-length encoded:
+//
+//   header   "LHRP", then little-endian uint32s:
+//            version, assetHash, seed, tickCount, runCount, finalChecksum
+//   runs     runCount x { varint ticks, uint16 p1 buttons, uint16 p2 buttons }
+//
+// assetHash is ReplayAssetHash() of the match the recording was made with: the
+// move table, both clip tables and both joint tables. A replay only re-simulates
+// to the same result against the same hash. seed is whatever generated the inputs
+// (self-play); 0 for human play. finalChecksum is ChecksumMatch() after the last
+// tick, which makes every archived replay a regression check.
+//
+// All little-endian byte by byte, like the rollback packets, so files move between
+// machines.
+
+#pragma once
+
+#include "match_sim.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// also bumped when a sim rule change makes old recordings play out differently
+const unsigned int REPLAY_VERSION = 6;
+const int REPLAY_HEADER_SIZE = 4 + 6 * 4;
+// runs a recording has room for before RecordTick() has to grow it mid-match: a new
+// input every tick for over four minutes, 128 KB
+const int REPLAY_RESERVED_RUNS = 16384;
+
+struct ReplayRun {
+	unsigned int ticks;
+	unsigned short buttons[2];
+};
+
+struct Replay {
+	unsigned int assetHash = 0;
+	unsigned int seed = 0;
+	unsigned int tickCount = 0;
+	unsigned int finalChecksum = 0;
+	std::vector<ReplayRun> runs;
+};
+
+// Everything outside MatchState that Step() reads. MoveTable, ClipTable and the
+// joint samples are made only of 4-byte ints and floats, so they have no padding to hash.
+inline unsigned int ReplayAssetHash(const MatchState& s)
+{
+	unsigned int hash = 2166136261u;
+	HashBytes(hash, s.moves, sizeof(MoveTable));
+	HashBytes(hash, s.clips[0], sizeof(ClipTable));
+	HashBytes(hash, s.clips[1], sizeof(ClipTable));
+	for (int i = 0; i < 2; ++i)
+	{
+		const JointTable* joints = s.joints[i];
+		if (!joints)
+			continue;
+		HashBytes(hash, joints->sampleCount, sizeof(joints->sampleCount));
+		HashBytes(hash, joints->firstSample, sizeof(joints->firstSample));
+		if (!joints->samples.empty())
+			HashBytes(hash, joints->samples.data(), joints->samples.size() * sizeof(JointPose));
+	}
+	return hash;
+}
+
+// ----------------------------------------------------------------------------
+// recording
+// ----------------------------------------------------------------------------
+
+// Append one tick. Call with exactly the inputs given to Step(), in order.
+inline void RecordTick(Replay& replay, const InputFrame& p1, const InputFrame& p2)
+{
+	unsigned short a = PackInput(p1);
+	unsigned short b = PackInput(p2);
+	replay.tickCount++;
+	if (!replay.runs.empty())
+	{
+		ReplayRun& last = replay.runs.back();
+		if (last.buttons[0] == a && last.buttons[1] == b)
+		{
+			last.ticks++;
+			return;
+		}
+	}
+	ReplayRun run = { 1, { a, b } };
+	replay.runs.push_back(run);
+}
+
+// Start a recording of 's', which must be right after InitMatch().
+inline void BeginReplay(Replay& replay, const MatchState& s, unsigned int seed)
+{
+	replay.assetHash = ReplayAssetHash(s);
+	replay.seed = seed;
+	replay.tickCount = 0;
+	replay.finalChecksum = 0;
+	replay.runs.clear();
+	replay.runs.reserve(REPLAY_RESERVED_RUNS);
+}
+
+// ----------------------------------------------------------------------------
+// file format
+// ----------------------------------------------------------------------------
+
+inline void ReplayPutU32(std::vector<unsigned char>& out, unsigned int v)
+{
+	for (int i = 0; i < 4; ++i)
+		out.push_back((unsigned char)(v >> (8 * i)));
+}
+
+inline bool ReplayGetU32(const unsigned char*& p, const unsigned char* end, unsigned int& v)
+{
+	if (end - p < 4)
+		return false;
+	v = p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+	p += 4;
+	return true;
+}
+
+inline void SerializeReplay(const Replay& replay, std::vector<unsigned char>& out)
+{
+	out.clear();
+	out.insert(out.end(), "LHRP", "LHRP" + 4);
+	ReplayPutU32(out, REPLAY_VERSION);
+	ReplayPutU32(out, replay.assetHash);
+	ReplayPutU32(out, replay.seed);
+	ReplayPutU32(out, replay.tickCount);
+	ReplayPutU32(out, (unsigned int)replay.runs.size());
+	ReplayPutU32(out, replay.finalChecksum);
+
+	for (const ReplayRun& run : replay.runs)
+	{
+		// 7 bits at a time, high bit = more follows; almost every run fits in one or two bytes
+		unsigned int ticks = run.ticks;
+		while (ticks >= 0x80)
+		{
+			out.push_back((unsigned char)(ticks | 0x80));
+			ticks >>= 7;
+		}
+		out.push_back((unsigned char)ticks);
+		for (int i = 0; i < 2; ++i)
+		{
+			out.push_back((unsigned char)run.buttons[i]);
+			out.push_back((unsigned char)(run.buttons[i] >> 8));
+		}
+	}
+}
+
+inline bool DeserializeReplay(const unsigned char* data, size_t size, Replay& replay)
+{
+	const unsigned char* p = data;
+	const unsigned char* end = data + size;
+	unsigned int version, runCount;
+	if (size < (size_t)REPLAY_HEADER_SIZE || memcmp(p, "LHRP", 4) != 0)
+		return false;
+	p += 4;
+	if (!ReplayGetU32(p, end, version) || version != REPLAY_VERSION ||
+		!ReplayGetU32(p, end, replay.assetHash) ||
+		!ReplayGetU32(p, end, replay.seed) ||
+		!ReplayGetU32(p, end, replay.tickCount) ||
+		!ReplayGetU32(p, end, runCount) ||
+		!ReplayGetU32(p, end, replay.finalChecksum))
+		return false;
+
+	// every run takes at least 5 bytes, which bounds runCount before reserving
+	if (runCount > (size_t)(end - p) / 5)
+		return false;
+	replay.runs.resize(runCount);
+
+	unsigned int total = 0;
+	for (ReplayRun& run : replay.runs)
+	{
+		run.ticks = 0;
+		for (int shift = 0; ; shift += 7)
+		{
+			if (p == end || shift > 28)
+				return false;
+			unsigned char byte = *p++;
+			run.ticks |= (unsigned int)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				break;
+		}
+		if (end - p < 4 || run.ticks == 0)
+			return false;
+		run.buttons[0] = (unsigned short)(p[0] | p[1] << 8);
+		run.buttons[1] = (unsigned short)(p[2] | p[3] << 8);
+		p += 4;
+		total += run.ticks;
+	}
+	return p == end && total == replay.tickCount;
+}
+
+inline bool SaveReplay(const std::string& path, const Replay& replay)
+{
+	std::vector<unsigned char> bytes;
+	SerializeReplay(replay, bytes);
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		printf("ERROR::REPLAY:: could not write %s\n", path.c_str());
+		return false;
+	}
+	bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		printf("ERROR::REPLAY:: could not write %s\n", path.c_str());
+	return ok;
+}
+
+inline bool LoadReplay(const std::string& path, Replay& replay)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		printf("ERROR::REPLAY:: could not open %s\n", path.c_str());
+		return false;
+	}
+	std::vector<unsigned char> bytes;
+	unsigned char chunk[4096];
+	size_t got;
+	while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		bytes.insert(bytes.end(), chunk, chunk + got);
+	fclose(file);
+
+	if (!DeserializeReplay(bytes.data(), bytes.size(), replay))
+	{
+		printf("ERROR::REPLAY:: %s is not a version %u replay\n", path.c_str(), REPLAY_VERSION);
+		return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// playback
+// ----------------------------------------------------------------------------
+
+// Walks a replay one tick at a time.
+struct ReplayCursor {
+	const Replay* replay = NULL;
+	size_t run = 0;
+	unsigned int tickInRun = 0;
+
+	explicit ReplayCursor(const Replay& r) : replay(&r) {}
+
+	bool Done() const { return run >= replay->runs.size(); }
+
+	// false once the recording is exhausted
+	bool Next(InputFrame& p1, InputFrame& p2)
+	{
+		if (Done())
+			return false;
+		const ReplayRun& current = replay->runs[run];
+		p1 = UnpackInput(current.buttons[0]);
+		p2 = UnpackInput(current.buttons[1]);
+		if (++tickInRun == current.ticks)
+		{
+			++run;
+			tickInRun = 0;
+		}
+		return true;
+	}
+};
+
+// Re-simulates the whole replay on 's', which must be freshly InitMatch()ed with the
+// same tables, and returns the final checksum (compare with replay.finalChecksum).
+inline unsigned int SimulateReplay(const Replay& replay, MatchState& s)
+{
+	for (const ReplayRun& run : replay.runs)
+	{
+		InputFrame p1 = UnpackInput(run.buttons[0]);
+		InputFrame p2 = UnpackInput(run.buttons[1]);
+		for (unsigned int t = 0; t < run.ticks; ++t)
+			Step(s, p1, p2);
+	}
+	return ChecksumMatch(s);
+}
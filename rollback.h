@@ -0,0 +1,476 @@
+// rollback.h
+//
+// GGPO-style rollback on top of match_sim.h. Every tick the local input is sent
+// to the peer and the simulation runs immediately with a *predicted* remote input
+// (the last one we actually received). When the real remote input for an already
+// simulated frame arrives and differs from the prediction, the session loads the
+// snapshot of that frame and re-simulates up to the present - at most
+// MAX_ROLLBACK_FRAMES Step() calls, which is a few microseconds.
+//
+// Transport is abstract: UdpTransport for real sessions, FakeTransport for an
+// in-process pair with injected delay, jitter and packet loss.
+
+#pragma once
+
+#include "match_sim.h"
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+const int MAX_ROLLBACK_FRAMES = 8;
+const int STATE_RING_SIZE = MAX_ROLLBACK_FRAMES + 2;
+const int INPUT_RING_SIZE = 64;
+const int MAX_PACKET_INPUTS = 32;
+
+// ----------------------------------------------------------------------------
+// transport
+// ----------------------------------------------------------------------------
+
+class Transport
+{
+public:
+	virtual ~Transport() {}
+	virtual void Send(const void* data, int size) = 0;
+	// copies one pending datagram into buffer, returns its size or 0 when nothing is pending
+	virtual int Receive(void* buffer, int capacity) = 0;
+};
+
+// In-process loopback. Packets are delayed by delayTicks (+ up to jitterTicks, which
+// also reorders them) and dropped with probability lossRate. Call Tick() once per frame.
+class FakeTransport : public Transport
+{
+public:
+	unsigned int delayTicks = 0;
+	unsigned int jitterTicks = 0;
+	float lossRate = 0.0f;
+
+	FakeTransport(unsigned int seed = 1) : rng(seed ? seed : 1) {}
+
+	static void Connect(FakeTransport& a, FakeTransport& b)
+	{
+		a.peer = &b;
+		b.peer = &a;
+	}
+
+	void Tick() { ++now; }
+
+	void Send(const void* data, int size) override
+	{
+		if (peer == NULL)
+			return;
+		if ((NextRandom() % 10000) < (unsigned int)(lossRate * 10000.0f))
+			return;
+
+		Packet packet;
+		packet.deliverAt = peer->now + delayTicks + (jitterTicks ? NextRandom() % (jitterTicks + 1) : 0);
+		packet.bytes.assign((const unsigned char*)data, (const unsigned char*)data + size);
+		peer->inbox.push_back(packet);
+	}
+
+	int Receive(void* buffer, int capacity) override
+	{
+		for (size_t i = 0; i < inbox.size(); ++i)
+		{
+			if (inbox[i].deliverAt > now)
+				continue;
+
+			int size = (int)inbox[i].bytes.size();
+			if (size > capacity)
+				size = capacity;
+			memcpy(buffer, inbox[i].bytes.data(), size);
+			inbox.erase(inbox.begin() + i);
+			return size;
+		}
+		return 0;
+	}
+
+private:
+	struct Packet {
+		unsigned int deliverAt;
+		std::vector<unsigned char> bytes;
+	};
+
+	FakeTransport* peer = NULL;
+	std::deque<Packet> inbox;
+	unsigned int now = 0;
+	unsigned int rng;
+
+	unsigned int NextRandom()
+	{
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng;
+	}
+};
+
+// Non-blocking IPv4 UDP socket talking to exactly one peer.
+class UdpTransport : public Transport
+{
+public:
+	~UdpTransport()
+	{
+		Close();
+	}
+
+	bool Open(unsigned short localPort, const char* remoteAddress, unsigned short remotePort)
+	{
+#ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+			return false;
+		started = true;
+#endif
+		sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (sock == INVALID_SOCK)
+			return false;
+
+		sockaddr_in local;
+		memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = htonl(INADDR_ANY);
+		local.sin_port = htons(localPort);
+		if (bind(sock, (sockaddr*)&local, sizeof(local)) != 0)
+		{
+			Close();
+			return false;
+		}
+
+#ifdef _WIN32
+		u_long nonBlocking = 1;
+		ioctlsocket(sock, FIONBIO, &nonBlocking);
+#else
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+		memset(&remote, 0, sizeof(remote));
+		remote.sin_family = AF_INET;
+		remote.sin_port = htons(remotePort);
+		if (inet_pton(AF_INET, remoteAddress, &remote.sin_addr) != 1)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close()
+	{
+		if (sock != INVALID_SOCK)
+		{
+#ifdef _WIN32
+			closesocket(sock);
+#else
+			close(sock);
+#endif
+			sock = INVALID_SOCK;
+		}
+#ifdef _WIN32
+		if (started)
+			WSACleanup();
+		started = false;
+#endif
+	}
+
+	void Send(const void* data, int size) override
+	{
+		sendto(sock, (const char*)data, size, 0, (const sockaddr*)&remote, sizeof(remote));
+	}
+
+	int Receive(void* buffer, int capacity) override
+	{
+		sockaddr_in from;
+		socklen_t fromSize = sizeof(from);
+		int size = (int)recvfrom(sock, (char*)buffer, capacity, 0, (sockaddr*)&from, &fromSize);
+		if (size <= 0)
+			return 0;
+		// ignore anything that isn't from our peer
+		if (from.sin_addr.s_addr != remote.sin_addr.s_addr || from.sin_port != remote.sin_port)
+			return 0;
+		return size;
+	}
+
+private:
+#ifdef _WIN32
+	typedef SOCKET socket_t;
+	static const socket_t INVALID_SOCK = INVALID_SOCKET;
+	bool started = false;
+#else
+	typedef int socket_t;
+	static const socket_t INVALID_SOCK = -1;
+#endif
+	socket_t sock = INVALID_SOCK;
+	sockaddr_in remote;
+};
+
+// ----------------------------------------------------------------------------
+// session
+// ----------------------------------------------------------------------------
+
+struct RollbackStats {
+	unsigned int rollbacks = 0;          // times a misprediction forced a reload
+	unsigned int framesResimulated = 0;
+	unsigned int maxRollbackDepth = 0;
+	unsigned int stalls = 0;             // AdvanceFrame calls refused because prediction ran too far ahead
+	unsigned int checksumsCompared = 0;
+	unsigned int desyncs = 0;
+};
+
+class RollbackSession
+{
+public:
+	RollbackStats stats;
+
+	RollbackSession(Transport& transport, int localPlayer, const MatchState& initial)
+		: transport(transport), localPlayer(localPlayer), state(initial)
+	{
+		memset(localInputs, 0, sizeof(localInputs));
+		memset(remoteInputs, 0, sizeof(remoteInputs));
+		memset(usedRemoteInputs, 0, sizeof(usedRemoteInputs));
+		for (int i = 0; i < INPUT_RING_SIZE; ++i)
+		{
+			localChecksumFrame[i] = -1;
+			remoteChecksumFrame[i] = -1;
+		}
+	}
+
+	const MatchState& State() const { return state; }
+
+	// every frame before this one was simulated with the real remote input
+	unsigned int ConfirmedFrame() const
+	{
+		unsigned int confirmed = (unsigned int)(lastRemoteFrame + 1);
+		return confirmed < state.frame ? confirmed : state.frame;
+	}
+
+	// checksum of our confirmed state at 'frame', if it is still in the history
+	bool ChecksumAt(int frame, unsigned int& checksum) const
+	{
+		if (frame < 0 || localChecksumFrame[frame % INPUT_RING_SIZE] != frame)
+			return false;
+		checksum = localChecksum[frame % INPUT_RING_SIZE];
+		return true;
+	}
+
+	// Advances one tick with the given local input. Returns false (and does not
+	// advance) when the remote has fallen more than MAX_ROLLBACK_FRAMES behind;
+	// the caller simply tries again next frame.
+	bool AdvanceFrame(const InputFrame& localInput)
+	{
+		Poll();
+
+		if (firstIncorrectFrame >= 0)
+		{
+			Rollback((unsigned int)firstIncorrectFrame);
+			firstIncorrectFrame = -1;
+		}
+		RecordConfirmedChecksum();
+
+		int frame = (int)state.frame;
+		if (frame - lastRemoteFrame > MAX_ROLLBACK_FRAMES)
+		{
+			++stats.stalls;
+			SendInputs();
+			return false;
+		}
+
+		localInputs[frame % INPUT_RING_SIZE] = PackInput(localInput);
+		lastLocalFrame = frame;
+		SendInputs();
+
+		SimulateFrame();
+		return true;
+	}
+
+private:
+	Transport& transport;
+	int localPlayer;
+	MatchState state;
+
+	MatchState snapshots[STATE_RING_SIZE];      // state at the start of frame f, in slot f % STATE_RING_SIZE
+	unsigned short localInputs[INPUT_RING_SIZE];
+	unsigned short remoteInputs[INPUT_RING_SIZE];
+	unsigned short usedRemoteInputs[INPUT_RING_SIZE]; // what the simulation actually ran with (real or predicted)
+
+	int lastLocalFrame = -1;
+	int lastRemoteFrame = -1;      // highest frame for which every remote input is known
+	int remoteAckedFrame = -1;     // highest local frame the peer has confirmed
+	int firstIncorrectFrame = -1;
+
+	// desync detection: checksums of confirmed frames, ours and the peer's
+	int localChecksumFrame[INPUT_RING_SIZE];
+	unsigned int localChecksum[INPUT_RING_SIZE];
+	int remoteChecksumFrame[INPUT_RING_SIZE];
+	unsigned int remoteChecksum[INPUT_RING_SIZE];
+	int lastChecksumFrame = -1;
+
+	unsigned short RemoteInputFor(int frame) const
+	{
+		if (frame <= lastRemoteFrame)
+			return remoteInputs[frame % INPUT_RING_SIZE];
+		// prediction: the remote keeps holding whatever it held last
+		if (lastRemoteFrame >= 0)
+			return remoteInputs[lastRemoteFrame % INPUT_RING_SIZE];
+		return 0;
+	}
+
+	void SimulateFrame()
+	{
+		int frame = (int)state.frame;
+		SaveState(state, snapshots[frame % STATE_RING_SIZE]);
+
+		unsigned short remote = RemoteInputFor(frame);
+		usedRemoteInputs[frame % INPUT_RING_SIZE] = remote;
+
+		InputFrame local = UnpackInput(localInputs[frame % INPUT_RING_SIZE]);
+		if (localPlayer == 0)
+			Step(state, local, UnpackInput(remote));
+		else
+			Step(state, UnpackInput(remote), local);
+	}
+
+	void Rollback(unsigned int frame)
+	{
+		unsigned int current = state.frame;
+		LoadState(state, snapshots[frame % STATE_RING_SIZE]);
+		while (state.frame < current)
+			SimulateFrame();
+
+		unsigned int depth = current - frame;
+		++stats.rollbacks;
+		stats.framesResimulated += depth;
+		if (depth > stats.maxRollbackDepth)
+			stats.maxRollbackDepth = depth;
+	}
+
+	void RecordConfirmedChecksum()
+	{
+		int confirmed = (int)ConfirmedFrame();
+		if (confirmed <= lastChecksumFrame)
+			return;
+
+		const MatchState& s = confirmed == (int)state.frame ? state : snapshots[confirmed % STATE_RING_SIZE];
+		localChecksumFrame[confirmed % INPUT_RING_SIZE] = confirmed;
+		localChecksum[confirmed % INPUT_RING_SIZE] = ChecksumMatch(s);
+		lastChecksumFrame = confirmed;
+		CompareChecksum(confirmed);
+	}
+
+	void CompareChecksum(int frame)
+	{
+		int slot = frame % INPUT_RING_SIZE;
+		if (localChecksumFrame[slot] != frame || remoteChecksumFrame[slot] != frame)
+			return;
+		++stats.checksumsCompared;
+		if (localChecksum[slot] != remoteChecksum[slot])
+			++stats.desyncs;
+	}
+
+	// packet layout (little endian):
+	//   int32 firstFrame, int32 ackFrame, int32 checksumFrame, uint32 checksum, uint8 count, uint16 inputs[count]
+	static void WriteU32(unsigned char*& p, unsigned int v)
+	{
+		p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8); p[2] = (unsigned char)(v >> 16); p[3] = (unsigned char)(v >> 24);
+		p += 4;
+	}
+
+	static unsigned int ReadU32(const unsigned char*& p)
+	{
+		unsigned int v = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+		p += 4;
+		return v;
+	}
+
+	void SendInputs()
+	{
+		if (lastLocalFrame < 0)
+			return;
+
+		int first = remoteAckedFrame + 1;
+		if (lastLocalFrame - first + 1 > MAX_PACKET_INPUTS)
+			first = lastLocalFrame - MAX_PACKET_INPUTS + 1;
+		int count = lastLocalFrame - first + 1;
+
+		unsigned char packet[17 + MAX_PACKET_INPUTS * 2];
+		unsigned char* p = packet;
+		WriteU32(p, (unsigned int)first);
+		WriteU32(p, (unsigned int)lastRemoteFrame);
+		WriteU32(p, (unsigned int)lastChecksumFrame);
+		WriteU32(p, lastChecksumFrame >= 0 ? localChecksum[lastChecksumFrame % INPUT_RING_SIZE] : 0);
+		*p++ = (unsigned char)count;
+		for (int f = first; f <= lastLocalFrame; ++f)
+		{
+			unsigned short bits = localInputs[f % INPUT_RING_SIZE];
+			*p++ = (unsigned char)bits;
+			*p++ = (unsigned char)(bits >> 8);
+		}
+		transport.Send(packet, (int)(p - packet));
+	}
+
+	void Poll()
+	{
+		unsigned char packet[17 + MAX_PACKET_INPUTS * 2];
+		int size;
+		while ((size = transport.Receive(packet, sizeof(packet))) > 0)
+		{
+			if (size < 17)
+				continue;
+
+			const unsigned char* p = packet;
+			int first = (int)ReadU32(p);
+			int ack = (int)ReadU32(p);
+			int checksumFrame = (int)ReadU32(p);
+			unsigned int checksum = ReadU32(p);
+			int count = *p++;
+			if (count > MAX_PACKET_INPUTS || size < 17 + count * 2)
+				continue;
+
+			if (ack > remoteAckedFrame)
+				remoteAckedFrame = ack;
+
+			if (checksumFrame >= 0)
+			{
+				remoteChecksumFrame[checksumFrame % INPUT_RING_SIZE] = checksumFrame;
+				remoteChecksum[checksumFrame % INPUT_RING_SIZE] = checksum;
+				CompareChecksum(checksumFrame);
+			}
+
+			for (int i = 0; i < count; ++i, p += 2)
+			{
+				int frame = first + i;
+				if (frame != lastRemoteFrame + 1)
+					continue;   // already have it, or a gap: it will be resent
+
+				unsigned short bits = (unsigned short)(p[0] | (p[1] << 8));
+				remoteInputs[frame % INPUT_RING_SIZE] = bits;
+				lastRemoteFrame = frame;
+
+				// we already simulated this frame on a guess; was the guess wrong?
+				if (frame < (int)state.frame && usedRemoteInputs[frame % INPUT_RING_SIZE] != bits)
+				{
+					if (firstIncorrectFrame < 0 || frame < firstIncorrectFrame)
+						firstIncorrectFrame = frame;
+				}
+			}
+		}
+	}
+};
@@ -10,12 +10,34 @@
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
-#include <learnopengl/animator.h>
 #include <learnopengl/model_animation.h>
 #include <glm/gtx/string_cast.hpp>
 
+#include "match_sim.h"
+#include "rollback.h"
+#include "replay.h"
+#include "pose_cache.h"
+#include "pose_bake.h"
+#include "bone_palette.h"
+#include "skinning.h"
+#include "ui_batch.h"
+#include "skinned_model.h"
+#include "job_system.h"
+#include "asset_loader.h"
+#include "profiler.h"
+#include "frame_pacer.h"
+#include "crowd.h"
+#include "frame_arena.h"
+#include "render_state.h"
+#include "render_packet.h"
+#include "render_queue.h"
+#include "clip_registry.h"
+#include "frame_build.h"
+
 
 #include <iostream>
+#include <cstring>
+#include <thread>
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -27,6 +49,11 @@ void processInput(GLFWwindow* window);
 const unsigned int SCR_WIDTH = 1000;
 const unsigned int SCR_HEIGHT = 800;
 
+// framebuffer size from the resize callback; the packet carries it to the thread
+// that draws, which sets the viewport
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
+
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = SCR_WIDTH / 2.0f;
@@ -36,25 +63,21 @@ bool firstMouse = true;
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
+float simAccumulator = 0.0f;
+const float MAX_FRAME_TIME = 0.25f; // don't try to catch up more than this after a stall
 
-// movement
-glm::vec3 charPosition_p1 = glm::vec3(0.0f, 0.0f, -2.0f);
-glm::vec3 charPosition_p2 = glm::vec3(0.0f, 0.0f, 2.0f);
-glm::vec3 charFront_p1 = glm::vec3(0.0f, 0.0f, 1.0f); // initial forward
-glm::vec3 charFront_p2 = glm::vec3(0.0f, 0.0f, -1.0f); // initial forward
-glm::vec3 charFrontTarget_p1 = glm::vec3(0.0f, 0.0f, 1.0f); // initial forward
-glm::vec3 charFrontTarget_p2 = glm::vec3(0.0f, 0.0f, 1.0f); // initial forward
-float charSpeed = 2.5f;
-
-float verticalVelocity_p1 = 0.0f;
-float verticalVelocity_p2 = 0.0f;
+// gameplay lives in match_sim.h; the window only feeds it input and draws the result
+MatchState match;
 
-bool isGrounded_p1 = true;
-bool isGrounded_p2 = true;
+// frame profiler (profiler.h); F3 toggles the overlay, the trace is written on exit
+Profiler profiler;
+bool showProfiler = false;
+bool profilerKeyHeld = false;
+const char* PROFILE_TRACE_PATH = "profile_trace.json";
 
-const float gravity = -10.0f;
-const float jumpForce = 6.0f;
-const float groundHeight = 0.0f; // your ground Y
+// heap allocations per frame, counted when built with -DTRACK_ALLOCATIONS (frame_arena.h);
+// the first two seconds load shaders into the driver and size the buffers
+AllocationWatch allocationWatch(120);
 
 // Hat Type
 enum HatType
@@ -65,38 +88,6 @@ enum HatType
 };
 HatType currentHatType = HatType::Ghost;
 
-
-enum AnimState {
-	IDLE = 1,
-	IDLE_PUNCH,
-	PUNCH_IDLE,
-	IDLE_CROUCH,
-	CROUCH_IDLE,
-	IDLE_WALK,
-	WALK_IDLE,
-	WALK,
-	CROUCH,
-
-	CROUCH_HIT,
-	HIT_CROUCH,
-
-	CROUCH_BLOCK,
-	BLOCK_CROUCH,
-
-	IDLE_BLOCK,
-	BLOCK_IDLE,
-
-	IDLE_HIT,
-	HIT_IDLE,
-
-	IDLE_JUMP,
-	JUMP_IDLE,
-	
-	IDLE_KICK,
-	KICK_IDLE
-
-};
-
 struct PlayerControls {
 	int moveLeft;
 	int moveRight;
@@ -133,15 +124,6 @@ PlayerControls P2_Controls = {
 	GLFW_KEY_3        // testHurt
 };
 
-enum AnimState P1_charState = IDLE;
-float P1_blendAmount = 0.0f;
-float P1_blendRate = 0.13f;
-
-
-enum AnimState P2_charState = IDLE;
-float P2_blendAmount = 0.0f;
-float P2_blendRate = 0.13f;
-
 // camera
 float cameraRadius = 10.0f;          // distance from model
 float orbitYaw = 0.0f;        // horizontal angle (degrees)
@@ -150,29 +132,6 @@ float smoothSpeed = 8.0f;  // higher = faster interpolation
 float targetYaw = orbitYaw;
 float targetPitch = orbitPitch;
 
-// Hit Distance
-const float MIN_Z = -5.0f;
-const float MAX_Z = 5.0f;
-
-float moveCollideDistanceOffset = 1.5f;
-float hitDistanceOffset = 2.5f;
-
-float P1_hitDelayTimer = 0.0f;
-float P2_hitDelayTimer = 0.0f;
-
-float P1_punchDelayTimer = 0.0f;
-float P2_punchDelayTimer = 0.0f;
-
-const float JUMPKICK_HIT_DELAY = 1.3f;         // your jump kick delay
-const float PUNCH_HIT_DELAY = 0.35f;   // new punch delay (tweak as you want)
-
-// Health
-float P1_HP = 100.0f;
-float P2_HP = 100.0f;
-
-float P1_MaxHP = 100.0f;
-float P2_MaxHP = 100.0f;
-
 unsigned int quadVAO = 0, quadVBO = 0;
 
 float skyboxVertices[] = {
@@ -258,13 +217,7 @@ unsigned int cubeIndices[] = {
 	6, 7, 3
 };
 
-// Freeze frame
-float hitStopTimer = 0.0f;      // remaining freeze time
-float hitStopDuration_hit = 0.24f;   // strong hit
-float hitStopDuration_block = 0.12f; // small block freeze
-
-// Camera Shake
-float cameraShakeTimer = 1.0f;
+// Camera Shake (the timer itself is match.cameraShakeTimer)
 float cameraShakeIntensity = 0.0f;
 float cameraMaxShakeIntensity = 0.5f; // fix intensity here
 
@@ -272,41 +225,76 @@ float shakeIntensity_hit = 0.5f;
 float shakeIntensity_block = 0.2f;
 float shakeDecaySpeed = 5.0f;
 
-void BridgeAnimation(Animator& animator, Animation& startAnim, Animation& endAnim, AnimState endState, float delayTime, float& blendAmount, float& blendRate, AnimState& charState);
-void UpdatePlayerAnimation(
-	GLFWwindow* window,
-	Animator& animator,
-	Animation& idleAnim,
-	Animation& walkAnim,
-	Animation& punchAnim,
-	Animation& crouchAnim,
-	Animation& crouchBlockAnim,
-	Animation& standBlockAnim,
-	Animation& standHitAnim,
-	Animation& jumpAnim,
-	Animation& jumpKickAnim,
-	AnimState& state,
-	float& blendAmount,
-	float blendRate,
-	const PlayerControls& controls,
-	const PlayerControls& victimControls,
-	glm::vec3 attackerPos,
-	glm::vec3 victimPos,
-	AnimState& victimState
-);
-
-void DrawBar(Shader& uiShader, float x, float y, float width, float height, float percent, const glm::vec3& color);
-
-unsigned int loadCubemap(vector<std::string> faces);
-
-bool CheckHit(const glm::vec3& attackerPos, const glm::vec3& victimPos, float hitDistanceOffset)
-{
-	float dist = glm::distance(attackerPos, victimPos);
-	return dist <= hitDistanceOffset;
-}
+InputFrame PollInput(GLFWwindow* window, const PlayerControls& controls);
+void FillClipTable(ClipTable& table, const ClipData clips[CLIP_COUNT]);
+float ShakeNoise(unsigned int frame, unsigned int axis);
+
+void DrawLoadingScreen(GLFWwindow* window, RenderState& state, Shader& uiShader, UIBatch& ui, float progress);
 
-int main()
+int main(int argc, char** argv)
 {
+	// command line: [--net <localPort> <remoteAddress> <remotePort> <1|2>] [--skinning mat4|3x4|dq]
+	//               [--record <file.lhrp>] [--replay <file.lhrp>]
+	//               [--present vsync|uncapped|limit:<hz>|late:<hz>] [--clip-error <units>]
+	//               [--crowd <spectators>] [--blend crossfade|inertial] [--render-thread]
+	//               [--clip-budget <MB>]
+	// ---------------------------------------------------------------------------------------------
+	SkinningMode skinningMode = SKIN_MAT4;
+	BlendMode blendMode = BLEND_CROSSFADE;
+	FramePacer pacer;
+	ClipCompression clipCompression;
+	int crowdSize = 0;
+	bool useRenderThread = false;
+	size_t clipBudget = DEFAULT_CLIP_BUDGET;
+	int netArg = 0;
+	const char* recordPath = NULL;
+	const char* replayPath = NULL;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--skinning") == 0 && i + 1 < argc)
+		{
+			skinningMode = ParseSkinningMode(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+		{
+			recordPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+		{
+			replayPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--present") == 0 && i + 1 < argc)
+		{
+			if (!pacer.Parse(argv[++i]))
+				std::cout << "Unknown present mode " << argv[i] << ", using vsync" << std::endl;
+		}
+		else if (strcmp(argv[i], "--clip-error") == 0 && i + 1 < argc)
+		{
+			clipCompression.positionError = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--crowd") == 0 && i + 1 < argc)
+		{
+			crowdSize = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--blend") == 0 && i + 1 < argc)
+		{
+			blendMode = strcmp(argv[++i], "inertial") == 0 ? BLEND_INERTIAL : BLEND_CROSSFADE;
+		}
+		else if (strcmp(argv[i], "--clip-budget") == 0 && i + 1 < argc)
+		{
+			clipBudget = (size_t)(atof(argv[++i]) * (1 << 20));
+		}
+		else if (strcmp(argv[i], "--render-thread") == 0)
+		{
+			useRenderThread = true;
+		}
+		else if (strcmp(argv[i], "--net") == 0 && i + 4 < argc)
+		{
+			netArg = i;
+			i += 4;
+		}
+	}
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
@@ -328,6 +316,8 @@ int main()
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
+	glfwSwapInterval(pacer.SwapInterval());
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetCursorPosCallback(window, mouse_callback);
 	glfwSetScrollCallback(window, scroll_callback);
@@ -343,8 +333,9 @@ int main()
 		return -1;
 	}
 
-	// tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-	stbi_set_flip_vertically_on_load(true);
+	// images are decoded on several threads at once, so the asset loader flips model
+	// textures itself rather than relying on stb_image's global flip switch
+	stbi_set_flip_vertically_on_load(false);
 
 	// configure global opengl state
 	// -----------------------------
@@ -352,7 +343,8 @@ int main()
 
 	// build and compile shaders
 	// -------------------------
-	Shader ourShader("anim_model.vs", "anim_model.fs");
+	Shader ourShader(SkinningVertexShader(skinningMode), "anim_model.fs");
+	Shader crowdShader("anim_model_instanced.vs", "anim_model.fs");
 	Shader hatShader(
 		FileSystem::getPath("src/8.guest/2020/skeletal_animation/1.model_loading.vs").c_str(),
 		FileSystem::getPath("src/8.guest/2020/skeletal_animation/1.model_loading.fs").c_str()
@@ -367,35 +359,154 @@ int main()
 		FileSystem::getPath("src/8.guest/2020/skeletal_animation/skybox.fs").c_str()
 	);
 
-	// load models
+	// every per-frame state change goes through one tracker, and uniforms are set by
+	// location (render_state.h); the program of each is bound when a uniform needs it
+	RenderState renderState;
+	ShaderUniforms ourUniforms, crowdUniforms, skyboxUniforms;
+	ourUniforms.Init(ourShader.ID);
+	crowdUniforms.Init(crowdShader.ID);
+	skyboxUniforms.Init(skyboxShader.ID);
+
+	// HUD: one persistent batch, one draw call per frame; the screen-space projection never changes.
+	// Set up before loading, the loading screen's progress bar uses it too.
+	UIBatch uiBatch;
+	uiBatch.Init(256);   // HP bars plus the profiler overlay
+	uiShader.use();
+	uiShader.setMat4("projection", glm::ortho(0.0f, (float)SCR_WIDTH, 0.0f, (float)SCR_HEIGHT));
+
+	// load assets
 	// -----------
 	// idle 3.3, walk 2.06, run 0.83, punch 1.03, kick 1.6
 
-	Model P1_Model(FileSystem::getPath("resources/objects/Fighting/P1_Idle.dae"));
-	Animation P1_idleAnimation(FileSystem::getPath("resources/objects/Fighting/P1_Idle.dae"), &P1_Model);
-	Animation P1_walkAnimation(FileSystem::getPath("resources/objects/Fighting/P1_Walk.dae"), &P1_Model);
-	Animation P1_punchAnimation(FileSystem::getPath("resources/objects/Fighting/P1_Punch.dae"), &P1_Model);
-	Animation P1_crouchAnimation(FileSystem::getPath("resources/objects/Fighting/P1_Crouch.dae"), &P1_Model);
-	Animation P1_crouchBlockAnimation(FileSystem::getPath("resources/objects/Fighting/P1_Crouch_Block.dae"), &P1_Model);
-	Animation P1_standBlockAnimation(FileSystem::getPath("resources/objects/Fighting/P1_Stand_Block.dae"), &P1_Model);
-	Animation P1_standHitAnimation(FileSystem::getPath("resources/objects/Fighting/P1_Stand_Hit.dae"), &P1_Model);
-	Animation P1_jumpAnimation(FileSystem::getPath("resources/objects/Fighting/P1_Jumping.dae"), &P1_Model);
-	Animation P1_jumpKickAnimation(FileSystem::getPath("resources/objects/Fighting/P1_TopKick.dae"), &P1_Model);
-
-	Animator P1_animator(&P1_idleAnimation);
-	
-	Model P2_Model(FileSystem::getPath("resources/objects/Fighting/P2_Idle.dae"));
-	Animation P2_idleAnimation(FileSystem::getPath("resources/objects/Fighting/P2_Idle.dae"), &P2_Model);
-	Animation P2_walkAnimation(FileSystem::getPath("resources/objects/Fighting/P2_Walk.dae"), &P2_Model);
-	Animation P2_punchAnimation(FileSystem::getPath("resources/objects/Fighting/P2_Punch.dae"), &P2_Model);
-	Animation P2_crouchAnimation(FileSystem::getPath("resources/objects/Fighting/P2_Crouch.dae"), &P2_Model);
-	Animation P2_crouchBlockAnimation(FileSystem::getPath("resources/objects/Fighting/P2_Crouch_Block.dae"), &P2_Model);
-	Animation P2_standBlockAnimation(FileSystem::getPath("resources/objects/Fighting/P2_Stand_Block.dae"), &P2_Model);
-	Animation P2_standHitAnimation(FileSystem::getPath("resources/objects/Fighting/P2_Stand_Hit.dae"), &P2_Model);
-	Animation P2_jumpAnimation(FileSystem::getPath("resources/objects/Fighting/P2_Jumping.dae"), &P2_Model);
-	Animation P2_jumpKickAnimation(FileSystem::getPath("resources/objects/Fighting/P2_TopKick.dae"), &P2_Model);
-
-	Animator P2_animator(&P2_idleAnimation);
+	vector<std::string> faces
+	{
+		FileSystem::getPath("resources/textures/skybox/right.jpg"),
+		FileSystem::getPath("resources/textures/skybox/left.jpg"),
+		FileSystem::getPath("resources/textures/skybox/top.jpg"),
+		FileSystem::getPath("resources/textures/skybox/bottom.jpg"),
+		FileSystem::getPath("resources/textures/skybox/front.jpg"),
+		FileSystem::getPath("resources/textures/skybox/back.jpg")
+	};
+
+	// imports, pose baking and image decodes run on the worker pool; GL uploads come back
+	// to this thread inside loader.Wait(), which also keeps the loading screen drawn
+	float loadStart = glfwGetTime();
+	JobSystem jobs;
+	AssetLoader loader(jobs, clipCompression);
+
+	std::string fightingDir = FileSystem::getPath("resources/objects/Fighting");
+	// Only idle, walk and the spectators' clips are baked before the first frame; the
+	// rest stream in while the match runs (clip_registry.h). When P2's files are the
+	// same as P1's, both are one CharacterAssets.
+	std::vector<CrowdMember> crowd;
+	BuildCrowd(crowdSize, crowd);
+	CharacterAssets& P1_assets = loader.LoadCharacter(fightingDir, "P1", STARTUP_CLIPS | CrowdClips(crowd, 0));
+	CharacterAssets& P2_assets = loader.LoadCharacter(fightingDir, "P2", STARTUP_CLIPS | CrowdClips(crowd, 1));
+
+	unsigned int cubemapTexture = 0;
+	loader.LoadCubemap(faces, cubemapTexture);
+
+	bool loaded = loader.Wait([&](float progress) { DrawLoadingScreen(window, renderState, uiShader, uiBatch, progress); });
+	std::cout << "Assets loaded in " << glfwGetTime() - loadStart << " s on " << jobs.ThreadCount() << " worker threads" << std::endl;
+	if (!loaded)
+	{
+		glfwTerminate();
+		return -1;
+	}
+
+	SkinnedModel& P1_Model = P1_assets.gpu;
+	SkinnedModel& P2_Model = P2_assets.gpu;
+	const PoseCache& P1_poseCache = P1_assets.poses;
+	const PoseCache& P2_poseCache = P2_assets.poses;
+
+	ClipTable P1_clipTable, P2_clipTable;
+	FillClipTable(P1_clipTable, P1_assets.clips);
+	FillClipTable(P2_clipTable, P2_assets.clips);
+
+	// attack frame data; edit moves.txt to rebalance without rebuilding
+	MoveTable moveTable = DefaultMoveTable();
+	if (!LoadMoveTable("moves.txt", moveTable))
+		std::cout << "Using the built-in move table" << std::endl;
+
+	InitMatch(match, &P1_clipTable, &P2_clipTable, &moveTable, &P1_assets.joints, &P2_assets.joints);
+
+	// both palettes live in one uniform buffer, uploaded once per frame
+	BonePaletteBuffer bonePalettes;
+	bonePalettes.Init(2, skinningMode);
+	bonePalettes.Attach(ourShader);
+
+	// what was baked at load stays; everything else is baked on the workers when the
+	// state machines may need it, and evicted again over the budget
+	ClipRegistry clipRegistry(jobs, clipBudget);
+	int P1_clips = clipRegistry.AddCharacter(P1_assets.poses, P1_assets.model, P1_assets.compressed);
+	int P2_clips = clipRegistry.AddCharacter(P2_assets.poses, P2_assets.model, P2_assets.compressed);
+	for (int c = 0; c < CLIP_COUNT; ++c)
+	{
+		if (P1_assets.residentClips & (1u << c))
+			clipRegistry.Pin(clipRegistry.Handle(P1_clips, (ClipId)c));
+		if (P2_assets.residentClips & (1u << c))
+			clipRegistry.Pin(clipRegistry.Handle(P2_clips, (ClipId)c));
+	}
+
+	// transitions of the --blend inertial mode; each one starts from the pose in its palette
+	Inertializer P1_inertial, P2_inertial;
+	InitInertializer(P1_inertial, P1_poseCache.boneCount);
+	InitInertializer(P2_inertial, P2_poseCache.boneCount);
+
+	// spectators: every member of each character drawn with one instanced call per mesh
+	InstancedSkinning P1_crowd, P2_crowd;
+	InstancedSkinning* const crowdBatches[2] = { &P1_crowd, &P2_crowd };
+	const BoneMask* const crowdMasks[2] = { &P1_assets.upperBody, &P2_assets.upperBody };
+	if (!crowd.empty())
+	{
+		P1_crowd.Init(CrowdCount(crowd, 0), P1_poseCache.boneCount);
+		P2_crowd.Init(CrowdCount(crowd, 1), P2_poseCache.boneCount);
+	}
+
+	// with --render-thread, GPU zones are timed by the render thread's profiler
+	profiler.Init(!useRenderThread);
+
+	// online play: skeletal_animation --net <localPort> <remoteAddress> <remotePort> <1|2>
+	// ----------------------------------------------------------------------------------
+	UdpTransport transport;
+	RollbackSession* session = NULL;
+	int localPlayer = 0;
+	if (netArg)
+	{
+		char** net = argv + netArg;
+		localPlayer = atoi(net[4]) == 2 ? 1 : 0;
+		if (!transport.Open((unsigned short)atoi(net[1]), net[2], (unsigned short)atoi(net[3])))
+		{
+			std::cout << "Failed to open UDP session to " << net[2] << ":" << net[3] << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		session = new RollbackSession(transport, localPlayer, match);
+	}
+
+	// recordings (replay.h): --replay plays a file back instead of the keyboard,
+	// --record saves this match when the window closes. Online matches re-simulate
+	// under rollback, so only local play is recorded.
+	// ------------------------------------------------------------------------------
+	Replay replay;
+	Replay recording;
+	ReplayCursor replayCursor(replay);
+	bool replaying = false;
+	if (replayPath && !session && LoadReplay(replayPath, replay))
+	{
+		replaying = true;
+		if (replay.assetHash != ReplayAssetHash(match))
+			std::cout << "Replay " << replayPath << " was recorded with other clip or move tables, it will not play back the same" << std::endl;
+	}
+	if (recordPath && session)
+	{
+		std::cout << "--record is ignored for online matches" << std::endl;
+		recordPath = NULL;
+	}
+	BeginReplay(recording, match, 0);
+
+	// the state one tick before 'match'; frames are drawn between the two
+	MatchState previousMatch = match;
 
 	unsigned int skyboxVAO, skyboxVBO;
 	glGenVertexArrays(1, &skyboxVAO);
@@ -428,378 +539,393 @@ int main()
 
 	glBindVertexArray(0);
 
-	vector<std::string> faces
-	{
-		FileSystem::getPath("resources/textures/skybox/right.jpg"),
-		FileSystem::getPath("resources/textures/skybox/left.jpg"),
-		FileSystem::getPath("resources/textures/skybox/top.jpg"),
-		FileSystem::getPath("resources/textures/skybox/bottom.jpg"),
-		FileSystem::getPath("resources/textures/skybox/front.jpg"),
-		FileSystem::getPath("resources/textures/skybox/back.jpg")
-	};
-
-	stbi_set_flip_vertically_on_load(false);
-	unsigned int cubemapTexture = loadCubemap(faces);
-	stbi_set_flip_vertically_on_load(true);
-
 	// draw in wireframe
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-	// render loop
-	// -----------
-	while (!glfwWindowShouldClose(window))
+	// the projection only changes with the scroll wheel zoom
+	glm::mat4 projection;
+	float projectionZoom = -1.0f;
+
+	// the fighters' poses stay on this side, each frame's packet gets a copy: an
+	// inertialized transition starts from the pose drawn last
+	std::vector<glm::mat4> fighterPoses(2 * MAX_BONES, glm::mat4(1.0f));
+
+	// spectators never move, only their poses go into the packets
+	if (!crowd.empty())
+		PlaceCrowd(crowd, crowdBatches);
+
+	// what BuildRenderPacket poses from every frame
+	PacketSources packetSources = {};
+	packetSources.poses[0] = &P1_poseCache;
+	packetSources.poses[1] = &P2_poseCache;
+	packetSources.clips = &clipRegistry;
+	packetSources.clipCharacters[0] = P1_clips;
+	packetSources.clipCharacters[1] = P2_clips;
+	packetSources.inertial[0] = &P1_inertial;
+	packetSources.inertial[1] = &P2_inertial;
+	packetSources.fighterPoses = fighterPoses.data();
+	packetSources.blendMode = blendMode;
+	packetSources.crowd = &crowd;
+	for (int c = 0; c < 2; ++c)
 	{
-		// per-frame time logic
-		// --------------------
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
-
-		float gameplayDelta = deltaTime;
-		if (hitStopTimer > 0.0f) {
-			hitStopTimer -= deltaTime;
-			gameplayDelta = 0.0f;   // freeze animation & gameplay
-		}
-
-		// input
-		// -----
-		processInput(window);
-	
-		UpdatePlayerAnimation(
-			window,
-			P1_animator,
-			P1_idleAnimation,
-			P1_walkAnimation,
-			P1_punchAnimation,
-			P1_crouchAnimation,
-			P1_crouchBlockAnimation,
-			P1_standBlockAnimation,
-			P1_standHitAnimation,
-			P1_jumpAnimation,
-			P1_jumpKickAnimation,
-			P1_charState,
-			P1_blendAmount,
-			P1_blendRate,
-			P1_Controls,
-			P2_Controls,
-			charPosition_p1,      // attacker
-			charPosition_p2,      // victim
-			P2_charState          // victim receives hit state
-		);
-
-		UpdatePlayerAnimation(
-			window,
-			P2_animator,
-			P2_idleAnimation,
-			P2_walkAnimation,
-			P2_punchAnimation,
-			P2_crouchAnimation,
-			P2_crouchBlockAnimation,
-			P2_standBlockAnimation,
-			P2_standHitAnimation,
-			P2_jumpAnimation,
-			P2_jumpKickAnimation,
-			P2_charState,
-			P2_blendAmount,
-			P2_blendRate,
-			P2_Controls,
-			P1_Controls,
-			charPosition_p2,      // attacker
-			charPosition_p1,      // victim
-			P1_charState
-		);
-
+		packetSources.crowdMasks[c] = crowdMasks[c];
+		packetSources.crowdCapacity[c] = crowdBatches[c]->Capacity();
+		packetSources.crowdBonesPerInstance[c] = crowdBatches[c]->BonesPerInstance();
+	}
+	packetSources.hudWidth = (float)SCR_WIDTH;
 
-		// lerp rotation
-		//float t = 0.1;
-		//charFront = glm::mix(charFront, charFrontTarget, t);
+	// Each frame is built into a RenderPacket (render_packet.h) and drawn from it by
+	// drawPacket, which touches GL and nothing of the sim. The packet goes through a
+	// FrameQueue (render_queue.h) either way; with --render-thread the drawing happens
+	// on a thread that owns the context, while this one builds the next frame.
+	FrameQueue<RenderPacket> frameQueue;
+	unsigned long long frameIndex = 0;
+	int viewportWidth = 0, viewportHeight = 0;
 
-		P1_animator.UpdateAnimation(gameplayDelta);
-		P2_animator.UpdateAnimation(gameplayDelta);
+	auto drawPacket = [&](const RenderPacket& packet, Profiler& prof)
+	{
+		if (packet.viewportWidth != viewportWidth || packet.viewportHeight != viewportHeight)
+		{
+			glViewport(0, 0, packet.viewportWidth, packet.viewportHeight);
+			viewportWidth = packet.viewportWidth;
+			viewportHeight = packet.viewportHeight;
+		}
 
-		// render
-		// ------
 		glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		
-
-		// don't forget to enable shader before setting uniforms
-		ourShader.use();
-
-		// view/projection transformations
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-
-		// Smoothly interpolate camera orbit
-		float lerpFactor = 1.0f - expf(-smoothSpeed * deltaTime);
-		orbitYaw = glm::mix(orbitYaw, targetYaw, lerpFactor);
-		orbitPitch = glm::mix(orbitPitch, targetPitch, lerpFactor);
-
-		glm::vec3 cameraPos(-10.0f, 2.0f, 0.0f);  // e.g. behind the origin, at z = +10
-
-		if (cameraShakeTimer > 0.0f)
+		ourUniforms.SetMat4(renderState, UNIFORM_PROJECTION, packet.projection);
+		ourUniforms.SetMat4(renderState, UNIFORM_VIEW, packet.view);
+
+		prof.BeginZone(PROF_BONE_UPLOAD, true);
+		for (int c = 0; c < 2; ++c)
+			memcpy(bonePalettes.Palette(c), packet.fighterPoses[c], sizeof(glm::mat4) * packet.fighterBones[c]);
+		bonePalettes.Upload();
+		if (packet.crowdPoses[0])
+			P1_crowd.Upload(packet.crowdCount[0], packet.crowdPoses[0]);
+		if (packet.crowdPoses[1])
+			P2_crowd.Upload(packet.crowdCount[1], packet.crowdPoses[1]);
+		prof.EndZone(PROF_BONE_UPLOAD);
+
+		// render the loaded models
+		bonePalettes.Select(0);
+		ourUniforms.SetMat4(renderState, UNIFORM_MODEL, packet.fighterModels[0]);
+		ourUniforms.SetVec3(renderState, UNIFORM_COLOR_TINT, glm::vec3(1.0f));
+		prof.BeginZone(PROF_DRAW_P1, true);
+		P1_Model.Draw(renderState);
+		prof.EndZone(PROF_DRAW_P1);
+
+		bonePalettes.Select(1);
+		ourUniforms.SetMat4(renderState, UNIFORM_MODEL, packet.fighterModels[1]);
+		ourUniforms.SetVec3(renderState, UNIFORM_COLOR_TINT, glm::vec3(1.0f));
+		prof.BeginZone(PROF_DRAW_P2, true);
+		P2_Model.Draw(renderState);
+		prof.EndZone(PROF_DRAW_P2);
+
+		if (packet.crowdPoses[0] || packet.crowdPoses[1])
 		{
-			printf("cameraShakeTimer = %f\n", cameraShakeTimer);
-			cameraShakeTimer -= deltaTime;
-
-			float shake = cameraShakeIntensity * (cameraShakeTimer);
-			cameraPos.x += (rand() % 1000 / 1000.0f - 0.5f) * shake;
-			cameraPos.y += (rand() % 1000 / 1000.0f - 0.5f) * shake;
-			cameraPos.z += (rand() % 1000 / 1000.0f - 0.5f) * shake;
-
-			// decay shake intensity smoothly
-			cameraShakeIntensity -= shakeDecaySpeed * deltaTime;
-			if (cameraShakeIntensity < 0.0f) cameraShakeIntensity = cameraMaxShakeIntensity;
+			prof.BeginZone(PROF_DRAW_CROWD, true);
+			crowdUniforms.SetMat4(renderState, UNIFORM_PROJECTION, packet.projection);
+			crowdUniforms.SetMat4(renderState, UNIFORM_VIEW, packet.view);
+			crowdUniforms.SetVec3(renderState, UNIFORM_COLOR_TINT, glm::vec3(0.8f));
+			P1_crowd.Draw(renderState, crowdUniforms, P1_Model);
+			P2_crowd.Draw(renderState, crowdUniforms, P2_Model);
+			prof.EndZone(PROF_DRAW_CROWD);
 		}
 
-		glm::mat4 view = glm::lookAt(
-			cameraPos,
-			glm::vec3(0.0f, 2.0f, 0.0f),   // look at world origin + some Y offset
-			glm::vec3(0.0f, 1.0f, 0.0f)    // up vector
-		);
-
-		
-
-		ourShader.use();
-
-		ourShader.setMat4("projection", projection);
-		ourShader.setMat4("view", view);
-		ourShader.setVec3("colorTint", glm::vec3(1.0f));
-
-		auto transforms = P1_animator.GetFinalBoneMatrices();
-		for (int i = 0; i < transforms.size(); ++i)
-			ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
-
-		// render the loaded model
-		glm::mat4 P1model = glm::mat4(1.0f);
-
-		P1model = glm::translate(P1model, charPosition_p1);
-		P1model = glm::rotate(P1model, 0.0f, glm::vec3(0, 1, 0));
-		P1model = glm::scale(P1model, glm::vec3(1.0f));
-
-		ourShader.setMat4("model", P1model);
-		ourShader.setVec3("colorTint", glm::vec3(1.0f));
-		P1_Model.Draw(ourShader);
-
-		// render the loaded model
-		glm::mat4 P2model = glm::mat4(1.0f);
-
-		P2model = glm::translate(P2model, charPosition_p2);
-		P2model = glm::rotate(P2model, glm::radians(180.f), glm::vec3(0, 1, 0));
-		P2model = glm::scale(P2model, glm::vec3(1.0f));
-
-		transforms = P2_animator.GetFinalBoneMatrices();
-		for (int i = 0; i < transforms.size(); ++i)
-			ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
-
-		ourShader.setMat4("model", P2model);
-		ourShader.setVec3("colorTint", glm::vec3(1.0f));
-		P2_Model.Draw(ourShader);
-
 		// Platform
 		// Draw platforms
-		ourShader.use();
-
-
 		glm::mat4 model = glm::mat4(1.0f);
 
 		// change cube size here
 		model = glm::translate(model, glm::vec3(0.0f, -1.5f, 0.0f));
 		model = glm::scale(model, glm::vec3(5.0f, 3.0f, 20.0f));   // half size
 
-		ourShader.setMat4("model", model);
-		ourShader.setVec3("colorTint", glm::vec3(137.0f / 256.0f, 97.0f / 256.0f, 0.0f)); // red tint
+		ourUniforms.SetMat4(renderState, UNIFORM_MODEL, model);
+		ourUniforms.SetVec3(renderState, UNIFORM_COLOR_TINT, glm::vec3(137.0f / 256.0f, 97.0f / 256.0f, 0.0f)); // red tint
 
-		glBindVertexArray(VAO);
+		prof.BeginZone(PROF_DRAW_STAGE, true);
+		renderState.UseProgram(ourShader.ID);
+		renderState.BindVertexArray(VAO);
 		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+		prof.EndZone(PROF_DRAW_STAGE);
 
-
-
-		glDepthFunc(GL_LEQUAL);
-
-		skyboxShader.use();
+		prof.BeginZone(PROF_DRAW_SKYBOX, true);
+		renderState.DepthFunc(GL_LEQUAL);
 
 		// remove translation from the view matrix
-		glm::mat4 skyboxView = glm::mat4(glm::mat3(view));
-		skyboxShader.setMat4("view", skyboxView);
-		skyboxShader.setMat4("projection", projection);
+		glm::mat4 skyboxView = glm::mat4(glm::mat3(packet.view));
+		skyboxUniforms.SetMat4(renderState, UNIFORM_VIEW, skyboxView);
+		skyboxUniforms.SetMat4(renderState, UNIFORM_PROJECTION, packet.projection);
 
-		glBindVertexArray(skyboxVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+		renderState.UseProgram(skyboxShader.ID);
+		renderState.BindVertexArray(skyboxVAO);
+		renderState.BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 
-		glDepthFunc(GL_LESS);
-
-		float barWidth = 300.0f;
-		float barHeight = 25.0f;
-
+		renderState.DepthFunc(GL_LESS);
+		prof.EndZone(PROF_DRAW_SKYBOX);
 
 		// ---- Draw 2D UI ----
-		glDisable(GL_DEPTH_TEST);
-
-		// switch to simple 2D shader
-		uiShader.use();
-
-		//printf("P1 hp = %f P2 HP = %f\n", P1_HP, P2_HP);
-
-		// Set orthographic projection once for the UI shader
-		glm::mat4 ortho = glm::ortho(0.0f, (float)SCR_WIDTH, 0.0f, (float)SCR_HEIGHT);
-		uiShader.setMat4("projection", ortho);
+		prof.BeginZone(PROF_UI, true);
+		renderState.SetEnabled(GL_DEPTH_TEST, false);
 
-		// --- P1 HP Bar ---
-		// 1. Draw Background (Max HP - dark grey)
-		DrawBar(uiShader, 50, 750, barWidth, barHeight, 1.0f, glm::vec3(0.2f, 0.2f, 0.2f));
-		// 2. Draw Foreground (Current HP - green)
-		DrawBar(uiShader, 50, 750, barWidth, barHeight, P1_HP / P1_MaxHP, glm::vec3(0.0f, 1.0f, 0.0f));
+		for (int q = 0; q < packet.hudCount; ++q)
+			uiBatch.AddQuad(packet.hud[q]);
+		if (packet.showProfiler)
+			prof.DrawHud(uiBatch, 20, 20, 120);
 
-		// --- P2 HP Bar ---
-		// 1. Draw Background (Max HP - dark grey)
-		DrawBar(uiShader, SCR_WIDTH - barWidth - 50, 750, barWidth, barHeight, 1.0f, glm::vec3(0.2f, 0.2f, 0.2f));
-		// 2. Draw Foreground (Current HP - red)
-		DrawBar(uiShader, SCR_WIDTH - barWidth - 50, 750, barWidth, barHeight, P2_HP / P2_MaxHP, glm::vec3(1.0f, 0.0f, 0.0f));
+		// switch to simple 2D shader and draw every queued quad at once
+		renderState.UseProgram(uiShader.ID);
+		uiBatch.Flush(renderState);
 
 		// restore depth test for next frame
-		glEnable(GL_DEPTH_TEST);
+		renderState.SetEnabled(GL_DEPTH_TEST, true);
+		prof.EndZone(PROF_UI);
 
-		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-		// -------------------------------------------------------------------------------
+		// glfw: swap buffers
+		// ------------------
+		prof.BeginZone(PROF_SWAP, false);
+		pacer.BeforeSwap();
 		glfwSwapBuffers(window);
-		glfwPollEvents();
-	}
+		prof.EndZone(PROF_SWAP);
 
-	// glfw: terminate, clearing all previously allocated GLFW resources.
-	// ------------------------------------------------------------------
-	glfwTerminate();
-	return 0;
-}
-
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow* window)
-{
+		prof.BeginZone(PROF_PACING, false);
+		pacer.AfterSwap();
+		prof.EndZone(PROF_PACING);
 
-	glm::vec3 moveDir_p1(0.0f);
-	glm::vec3 moveDir_p2(0.0f);
+		renderState.EndFrame();
+	};
 
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-		glfwSetWindowShouldClose(window, true);
+	// the uploads and Init()s above bound vertex arrays and textures directly; a fresh
+	// tracker also leaves the loading screen out of the call counts
+	renderState = RenderState();
 
-	/*
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		moveDir += glm::vec3(0.0f, 0.0f, -1.0f);
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		moveDir += glm::vec3(0.0f, 0.0f, 1.0f);
-	*/
-
-	if (P1_charState != AnimState::IDLE_PUNCH && P1_charState != AnimState::PUNCH_IDLE &&
-		P1_charState != AnimState::IDLE_BLOCK && P1_charState != AnimState::BLOCK_IDLE &&
-		P1_charState != AnimState::CROUCH_BLOCK && P1_charState != AnimState::BLOCK_CROUCH &&
-		P1_charState != AnimState::IDLE_HIT && P1_charState != AnimState::HIT_IDLE &&
-		P1_charState != AnimState::CROUCH_HIT && P1_charState != AnimState::HIT_CROUCH &&
-		P1_charState != AnimState::CROUCH && P1_charState != AnimState::IDLE_CROUCH && P1_charState != AnimState::CROUCH_IDLE)
+	// --render-thread: the context moves to a thread that draws each packet as it
+	// arrives, paced there; this thread keeps events, input, the sim and the packets.
+	// Its profiler shares the main one's clock, and both go into the one trace.
+	Profiler renderProfiler;
+	std::thread renderThread;
+	if (useRenderThread)
 	{
-		if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-			moveDir_p1 += glm::vec3(0.0f, 0.0f, -1.0f);
-		if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-			moveDir_p1 += glm::vec3(0.0f, 0.0f, 1.0f);
+		glfwMakeContextCurrent(NULL);
+		renderThread = std::thread([&]
+		{
+			glfwMakeContextCurrent(window);
+			glfwSwapInterval(pacer.SwapInterval());
+			renderProfiler.Init(true, &profiler);
+			for (;;)
+			{
+				pacer.BeginFrame();
+				if (!frameQueue.Take())
+					break;
+				renderProfiler.BeginFrame();
+				drawPacket(frameQueue.Front(), renderProfiler);
+				renderProfiler.EndFrame();
+			}
+			renderProfiler.Release();
+			glfwMakeContextCurrent(NULL);
+		});
 	}
 
-	if (P2_charState != AnimState::IDLE_PUNCH && P2_charState != AnimState::PUNCH_IDLE &&
-		P2_charState != AnimState::IDLE_BLOCK && P2_charState != AnimState::BLOCK_IDLE &&
-		P2_charState != AnimState::CROUCH_BLOCK && P2_charState != AnimState::BLOCK_CROUCH &&
-		P2_charState != AnimState::IDLE_HIT && P2_charState != AnimState::HIT_IDLE &&
-		P2_charState != AnimState::CROUCH_HIT && P2_charState != AnimState::HIT_CROUCH &&
-		P2_charState != AnimState::CROUCH && P2_charState != AnimState::IDLE_CROUCH && P2_charState != AnimState::CROUCH_IDLE)
+	// render loop
+	// -----------
+	while (!glfwWindowShouldClose(window))
 	{
-		if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
-			moveDir_p2 += glm::vec3(0.0f, 0.0f, -1.0f);
-		if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-			moveDir_p2 += glm::vec3(0.0f, 0.0f, 1.0f);
-	}
+		profiler.BeginFrame();
+		allocationWatch.BeginFrame();
+
+		// late present modes sleep here, so the input below is as fresh as possible. With
+		// a render thread the pacer runs over there, and this waits for it to take the
+		// last packet instead: the sim stays at most one frame ahead of the screen.
+		profiler.BeginZone(PROF_PACING, false);
+		if (!useRenderThread)
+		{
+			pacer.BeginFrame();
+			if (pacer.Mode() == PRESENT_LATE)
+				glfwPollEvents();
+		}
+		RenderPacket& packet = frameQueue.Begin();
+		profiler.EndZone(PROF_PACING);
+		packet.Reset(frameIndex++);
 
-	if (isGrounded_p1 && glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-	{
-		verticalVelocity_p1 = jumpForce;
-		isGrounded_p1 = false;
-	}
+		// per-frame time logic
+		// --------------------
+		float currentFrame = glfwGetTime();
+		deltaTime = currentFrame - lastFrame;
+		lastFrame = currentFrame;
 
-	// P2 JUMP KEY
-	if (isGrounded_p2 && glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
-	{
-		verticalVelocity_p2 = jumpForce;
-		isGrounded_p2 = false;
-	}
+		// input
+		// -----
+		profiler.BeginZone(PROF_INPUT, false);
+		processInput(window);
 
-	if (!isGrounded_p1)
-		verticalVelocity_p1 += gravity * deltaTime;
+		InputFrame P1_input = PollInput(window, P1_Controls);
+		InputFrame P2_input = PollInput(window, P2_Controls);
+		profiler.EndZone(PROF_INPUT);
 
-	if (!isGrounded_p2)
-		verticalVelocity_p2 += gravity * deltaTime;
+		// simulation: fixed 60 Hz ticks, as many as the elapsed time covers
+		// -----------------------------------------------------------------
+		profiler.BeginZone(PROF_SIM, false);
+		simAccumulator += glm::min(deltaTime, MAX_FRAME_TIME);
+		while (simAccumulator >= SIM_DT)
+		{
+			previousMatch = match;
+			if (session)
+			{
+				// a refused frame means the peer is too far behind; it is simply retried next tick
+				session->AdvanceFrame(localPlayer == 0 ? P1_input : P2_input);
+				match = session->State();
+			}
+			else if (replaying)
+			{
+				// the match holds on its last frame once the recording runs out
+				InputFrame replayP1, replayP2;
+				if (replayCursor.Next(replayP1, replayP2))
+				{
+					Step(match, replayP1, replayP2);
+					if (replayCursor.Done())
+					{
+						bool same = ChecksumMatch(match) == replay.finalChecksum;
+						std::cout << "Replay finished after " << match.frame << " ticks, " << (same ? "matches the recording" : "DESYNC from the recording") << std::endl;
+					}
+				}
+			}
+			else
+			{
+				Step(match, P1_input, P2_input);
+				if (recordPath)
+					RecordTick(recording, P1_input, P2_input);
+			}
+			simAccumulator -= SIM_DT;
+		}
+		profiler.EndZone(PROF_SIM);
 
-	// ----- P1 MOVEMENT -----
-	if (glm::length(moveDir_p1) > 0.0f)
-	{
-		moveDir_p1 = glm::normalize(moveDir_p1);
+		// draw 'renderAlpha' of the way from the previous tick to the latest one, so
+		// displays faster than 60 Hz move smoothly (at the cost of one tick of delay)
+		profiler.BeginZone(PROF_POSE, false);
+		float renderAlpha = simAccumulator / SIM_DT;
+		BuildRenderPacket(packetSources, previousMatch, match, renderAlpha, deltaTime, currentFrame, packet);
+		profiler.EndZone(PROF_POSE);
 
-		glm::vec3 newPosP1 = charPosition_p1 + moveDir_p1 * charSpeed * deltaTime;
-		float futureDist = std::abs(newPosP1.z - charPosition_p2.z);
-		//printf("newPosP1.z = %f charPosition_p2.z = %f P1 futureDist = %f \n", newPosP1.z, charPosition_p2.z, futureDist);
-		if (futureDist > moveCollideDistanceOffset)
+		// view/projection transformations
+		if (camera.Zoom != projectionZoom)
 		{
-			// Apply boundary limit
-			newPosP1.z = glm::clamp(newPosP1.z, MIN_Z, MAX_Z);
-
-			charPosition_p1 = newPosP1;
-			charFrontTarget_p1 = moveDir_p1;
+			projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+			projectionZoom = camera.Zoom;
 		}
-	}
 
-	// ----- P2 MOVEMENT -----
-	if (glm::length(moveDir_p2) > 0.0f)
-	{
-		moveDir_p2 = glm::normalize(moveDir_p2);
+		// Smoothly interpolate camera orbit
+		float lerpFactor = 1.0f - expf(-smoothSpeed * deltaTime);
+		orbitYaw = glm::mix(orbitYaw, targetYaw, lerpFactor);
+		orbitPitch = glm::mix(orbitPitch, targetPitch, lerpFactor);
 
-		glm::vec3 newPosP2 = charPosition_p2 + moveDir_p2 * charSpeed * deltaTime;
-		float futureDist = std::abs(newPosP2.z - charPosition_p1.z);
+		glm::vec3 cameraPos(-10.0f, 2.0f, 0.0f);  // e.g. behind the origin, at z = +10
 
-		//printf("newPosP2.z = %f charPosition_p1.z = %f P1 futureDist = %f \n", newPosP2.z, charPosition_p1.z, futureDist);
-		if (futureDist > moveCollideDistanceOffset)
+		if (match.cameraShakeTimer > 0.0f)
 		{
-			// Apply boundary limit
-			newPosP2.z = glm::clamp(newPosP2.z, MIN_Z, MAX_Z);
+			float shake = cameraShakeIntensity * (match.cameraShakeTimer);
+			cameraPos.x += ShakeNoise(match.frame, 0) * shake;
+			cameraPos.y += ShakeNoise(match.frame, 1) * shake;
+			cameraPos.z += ShakeNoise(match.frame, 2) * shake;
 
-			charPosition_p2 = newPosP2;
-			charFrontTarget_p2 = moveDir_p2;
+			// decay shake intensity smoothly
+			cameraShakeIntensity -= shakeDecaySpeed * deltaTime;
+			if (cameraShakeIntensity < 0.0f) cameraShakeIntensity = cameraMaxShakeIntensity;
 		}
-	}
 
-	// ----- P1 -----
-	charPosition_p1.y += verticalVelocity_p1 * deltaTime;
+		packet.projection = projection;
+		packet.view = glm::lookAt(
+			cameraPos,
+			glm::vec3(0.0f, 2.0f, 0.0f),   // look at world origin + some Y offset
+			glm::vec3(0.0f, 1.0f, 0.0f)    // up vector
+		);
 
-	if (charPosition_p1.y <= groundHeight)
-	{
-		charPosition_p1.y = groundHeight;
-		verticalVelocity_p1 = 0.0f;
-		isGrounded_p1 = true;
+		packet.viewportWidth = framebufferWidth;
+		packet.viewportHeight = framebufferHeight;
+		packet.showProfiler = showProfiler;
+		frameQueue.Submit();
 
-		// P1_charState = AnimState::IDLE;  <-- optional
+		// without a render thread the packet is drawn right away
+		if (!useRenderThread && frameQueue.Take())
+			drawPacket(frameQueue.Front(), profiler);
+
+		// glfw: poll IO events (keys pressed/released, mouse moved etc.)
+		// --------------------------------------------------------------
+		glfwPollEvents();
+
+		allocationWatch.EndFrame();
+		profiler.EndFrame();
 	}
 
-	// ----- P2 -----
-	charPosition_p2.y += verticalVelocity_p2 * deltaTime;
+	frameQueue.Stop();
+	if (renderThread.joinable())
+	{
+		renderThread.join();
+		glfwMakeContextCurrent(window);
+	}
 
-	if (charPosition_p2.y <= groundHeight)
+	profiler.PrintSummary();
+	if (useRenderThread)
 	{
-		charPosition_p2.y = groundHeight;
-		verticalVelocity_p2 = 0.0f;
-		isGrounded_p2 = true;
+		std::cout << "render thread:" << std::endl;
+		renderProfiler.PrintSummary();
+	}
+	renderState.PrintSummary();
+	clipRegistry.PrintSummary();
+	allocationWatch.PrintSummary();
+	profiler.WriteChromeTrace(PROFILE_TRACE_PATH, useRenderThread ? &renderProfiler : NULL);
 
-		// P2_charState = AnimState::IDLE;
+	if (recordPath)
+	{
+		recording.finalChecksum = ChecksumMatch(match);
+		if (SaveReplay(recordPath, recording))
+			std::cout << "Recorded " << recording.tickCount << " ticks to " << recordPath << std::endl;
 	}
 
-	// update y pos
+	delete session;
+	P1_Model.Release();
+	P2_Model.Release();
+	bonePalettes.Release();
+	P1_crowd.Release();
+	P2_crowd.Release();
+	uiBatch.Release();
+	profiler.Release();
 
+	// glfw: terminate, clearing all previously allocated GLFW resources.
+	// ------------------------------------------------------------------
+	glfwTerminate();
+	return 0;
+}
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// ---------------------------------------------------------------------------------------------------------
+void processInput(GLFWwindow* window)
+{
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, true);
+
+	// toggle on press, not every frame the key is held
+	bool profilerKey = glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS;
+	if (profilerKey && !profilerKeyHeld)
+		showProfiler = !showProfiler;
+	profilerKeyHeld = profilerKey;
+}
+
+// sample one player's keys into the sim's input format, once per frame
+InputFrame PollInput(GLFWwindow* window, const PlayerControls& controls)
+{
+	InputFrame input;
+	input.moveLeft = glfwGetKey(window, controls.moveLeft) == GLFW_PRESS;
+	input.moveRight = glfwGetKey(window, controls.moveRight) == GLFW_PRESS;
+	input.jump = glfwGetKey(window, controls.jump) == GLFW_PRESS;
+	input.jumpKick = glfwGetKey(window, controls.jumpKick) == GLFW_PRESS;
+	input.punch = glfwGetKey(window, controls.punch) == GLFW_PRESS;
+	input.crouch = glfwGetKey(window, controls.crouch) == GLFW_PRESS;
+	input.testStandBlock = glfwGetKey(window, controls.testStandBlock) == GLFW_PRESS;
+	input.testCrouchBlock = glfwGetKey(window, controls.testCrouchBlock) == GLFW_PRESS;
+	input.testHurt = glfwGetKey(window, controls.testHurt) == GLFW_PRESS;
+	return input;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -808,7 +934,10 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
 	// make sure the viewport matches the new window dimensions; note that width and 
 	// height will be significantly larger than specified on retina displays.
-	glViewport(0, 0, width, height);
+	// Events come in on the main thread, which may not hold the context: the next
+	// packet drawn sets the viewport.
+	framebufferWidth = width;
+	framebufferHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -850,399 +979,47 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 	camera.ProcessMouseScroll(yoffset);
 }
 
-void BridgeAnimation(Animator& animator, Animation& startAnim, Animation& endAnim, AnimState endState, float delayTime, float& blendAmount, float& blendRate, AnimState& charState)
+void FillClipTable(ClipTable& table, const ClipData clips[CLIP_COUNT])
 {
-	if (animator.m_CurrentTime > delayTime)
+	for (int i = 0; i < CLIP_COUNT; i++)
 	{
-		blendAmount += blendRate;
-		blendAmount = fmod(blendAmount, 1.0f);
-		animator.PlayAnimation(&startAnim, &endAnim, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-		if (blendAmount > 0.9f) {
-			blendAmount = 0.0f;
-			float startTime = animator.m_CurrentTime2;
-			animator.PlayAnimation(&endAnim, NULL, startTime, 0.0f, blendAmount);
-			charState = endState;
-			//printf("-------------- charState change to %d\n", charState);
-		}
-		//printf("charState = %d\n", charState);
+		table.ticksPerSecond[i] = clips[i].ticksPerSecond;
+		table.duration[i] = clips[i].duration;
 	}
-
 }
 
-bool IsHoldingBack(GLFWwindow* window, const PlayerControls& controls, const glm::vec3& selfPos, const glm::vec3& enemyPos)
+// Deterministic noise in [-0.5, 0.5) keyed on the sim frame, so every peer and
+// every re-run of a match shakes the camera identically (rand() did not).
+float ShakeNoise(unsigned int frame, unsigned int axis)
 {
-	float dz = enemyPos.z - selfPos.z;
-
-	if (dz > 0)
-	{
-		return glfwGetKey(window, controls.moveLeft) == GLFW_PRESS;
-	}
-	else 
-	{
-		return glfwGetKey(window, controls.moveRight) == GLFW_PRESS;
-	}
-}
-
-void UpdatePlayerAnimation(
-	GLFWwindow* window,
-	Animator& animator,
-	Animation& idleAnim,
-	Animation& walkAnim,
-	Animation& punchAnim,
-	Animation& crouchAnim,
-	Animation& crouchBlockAnim,
-	Animation& standBlockAnim,
-	Animation& standHitAnim,
-	Animation& jumpAnim,
-	Animation& jumpKickAnim,
-	AnimState& state,
-	float& blendAmount,
-	float blendRate,
-	const PlayerControls& controls,
-	const PlayerControls& victimControls,
-	glm::vec3 attackerPos,
-	glm::vec3 victimPos,
-	AnimState& victimState
-)
-{	
-
-	float& kickTimer = (&state == &P1_charState) ? P1_hitDelayTimer : P2_hitDelayTimer;
-	float& punchTimer = (&state == &P1_charState) ? P1_punchDelayTimer : P2_punchDelayTimer;
-	float& currentHP = (&state == &P1_charState) ? P1_HP : P2_HP;
-	float& victimHP = (&state == &P1_charState) ? P2_HP : P1_HP;
-
-	// ========================= DELAYED KICK DAMAGE =========================
-	if (kickTimer > 0.0f)
-	{
-		kickTimer -= deltaTime;
-
-		if (kickTimer <= 0.0f)
-		{
-			bool crouching =
-				state == CROUCH ||
-				state == IDLE_CROUCH ||
-				state == CROUCH_IDLE;
-
-			bool blocking = IsHoldingBack(window, controls, attackerPos, victimPos);
-
-			if (blocking)
-			{
-				state = crouching ? CROUCH_HIT : IDLE_BLOCK;
-
-				if (state == CROUCH_HIT)
-				{
-					hitStopTimer = hitStopDuration_hit;
-					cameraShakeTimer = 0.5f;
-					currentHP -= 5.0f;
-				}
-				else
-				{
-					hitStopTimer = hitStopDuration_block;
-					cameraShakeTimer = 0.3f;
-					currentHP -= 2.0f;
-				}
-			}
-			else
-			{
-				state = crouching ? CROUCH_HIT : IDLE_HIT;
-
-				hitStopTimer = hitStopDuration_hit;
-				cameraShakeTimer = 0.5f;
-				currentHP -= 5.0f;
-			}
-
-			blendAmount = 0.0f;
-		}
-	}
-
-	// ========================= DELAYED PUNCH DAMAGE =========================
-	if (punchTimer > 0.0f)
-	{
-		punchTimer -= deltaTime;
-
-		if (punchTimer <= 0.0f)
-		{
-			bool blocking = IsHoldingBack(window, controls, attackerPos, victimPos);
-
-			if (blocking)
-			{
-				state = IDLE_BLOCK;
-
-				// block hit-stop + reduced shake
-				hitStopTimer = hitStopDuration_block;
-				cameraShakeTimer = 0.3f;
-
-				currentHP -= 2.0f;
-			}
-			else
-			{
-				state = IDLE_HIT;
-
-				// normal hit-stop + full shake
-				hitStopTimer = hitStopDuration_hit;
-				cameraShakeTimer = 0.5f;
-
-				currentHP -= 5.0f;
-			}
-
-			blendAmount = 0.0f;
-		}
-	}
-
-	
-
-	switch (state) {
-
-		// ========================= IDLE =========================
-	case IDLE:
-		if (glfwGetKey(window, controls.moveLeft) == GLFW_PRESS ||
-			glfwGetKey(window, controls.moveRight) == GLFW_PRESS)
-		{
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&idleAnim, &walkAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = IDLE_WALK;
-		}
-		else if (glfwGetKey(window, controls.punch) == GLFW_PRESS) {        // Punch
-			// Check hit range
-			if (CheckHit(attackerPos, victimPos, hitDistanceOffset))
-			{
-				if (&victimState == &P1_charState)
-					P1_punchDelayTimer = PUNCH_HIT_DELAY;
-
-				if (&victimState == &P2_charState)
-					P2_punchDelayTimer = PUNCH_HIT_DELAY;
-			}
-
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&idleAnim, &punchAnim, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			state = AnimState::IDLE_PUNCH;
-			return;
-		}
-		else if (glfwGetKey(window, controls.crouch) == GLFW_PRESS) {    // Crouch
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&idleAnim, &crouchAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = IDLE_CROUCH;
-		}
-		else if (glfwGetKey(window, controls.testStandBlock) == GLFW_PRESS) {   // Block
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&idleAnim, &standBlockAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = IDLE_BLOCK;
-		}
-		else if (glfwGetKey(window, controls.testHurt) == GLFW_PRESS) {  // Hit
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&idleAnim, &standHitAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = IDLE_HIT;
-		}
-		else if (glfwGetKey(window, controls.jump) == GLFW_PRESS) {      // Jump
-
-			
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&idleAnim, &jumpAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = IDLE_JUMP;
-		}
-		if (glfwGetKey(window, controls.jumpKick) == GLFW_PRESS) 
-		{
-			if (CheckHit(attackerPos, victimPos, hitDistanceOffset))
-			{
-				if (&victimState == &P1_charState)
-					P1_hitDelayTimer = JUMPKICK_HIT_DELAY;
-
-				if (&victimState == &P2_charState)
-					P2_hitDelayTimer = JUMPKICK_HIT_DELAY;
-			}
-
-			
-
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&idleAnim, &jumpKickAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = IDLE_KICK;
-		}
-		break;
-
-		// ========================= CROUCH =========================
-	case IDLE_CROUCH:
-		BridgeAnimation(animator, idleAnim, crouchAnim, CROUCH, 0, blendAmount, blendRate, state);
-		break;
-
-	case CROUCH:
-		if (glfwGetKey(window, controls.crouch) == GLFW_RELEASE) {
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&crouchAnim, &idleAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = CROUCH_IDLE;
-		}
-		else if (glfwGetKey(window, controls.testCrouchBlock) == GLFW_PRESS) {
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&crouchAnim, &crouchBlockAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = CROUCH_BLOCK;
-		}
-		else if (glfwGetKey(window, controls.testHurt) == GLFW_PRESS) {
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&crouchAnim, &standHitAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = CROUCH_HIT;
-		}
-		break;
-
-	case CROUCH_IDLE:
-		BridgeAnimation(animator, crouchAnim, idleAnim, IDLE, 0, blendAmount, blendRate, state);
-		break;
-
-	case CROUCH_HIT:
-		BridgeAnimation(animator, crouchAnim, standHitAnim, HIT_IDLE, 0, blendAmount, blendRate, state);
-		break;
-
-	case HIT_CROUCH:
-		BridgeAnimation(animator, standHitAnim, idleAnim, IDLE, 0.2f, blendAmount, blendRate, state);
-		break;
-
-	case CROUCH_BLOCK:
-		BridgeAnimation(animator, crouchAnim, crouchBlockAnim, BLOCK_CROUCH, 0, blendAmount, blendRate, state);
-		break;
-
-	case BLOCK_CROUCH:
-		BridgeAnimation(animator, crouchBlockAnim, crouchAnim, CROUCH, 0.2f, blendAmount, blendRate, state);
-		break;
-
-		// ========================= WALK =========================
-	case IDLE_WALK:
-		BridgeAnimation(animator, idleAnim, walkAnim, WALK, 0, blendAmount, blendRate, state);
-		break;
-
-	case WALK:
-		animator.PlayAnimation(&walkAnim, NULL, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-
-		if (glfwGetKey(window, controls.punch) == GLFW_PRESS) {
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&idleAnim, &punchAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = IDLE_PUNCH;
-		}
-		else if (glfwGetKey(window, controls.crouch) == GLFW_PRESS) {
-			blendAmount = 0.0f;
-			animator.PlayAnimation(&idleAnim, &crouchAnim, animator.m_CurrentTime, 0.0f, blendAmount);
-			state = IDLE_CROUCH;
-		}
-		else if (glfwGetKey(window, controls.moveLeft) != GLFW_PRESS &&
-			glfwGetKey(window, controls.moveRight) != GLFW_PRESS)
-		{
-			state = WALK_IDLE;
-		}
-		break;
-
-	case WALK_IDLE:
-		BridgeAnimation(animator, walkAnim, idleAnim, IDLE, 0, blendAmount, blendRate, state);
-		break;
-
-		// ========================= PUNCH =========================
-	case IDLE_PUNCH:
-		BridgeAnimation(animator, idleAnim, punchAnim, PUNCH_IDLE, 0, blendAmount, blendRate, state);
-		break;
-
-	case PUNCH_IDLE:
-		BridgeAnimation(animator, punchAnim, idleAnim, IDLE, 0.7f, blendAmount, blendRate, state);
-		break;
-
-		// ========================= Kick =========================
-	case IDLE_KICK:
-		BridgeAnimation(animator, idleAnim, jumpKickAnim, KICK_IDLE, 0, blendAmount, blendRate, state);
-		break;
-
-	case KICK_IDLE:
-		BridgeAnimation(animator, jumpKickAnim, idleAnim, IDLE, 2.0f, blendAmount, blendRate, state);
-		break;
-
-		// ========================= Hit =========================
-	case IDLE_HIT:
-		BridgeAnimation(animator, idleAnim, standHitAnim, HIT_IDLE, 0, blendAmount, blendRate, state);
-		break;
-
-	case HIT_IDLE:
-		BridgeAnimation(animator, standHitAnim, idleAnim, IDLE, 1.0f, blendAmount, blendRate, state);
-		break;
-
-		// ========================= Block =========================
-	case IDLE_BLOCK:
-		BridgeAnimation(animator, idleAnim, standBlockAnim, BLOCK_IDLE, 0, blendAmount, blendRate, state);
-		break;
-
-	case BLOCK_IDLE:
-		BridgeAnimation(animator, standBlockAnim, idleAnim, IDLE, 0.5f, blendAmount, blendRate, state);
-		break;
-	}
-
+	unsigned int h = frame * 2654435761u ^ (axis + 1) * 2246822519u;
+	h ^= h >> 15;
+	h *= 2246822519u;
+	h ^= h >> 13;
+	return (h % 1000) / 1000.0f - 0.5f;
 }
 
-void DrawBar(Shader& uiShader, float x, float y, float width, float height, float percent, const glm::vec3& color)
+// one frame of the loading screen: a progress bar in the middle of a cleared window
+void DrawLoadingScreen(GLFWwindow* window, RenderState& state, Shader& uiShader, UIBatch& ui, float progress)
 {
-	uiShader.use();
-
-	uiShader.setVec3("barColor", color.x, color.y, color.z);
-
-	// 1. Set Projection
-	glm::mat4 ortho = glm::ortho(0.0f, (float)SCR_WIDTH, 0.0f, (float)SCR_HEIGHT);
-	uiShader.setMat4("projection", ortho);
-
-	glDisable(GL_DEPTH_TEST);
-
-	// 2. Calculate vertices (only for the filled bar portion)
-	float vertices[] = {
-		x, y,
-		x + width * percent, y,
-		x + width * percent, y + height,
-		x, y + height
-	};
-
-	// 3. Update VBO data
-	// ... VAO/VBO binding and attribute setup ...
-	// You must re-send the data because the bar width (percent) changes!
-
-	GLuint VAO, VBO; // In-function declaration for simplicity
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
-
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-
-	// 4. Draw
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-
-	// 5. Cleanup
-	glBindVertexArray(0);
-	glDeleteBuffers(1, &VBO);
-	glDeleteVertexArrays(1, &VAO);
-
-	glEnable(GL_DEPTH_TEST);
+	// asset uploads ran since the last loading frame
+	state.Invalidate();
+
+	glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	state.SetEnabled(GL_DEPTH_TEST, false);
+
+	float barWidth = 400.0f;
+	float barHeight = 20.0f;
+	float x = (SCR_WIDTH - barWidth) * 0.5f;
+	float y = (SCR_HEIGHT - barHeight) * 0.5f;
+	ui.AddQuad(BarQuad(x, y, barWidth, barHeight, 1.0f, glm::vec3(0.2f, 0.2f, 0.2f)));
+	ui.AddQuad(BarQuad(x, y, barWidth, barHeight, progress, glm::vec3(1.0f, 1.0f, 1.0f)));
+
+	state.UseProgram(uiShader.ID);
+	ui.Flush(state);
+
+	state.SetEnabled(GL_DEPTH_TEST, true);
+	glfwSwapBuffers(window);
+	glfwPollEvents();
 }
-
-unsigned int loadCubemap(vector<std::string> faces)
-{
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++)
-	{
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-				0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		}
-		else
-		{
-			std::cout << "Cubemap failed to load at: " << faces[i] << std::endl;
-		}
-		stbi_image_free(data);
-	}
-
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	return textureID;
-}
\ No newline at end of file
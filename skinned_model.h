@@ -0,0 +1,149 @@
+// skinned_model.h
+//
+// GL side of a ModelData: one VAO/VBO/EBO per mesh with the same attribute layout
+// learnopengl's Mesh uses (so anim_model.vs is unchanged). Diffuse textures are
+// uploaded beforehand by the asset loader and looked up here by file name. Bone
+// matrices come from bone_palette.h. Draws bind through a RenderState
+// (render_state.h); the caller binds the program and sets its uniforms.
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include "asset_data.h"
+#include "render_state.h"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+class SkinnedModel
+{
+public:
+	static const GLuint INSTANCE_MODEL_LOCATION = 7;
+
+	// 'textures' maps MeshData::diffuseTexture names to GL texture ids; missing ones draw untextured
+	void Init(const ModelData& data, const std::map<std::string, unsigned int>& textures)
+	{
+		std::vector<MeshView> views;
+		for (const MeshData& mesh : data.meshes)
+			views.push_back(ViewMesh(mesh));
+		Init(views, textures);
+	}
+
+	// The arrays are only read by the upload, so they may be a mapped asset cache's
+	// (MappedAsset) that is unmapped right after.
+	void Init(const std::vector<MeshView>& data, const std::map<std::string, unsigned int>& textures)
+	{
+		meshes.resize(data.size());
+		for (size_t m = 0; m < data.size(); ++m)
+		{
+			const MeshView& src = data[m];
+			GpuMesh& mesh = meshes[m];
+			mesh.indexCount = (GLsizei)src.indexCount;
+			mesh.texture = 0;
+
+			if (!src.diffuseTexture->empty())
+			{
+				auto it = textures.find(*src.diffuseTexture);
+				if (it != textures.end())
+					mesh.texture = it->second;
+			}
+
+			glGenVertexArrays(1, &mesh.vao);
+			glGenBuffers(1, &mesh.vbo);
+			glGenBuffers(1, &mesh.ebo);
+
+			glBindVertexArray(mesh.vao);
+			glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+			glBufferData(GL_ARRAY_BUFFER, src.vertexCount * sizeof(SkinVertex), src.vertices, GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, src.indexCount * sizeof(unsigned int), src.indices, GL_STATIC_DRAW);
+
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, texCoords));
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, tangent));
+			glEnableVertexAttribArray(4);
+			glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, bitangent));
+			glEnableVertexAttribArray(5);
+			glVertexAttribIPointer(5, MAX_BONE_WEIGHTS, GL_INT, sizeof(SkinVertex), (void*)offsetof(SkinVertex, boneIds));
+			glEnableVertexAttribArray(6);
+			glVertexAttribPointer(6, MAX_BONE_WEIGHTS, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, weights));
+
+			glBindVertexArray(0);
+		}
+	}
+
+	// texture_diffuse1 is left at its default, unit 0
+	void Draw(RenderState& state) const
+	{
+		for (const GpuMesh& mesh : meshes)
+		{
+			state.BindTexture(0, GL_TEXTURE_2D, mesh.texture);
+			state.BindVertexArray(mesh.vao);
+			glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0);
+		}
+	}
+
+	// Per-instance model matrices for DrawInstanced: attribute locations 7-10 read one
+	// mat4 per instance from 'instanceVbo' (see instanced_skinning.h). Draw() is
+	// unaffected, its shaders don't declare them. Nothing to do when 'instanceVbo' is
+	// already attached, so batches sharing a model (asset_loader.h) can each attach
+	// theirs right before they draw.
+	void AttachInstances(RenderState& state, GLuint instanceVbo)
+	{
+		if (instanceVbo == attachedInstances)
+			return;
+		for (const GpuMesh& mesh : meshes)
+		{
+			state.BindVertexArray(mesh.vao);
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+			for (int column = 0; column < 4; ++column)
+			{
+				GLuint location = INSTANCE_MODEL_LOCATION + column;
+				glEnableVertexAttribArray(location);
+				glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+				glVertexAttribDivisor(location, 1);
+			}
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		attachedInstances = instanceVbo;
+	}
+
+	void DrawInstanced(RenderState& state, GLsizei instances) const
+	{
+		for (const GpuMesh& mesh : meshes)
+		{
+			state.BindTexture(0, GL_TEXTURE_2D, mesh.texture);
+			state.BindVertexArray(mesh.vao);
+			glDrawElementsInstanced(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0, instances);
+		}
+	}
+
+	void Release()
+	{
+		for (GpuMesh& mesh : meshes)
+		{
+			glDeleteBuffers(1, &mesh.ebo);
+			glDeleteBuffers(1, &mesh.vbo);
+			glDeleteVertexArrays(1, &mesh.vao);
+		}
+		meshes.clear();
+		attachedInstances = 0;
+	}
+
+private:
+	struct GpuMesh {
+		GLuint vao, vbo, ebo;
+		GLsizei indexCount;
+		unsigned int texture;
+	};
+	std::vector<GpuMesh> meshes;
+	GLuint attachedInstances = 0;
+};
@@ -0,0 +1,110 @@
+// skinning.h
+//
+// GPU palette formats. The pose cache always produces full mat4 bones; before
+// upload they can be packed smaller:
+//
+//   SKIN_MAT4       64 bytes/bone, anim_model.vs        (the original path)
+//   SKIN_AFFINE3X4  48 bytes/bone, anim_model_3x4.vs    three rows of the affine matrix
+//   SKIN_DUALQUAT   32 bytes/bone, anim_model_dq.vs     unit dual quaternion (real, dual)
+//
+// Dual quaternions carry rotation and translation only. That matches the Mixamo
+// rigs (their bone palettes are rigid); a rig with scaled bones should use 3x4.
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstring>
+
+enum SkinningMode
+{
+	SKIN_MAT4,
+	SKIN_AFFINE3X4,
+	SKIN_DUALQUAT,
+	SKIN_MODE_COUNT
+};
+
+// vec4s per bone in the BonePalette block
+inline int SkinningVec4sPerBone(SkinningMode mode)
+{
+	switch (mode)
+	{
+	case SKIN_AFFINE3X4: return 3;
+	case SKIN_DUALQUAT:  return 2;
+	default:             return 4;
+	}
+}
+
+inline const char* SkinningModeName(SkinningMode mode)
+{
+	switch (mode)
+	{
+	case SKIN_AFFINE3X4: return "3x4";
+	case SKIN_DUALQUAT:  return "dq";
+	default:             return "mat4";
+	}
+}
+
+inline const char* SkinningVertexShader(SkinningMode mode)
+{
+	switch (mode)
+	{
+	case SKIN_AFFINE3X4: return "anim_model_3x4.vs";
+	case SKIN_DUALQUAT:  return "anim_model_dq.vs";
+	default:             return "anim_model.vs";
+	}
+}
+
+// "mat4", "3x4" or "dq"; anything else falls back to mat4
+inline SkinningMode ParseSkinningMode(const char* name)
+{
+	for (int m = 0; m < SKIN_MODE_COUNT; ++m)
+		if (strcmp(name, SkinningModeName((SkinningMode)m)) == 0)
+			return (SkinningMode)m;
+	return SKIN_MAT4;
+}
+
+// rows of the upper 3x4 of a column-major affine matrix; the shader does dot(row, vec4(p, 1))
+inline void PackBone3x4(const glm::mat4& m, glm::vec4 out[3])
+{
+	for (int r = 0; r < 3; ++r)
+		out[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+}
+
+// out[0] = rotation (x, y, z, w), out[1] = dual part 0.5 * t * rotation
+inline void PackBoneDQ(const glm::mat4& m, glm::vec4 out[2])
+{
+	// cached poses are lerped matrices, so re-orthonormalize before taking the rotation
+	glm::vec3 x = glm::normalize(glm::vec3(m[0]));
+	glm::vec3 y = glm::normalize(glm::vec3(m[1]) - x * glm::dot(x, glm::vec3(m[1])));
+	glm::vec3 z = glm::cross(x, y);
+	glm::quat q = glm::quat_cast(glm::mat3(x, y, z));
+	glm::vec3 t(m[3]);
+
+	// (0, t) * q
+	glm::vec3 dualV = q.w * t + glm::cross(t, glm::vec3(q.x, q.y, q.z));
+	float dualW = -glm::dot(t, glm::vec3(q.x, q.y, q.z));
+
+	out[0] = glm::vec4(q.x, q.y, q.z, q.w);
+	out[1] = 0.5f * glm::vec4(dualV, dualW);
+}
+
+// Packs 'count' bones into 'out' (count * SkinningVec4sPerBone(mode) vec4s).
+inline void PackPalette(SkinningMode mode, const glm::mat4* bones, int count, glm::vec4* out)
+{
+	switch (mode)
+	{
+	case SKIN_AFFINE3X4:
+		for (int i = 0; i < count; ++i)
+			PackBone3x4(bones[i], out + i * 3);
+		break;
+	case SKIN_DUALQUAT:
+		for (int i = 0; i < count; ++i)
+			PackBoneDQ(bones[i], out + i * 2);
+		break;
+	default:
+		memcpy((void*)out, bones, count * sizeof(glm::mat4));
+		break;
+	}
+}
@@ -0,0 +1,319 @@
+// alloc_check.cpp
+//
+// Checks that the per-frame work of the game loop never touches the heap once it
+// has warmed up. Built with heap tracking (frame_arena.h), it runs each stage for
+// many ticks on a synthetic rig and counts operator new calls per tick:
+//
+//   sim        Step() under random input with the tick recorded (RecordTick)
+//   online     a pair of RollbackSessions over a fixed-size loopback link
+//   pose       EvaluateBlend in both modes for two fighters, through transitions, and
+//              a layered pose (ApplyLayers)
+//   upload     PackPalette in every skinning mode, the CPU side of the bone upload
+//   arena      a FrameArena asked for a different amount every tick, growing from
+//              empty; once it has seen the largest frame it must stop allocating
+//   frame      what the game does every frame short of GL: Step(), then
+//              BuildRenderPacket (frame_build.h) for two characters whose clips
+//              stream through a ClipRegistry with fewer blocks than clips, a crowd
+//              and the HP bars. The debug buttons are pressed now and then. Counts
+//              the registry's bakes on the workers too
+//
+//   alloc_check [ticks] [seed]
+//
+// The first WARMUP_TICKS ticks of each stage are not counted. The exit code is
+// non-zero if any later tick allocates.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> -I<path to glad> alloc_check.cpp -o alloc_check -pthread
+
+#define TRACK_ALLOCATIONS
+#include "../frame_arena.h"
+
+#include "../blend_tree.h"
+#include "../frame_build.h"
+#include "../match_sim.h"
+#include "../pose_bake.h"
+#include "../replay.h"
+#include "../rollback.h"
+#include "../skinning.h"
+#include "synthetic_rig.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+const int WARMUP_TICKS = 60;
+
+// Held buttons change every few ticks, like a player mashing (bench.cpp's MashInput),
+// with a debug button once in a while if asked. No jump: IDLE_JUMP has no way back
+// to IDLE.
+static InputFrame MashInput(unsigned int& rng, unsigned short& held, bool debugButtons = false)
+{
+	if ((NextRandom(rng) & 7) == 0)
+	{
+		held = (unsigned short)(NextRandom(rng) & (BUTTON_LEFT | BUTTON_RIGHT | BUTTON_JUMP_KICK | BUTTON_PUNCH | BUTTON_CROUCH));
+		if (debugButtons && (NextRandom(rng) & 31) == 0)
+			held |= (unsigned short)(BUTTON_STAND_BLOCK << (NextRandom(rng) % 3));
+	}
+	return UnpackInput(held);
+}
+
+// Loopback like FakeTransport, but into a fixed ring of fixed-size packets, so the
+// link itself never allocates. Packets arrive 'delay' ticks after they are sent.
+class RingTransport : public Transport
+{
+public:
+	static const int SLOTS = 64;
+	static const int PACKET_BYTES = 128;
+	unsigned int delay = 2;
+
+	static void Connect(RingTransport& a, RingTransport& b)
+	{
+		a.peer = &b;
+		b.peer = &a;
+	}
+
+	void Tick() { ++now; }
+
+	void Send(const void* data, int size) override
+	{
+		if (!peer || size > PACKET_BYTES || peer->count == SLOTS)
+			return;
+		Slot& slot = peer->slots[(peer->first + peer->count) % SLOTS];
+		slot.deliverAt = peer->now + delay;
+		slot.size = size;
+		memcpy(slot.bytes, data, size);
+		peer->count++;
+	}
+
+	int Receive(void* buffer, int capacity) override
+	{
+		if (count == 0 || slots[first].deliverAt > now)
+			return 0;
+		Slot& slot = slots[first];
+		int size = slot.size < capacity ? slot.size : capacity;
+		memcpy(buffer, slot.bytes, size);
+		first = (first + 1) % SLOTS;
+		count--;
+		return size;
+	}
+
+private:
+	struct Slot {
+		unsigned int deliverAt;
+		int size;
+		unsigned char bytes[PACKET_BYTES];
+	};
+
+	RingTransport* peer = NULL;
+	Slot slots[SLOTS];
+	int first = 0;
+	int count = 0;
+	unsigned int now = 0;
+};
+
+// Runs 'tick' 'ticks' times and reports the ticks after warm-up that allocated.
+static bool CheckStage(const char* name, int ticks, const std::function<void(int)>& tick)
+{
+	AllocationWatch watch(WARMUP_TICKS);
+	int firstAllocating = -1;
+	for (int t = 0; t < ticks; ++t)
+	{
+		watch.BeginFrame();
+		tick(t);
+		if (watch.EndFrame() > 0 && t >= WARMUP_TICKS && firstAllocating < 0)
+			firstAllocating = t;
+	}
+	bool ok = watch.AllocatingFrames() == 0;
+	printf("%-8s %d ticks, %d allocated", name, watch.SteadyFrames(), watch.AllocatingFrames());
+	if (!ok)
+		printf(" (first at tick %d, at most %llu in one)", firstAllocating, watch.Worst());
+	printf("  %s\n", ok ? "OK" : "ALLOCATES");
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	int ticks = argc > 1 ? atoi(argv[1]) : 20000;
+	unsigned int rng = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 1u;
+	if (rng == 0)
+		rng = 1;
+	if (ticks <= WARMUP_TICKS)
+		ticks = WARMUP_TICKS + 1;
+	bool ok = true;
+
+	// sim: a local match, recorded, restarted at every KO
+	{
+		MatchState match;
+		InitMatch(match);
+		Replay recording;
+		BeginReplay(recording, match, 0);
+		unsigned short held[2] = { 0, 0 };
+		ok &= CheckStage("sim", ticks, [&](int) {
+			InputFrame p1 = MashInput(rng, held[0]);
+			InputFrame p2 = MashInput(rng, held[1]);
+			Step(match, p1, p2);
+			RecordTick(recording, p1, p2);
+			if (match.p[0].HP <= 0.0f || match.p[1].HP <= 0.0f)
+			{
+				InitMatch(match);
+				BeginReplay(recording, match, 0);
+			}
+		});
+	}
+
+	// online: both ends of a rollback session; the delay makes every tick predict
+	{
+		MatchState match;
+		InitMatch(match);
+		RingTransport links[2];
+		RingTransport::Connect(links[0], links[1]);
+		RollbackSession session0(links[0], 0, match);
+		RollbackSession session1(links[1], 1, match);
+		unsigned short held[2] = { 0, 0 };
+		ok &= CheckStage("online", ticks, [&](int) {
+			session0.AdvanceFrame(MashInput(rng, held[0]));
+			session1.AdvanceFrame(MashInput(rng, held[1]));
+			links[0].Tick();
+			links[1].Tick();
+		});
+	}
+
+	// pose: about the size of the Mixamo rigs, 65 bones, one clip per ClipId
+	ModelData model;
+	ClipData clips[CLIP_COUNT];
+	for (int c = 0; c < CLIP_COUNT; ++c)
+		MakeRig(65, 31, TreeParent, rng, model, clips[c]);
+	PoseCache cache;
+	BakePoseCache(cache, model, clips);
+	std::vector<glm::mat4> palettes(2 * MAX_BONES, glm::mat4(1.0f));
+	{
+		std::vector<float> weights(cache.boneCount, 0.0f);
+		for (int b = cache.boneCount / 2; b < cache.boneCount; ++b)
+			weights[b] = 1.0f;
+		BoneMask mask;
+		BuildBoneMask(weights, mask);
+		Inertializer inert[2];
+		for (int p = 0; p < 2; ++p)
+			InitInertializer(inert[p], cache.boneCount);
+
+		ok &= CheckStage("pose", ticks, [&](int t) {
+			// a new pair of clips every 20 ticks, crossfading for the first 10
+			for (int p = 0; p < 2; ++p)
+			{
+				int phase = t / 20 + p;
+				AnimClock anim = { (ClipId)(phase % CLIP_COUNT), CLIP_NONE, fmodf(t * 0.5f, 30.0f), 0.0f, 0.0f };
+				if (t % 20 < 10)
+				{
+					anim.clip2 = (ClipId)((phase + 1) % CLIP_COUNT);
+					anim.time2 = anim.time;
+					anim.blend = (t % 20) / 10.0f;
+				}
+				BlendMode mode = (t / 200) % 2 ? BLEND_INERTIAL : BLEND_CROSSFADE;
+				EvaluateBlend(mode, cache, anim, SIM_DT, inert[p], &palettes[p * MAX_BONES]);
+			}
+			PoseLayer layer = { CLIP_PUNCH, fmodf(t * 0.5f, 30.0f), 1.0f, &mask };
+			ApplyLayers(cache, &layer, 1, palettes.data());
+		});
+	}
+
+	// upload: pack both palettes the way BonePaletteBuffer does
+	{
+		std::vector<glm::vec4> packed(2 * MAX_BONES * 4);
+		ok &= CheckStage("upload", ticks, [&](int t) {
+			SkinningMode mode = (SkinningMode)(t % SKIN_MODE_COUNT);
+			PackPalette(mode, palettes.data(), 2 * cache.boneCount, packed.data());
+		});
+	}
+
+	// arena: starts empty and grows until it holds the largest frame (4 KB to 64 KB)
+	{
+		FrameArena arena;
+		ok &= CheckStage("arena", ticks, [&](int t) {
+			arena.Reset();
+			int blocks = 1 + (t * 7) % 16;
+			for (int b = 0; b < blocks; ++b)
+			{
+				glm::mat4* scratch = arena.Alloc<glm::mat4>(64);
+				scratch[0] = glm::mat4((float)b);
+			}
+		});
+		printf("         arena settled at %zu KB\n", arena.Capacity() / 1024);
+	}
+
+	// frame: two characters loaded the way the game loads them, only the startup
+	// and crowd clips baked, the rest streamed into the registry's minimum of blocks.
+	// The spectators are all P1's, so P2 streams everything but idle and walk and
+	// there are more clips than blocks.
+	{
+		std::vector<CrowdMember> stands, crowd;
+		BuildCrowd(128, stands);
+		for (const CrowdMember& member : stands)
+			if (member.character == 0)
+				crowd.push_back(member);
+		ModelData models[2];
+		CompressedClip compressed[2][CLIP_COUNT];
+		PoseCache caches[2];
+		JobSystem jobs(2);
+		ClipRegistry registry(jobs, 0);
+		BoneMask masks[2];
+		Inertializer inertial[2];
+		std::vector<glm::mat4> fighterPoses(2 * MAX_BONES, glm::mat4(1.0f));
+
+		PacketSources sources = {};
+		for (int ch = 0; ch < 2; ++ch)
+		{
+			for (int c = 0; c < CLIP_COUNT; ++c)
+			{
+				ClipData clip;
+				MakeRig(65, 31, TreeParent, rng, models[ch], clip);
+				CompressClip(clip, ClipCompression(), compressed[ch][c]);
+			}
+			BakePoseCache(caches[ch], models[ch], compressed[ch], NULL, STARTUP_CLIPS | CrowdClips(crowd, ch));
+			sources.clipCharacters[ch] = registry.AddCharacter(caches[ch], models[ch], compressed[ch]);
+
+			std::vector<float> weights(caches[ch].boneCount, 0.0f);
+			for (int b = caches[ch].boneCount / 2; b < caches[ch].boneCount; ++b)
+				weights[b] = 1.0f;
+			BuildBoneMask(weights, masks[ch]);
+			InitInertializer(inertial[ch], caches[ch].boneCount);
+
+			sources.poses[ch] = &caches[ch];
+			sources.inertial[ch] = &inertial[ch];
+			sources.crowdMasks[ch] = &masks[ch];
+			sources.crowdCapacity[ch] = CrowdCount(crowd, ch);
+			sources.crowdBonesPerInstance[ch] = caches[ch].boneCount;
+		}
+		sources.clips = &registry;
+		sources.fighterPoses = fighterPoses.data();
+		sources.blendMode = BLEND_INERTIAL;
+		sources.crowd = &crowd;
+		sources.hudWidth = 1000.0f;
+
+		MatchState match, previous;
+		InitMatch(match);
+		RenderPacket packet;
+		unsigned short held[2] = { 0, 0 };
+		int loadsAtWarmup = 0;
+		ok &= CheckStage("frame", ticks, [&](int t) {
+			packet.Reset(t);
+			previous = match;
+			InputFrame p1 = MashInput(rng, held[0], true);
+			InputFrame p2 = MashInput(rng, held[1], true);
+			Step(match, p1, p2);
+			if (match.p[0].HP <= 0.0f || match.p[1].HP <= 0.0f)
+				InitMatch(match);
+			BuildRenderPacket(sources, previous, match, 0.5f, SIM_DT, t * SIM_DT, packet);
+			if (t == WARMUP_TICKS)
+				loadsAtWarmup = registry.Loads();
+		});
+		registry.Drain();
+		printf("         %d blocks for %d clips, %d streamed in after warm-up, %d evicted, %d missed\n", registry.Blocks(),
+			2 * CLIP_COUNT, registry.Loads() - loadsAtWarmup, registry.Evictions(), registry.Misses());
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,511 @@
+// bench.cpp
+//
+// Micro and macro benchmarks for the animation and simulation hot paths, run on
+// synthetic rigs so no assets or GPU are needed:
+//
+//   pose/single              EvaluatePose, one clip (the old Animator::UpdateAnimation)
+//   pose/blended             EvaluatePose, two clips crossfaded as BridgeAnimation drives it
+//   pose/inertial            the same transition inertialized (blend_tree.h): one clip
+//                            plus the decaying offset
+//   pose/layered             one clip with a second one layered over half the bones
+//   hierarchy/depth:N        one PoseHierarchy walk of an N node chain with full tracks
+//                            (the old CalculateBoneTransform recursion)
+//   hierarchy_soa/depth:N    the same walk through PoseHierarchySoA, the baker's path
+//   sim/step                 one Step() of a match under random input, both players
+//   sim/round                whole rounds of scripted play until a KO; items are ticks
+//   sim/anim-graph           the state machine of a batch of players under random input,
+//                            one compiled table lookup each; items are players
+//   collision/1v1            FindHits with both players' hitboxes out: joints sampled
+//                            from a JointTable, 20 hurtboxes posed, broad and narrow
+//                            phase; the worst case of one sim tick
+//   collision/2v2+projectiles FindContacts over four bodies, four hitboxes and eight
+//                            projectile capsules
+//   palette/pack:<mode>      PackPalette for a 100 bone palette, the CPU side of the
+//                            bone upload (the glBufferSubData itself needs a context)
+//
+//   bench [--filter <substring>] [--min-time <seconds>] [--repetitions <n>] [--json <file>]
+//
+// Like Google Benchmark, every benchmark first grows its iteration count until one
+// run takes --min-time. It then reports the median of --repetitions such runs. --json
+// writes the results in Google Benchmark's JSON layout; compare two of those with
+// bench_compare.py.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> bench.cpp -o bench
+
+#include "../blend_tree.h"
+#include "../match_sim.h"
+#include "../pose_bake.h"
+#include "../skinning.h"
+#include "synthetic_rig.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// keeps the optimizer from deleting work whose result is never used
+template <typename T>
+inline void DoNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const void* sink;
+	sink = &value;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// harness
+// ----------------------------------------------------------------------------
+
+struct BenchResult {
+	std::string name;
+	long long iterations;
+	double nsPerIteration;   // median over repetitions, wall clock
+	double cpuNsPerIteration;
+	double stddev;           // of the repetitions, ns
+	double itemsPerSecond;   // 0 when the benchmark has no item count
+};
+
+struct BenchOptions {
+	std::string filter;
+	double minTime = 0.2;
+	int repetitions = 5;
+};
+
+// 'body' runs 'iterations' iterations of the measured work; every iteration is 'items' items
+typedef std::function<void(long long iterations)> BenchBody;
+
+// wall seconds; process CPU seconds go to 'cpuSeconds'
+static double TimeRun(const BenchBody& body, long long iterations, double* cpuSeconds = NULL)
+{
+	std::clock_t cpuStart = std::clock();
+	auto start = std::chrono::steady_clock::now();
+	body(iterations);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (cpuSeconds)
+		*cpuSeconds = (double)(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+	return seconds;
+}
+
+static void RunBench(const BenchOptions& options, std::vector<BenchResult>& results,
+	const std::string& name, double items, const BenchBody& body)
+{
+	if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+		return;
+
+	// grow until one run is long enough to time, then size the real runs from that
+	long long iterations = 1;
+	double seconds = TimeRun(body, iterations);
+	while (seconds < options.minTime / 10.0 && iterations < (1LL << 40))
+	{
+		iterations *= 10;
+		seconds = TimeRun(body, iterations);
+	}
+	iterations = std::max(1LL, (long long)(iterations * options.minTime / std::max(seconds, 1e-9)));
+
+	std::vector<double> perIteration, cpuPerIteration;
+	for (int r = 0; r < options.repetitions; ++r)
+	{
+		double cpuSeconds;
+		perIteration.push_back(TimeRun(body, iterations, &cpuSeconds) * 1e9 / iterations);
+		cpuPerIteration.push_back(cpuSeconds * 1e9 / iterations);
+	}
+
+	std::vector<double> sorted = perIteration;
+	std::sort(sorted.begin(), sorted.end());
+	std::sort(cpuPerIteration.begin(), cpuPerIteration.end());
+	double mean = 0.0, variance = 0.0;
+	for (double v : perIteration)
+		mean += v / perIteration.size();
+	for (double v : perIteration)
+		variance += (v - mean) * (v - mean) / perIteration.size();
+
+	BenchResult result;
+	result.name = name;
+	result.iterations = iterations;
+	result.nsPerIteration = sorted[sorted.size() / 2];
+	result.cpuNsPerIteration = cpuPerIteration[cpuPerIteration.size() / 2];
+	result.stddev = sqrt(variance);
+	result.itemsPerSecond = items > 0.0 ? items * 1e9 / result.nsPerIteration : 0.0;
+	results.push_back(result);
+
+	printf("%-28s %14.1f ns %10.1f ns %12lld", name.c_str(), result.nsPerIteration, result.stddev, iterations);
+	if (items > 0.0)
+		printf(" %14.0f items/s", result.itemsPerSecond);
+	printf("\n");
+	fflush(stdout);
+}
+
+static bool WriteJson(const char* path, const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		printf("can't write %s\n", path);
+		return false;
+	}
+	char date[64];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+	fprintf(file, "{\n  \"context\": {\n");
+	fprintf(file, "    \"date\": \"%s\",\n", date);
+	fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+	fprintf(file, "    \"min_time\": %g,\n", options.minTime);
+	fprintf(file, "    \"repetitions\": %d\n", options.repetitions);
+	fprintf(file, "  },\n  \"benchmarks\": [");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchResult& r = results[i];
+		fprintf(file, "%s\n    {\"name\": \"%s\", \"iterations\": %lld, \"real_time\": %.3f, \"cpu_time\": %.3f, "
+			"\"real_time_stddev\": %.3f, \"time_unit\": \"ns\"",
+			i ? "," : "", r.name.c_str(), r.iterations, r.nsPerIteration, r.cpuNsPerIteration, r.stddev);
+		if (r.itemsPerSecond > 0.0)
+			fprintf(file, ", \"items_per_second\": %.1f", r.itemsPerSecond);
+		fprintf(file, "}");
+	}
+	fprintf(file, "\n  ]\n}\n");
+	return fclose(file) == 0;
+}
+
+// ----------------------------------------------------------------------------
+// benchmarks
+// ----------------------------------------------------------------------------
+
+static void PoseBenchmarks(const BenchOptions& options, std::vector<BenchResult>& results)
+{
+	// about the size of the Mixamo rigs: 65 bones, 9 clips
+	unsigned int rng = 1;
+	ModelData model;
+	ClipData clips[CLIP_COUNT];
+	for (int c = 0; c < CLIP_COUNT; ++c)
+		MakeRig(65, 31, TreeParent, rng, model, clips[c]);
+	PoseCache cache;
+	BakePoseCache(cache, model, clips);
+
+	std::vector<glm::mat4> palette(MAX_BONES);
+
+	RunBench(options, results, "pose/single", 0.0, [&](long long iterations) {
+		AnimClock anim = { CLIP_WALK, CLIP_NONE, 0.0f, 0.0f, 0.0f };
+		for (long long i = 0; i < iterations; ++i)
+		{
+			anim.time = fmodf(anim.time + 0.5f, 30.0f);
+			EvaluatePose(cache, anim, palette.data());
+			DoNotOptimize(palette[0]);
+		}
+	});
+
+	RunBench(options, results, "pose/blended", 0.0, [&](long long iterations) {
+		AnimClock anim = { CLIP_IDLE, CLIP_PUNCH, 0.0f, 0.0f, 0.5f };
+		for (long long i = 0; i < iterations; ++i)
+		{
+			anim.time = fmodf(anim.time + 0.5f, 30.0f);
+			anim.time2 = fmodf(anim.time2 + 0.5f, 30.0f);
+			EvaluatePose(cache, anim, palette.data());
+			DoNotOptimize(palette[0]);
+		}
+	});
+
+	RunBench(options, results, "pose/inertial", 0.0, [&](long long iterations) {
+		AnimClock anim = { CLIP_IDLE, CLIP_PUNCH, 0.0f, 0.0f, 0.5f };
+		Inertializer inert;
+		inert.target = CLIP_IDLE;   // the first call starts the transition
+		inert.duration = 1e9f;
+		for (long long i = 0; i < iterations; ++i)
+		{
+			anim.time = fmodf(anim.time + 0.5f, 30.0f);
+			anim.time2 = fmodf(anim.time2 + 0.5f, 30.0f);
+			EvaluateInertial(cache, anim, SIM_DT, inert, palette.data());
+			DoNotOptimize(palette[0]);
+		}
+	});
+
+	std::vector<float> weights(cache.boneCount, 0.0f);
+	for (int b = cache.boneCount / 2; b < cache.boneCount; ++b)
+		weights[b] = 1.0f;
+	BoneMask mask;
+	BuildBoneMask(weights, mask);
+	RunBench(options, results, "pose/layered", 0.0, [&](long long iterations) {
+		AnimClock anim = { CLIP_WALK, CLIP_NONE, 0.0f, 0.0f, 0.0f };
+		PoseLayer layer = { CLIP_PUNCH, 0.0f, 1.0f, &mask };
+		for (long long i = 0; i < iterations; ++i)
+		{
+			anim.time = fmodf(anim.time + 0.5f, 30.0f);
+			layer.time = anim.time;
+			EvaluatePose(cache, anim, palette.data());
+			ApplyLayers(cache, &layer, 1, palette.data());
+			DoNotOptimize(palette[0]);
+		}
+	});
+}
+
+static void HierarchyBenchmarks(const BenchOptions& options, std::vector<BenchResult>& results)
+{
+	const int depths[] = { 1, 4, 16, 64 };
+	for (int depth : depths)
+	{
+		unsigned int rng = 2;
+		ModelData model;
+		ClipData clip;
+		MakeRig(depth, 31, ChainParent, rng, model, clip);
+
+		std::vector<const TrackData*> tracks(depth);
+		std::vector<const BoneData*> bones(depth);
+		for (int n = 0; n < depth; ++n)
+		{
+			tracks[n] = &clip.tracks[n];
+			bones[n] = &model.bones[clip.nodes[n].name];
+		}
+		std::vector<glm::mat4> globals(depth), palette(depth);
+
+		RunBench(options, results, "hierarchy/depth:" + std::to_string(depth), depth, [&](long long iterations) {
+			float time = 0.0f;
+			for (long long i = 0; i < iterations; ++i)
+			{
+				time = fmodf(time + 0.37f, clip.duration);
+				PoseHierarchy(clip, tracks.data(), bones.data(), time, globals.data(), palette.data());
+				DoNotOptimize(palette[depth - 1]);
+			}
+		});
+
+		PoseLocalsSoA locals;
+		locals.Resize(depth);
+		RunBench(options, results, "hierarchy_soa/depth:" + std::to_string(depth), depth, [&](long long iterations) {
+			float time = 0.0f;
+			for (long long i = 0; i < iterations; ++i)
+			{
+				time = fmodf(time + 0.37f, clip.duration);
+				PoseHierarchySoA(clip, tracks.data(), bones.data(), time, locals, globals.data(), palette.data());
+				DoNotOptimize(palette[depth - 1]);
+			}
+		});
+	}
+}
+
+static InputFrame MashInput(unsigned int& rng, unsigned short& held)
+{
+	// no jump: IDLE_JUMP has no way back to IDLE yet
+	if ((NextRandom(rng) & 7) == 0)
+		held = (unsigned short)(NextRandom(rng) & ((1 << 0) | (1 << 1) | (1 << 3) | (1 << 4) | (1 << 5)));
+	return UnpackInput(held);
+}
+
+static void SimBenchmarks(const BenchOptions& options, std::vector<BenchResult>& results)
+{
+	// inputs are pre-generated so only Step() is timed
+	const int inputCount = 4096;
+	std::vector<InputFrame> inputs[2];
+	unsigned int rng = 3;
+	unsigned short held[2] = { 0, 0 };
+	for (int i = 0; i < inputCount; ++i)
+		for (int p = 0; p < 2; ++p)
+			inputs[p].push_back(MashInput(rng, held[p]));
+
+	RunBench(options, results, "sim/step", 1.0, [&](long long iterations) {
+		MatchState match;
+		InitMatch(match);
+		for (long long i = 0; i < iterations; ++i)
+		{
+			Step(match, inputs[0][i & (inputCount - 1)], inputs[1][i & (inputCount - 1)]);
+			if (match.p[0].HP <= 0.0f || match.p[1].HP <= 0.0f)
+				InitMatch(match);
+		}
+		DoNotOptimize(match);
+	});
+
+	// P1 walks in and punches, P2 stands: a round of known length
+	MatchState probe;
+	InitMatch(probe);
+	InputFrame walk = {}, punch = {}, idle = {};
+	walk.moveRight = true;
+	punch.punch = true;
+	unsigned int roundTicks = 0;
+	while (probe.p[1].HP > 0.0f && roundTicks < 100000)
+	{
+		Step(probe, probe.p[1].position.z - probe.p[0].position.z > 2.0f ? walk : punch, idle);
+		++roundTicks;
+	}
+
+	RunBench(options, results, "sim/round", roundTicks, [&](long long iterations) {
+		MatchState match;
+		for (long long i = 0; i < iterations; ++i)
+		{
+			InitMatch(match);
+			while (match.p[1].HP > 0.0f && match.frame < 100000)
+				Step(match, match.p[1].position.z - match.p[0].position.z > 2.0f ? walk : punch, idle);
+			DoNotOptimize(match);
+		}
+	});
+
+	// players of many matches through one table; stun and recovery count down as
+	// StepMoves does, so the crossfades that wait for them complete
+	const int batchPlayers = 1024;
+	std::vector<unsigned short> buttons(inputCount);
+	for (int i = 0; i < inputCount; ++i)
+		buttons[i] = PackInput(inputs[i & 1][i]);
+	const AnimGraph& graph = AnimGraphTable();
+	const MoveTable& moves = DefaultMoveTable();
+	RunBench(options, results, "sim/anim-graph", batchPlayers, [&](long long iterations) {
+		MatchState match;
+		InitMatch(match);
+		std::vector<PlayerState> players(batchPlayers, match.p[0]);
+		for (long long i = 0; i < iterations; ++i)
+		{
+			for (int p = 0; p < batchPlayers; ++p)
+			{
+				PlayerState& player = players[p];
+				if (player.stunFrames > 0)
+					player.stunFrames--;
+				if (player.move != MOVE_NONE && ++player.moveFrame >= moves.moves[player.move].TotalFrames())
+					player.move = MOVE_NONE;
+				StepAnimState(graph, player, buttons[(i * 7 + p) & (inputCount - 1)], moves.character, SIM_DT);
+			}
+			DoNotOptimize(players[0]);
+		}
+	});
+}
+
+static void CollisionBenchmarks(const BenchOptions& options, std::vector<BenchResult>& results)
+{
+	// both players mid-punch, a step apart, every clip with a second of joint samples
+	unsigned int rng = 5;
+	JointTable joints;
+	for (int c = 0; c < CLIP_COUNT; ++c)
+	{
+		joints.sampleCount[c] = 60;
+		joints.firstSample[c] = (int)joints.samples.size();
+		for (int s = 0; s < 60; ++s)
+		{
+			JointPose pose;
+			DefaultJointPose(1.8f, pose);
+			for (int j = 0; j < JOINT_COUNT; ++j)
+				pose.joints[j] += glm::vec3(RandomFloat(rng, -0.1f, 0.1f), RandomFloat(rng, -0.1f, 0.1f), RandomFloat(rng, -0.1f, 0.1f));
+			joints.samples.push_back(pose);
+		}
+	}
+	MatchState match;
+	InitMatch(match, &DefaultClipTable(), &DefaultClipTable(), &DefaultMoveTable(), &joints, &joints);
+	match.p[0].position.z = -1.1f;
+	match.p[1].position.z = 1.1f;
+	for (int i = 0; i < 2; ++i)
+	{
+		StartMove(match.p[i], MOVE_PUNCH);
+		match.p[i].moveFrame = DefaultMoveTable().moves[MOVE_PUNCH].startup;
+		PlayClip(match.p[i].anim, CLIP_IDLE, CLIP_PUNCH, 0.5f, 0.3f, 0.4f);
+	}
+
+	RunBench(options, results, "collision/1v1", 1.0, [&](long long iterations) {
+		bool connects[2];
+		for (long long i = 0; i < iterations; ++i)
+		{
+			match.p[0].anim.time = (i & 31) * 0.03f;
+			FindHits(match, connects);
+			DoNotOptimize(connects);
+		}
+	});
+
+	// two teams of two in a line, everyone swinging, eight projectiles in flight
+	CollisionWorld scene;
+	for (int body = 0; body < 4; ++body)
+	{
+		const CharacterData& character = DefaultMoveTable().character;
+		JointPose pose;
+		DefaultJointPose(1.8f, pose);
+		float z = -3.0f + body * 2.0f, facing = body < 2 ? 1.0f : -1.0f;
+		for (int h = 0; h < character.hurtboxCount; ++h)
+		{
+			const HurtCapsule& hurt = character.hurtboxes[h];
+			glm::vec3 a = pose.joints[hurt.from], b = pose.joints[hurt.to];
+			Collider collider = { Capsule{ glm::vec3(a.x * facing, a.y, z + a.z * facing), glm::vec3(b.x * facing, b.y, z + b.z * facing), hurt.radius },
+				body, body / 2, COLLIDE_HURT, 0 };
+			scene.Add(collider);
+		}
+		glm::vec3 fist(0.0f, 1.4f, z + 1.3f * facing);
+		scene.Add(Collider{ Capsule{ fist, fist, 0.8f }, body, body / 2, COLLIDE_HIT, COLLIDE_HURT });
+	}
+	for (int p = 0; p < 8; ++p)
+	{
+		glm::vec3 from(RandomFloat(rng, -0.5f, 0.5f), RandomFloat(rng, 0.5f, 1.8f), RandomFloat(rng, -4.0f, 4.0f));
+		glm::vec3 to = from + glm::vec3(0.0f, 0.0f, p & 1 ? 0.15f : -0.15f);
+		scene.Add(Collider{ Capsule{ from, to, 0.2f }, 4 + p, p & 1, COLLIDE_HIT, COLLIDE_HURT | COLLIDE_HIT });
+	}
+
+	RunBench(options, results, "collision/2v2+projectiles", scene.count, [&](long long iterations) {
+		Contact contacts[MAX_COLLIDERS];
+		for (long long i = 0; i < iterations; ++i)
+		{
+			int count = FindContacts(scene, contacts, MAX_COLLIDERS);
+			DoNotOptimize(count);
+		}
+	});
+}
+
+static void PaletteBenchmarks(const BenchOptions& options, std::vector<BenchResult>& results)
+{
+	unsigned int rng = 4;
+	std::vector<glm::mat4> bones(MAX_BONES);
+	for (glm::mat4& bone : bones)
+	{
+		glm::vec3 axis = glm::normalize(glm::vec3(RandomFloat(rng, -1, 1), RandomFloat(rng, -1, 1), 1.0f));
+		bone = glm::translate(glm::mat4(1.0f), glm::vec3(RandomFloat(rng, -1, 1), RandomFloat(rng, 0, 2), 0.0f));
+		bone = glm::rotate(bone, RandomFloat(rng, -3.0f, 3.0f), axis);
+	}
+	std::vector<glm::vec4> packed(MAX_BONES * 4);
+
+	for (int m = 0; m < SKIN_MODE_COUNT; ++m)
+	{
+		SkinningMode mode = (SkinningMode)m;
+		RunBench(options, results, std::string("palette/pack:") + SkinningModeName(mode), MAX_BONES, [&](long long iterations) {
+			for (long long i = 0; i < iterations; ++i)
+			{
+				PackPalette(mode, bones.data(), MAX_BONES, packed.data());
+				DoNotOptimize(packed[0]);
+			}
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	const char* jsonPath = NULL;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			options.filter = argv[++i];
+		else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+			options.minTime = atof(argv[++i]);
+		else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc)
+			options.repetitions = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			jsonPath = argv[++i];
+		else
+		{
+			printf("usage: bench [--filter <substring>] [--min-time <seconds>] [--repetitions <n>] [--json <file>]\n");
+			return 1;
+		}
+	}
+
+	printf("%-28s %17s %13s %12s\n", "benchmark", "time (median)", "stddev", "iterations");
+
+	std::vector<BenchResult> results;
+	PoseBenchmarks(options, results);
+	HierarchyBenchmarks(options, results);
+	SimBenchmarks(options, results);
+	CollisionBenchmarks(options, results);
+	PaletteBenchmarks(options, results);
+
+	if (jsonPath && !WriteJson(jsonPath, options, results))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+# bench_compare.py
+#
+# Compares two JSON files written by bench (or any Google Benchmark JSON) and
+# flags benchmarks that got slower.
+#
+#   bench_compare.py <baseline.json> <contender.json> [--threshold <percent>]
+#
+# For every benchmark present in both files it prints the median time per
+# iteration and the change. A benchmark counts as a regression when it is more
+# than --threshold percent slower (default 5) AND the slowdown is bigger than
+# two standard deviations of the noisier of the two runs, so one jittery run
+# doesn't fail the check. The exit code is 1 if anything regressed.
+#
+# Only the standard library is needed.
+
+import json
+import sys
+
+UNIT_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    results = {}
+    for b in data.get("benchmarks", []):
+        # Google Benchmark aggregates: keep only the median when repetitions were reported separately
+        if b.get("run_type") == "aggregate" and b.get("aggregate_name") != "median":
+            continue
+        name = b.get("run_name", b["name"])
+        scale = UNIT_NS.get(b.get("time_unit", "ns"), 1.0)
+        results[name] = (b["real_time"] * scale, b.get("real_time_stddev", 0.0) * scale)
+    return results
+
+
+def main(argv):
+    args = [a for a in argv[1:]]
+    threshold = 5.0
+    if "--threshold" in args:
+        i = args.index("--threshold")
+        threshold = float(args[i + 1])
+        del args[i:i + 2]
+    if len(args) != 2:
+        print("usage: bench_compare.py <baseline.json> <contender.json> [--threshold <percent>]")
+        return 2
+
+    base = load(args[0])
+    new = load(args[1])
+
+    print("%-28s %14s %14s %9s" % ("benchmark", "baseline ns", "contender ns", "change"))
+    regressions = []
+    for name in base:
+        if name not in new:
+            print("%-28s %14.1f %14s" % (name, base[name][0], "missing"))
+            continue
+        old_time, old_dev = base[name]
+        new_time, new_dev = new[name]
+        change = (new_time - old_time) / old_time * 100.0 if old_time > 0 else 0.0
+        noise = 2.0 * max(old_dev, new_dev)
+        regressed = change > threshold and new_time - old_time > noise
+        if regressed:
+            regressions.append(name)
+        print("%-28s %14.1f %14.1f %+8.1f%%%s" % (name, old_time, new_time, change, "  REGRESSION" if regressed else ""))
+    for name in new:
+        if name not in base:
+            print("%-28s %14s %14.1f" % (name, "new", new[name][0]))
+
+    if regressions:
+        print("%d regression(s) over %.1f%%: %s" % (len(regressions), threshold, ", ".join(regressions)))
+        return 1
+    print("no regressions over %.1f%%" % threshold)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
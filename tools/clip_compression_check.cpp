@@ -0,0 +1,147 @@
+// clip_compression_check.cpp
+//
+// Compresses synthetic clips shaped like the Mixamo ones (a 65 node tree keyed at
+// 30 fps: a moving root, rotating joints, constant bone lengths and unit scales) and
+// checks the result:
+//
+//   memory      raw and compressed track bytes per clip, as the loader prints them
+//   error       the pose cache baked from the compressed clips against the one baked
+//               from the raw tracks, as the largest palette element difference
+//   cursor      random-order sampling through a cursor against the forward bake; the
+//               cursor must give the same pose whichever way it gets there
+//
+//   clip_compression_check [rounds] [seed] [position error]
+//
+// Each round is one rig with a full set of clips.
+//
+// The exit code is non-zero if the baked error exceeds PALETTE_TOLERANCE or the cursor
+// check finds any difference.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> clip_compression_check.cpp -o clip_compression_check
+
+#include "../pose_bake.h"
+#include "synthetic_rig.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+const float PALETTE_TOLERANCE = 0.01f;
+
+// Every node keyed every frame, as the Collada exporter writes them. Node 0 is the
+// hips and moves; the rest only rotate, with a constant offset from their parent.
+static void MakeClip(unsigned int& rng, ModelData& model, ClipData& clip)
+{
+	const int nodeCount = 65;
+	const int frames = 20 + NextRandom(rng) % 60;
+	clip = ClipData();
+	clip.ticksPerSecond = 30.0f;
+	clip.duration = (float)(frames - 1);
+	model.bones.clear();
+
+	for (int n = 0; n < nodeCount; ++n)
+	{
+		glm::vec3 offset(0.0f, n == 0 ? 1.0f : RandomFloat(rng, 0.05f, 0.15f), 0.0f);
+		AddRigNode(clip, model, TreeParent(n), glm::translate(glm::mat4(1.0f), offset), n, glm::inverse(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.1f * n, 0.0f))));
+
+		TrackData track;
+		track.node = n;
+		glm::vec3 axis = RandomAxis(rng);
+		float amplitude = n % 5 == 4 ? 0.0f : RandomFloat(rng, 0.1f, 1.0f);   // some joints never move
+		float phase = RandomFloat(rng, 0.0f, 6.28f);
+		glm::vec3 stride(RandomFloat(rng, -0.2f, 0.2f), 0.05f, RandomFloat(rng, -0.2f, 0.2f));
+		for (int f = 0; f < frames; ++f)
+		{
+			float t = (float)f;
+			float wave = sinf(phase + t * 0.2f);
+			KeyPos p = { t, n == 0 ? offset + stride * wave : offset };
+			KeyRot r = { t, glm::angleAxis(amplitude * wave, axis) };
+			KeyScale s = { t, glm::vec3(1.0f) };
+			track.positions.push_back(p);
+			track.rotations.push_back(r);
+			track.scales.push_back(s);
+		}
+		clip.tracks.push_back(track);
+	}
+}
+
+static float MaxPaletteError(const PoseCache& a, const PoseCache& b)
+{
+	float error = 0.0f;
+	for (int clip = 0; clip < CLIP_COUNT; ++clip)
+	{
+		const std::vector<glm::mat4>& ma = a.clips[clip].matrices;
+		const std::vector<glm::mat4>& mb = b.clips[clip].matrices;
+		for (size_t m = 0; m < ma.size() && m < mb.size(); ++m)
+			for (int c = 0; c < 4; ++c)
+				for (int i = 0; i < 4; ++i)
+					error = fmaxf(error, fabsf(ma[m][c][i] - mb[m][c][i]));
+	}
+	return error;
+}
+
+int main(int argc, char** argv)
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 4;
+	unsigned int rng = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 1u;
+	if (rng == 0)
+		rng = 1;
+	ClipCompression settings;
+	if (argc > 3)
+		settings.positionError = (float)atof(argv[3]);
+
+	size_t rawTotal = 0, compressedTotal = 0;
+	float worstError = 0.0f;
+	bool cursorOk = true;
+	for (int round = 0; round < rounds; ++round)
+	{
+		ModelData model;
+		ClipData clips[CLIP_COUNT];
+		CompressedClip compressed[CLIP_COUNT];
+		for (int c = 0; c < CLIP_COUNT; ++c)
+		{
+			MakeClip(rng, model, clips[c]);
+			ClipCompressionStats stats = CompressClip(clips[c], settings, compressed[c]);
+			PrintCompressionStats(("round" + std::to_string(round) + "_clip" + std::to_string(c)).c_str(), stats);
+			rawTotal += stats.rawBytes;
+			compressedTotal += stats.compressedBytes;
+		}
+
+		PoseCache raw, packed;
+		BakePoseCache(raw, model, clips);
+		BakePoseCache(packed, model, compressed);
+		worstError = fmaxf(worstError, MaxPaletteError(raw, packed));
+
+		// jump around one clip with a single cursor; every sample must match the bake
+		const CompressedClip& clip = compressed[CLIP_WALK];
+		const BakedClip& baked = packed.clips[CLIP_WALK];
+		std::vector<const BoneData*> nodeBones;
+		ResolveNodeBones(packed, model, clip.nodes, nodeBones);
+		std::vector<glm::mat4> globals(clip.nodes.size()), palette(packed.boneCount);
+		PoseLocalsSoA locals;
+		locals.Resize((int)clip.nodes.size());
+		ClipCursor cursor;
+		cursor.Reset(clip);
+		for (int i = 0; i < 200; ++i)
+		{
+			int s = NextRandom(rng) % baked.sampleCount;
+			PoseHierarchyCompressed(clip, cursor, nodeBones.data(), s * baked.ticksPerSecond / POSE_SAMPLE_RATE,
+				locals, globals.data(), palette.data());
+			const glm::mat4* expected = packed.Sample(CLIP_WALK, s);
+			for (int b = 0; b < packed.boneCount; ++b)
+				for (int col = 0; col < 4; ++col)
+					for (int row = 0; row < 4; ++row)
+						cursorOk = cursorOk && palette[b][col][row] == expected[b][col][row];
+		}
+	}
+
+	printf("total %.1f KB -> %.1f KB (%.1fx)\n", rawTotal / 1024.0, compressedTotal / 1024.0,
+		compressedTotal ? (double)rawTotal / compressedTotal : 0.0);
+	bool errorOk = worstError <= PALETTE_TOLERANCE;
+	printf("baked palette max error %.3g (tolerance %.3g)  %s\n", worstError, PALETTE_TOLERANCE, errorOk ? "OK" : "MISMATCH");
+	printf("cursor random access  %s\n", cursorOk ? "OK" : "MISMATCH");
+	return errorOk && cursorOk ? 0 : 1;
+}
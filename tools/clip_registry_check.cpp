@@ -0,0 +1,186 @@
+// clip_registry_check.cpp
+//
+// Checks clip_registry.h on synthetic Mixamo-sized characters:
+//
+//   startup    bakes both characters' pose caches with every clip, then with only
+//              STARTUP_CLIPS (joints still for every clip), and reports the time and
+//              the memory of each
+//   streaming  plays a local match under random input with the registry in the
+//              loop the way the game runs it: Update(), the state machines'
+//              predictions, then Use() of the clips being posed, one frame every
+//              'frameMs'. Every clip the registry publishes must match the eager
+//              bake exactly, and idle and walk must never be evicted. Misses,
+//              evictions and bakes that waited for a block are reported; the debug
+//              buttons are pressed now and then, and those clips are only loaded
+//              once they are wanted
+//
+//   clip_registry_check [ticks] [frameMs] [budgetPercent] [seed]
+//
+// budgetPercent is the registry budget as a share of every clip of both characters.
+// The exit code is non-zero on a mismatch or an evicted startup clip.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> clip_registry_check.cpp -o clip_registry_check -pthread
+
+#include "../clip_registry.h"
+#include "synthetic_rig.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+static double Seconds(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Held buttons change every few ticks (alloc_check.cpp's MashInput), with a debug
+// button once in a while. No jump: IDLE_JUMP has no way back to IDLE.
+static InputFrame MashInput(unsigned int& rng, unsigned short& held)
+{
+	if ((NextRandom(rng) & 7) == 0)
+	{
+		held = (unsigned short)(NextRandom(rng) & (BUTTON_LEFT | BUTTON_RIGHT | BUTTON_JUMP_KICK | BUTTON_PUNCH | BUTTON_CROUCH));
+		if ((NextRandom(rng) & 31) == 0)
+			held |= (unsigned short)(BUTTON_STAND_BLOCK << (NextRandom(rng) % 3));
+	}
+	return UnpackInput(held);
+}
+
+// bench.cpp's rig with 'nodeCount' nodes, the lengths of the real clips and 'keys'
+// keys a second. The first nodes carry the hurtbox joints' names so the joint tables
+// are really baked.
+static void MakeCharacter(int nodeCount, int keys, unsigned int& rng, ModelData& model, CompressedClip compressed[CLIP_COUNT])
+{
+	static const char* const jointNames[] = {
+		"mixamorig:Hips", "mixamorig:Neck", "mixamorig:HeadTop_End", "mixamorig:LeftArm", "mixamorig:LeftForeArm",
+		"mixamorig:LeftHand", "mixamorig:RightArm", "mixamorig:RightForeArm", "mixamorig:RightHand",
+		"mixamorig:LeftLeg", "mixamorig:LeftFoot", "mixamorig:RightLeg", "mixamorig:RightFoot"
+	};
+	const ClipTable& timing = DefaultClipTable();
+	RigShape shape;
+	shape.nodes = nodeCount;
+	shape.names = jointNames;
+	shape.nameCount = (int)(sizeof(jointNames) / sizeof(jointNames[0]));
+	for (int c = 0; c < CLIP_COUNT; ++c)
+	{
+		shape.ticksPerSecond = timing.ticksPerSecond[c];
+		shape.duration = timing.duration[c];
+		shape.keys = 2 + (int)(shape.duration / shape.ticksPerSecond * keys);
+		ClipData clip;
+		MakeRig(shape, rng, model, clip);
+		CompressClip(clip, ClipCompression(), compressed[c]);
+	}
+}
+
+static size_t ResidentBytes(const PoseCache& cache)
+{
+	size_t bytes = 0;
+	for (int c = 0; c < CLIP_COUNT; ++c)
+		bytes += cache.clips[c].matrices.size() * sizeof(glm::mat4);
+	return bytes;
+}
+
+// resident clips of 'lazy' that differ from the same clip of 'eager'
+static int Mismatches(const PoseCache& lazy, const PoseCache& eager)
+{
+	int bad = 0;
+	for (int c = 0; c < CLIP_COUNT; ++c)
+	{
+		const std::vector<glm::mat4>& a = lazy.clips[c].matrices;
+		if (!a.empty() && (a.size() != eager.clips[c].matrices.size() || memcmp(a.data(), eager.clips[c].matrices.data(), a.size() * sizeof(glm::mat4)) != 0))
+			bad++;
+	}
+	return bad;
+}
+
+int main(int argc, char** argv)
+{
+	int ticks = argc > 1 ? atoi(argv[1]) : 1200;
+	int frameMs = argc > 2 ? atoi(argv[2]) : 4;
+	int budgetPercent = argc > 3 ? atoi(argv[3]) : 50;
+	unsigned int rng = argc > 4 ? (unsigned int)strtoul(argv[4], NULL, 10) : 1u;
+	if (rng == 0)
+		rng = 1;
+
+	ModelData models[2];
+	CompressedClip compressed[2][CLIP_COUNT];
+	for (int ch = 0; ch < 2; ++ch)
+		MakeCharacter(65, 30, rng, models[ch], compressed[ch]);
+
+	// startup: everything against idle and walk
+	PoseCache eager[2], lazy[2];
+	JointTable eagerJoints[2], lazyJoints[2];
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int ch = 0; ch < 2; ++ch)
+		BakePoseCache(eager[ch], models[ch], compressed[ch], &eagerJoints[ch]);
+	double eagerSeconds = Seconds(start);
+	start = std::chrono::steady_clock::now();
+	for (int ch = 0; ch < 2; ++ch)
+		BakePoseCache(lazy[ch], models[ch], compressed[ch], &lazyJoints[ch], STARTUP_CLIPS);
+	double lazySeconds = Seconds(start);
+
+	bool ok = true;
+	size_t allBytes = ResidentBytes(eager[0]) + ResidentBytes(eager[1]);
+	size_t startupBytes = ResidentBytes(lazy[0]) + ResidentBytes(lazy[1]);
+	bool jointsSame = true;
+	for (int ch = 0; ch < 2; ++ch)
+		jointsSame = jointsSame && eagerJoints[ch].samples.size() == lazyJoints[ch].samples.size() &&
+			memcmp(eagerJoints[ch].samples.data(), lazyJoints[ch].samples.data(), eagerJoints[ch].samples.size() * sizeof(JointPose)) == 0;
+	ok &= jointsSame && Mismatches(lazy[0], eager[0]) == 0 && Mismatches(lazy[1], eager[1]) == 0;
+	printf("startup    every clip    %7.1f ms  %6zu KB of pose samples\n", eagerSeconds * 1000.0, allBytes / 1024);
+	printf("           idle + walk   %7.1f ms  %6zu KB, hurtbox joints %s  %s\n", lazySeconds * 1000.0, startupBytes / 1024,
+		jointsSame ? "identical" : "DIFFER", ok ? "OK" : "FAILED");
+
+	// streaming: a match with the registry in the loop
+	JobSystem jobs(2);
+	size_t budget = allBytes * budgetPercent / 100;
+	ClipRegistry registry(jobs, budget);
+	int handles[2];
+	for (int ch = 0; ch < 2; ++ch)
+	{
+		handles[ch] = registry.AddCharacter(lazy[ch], models[ch], compressed[ch]);
+		for (int c = 0; c < CLIP_COUNT; ++c)
+			if (STARTUP_CLIPS & (1u << c))
+				registry.Pin(registry.Handle(handles[ch], (ClipId)c));
+	}
+
+	MatchState match;
+	InitMatch(match);
+	unsigned short held[2] = { 0, 0 };
+	int mismatches = 0, startupEvicted = 0;
+	size_t peak = 0;
+	for (int t = 0; t < ticks; ++t)
+	{
+		InputFrame p1 = MashInput(rng, held[0]);
+		InputFrame p2 = MashInput(rng, held[1]);
+		Step(match, p1, p2);
+		if (match.p[0].HP <= 0.0f || match.p[1].HP <= 0.0f)
+			InitMatch(match);
+
+		registry.Update();
+		for (int ch = 0; ch < 2; ++ch)
+		{
+			registry.Prefetch(handles[ch], PredictPlayerClips(match, ch));
+			registry.Use(registry.Handle(handles[ch], match.p[ch].anim.clip));
+			registry.Use(registry.Handle(handles[ch], match.p[ch].anim.clip2));
+			mismatches += Mismatches(lazy[ch], eager[ch]);
+			startupEvicted += !lazy[ch].Resident(CLIP_IDLE) || !lazy[ch].Resident(CLIP_WALK);
+		}
+		if (registry.ResidentBytes() > peak)
+			peak = registry.ResidentBytes();
+		std::this_thread::sleep_for(std::chrono::milliseconds(frameMs));
+	}
+	registry.Drain();
+
+	bool streamOk = mismatches == 0 && startupEvicted == 0;
+	ok &= streamOk;
+	printf("streaming  %d frames, budget %zu KB (%d blocks): %d streamed in, %d evicted, %d missed, %d waited, %zu KB resident at most\n",
+		ticks, budget / 1024, registry.Blocks(), registry.Loads(), registry.Evictions(), registry.Misses(), registry.Waits(), peak / 1024);
+	printf("           %d mismatched clips, %d frames without idle or walk  %s\n", mismatches, startupEvicted, streamOk ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+// collision_check.cpp
+//
+// Checks collision.h on random shapes:
+//
+//   kernel       SegmentDistanceSq4 (SSE when available) against SegmentDistanceSq on
+//                the same pairs, which must match bit for bit, including points,
+//                parallel and touching segments
+//   distance     SegmentDistanceSq against a brute force search along both segments;
+//                it may never report more than the search finds, nor noticeably less
+//   broadphase   FindContacts against testing every pair of a random world with
+//                CapsulesTouch and the same layer and team rules
+//
+//   collision_check [rounds] [seed]
+//
+// The exit code is non-zero on any mismatch.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> collision_check.cpp -o collision_check
+
+#include "../collision.h"
+#include "synthetic_rig.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+const int SEARCH_STEPS = 2000;
+const float DISTANCE_TOLERANCE = 1e-3f;
+
+static glm::vec3 RandomPoint(unsigned int& rng, float extent)
+{
+	return glm::vec3(RandomFloat(rng, -extent, extent), RandomFloat(rng, -extent, extent), RandomFloat(rng, -extent, extent));
+}
+
+// A random segment pair; every few are one of the awkward cases.
+static void RandomPair(unsigned int& rng, glm::vec3& p1, glm::vec3& q1, glm::vec3& p2, glm::vec3& q2)
+{
+	p1 = RandomPoint(rng, 2.0f);
+	q1 = RandomPoint(rng, 2.0f);
+	p2 = RandomPoint(rng, 2.0f);
+	q2 = RandomPoint(rng, 2.0f);
+	switch (NextRandom(rng) % 8)
+	{
+	case 0: q1 = p1; break;                            // point against segment
+	case 1: q1 = p1; q2 = p2; break;                   // two points
+	case 2: q2 = p2 + (q1 - p1) * 0.5f; break;         // parallel
+	case 3: p2 = p1 + (q1 - p1) * 0.3f; q2 = p1 + (q1 - p1) * 1.4f; break;   // collinear, overlapping
+	case 4: p2 = (p1 + q1) * 0.5f; break;              // touching
+	default: break;
+	}
+}
+
+static float SearchDistanceSq(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2, const glm::vec3& q2)
+{
+	// for each point along one segment, the exact closest point on the other
+	float best = 1e30f;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		const glm::vec3& a = pass == 0 ? p1 : p2;
+		const glm::vec3& b = pass == 0 ? q1 : q2;
+		const glm::vec3& c = pass == 0 ? p2 : p1;
+		const glm::vec3& d = pass == 0 ? q2 : q1;
+		glm::vec3 cd = d - c;
+		float length = glm::dot(cd, cd);
+		for (int i = 0; i <= SEARCH_STEPS; ++i)
+		{
+			glm::vec3 point = a + (b - a) * ((float)i / SEARCH_STEPS);
+			float t = length > 0.0f ? glm::clamp(glm::dot(point - c, cd) / length, 0.0f, 1.0f) : 0.0f;
+			glm::vec3 delta = point - (c + cd * t);
+			best = std::min(best, glm::dot(delta, delta));
+		}
+	}
+	return best;
+}
+
+static Collider RandomCollider(unsigned int& rng)
+{
+	Collider collider;
+	collider.shape.a = RandomPoint(rng, 3.0f);
+	collider.shape.b = NextRandom(rng) % 4 == 0 ? collider.shape.a : collider.shape.a + RandomPoint(rng, 0.6f);
+	collider.shape.radius = RandomFloat(rng, 0.05f, 0.5f);
+	collider.owner = NextRandom(rng) % 8;
+	collider.team = collider.owner % 3;
+	collider.layer = 1u << (NextRandom(rng) % 3);
+	collider.hits = NextRandom(rng) % 3 == 0 ? (NextRandom(rng) & 7u) : 0u;
+	return collider;
+}
+
+int main(int argc, char** argv)
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 200;
+	unsigned int rng = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 1u;
+	if (rng == 0)
+		rng = 1;
+	printf("narrowphase: %s\n", PoseSimdName());
+
+	// kernel and distance
+	int kernelMismatches = 0, distanceMismatches = 0;
+	float worstUnder = 0.0f;
+	for (int r = 0; r < rounds; ++r)
+	{
+		SegmentPairs4 batch;
+		float scalar[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			glm::vec3 p1, q1, p2, q2;
+			RandomPair(rng, p1, q1, p2, q2);
+			for (int k = 0; k < 3; ++k)
+			{
+				batch.p1[k][i] = p1[k];
+				batch.q1[k][i] = q1[k];
+				batch.p2[k][i] = p2[k];
+				batch.q2[k][i] = q2[k];
+			}
+			scalar[i] = SegmentDistanceSq(p1, q1, p2, q2);
+
+			float searched = sqrtf(SearchDistanceSq(p1, q1, p2, q2));
+			float found = sqrtf(scalar[i]);
+			worstUnder = std::max(worstUnder, searched - found);
+			if (found > searched + 1e-5f || found < searched - DISTANCE_TOLERANCE)
+				distanceMismatches++;
+		}
+		float simd[4];
+		SegmentDistanceSq4(batch, simd);
+		kernelMismatches += memcmp(simd, scalar, sizeof(simd)) != 0;
+	}
+	printf("kernel      %d batches, %d differ from the scalar code  %s\n", rounds, kernelMismatches, kernelMismatches ? "MISMATCH" : "OK");
+	printf("distance    %d pairs, %d off the search (largest shortfall %.2g)  %s\n", rounds * 4, distanceMismatches, worstUnder,
+		distanceMismatches ? "MISMATCH" : "OK");
+
+	// broadphase
+	int broadphaseMismatches = 0;
+	long long contactTotal = 0;
+	for (int r = 0; r < rounds; ++r)
+	{
+		CollisionWorld world;
+		int count = 1 + NextRandom(rng) % MAX_COLLIDERS;
+		for (int i = 0; i < count; ++i)
+			world.Add(RandomCollider(rng));
+
+		std::vector<std::pair<int, int> > expected;
+		for (int a = 0; a < count; ++a)
+		{
+			for (int b = 0; b < count; ++b)
+			{
+				// FindContacts measures every pair from the collider added first
+				const Collider& x = world.colliders[a];
+				const Collider& y = world.colliders[b];
+				const Capsule& first = world.colliders[std::min(a, b)].shape;
+				const Capsule& second = world.colliders[std::max(a, b)].shape;
+				if (a != b && x.team != y.team && (x.hits & y.layer) != 0 && CapsulesTouch(first, second))
+					expected.push_back(std::make_pair(a, b));
+			}
+		}
+
+		Contact contacts[MAX_COLLIDERS * MAX_COLLIDERS];
+		int found = FindContacts(world, contacts, MAX_COLLIDERS * MAX_COLLIDERS);
+		std::vector<std::pair<int, int> > actual;
+		for (int c = 0; c < found; ++c)
+			actual.push_back(std::make_pair(contacts[c].collider, contacts[c].other));
+
+		std::sort(expected.begin(), expected.end());
+		std::sort(actual.begin(), actual.end());
+		broadphaseMismatches += expected != actual;
+		contactTotal += found;
+	}
+	printf("broadphase  %d worlds, %lld contacts, %d differ from all pairs  %s\n", rounds, contactTotal, broadphaseMismatches,
+		broadphaseMismatches ? "MISMATCH" : "OK");
+
+	return kernelMismatches == 0 && distanceMismatches == 0 && broadphaseMismatches == 0 ? 0 : 1;
+}
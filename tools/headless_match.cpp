@@ -0,0 +1,69 @@
+// headless_match.cpp
+//
+// Runs the fighting game simulation without a window or GPU. Both players are
+// driven by random button mashing; the match restarts whenever a player is KO'd.
+//
+//   headless_match [ticks] [seed]
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> headless_match.cpp -o headless_match
+
+#include "../match_sim.h"
+#include "synthetic_rig.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// xorshift32, so every run with the same seed produces the same matches
+static InputFrame RandomInput(unsigned int& rng)
+{
+	unsigned int bits = NextRandom(rng);
+
+	InputFrame input = {};
+	input.moveLeft = (bits & 0x03) == 0x01;
+	input.moveRight = (bits & 0x03) == 0x02;
+	// no jump: IDLE_JUMP has no way back to IDLE yet, one press would lock out attacks for the round
+	input.crouch = (bits & 0x1C) == 0x08;
+	input.punch = (bits & 0xE0) == 0x20;
+	input.jumpKick = (bits & 0xE0) == 0x40;
+	return input;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long ticks = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000ULL;
+	unsigned int rng = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 1u;
+	if (rng == 0)
+		rng = 1;
+
+	MatchState match;
+	InitMatch(match);
+
+	unsigned long long rounds = 0;
+	unsigned long long p1Wins = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned long long i = 0; i < ticks; ++i)
+	{
+		Step(match, RandomInput(rng), RandomInput(rng));
+
+		if (match.p[0].HP <= 0.0f || match.p[1].HP <= 0.0f)
+		{
+			++rounds;
+			if (match.p[1].HP <= 0.0f)
+				++p1Wins;
+			InitMatch(match);
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+
+	printf("ticks          : %llu (%.1f simulated minutes)\n", ticks, ticks * SIM_DT / 60.0);
+	printf("rounds finished: %llu (P1 won %llu)\n", rounds, p1Wins);
+	printf("wall time      : %.3f s\n", seconds);
+	printf("ticks/second   : %.0f\n", ticks / seconds);
+	return 0;
+}
@@ -0,0 +1,353 @@
+// instancing_check.cpp
+//
+// Renders a crowd of skinned characters offscreen twice: once through
+// InstancedSkinning (one glDrawElementsInstanced per mesh) and once the way the
+// fighters are drawn, one SkinnedModel::Draw per character with its 3x4 palette
+// selected from a BonePaletteBuffer. The two images must be identical. Then it times
+// both paths over a few frames.
+//
+// It also renders the crowd the fighters' way once per skinning mode (skinning.h),
+// with anim_model_normal.fs coloring every pixel by its skinned normal, and compares
+// 3x4 and dq with mat4 pixel by pixel, so a mistake in a packed palette decode or in
+// the normal skinning shows up. Two poses:
+//
+//   bent    every bone turned its own way about a tilted axis; 3x4 must match mat4.
+//           Dual quaternions blend rotations differently, so dq is only reported
+//   rigid   one rotation per character and a translation per bone, where dual
+//           quaternion blending comes out the same as linear; both must match
+//
+//   instancing_check [instances]        (default 256)
+//
+// It needs no window. The context is a surfaceless EGL one, so it runs on a headless
+// machine under Mesa's software rasterizer:
+//
+//   EGL_PLATFORM=surfaceless LIBGL_ALWAYS_SOFTWARE=1 ./instancing_check 256
+//
+// Run it from this project's directory; it loads the anim_model shaders from there.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<learnopengl includes> -I<path to glm> instancing_check.cpp <path to glad.c> -lEGL -ldl
+
+#include <EGL/egl.h>
+
+#include "../instanced_skinning.h"
+#include "../bone_palette.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+const int IMAGE_SIZE = 512;
+const int RIG_BONES = 65;
+const int TIMED_FRAMES = 20;
+const int COLOR_TOLERANCE = 3;   // per channel, out of 255: float rounding between the shaders
+const double EDGE_PIXELS = 0.002;   // share of the covered pixels allowed to differ, along triangle edges
+
+static double Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool CreateContext()
+{
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+	{
+		printf("no EGL display\n");
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = NULL;
+	EGLint configCount = 0;
+	eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+
+	EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, configCount ? config : NULL, EGL_NO_CONTEXT, contextAttributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		printf("no GL 3.3 core context (EGL error 0x%x)\n", eglGetError());
+		return false;
+	}
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+	{
+		printf("failed to load GL functions\n");
+		return false;
+	}
+	printf("%s, %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+	return true;
+}
+
+// A strip of eight quads up the y axis, each row of vertices weighted between two
+// neighbouring bones, with a 1x1 texture so the image has some color.
+static void MakeStrip(ModelData& model, std::map<std::string, unsigned int>& textures)
+{
+	unsigned char pixel[4] = { 255, 200, 100, 255 };
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	textures["strip"] = texture;
+
+	model.meshes.resize(1);
+	MeshData& mesh = model.meshes[0];
+	mesh.diffuseTexture = "strip";
+	for (int segment = 0; segment < 8; ++segment)
+	{
+		for (int corner = 0; corner < 4; ++corner)
+		{
+			SkinVertex v = {};
+			v.position = glm::vec3(corner & 1 ? 0.5f : -0.5f, (segment + corner / 2) * 0.25f, 0.0f);
+			v.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+			float upper = corner / 2 ? 0.7f : 0.3f;
+			v.boneIds[0] = segment;
+			v.boneIds[1] = segment + 1;
+			v.boneIds[2] = v.boneIds[3] = -1;
+			v.weights[0] = 1.0f - upper;
+			v.weights[1] = upper;
+			mesh.vertices.push_back(v);
+		}
+		unsigned int first = segment * 4;
+		unsigned int indices[6] = { first, first + 1, first + 2, first + 1, first + 3, first + 2 };
+		mesh.indices.insert(mesh.indices.end(), indices, indices + 6);
+	}
+}
+
+static bool Linked(const Shader& shader)
+{
+	GLint linked = GL_FALSE;
+	glGetProgramiv(shader.ID, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+// pixels of 'a' and 'b' further apart than COLOR_TOLERANCE in some channel
+static int DifferentPixels(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+{
+	int different = 0;
+	for (size_t p = 0; p < a.size(); p += 4)
+	{
+		for (int c = 0; c < 4; ++c)
+		{
+			if (abs((int)a[p + c] - (int)b[p + c]) > COLOR_TOLERANCE)
+			{
+				different++;
+				break;
+			}
+		}
+	}
+	return different;
+}
+
+static glm::mat4 BentBone(int character, int bone)
+{
+	return glm::rotate(glm::mat4(1.0f), 0.5f * sinf(character * 0.7f + bone), glm::normalize(glm::vec3(0.4f, 0.3f, 1.0f)));
+}
+
+static glm::mat4 RigidBone(int character, int bone)
+{
+	glm::vec3 offset(0.08f * sinf(character + bone * 0.9f), 0.05f * cosf(character * 0.3f + bone * 1.3f), 0.0f);
+	glm::mat4 turn = glm::rotate(glm::mat4(1.0f), 0.8f * sinf(character * 0.37f + 0.5f), glm::normalize(glm::vec3(1.0f, 0.4f, 0.2f)));
+	return glm::translate(glm::mat4(1.0f), offset) * turn;
+}
+
+// renders 'count' characters in every skinning mode with both poses and compares
+// them with mat4; true if 3x4 always matches and dq matches on the rigid pose
+static bool CompareSkinningModes(SkinnedModel& model, int count, const std::vector<glm::mat4>& placements)
+{
+	BonePaletteBuffer palettes[SKIN_MODE_COUNT];
+	Shader* shaders[SKIN_MODE_COUNT];
+	ShaderUniforms uniforms[SKIN_MODE_COUNT];
+	bool linked = true;
+	for (int m = 0; m < SKIN_MODE_COUNT; ++m)
+	{
+		palettes[m].Init(count, (SkinningMode)m);
+		shaders[m] = new Shader(SkinningVertexShader((SkinningMode)m), "anim_model_normal.fs");
+		palettes[m].Attach(*shaders[m]);
+		uniforms[m].Init(shaders[m]->ID);
+		if (!Linked(*shaders[m]))
+		{
+			printf("%s with anim_model_normal.fs doesn't link\n", SkinningVertexShader((SkinningMode)m));
+			linked = false;
+		}
+	}
+
+	bool ok = linked;
+	RenderState state;
+	const glm::mat4 identity(1.0f);
+	std::vector<unsigned char> images[SKIN_MODE_COUNT];
+	for (int pose = 0; pose < 2 && linked; ++pose)
+	{
+		for (int m = 0; m < SKIN_MODE_COUNT; ++m)
+		{
+			for (int i = 0; i < count; ++i)
+				for (int b = 0; b < RIG_BONES; ++b)
+					palettes[m].Palette(i)[b] = pose == 0 ? BentBone(i, b) : RigidBone(i, b);
+			palettes[m].Upload();
+
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			uniforms[m].SetMat4(state, UNIFORM_PROJECTION, identity);
+			uniforms[m].SetMat4(state, UNIFORM_VIEW, identity);
+			state.UseProgram(shaders[m]->ID);
+			for (int i = 0; i < count; ++i)
+			{
+				palettes[m].Select(i);
+				uniforms[m].SetMat4(state, UNIFORM_MODEL, placements[i]);
+				model.Draw(state);
+			}
+			images[m].resize(IMAGE_SIZE * IMAGE_SIZE * 4);
+			glReadPixels(0, 0, IMAGE_SIZE, IMAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, images[m].data());
+		}
+
+		int covered = 0;
+		for (size_t p = 0; p < images[SKIN_MAT4].size(); p += 4)
+			covered += images[SKIN_MAT4][p] != 0 || images[SKIN_MAT4][p + 1] != 0 || images[SKIN_MAT4][p + 2] != 0;
+		ok &= covered > 0;
+		for (int m = SKIN_AFFINE3X4; m < SKIN_MODE_COUNT; ++m)
+		{
+			int different = DifferentPixels(images[m], images[SKIN_MAT4]);
+			bool required = m == SKIN_AFFINE3X4 || pose == 1;
+			bool match = different <= covered * EDGE_PIXELS;
+			if (required)
+				ok &= match;
+			printf("skinning %-6s %-4s against mat4: %d of %d covered pixels differ  %s\n", pose == 0 ? "bent" : "rigid",
+				SkinningModeName((SkinningMode)m), different, covered, !required ? "(not compared)" : match ? "OK" : "MISMATCH");
+		}
+	}
+
+	for (int m = 0; m < SKIN_MODE_COUNT; ++m)
+	{
+		palettes[m].Release();
+		delete shaders[m];
+	}
+	return ok && glGetError() == GL_NO_ERROR;
+}
+
+int main(int argc, char** argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 256;
+	if (count < 1 || !CreateContext())
+		return 1;
+
+	GLuint framebuffer, renderbuffers[2];
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, IMAGE_SIZE, IMAGE_SIZE);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, IMAGE_SIZE, IMAGE_SIZE);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	glViewport(0, 0, IMAGE_SIZE, IMAGE_SIZE);
+	glEnable(GL_DEPTH_TEST);
+
+	ModelData data;
+	std::map<std::string, unsigned int> textures;
+	MakeStrip(data, textures);
+	SkinnedModel model;
+	model.Init(data, textures);
+
+	InstancedSkinning instanced;
+	instanced.Init(count, RIG_BONES);
+	count = instanced.Capacity();
+	BonePaletteBuffer perCharacter;
+	perCharacter.Init(count, SKIN_AFFINE3X4);
+
+	Shader instancedShader("anim_model_instanced.vs", "anim_model.fs");
+	Shader referenceShader("anim_model_3x4.vs", "anim_model.fs");
+	perCharacter.Attach(referenceShader);
+	RenderState state;
+	ShaderUniforms instancedUniforms, referenceUniforms;
+	instancedUniforms.Init(instancedShader.ID);
+	referenceUniforms.Init(referenceShader.ID);
+
+	// a grid in clip space, every character bent differently
+	int side = (int)ceil(sqrt((double)count));
+	std::vector<glm::mat4> placements(count);
+	for (int i = 0; i < count; ++i)
+	{
+		for (int b = 0; b < RIG_BONES; ++b)
+		{
+			glm::mat4 bone = glm::rotate(glm::mat4(1.0f), 0.3f * sinf(i * 0.7f + b), glm::vec3(0.0f, 0.0f, 1.0f));
+			instanced.Palette(i)[b] = bone;
+			perCharacter.Palette(i)[b] = bone;
+		}
+		glm::vec3 position(-0.95f + 1.9f * (i % side + 0.5f) / side, -0.95f + 1.9f * (i / side) / side, -0.5f + 0.001f * i);
+		placements[i] = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.5f / side));
+		instanced.Model(i) = placements[i];
+	}
+
+	const glm::mat4 identity(1.0f);
+	auto drawInstanced = [&]() {
+		glClearColor(0.0f, 0.0f, 0.2f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		instanced.Upload(count);
+		instancedUniforms.SetMat4(state, UNIFORM_PROJECTION, identity);
+		instancedUniforms.SetMat4(state, UNIFORM_VIEW, identity);
+		instancedUniforms.SetVec3(state, UNIFORM_COLOR_TINT, glm::vec3(1.0f));
+		instanced.Draw(state, instancedUniforms, model);
+	};
+	auto drawPerCharacter = [&]() {
+		glClearColor(0.0f, 0.0f, 0.2f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		perCharacter.Upload();
+		referenceUniforms.SetMat4(state, UNIFORM_PROJECTION, identity);
+		referenceUniforms.SetMat4(state, UNIFORM_VIEW, identity);
+		referenceUniforms.SetVec3(state, UNIFORM_COLOR_TINT, glm::vec3(1.0f));
+		state.UseProgram(referenceShader.ID);
+		for (int i = 0; i < count; ++i)
+		{
+			perCharacter.Select(i);
+			referenceUniforms.SetMat4(state, UNIFORM_MODEL, placements[i]);
+			model.Draw(state);
+		}
+	};
+
+	std::vector<unsigned char> a(IMAGE_SIZE * IMAGE_SIZE * 4), b(a.size());
+	drawInstanced();
+	glReadPixels(0, 0, IMAGE_SIZE, IMAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, a.data());
+	drawPerCharacter();
+	glReadPixels(0, 0, IMAGE_SIZE, IMAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, b.data());
+
+	int covered = 0, different = 0;
+	for (int p = 0; p < IMAGE_SIZE * IMAGE_SIZE; ++p)
+	{
+		covered += a[p * 4] != 0;
+		different += memcmp(&a[p * 4], &b[p * 4], 4) != 0;
+	}
+	GLenum error = glGetError();
+	bool ok = different == 0 && covered > 0 && error == GL_NO_ERROR;
+	printf("%d instances: %d pixels covered, %d differ, GL error 0x%x  %s\n", count, covered, different, error, ok ? "OK" : "MISMATCH");
+	ok &= CompareSkinningModes(model, count, placements);
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		state = RenderState();
+		double start = Now();
+		for (int f = 0; f < TIMED_FRAMES; ++f)
+		{
+			pass == 0 ? drawInstanced() : drawPerCharacter();
+			state.EndFrame();
+		}
+		glFinish();
+		printf("%-14s %7.2f ms/frame, %d draw calls\n", pass == 0 ? "instanced" : "per character",
+			(Now() - start) / TIMED_FRAMES * 1000.0, pass == 0 ? 1 : count);
+		state.PrintSummary();
+	}
+
+	instanced.Release();
+	perCharacter.Release();
+	model.Release();
+	return ok ? 0 : 1;
+}
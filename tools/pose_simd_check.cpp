@@ -0,0 +1,205 @@
+// pose_simd_check.cpp
+//
+// Checks the SIMD pose kernels of pose_simd.h against their scalar twins and the
+// struct-of-arrays hierarchy walk against the glm one the baker used before.
+//
+//   pose_simd_check [rigs] [seed]
+//
+//   palette     LerpPalette / BlendPalette / OffsetPalette vs the scalar loops, random data with a
+//               length that isn't a multiple of the vector width
+//   compose     the SSE / AVX2 local transform kernels vs ComposeLocalsScalar, on
+//               random key pairs (including pairs more than 180 degrees apart)
+//   hierarchy   PoseHierarchySoA vs PoseHierarchy on random rigs with missing tracks
+//               and channels, scaled nodes and keys far apart
+//
+// palette and compose must match to float precision; hierarchy differs by the slerp
+// approximation and must stay under HIERARCHY_TOLERANCE. The exit code is non-zero
+// if any check fails. Build once plain and once with -mavx2 to cover both kernels.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> pose_simd_check.cpp -o pose_simd_check
+
+#include "../pose_bake.h"
+#include "synthetic_rig.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+const float KERNEL_TOLERANCE = 1e-5f;
+const float HIERARCHY_TOLERANCE = 2e-3f;
+
+static bool Report(const char* name, float error, float tolerance)
+{
+	bool ok = error <= tolerance;
+	printf("%-10s max error %.3g (tolerance %.3g)  %s\n", name, error, tolerance, ok ? "OK" : "MISMATCH");
+	return ok;
+}
+
+// ----------------------------------------------------------------------------
+// checks
+// ----------------------------------------------------------------------------
+
+static float CheckPalette(unsigned int& rng)
+{
+	const size_t count = 65 * 16 + 3;
+	std::vector<float> a0(count), a1(count), b0(count), b1(count), simd(count), scalar(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		a0[i] = RandomFloat(rng, -2, 2);
+		a1[i] = RandomFloat(rng, -2, 2);
+		b0[i] = RandomFloat(rng, -2, 2);
+		b1[i] = RandomFloat(rng, -2, 2);
+	}
+
+	float error = 0.0f;
+	for (int round = 0; round < 100; ++round)
+	{
+		float fa = RandomFloat(rng, 0, 1), fb = RandomFloat(rng, 0, 1), blend = RandomFloat(rng, 0, 1);
+		LerpPalette(a0.data(), a1.data(), fa, simd.data(), count);
+		LerpPaletteScalar(a0.data(), a1.data(), fa, scalar.data(), count);
+		for (size_t i = 0; i < count; ++i)
+			error = fmaxf(error, fabsf(simd[i] - scalar[i]));
+
+		BlendPalette(a0.data(), a1.data(), fa, b0.data(), b1.data(), fb, blend, simd.data(), count);
+		BlendPaletteScalar(a0.data(), a1.data(), fa, b0.data(), b1.data(), fb, blend, scalar.data(), count);
+		for (size_t i = 0; i < count; ++i)
+			error = fmaxf(error, fabsf(simd[i] - scalar[i]));
+
+		OffsetPalette(a0.data(), a1.data(), fa, b0.data(), blend, simd.data(), count);
+		OffsetPaletteScalar(a0.data(), a1.data(), fa, b0.data(), blend, scalar.data(), count);
+		for (size_t i = 0; i < count; ++i)
+			error = fmaxf(error, fabsf(simd[i] - scalar[i]));
+	}
+	return error;
+}
+
+static float CheckCompose(unsigned int& rng)
+{
+	const int count = 1000 + 5;
+	PoseLocalsSoA simd, scalar;
+	simd.Resize(count);
+	for (int f = 0; f < PF_M00; ++f)
+	{
+		float* field = simd.Field((PoseField)f);
+		for (int n = 0; n < count; ++n)
+			field[n] = RandomFloat(rng, -2, 2);
+	}
+	for (int n = 0; n < count; ++n)
+	{
+		// unit key rotations, arbitrary relative angle and sign, factors in [0, 1]
+		glm::quat a = RandomRotation(rng, 3.14159f), b = RandomRotation(rng, 3.14159f);
+		simd.Field(PF_ROT_A_X)[n] = a.x; simd.Field(PF_ROT_A_Y)[n] = a.y; simd.Field(PF_ROT_A_Z)[n] = a.z; simd.Field(PF_ROT_A_W)[n] = a.w;
+		simd.Field(PF_ROT_B_X)[n] = b.x; simd.Field(PF_ROT_B_Y)[n] = b.y; simd.Field(PF_ROT_B_Z)[n] = b.z; simd.Field(PF_ROT_B_W)[n] = b.w;
+		simd.Field(PF_POS_T)[n] = RandomFloat(rng, 0, 1);
+		simd.Field(PF_ROT_T)[n] = RandomFloat(rng, 0, 1);
+		simd.Field(PF_SCALE_T)[n] = RandomFloat(rng, 0, 1);
+	}
+	scalar = simd;
+
+	ComposeLocals(simd);
+	ComposeLocalsScalar(scalar, 0, count);
+
+	float error = 0.0f;
+	for (int f = PF_M00; f < PF_FIELD_COUNT; ++f)
+		for (int n = 0; n < count; ++n)
+			error = fmaxf(error, fabsf(simd.Field((PoseField)f)[n] - scalar.Field((PoseField)f)[n]));
+	return error;
+}
+
+// A 'nodeCount' node tree. Some nodes have no track or no bone, some tracks lack a
+// channel or have a single key, and rotation keys are up to 'maxAngle' apart.
+static void MakeRig(int nodeCount, float maxAngle, unsigned int& rng, ModelData& model, ClipData& clip)
+{
+	clip = ClipData();
+	clip.ticksPerSecond = 30.0f;
+	clip.duration = 30.0f;
+	model.bones.clear();
+	for (int n = 0; n < nodeCount; ++n)
+	{
+		int parent = n == 0 ? -1 : (int)(NextRandom(rng) % n);
+		glm::mat4 transformation = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.1f, 0.0f)) * glm::mat4_cast(RandomRotation(rng, 1.0f));
+		int boneId = NextRandom(rng) % 4 != 0 ? (int)model.bones.size() : -1;
+		AddRigNode(clip, model, parent, transformation, boneId, glm::inverse(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.1f * n, 0.0f))));
+
+		if (NextRandom(rng) % 8 != 0)
+		{
+			TrackData track;
+			track.node = n;
+			unsigned int channels = NextRandom(rng) % 8;
+			int keys = NextRandom(rng) % 4 == 0 ? 1 : 2 + NextRandom(rng) % 20;
+			glm::quat rotation = RandomRotation(rng, 3.14159f);
+			for (int k = 0; k < keys; ++k)
+			{
+				float t = keys == 1 ? 0.0f : clip.duration * k / (keys - 1);
+				rotation = rotation * RandomRotation(rng, maxAngle * 0.5f);
+				KeyPos p = { t, glm::vec3(RandomFloat(rng, -0.2f, 0.2f), RandomFloat(rng, 0.0f, 0.3f), RandomFloat(rng, -0.2f, 0.2f)) };
+				KeyRot r = { t, NextRandom(rng) % 2 ? rotation : -rotation };
+				KeyScale s = { t, glm::vec3(RandomFloat(rng, 0.8f, 1.2f)) };
+				if (channels != 1)
+					track.positions.push_back(p);
+				if (channels != 2)
+					track.rotations.push_back(r);
+				if (channels != 3)
+					track.scales.push_back(s);
+			}
+			clip.tracks.push_back(track);
+		}
+	}
+}
+
+static float CheckHierarchy(int rigs, unsigned int& rng)
+{
+	float error = 0.0f;
+	for (int r = 0; r < rigs; ++r)
+	{
+		ModelData model;
+		ClipData clip;
+		// neighbouring keys are usually close; every fourth rig has them up to 180 degrees apart
+		MakeRig(65, r % 4 == 3 ? 3.14159f : 0.6f, rng, model, clip);
+
+		const size_t nodeCount = clip.nodes.size();
+		std::vector<const TrackData*> tracks(nodeCount, NULL);
+		std::vector<const BoneData*> bones(nodeCount, NULL);
+		for (const TrackData& track : clip.tracks)
+			tracks[track.node] = &track;
+		for (size_t n = 0; n < nodeCount; ++n)
+		{
+			auto it = model.bones.find(clip.nodes[n].name);
+			if (it != model.bones.end())
+				bones[n] = &it->second;
+		}
+
+		std::vector<glm::mat4> globals(nodeCount), reference(model.bones.size()), palette(model.bones.size());
+		PoseLocalsSoA locals;
+		locals.Resize((int)nodeCount);
+		for (int s = 0; s < 50; ++s)
+		{
+			float time = RandomFloat(rng, -1.0f, clip.duration + 1.0f);
+			PoseHierarchy(clip, tracks.data(), bones.data(), time, globals.data(), reference.data());
+			PoseHierarchySoA(clip, tracks.data(), bones.data(), time, locals, globals.data(), palette.data());
+			for (size_t b = 0; b < palette.size(); ++b)
+				for (int c = 0; c < 4; ++c)
+					for (int i = 0; i < 4; ++i)
+						error = fmaxf(error, fabsf(palette[b][c][i] - reference[b][c][i]));
+		}
+	}
+	return error;
+}
+
+int main(int argc, char** argv)
+{
+	int rigs = argc > 1 ? atoi(argv[1]) : 40;
+	unsigned int rng = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : 1u;
+	if (rng == 0)
+		rng = 1;
+
+	printf("kernels: %s\n", PoseSimdName());
+	bool ok = true;
+	ok = Report("palette", CheckPalette(rng), KERNEL_TOLERANCE) && ok;
+	ok = Report("compose", CheckCompose(rng), KERNEL_TOLERANCE) && ok;
+	ok = Report("hierarchy", CheckHierarchy(rigs, rng), HIERARCHY_TOLERANCE) && ok;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+// render_queue_check.cpp
+//
+// Checks render_queue.h with a producer thread and a consumer thread, and times
+// what overlapping them buys:
+//
+//   triple    a free-running producer publishes frames through a bare TripleBuffer
+//             as fast as it can. Every frame the consumer gets must be whole (no
+//             slot written while it was read), newer than the last one, and the
+//             last frame published must arrive
+//   queue     the same through a FrameQueue. The producer waits for each frame to
+//             be taken, so the consumer must get every frame, in order, and Take()
+//             must return false after Stop()
+//   overlap   'build' and 'draw' stand-ins that do a fixed amount of work, run one after
+//             the other on one thread and then on two threads through a FrameQueue.
+//             With two cores the second should approach the slower of the two per
+//             frame instead of their sum
+//
+//   render_queue_check [frames] [buildMicroseconds] [drawMicroseconds]
+//
+// The exit code is non-zero if the triple or queue test fails; the overlap timing
+// is only reported.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. render_queue_check.cpp -o render_queue_check -pthread
+
+#include "../render_queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+const int PAYLOAD_WORDS = 4096;   // 16 KB, about the size of a RenderPacket
+
+struct TestFrame {
+	unsigned long long frame = 0;
+	unsigned int words[PAYLOAD_WORDS];
+};
+
+static void FillFrame(TestFrame& f, unsigned long long frame)
+{
+	f.frame = frame;
+	for (int w = 0; w < PAYLOAD_WORDS; ++w)
+		f.words[w] = (unsigned int)(frame * 2654435761u + w);
+}
+
+static bool FrameWhole(const TestFrame& f)
+{
+	for (int w = 0; w < PAYLOAD_WORDS; ++w)
+		if (f.words[w] != (unsigned int)(f.frame * 2654435761u + w))
+			return false;
+	return true;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Fixed work rather than spinning until a deadline: a thread that is descheduled
+// halfway has to finish it later, so on one core the overlap gains nothing, as it
+// wouldn't with real build and draw work.
+static std::atomic<unsigned int> workSink;
+static double workPerMicrosecond = 0.0;
+
+static void Work(long long units)
+{
+	unsigned int x = 1;
+	for (long long i = 0; i < units; ++i)
+		x = x * 1664525u + 1013904223u;
+	workSink.store(x, std::memory_order_relaxed);
+}
+
+static void CalibrateWork()
+{
+	const long long units = 20000000;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Work(units);
+	workPerMicrosecond = units / (Seconds(start) * 1e6);
+}
+
+static void BusyFor(int microseconds)
+{
+	Work((long long)(microseconds * workPerMicrosecond));
+}
+
+static bool CheckTriple(int frames)
+{
+	static TripleBuffer<TestFrame> buffer;
+	std::thread producer([&]
+	{
+		for (int f = 1; f <= frames; ++f)
+		{
+			FillFrame(buffer.Back(), f);
+			buffer.Publish();
+		}
+	});
+
+	unsigned long long last = 0;
+	int received = 0, torn = 0, stale = 0;
+	while (last < (unsigned long long)frames)
+	{
+		if (!buffer.Acquire())
+			continue;
+		const TestFrame& f = buffer.Front();
+		if (!FrameWhole(f))
+			torn++;
+		if (f.frame <= last)
+			stale++;
+		last = f.frame;
+		received++;
+	}
+	producer.join();
+
+	bool ok = torn == 0 && stale == 0;
+	printf("triple   %d published, %d received (%d replaced before they were taken), %d torn, %d out of order  %s\n",
+		frames, received, frames - received, torn, stale, ok ? "OK" : "FAILED");
+	return ok;
+}
+
+static bool CheckQueue(int frames)
+{
+	static FrameQueue<TestFrame> queue;
+	std::thread producer([&]
+	{
+		for (int f = 1; f <= frames; ++f)
+		{
+			FillFrame(queue.Begin(), f);
+			queue.Submit();
+		}
+		queue.Stop();
+	});
+
+	unsigned long long last = 0;
+	int received = 0, torn = 0, skipped = 0;
+	while (queue.Take())
+	{
+		const TestFrame& f = queue.Front();
+		if (!FrameWhole(f))
+			torn++;
+		if (f.frame != last + 1)
+			skipped++;
+		last = f.frame;
+		received++;
+	}
+	producer.join();
+
+	bool ok = torn == 0 && skipped == 0 && received == frames && !queue.Take();
+	printf("queue    %d submitted, %d taken, %d torn, %d skipped or out of order  %s\n",
+		frames, received, torn, skipped, ok ? "OK" : "FAILED");
+	return ok;
+}
+
+static void TimeOverlap(int frames, int buildUs, int drawUs)
+{
+	static FrameQueue<TestFrame> queue;
+	CalibrateWork();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int f = 1; f <= frames; ++f)
+	{
+		TestFrame& frame = queue.Begin();
+		BusyFor(buildUs);
+		frame.frame = f;
+		queue.Submit();
+		queue.Take();
+		BusyFor(drawUs);
+	}
+	double serial = Seconds(start);
+
+	start = std::chrono::steady_clock::now();
+	std::thread renderThread([&]
+	{
+		while (queue.Take())
+			BusyFor(drawUs);
+	});
+	for (int f = 1; f <= frames; ++f)
+	{
+		TestFrame& frame = queue.Begin();
+		BusyFor(buildUs);
+		frame.frame = f;
+		queue.Submit();
+	}
+	queue.Stop();
+	renderThread.join();
+	double overlapped = Seconds(start);
+
+	printf("overlap  build %d us + draw %d us, %u hardware threads\n", buildUs, drawUs, std::thread::hardware_concurrency());
+	printf("  one thread     %8.3f ms/frame  %7.1f fps\n", serial * 1000.0 / frames, frames / serial);
+	printf("  render thread  %8.3f ms/frame  %7.1f fps  (%.2fx)\n", overlapped * 1000.0 / frames, frames / overlapped, serial / overlapped);
+}
+
+int main(int argc, char** argv)
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 20000;
+	int buildUs = argc > 2 ? atoi(argv[2]) : 2000;
+	int drawUs = argc > 3 ? atoi(argv[3]) : 3000;
+	if (frames < 1)
+		frames = 1;
+
+	bool ok = true;
+	ok &= CheckTriple(frames);
+	ok &= CheckQueue(frames);
+	// the timing runs really do their build and draw work, so they get fewer frames
+	TimeOverlap(frames < 500 ? frames : 500, buildUs, drawUs);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+// replay.cpp
+//
+// Re-simulates .lhrp recordings (replay.h) headless, as fast as Step() runs, and
+// checks each one still ends on the checksum it was recorded with. Use it as a
+// regression test over an archive of matches after touching match_sim.h or the
+// frame data.
+//
+//   replay [--moves <moves.txt>] <file.lhrp>...
+//
+// Matches run with the default clip tables and the given move table (the built-in
+// one without --moves). Recordings made with other tables, such as games recorded
+// with the real .dae timings, are reported as skipped; play those back with
+// skeletal_animation --replay instead. The exit code is non-zero if any replay
+// failed to load or desynced.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> replay.cpp -o replay
+
+#include "../replay.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+	MoveTable moves = DefaultMoveTable();
+	int first = 1;
+	if (argc > 2 && strcmp(argv[1], "--moves") == 0)
+	{
+		if (!LoadMoveTable(argv[2], moves))
+			return 1;
+		first = 3;
+	}
+	if (first >= argc)
+	{
+		printf("usage: replay [--moves <moves.txt>] <file.lhrp>...\n");
+		return 1;
+	}
+
+	MatchState fresh;
+	InitMatch(fresh, &DefaultClipTable(), &DefaultClipTable(), &moves);
+	unsigned int assetHash = ReplayAssetHash(fresh);
+
+	int passed = 0, failed = 0, skipped = 0;
+	unsigned long long ticks = 0, runs = 0;
+	double seconds = 0.0;
+
+	for (int i = first; i < argc; ++i)
+	{
+		Replay replay;
+		if (!LoadReplay(argv[i], replay))
+		{
+			++failed;
+			continue;
+		}
+		if (replay.assetHash != assetHash)
+		{
+			printf("%s: recorded with other tables (asset hash %08x, ours %08x), skipped\n", argv[i], replay.assetHash, assetHash);
+			++skipped;
+			continue;
+		}
+
+		MatchState match = fresh;
+		auto start = std::chrono::steady_clock::now();
+		unsigned int checksum = SimulateReplay(replay, match);
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		ticks += replay.tickCount;
+		runs += replay.runs.size();
+
+		if (checksum != replay.finalChecksum)
+		{
+			printf("%s: DESYNC after %u ticks (checksum %08x, recorded %08x)\n", argv[i], replay.tickCount, checksum, replay.finalChecksum);
+			++failed;
+		}
+		else
+		{
+			++passed;
+		}
+	}
+
+	printf("replays        : %d ok, %d failed, %d skipped\n", passed, failed, skipped);
+	printf("ticks          : %llu in %llu runs (%.1f ticks per run)\n", ticks, runs, runs ? (double)ticks / runs : 0.0);
+	if (seconds > 0.0)
+		printf("ticks/second   : %.0f\n", ticks / seconds);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,285 @@
+// selfplay.cpp
+//
+// Runs many independent headless matches across all cores for balance testing and
+// reports win rates, average match length and simulation throughput.
+//
+//   selfplay [matches] [threads] [p1 policy] [p2 policy] [seed] [record dir]
+//
+// threads 0 = one per hardware thread. Policies:
+//   random          button mashing, held for a few ticks at a time
+//   scripted        walks in, punches in range, holds back while the opponent attacks
+//   replay:<file>   the same player's inputs from a .lhrp recording, looped
+//
+// With a record dir every match is also saved as <dir>/match_<n>.lhrp (replay.h);
+// tools/replay.cpp re-runs them.
+//
+// Matches are handed out in batches of BATCH_SIZE to a WorkStealingPool. A batch
+// keeps its per-match bookkeeping in parallel arrays (state, rng, ticks, result)
+// and one thread steps every live match of the batch once per pass, so the hot
+// loop is Step() over a contiguous array of MatchStates. A match ends on a KO or
+// as a draw after MAX_TICKS.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> selfplay.cpp -o selfplay -pthread
+
+#include "../match_sim.h"
+#include "../replay.h"
+#include "../work_stealing.h"
+#include "synthetic_rig.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+const int BATCH_SIZE = 64;
+const unsigned int MAX_TICKS = 99 * 60;   // 99 second round timer
+
+// ----------------------------------------------------------------------------
+// policies
+// ----------------------------------------------------------------------------
+
+enum PolicyKind {
+	POLICY_RANDOM,
+	POLICY_SCRIPTED,
+	POLICY_REPLAY
+};
+
+struct Policy {
+	PolicyKind kind;
+	std::string name;
+	std::vector<unsigned short> replay[2];   // POLICY_REPLAY only, one tick per entry for each player
+};
+
+// no jump in any generated input: IDLE_JUMP has no way back to IDLE yet
+const unsigned short RANDOM_BUTTONS = (1 << 0) | (1 << 1) | (1 << 3) | (1 << 4) | (1 << 5);
+
+static InputFrame ScriptedInput(const MatchState& s, int self, unsigned int& rng)
+{
+	const PlayerState& me = s.p[self];
+	const PlayerState& enemy = s.p[1 - self];
+	float dz = enemy.position.z - me.position.z;
+	float distance = std::abs(dz);
+
+	InputFrame input = {};
+	bool towardRight = dz > 0.0f;
+	if (enemy.move != MOVE_NONE && distance < 3.0f)
+	{
+		// block; crouch half the time so both block states get exercised
+		input.moveLeft = towardRight;
+		input.moveRight = !towardRight;
+		input.crouch = (NextRandom(rng) & 1) != 0;
+	}
+	else if (distance > 2.2f)
+	{
+		input.moveLeft = !towardRight;
+		input.moveRight = towardRight;
+	}
+	else
+	{
+		// mostly punches, an occasional kick
+		unsigned int roll = NextRandom(rng) & 15;
+		input.punch = roll < 12;
+		input.jumpKick = roll == 12;
+	}
+	return input;
+}
+
+// 'held' is the random policy's current button set; replays are indexed by the match's frame
+static InputFrame PolicyInput(const Policy& policy, const MatchState& s, int self, unsigned int& rng, unsigned short& held)
+{
+	switch (policy.kind)
+	{
+	case POLICY_SCRIPTED:
+		return ScriptedInput(s, self, rng);
+	case POLICY_REPLAY:
+		return UnpackInput(policy.replay[self][s.frame % policy.replay[self].size()]);
+	default:
+		if ((NextRandom(rng) & 7) == 0)
+			held = (unsigned short)(NextRandom(rng) & RANDOM_BUTTONS);
+		return UnpackInput(held);
+	}
+}
+
+static bool ParsePolicy(const char* arg, Policy& policy)
+{
+	policy.name = arg;
+	if (strcmp(arg, "random") == 0)
+	{
+		policy.kind = POLICY_RANDOM;
+		return true;
+	}
+	if (strcmp(arg, "scripted") == 0)
+	{
+		policy.kind = POLICY_SCRIPTED;
+		return true;
+	}
+	if (strncmp(arg, "replay:", 7) == 0)
+	{
+		policy.kind = POLICY_REPLAY;
+		Replay replay;
+		if (!LoadReplay(arg + 7, replay))
+			return false;
+		if (replay.tickCount == 0)
+		{
+			printf("replay %s is empty\n", arg + 7);
+			return false;
+		}
+		// expanded, so the batch loop indexes by tick instead of walking runs
+		for (const ReplayRun& run : replay.runs)
+			for (int i = 0; i < 2; ++i)
+				policy.replay[i].insert(policy.replay[i].end(), run.ticks, run.buttons[i]);
+		return true;
+	}
+	printf("unknown policy %s\n", arg);
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+// batches
+// ----------------------------------------------------------------------------
+
+struct Results {
+	unsigned long long matches;
+	unsigned long long wins[2];
+	unsigned long long draws;
+	unsigned long long ticks;
+};
+
+struct Batch {
+	int count;
+	std::vector<MatchState> states;
+	std::vector<unsigned int> rng[2];
+	std::vector<unsigned short> held[2];
+	std::vector<unsigned char> live;
+	std::vector<Replay> recordings;   // only when recording
+};
+
+static void RunBatch(Batch& batch, unsigned int firstMatch, unsigned int seed, const Policy policies[2],
+	const std::string& recordDir, Results& results)
+{
+	bool recording = !recordDir.empty();
+	int count = batch.count;
+	batch.states.resize(count);
+	batch.live.assign(count, 1);
+	for (int i = 0; i < 2; ++i)
+	{
+		batch.rng[i].resize(count);
+		batch.held[i].assign(count, 0);
+	}
+
+	for (int m = 0; m < count; ++m)
+	{
+		InitMatch(batch.states[m]);
+		// a separate stream per match and player, so results don't depend on the batching
+		unsigned int matchSeed = seed ^ ((firstMatch + m) * 2654435761u);
+		for (int i = 0; i < 2; ++i)
+		{
+			unsigned int r = matchSeed + 0x9E3779B9u * (i + 1);
+			batch.rng[i][m] = r ? r : 1;
+		}
+	}
+	if (recording)
+	{
+		batch.recordings.resize(count);
+		for (int m = 0; m < count; ++m)
+			BeginReplay(batch.recordings[m], batch.states[m], seed);
+	}
+
+	int live = count;
+	while (live > 0)
+	{
+		for (int m = 0; m < count; ++m)
+		{
+			if (!batch.live[m])
+				continue;
+
+			MatchState& s = batch.states[m];
+			InputFrame p1 = PolicyInput(policies[0], s, 0, batch.rng[0][m], batch.held[0][m]);
+			InputFrame p2 = PolicyInput(policies[1], s, 1, batch.rng[1][m], batch.held[1][m]);
+			Step(s, p1, p2);
+			if (recording)
+				RecordTick(batch.recordings[m], p1, p2);
+
+			bool p1Down = s.p[0].HP <= 0.0f;
+			bool p2Down = s.p[1].HP <= 0.0f;
+			if (p1Down || p2Down || s.frame >= MAX_TICKS)
+			{
+				batch.live[m] = 0;
+				--live;
+				results.matches++;
+				results.ticks += s.frame;
+				if (p1Down == p2Down)
+					results.draws++;   // time out, or a double KO from a trade
+				else
+					results.wins[p2Down ? 0 : 1]++;
+
+				if (recording)
+				{
+					Replay& replay = batch.recordings[m];
+					replay.finalChecksum = ChecksumMatch(s);
+					char name[32];
+					snprintf(name, sizeof(name), "/match_%u.lhrp", firstMatch + m);
+					SaveReplay(recordDir + name, replay);
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int matches = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 100000;
+	int threads = argc > 2 ? atoi(argv[2]) : 0;
+	Policy policies[2];
+	if (!ParsePolicy(argc > 3 ? argv[3] : "random", policies[0]) ||
+		!ParsePolicy(argc > 4 ? argv[4] : "random", policies[1]))
+		return 1;
+	unsigned int seed = argc > 5 ? (unsigned int)strtoul(argv[5], NULL, 10) : 1u;
+	std::string recordDir = argc > 6 ? argv[6] : "";
+
+	WorkStealingPool pool(threads);
+	std::vector<Results> results(pool.ThreadCount());
+	memset(results.data(), 0, results.size() * sizeof(Results));
+	std::vector<Batch> batches(pool.ThreadCount());
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned int first = 0; first < matches; first += BATCH_SIZE)
+	{
+		int count = (int)std::min<unsigned int>(BATCH_SIZE, matches - first);
+		pool.Submit([&, first, count](int worker) {
+			Batch& batch = batches[worker];
+			batch.count = count;
+			RunBatch(batch, first, seed, policies, recordDir, results[worker]);
+		});
+	}
+	pool.Wait();
+
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+
+	Results total = {};
+	for (const Results& r : results)
+	{
+		total.matches += r.matches;
+		total.wins[0] += r.wins[0];
+		total.wins[1] += r.wins[1];
+		total.draws += r.draws;
+		total.ticks += r.ticks;
+	}
+
+	double n = total.matches ? (double)total.matches : 1.0;
+	printf("policies       : %s vs %s\n", policies[0].name.c_str(), policies[1].name.c_str());
+	printf("matches        : %llu on %d threads\n", total.matches, pool.ThreadCount());
+	printf("P1 wins        : %.2f%%\n", 100.0 * total.wins[0] / n);
+	printf("P2 wins        : %.2f%%\n", 100.0 * total.wins[1] / n);
+	printf("draws          : %.2f%%\n", 100.0 * total.draws / n);
+	printf("average length : %.0f ticks (%.1f s)\n", total.ticks / n, total.ticks / n * SIM_DT);
+	printf("wall time      : %.3f s\n", seconds);
+	printf("ticks/second   : %.0f\n", total.ticks / seconds);
+	printf("matches/second : %.0f\n", total.matches / seconds);
+	return 0;
+}
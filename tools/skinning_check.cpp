@@ -0,0 +1,181 @@
+// skinning_check.cpp
+//
+// Compares the packed skinning paths against the original mat4 path without a GPU.
+// The vertex math of anim_model.vs, anim_model_3x4.vs and anim_model_dq.vs is
+// mirrored here on the CPU. It runs over random rigs whose poses are lerped between
+// two samples, the same way the pose cache produces them, and reports the largest
+// position and normal difference per mode.
+//
+//   skinning_check [vertices] [seed]
+//
+// 3x4 must match mat4 to float precision. Dual quaternions are a different blend,
+// so for vertices with several influences they are only reported. Vertices bound
+// to a single bone must still match. The exit code is non-zero if either check fails.
+//
+// build (from this directory):
+//   g++ -O2 -std=c++17 -I.. -I<path to glm> skinning_check.cpp -o skinning_check
+
+#include "../skinning.h"
+#include "../pose_cache.h"
+#include "synthetic_rig.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static glm::mat4 RandomRigidBone(unsigned int& rng)
+{
+	glm::vec3 axis(RandomFloat(rng, -1, 1), RandomFloat(rng, -1, 1), RandomFloat(rng, -1, 1) + 0.01f);
+	glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(RandomFloat(rng, -1, 1), RandomFloat(rng, 0, 2), RandomFloat(rng, -1, 1)));
+	return glm::rotate(m, RandomFloat(rng, -3.0f, 3.0f), axis);
+}
+
+struct Vertex {
+	glm::vec3 pos, norm;
+	int boneIds[4];
+	float weights[4];
+};
+
+struct Skinned {
+	glm::vec3 pos, norm;
+};
+
+// anim_model.vs (positions only in the shader; the normal here is what it would be with the same blend)
+static Skinned SkinMat4(const glm::mat4* bones, const Vertex& v)
+{
+	glm::vec4 total(0.0f);
+	glm::vec3 normal(0.0f);
+	for (int i = 0; i < 4; ++i)
+	{
+		if (v.boneIds[i] == -1)
+			continue;
+		total += bones[v.boneIds[i]] * glm::vec4(v.pos, 1.0f) * v.weights[i];
+		normal += glm::mat3(bones[v.boneIds[i]]) * v.norm * v.weights[i];
+	}
+	Skinned s = { glm::vec3(total), glm::normalize(normal) };
+	return s;
+}
+
+// anim_model_3x4.vs
+static Skinned Skin3x4(const glm::vec4* rows, const Vertex& v)
+{
+	glm::vec4 r0(0.0f), r1(0.0f), r2(0.0f);
+	for (int i = 0; i < 4; ++i)
+	{
+		int b = glm::clamp(v.boneIds[i], 0, MAX_BONES - 1) * 3;
+		r0 += rows[b] * v.weights[i];
+		r1 += rows[b + 1] * v.weights[i];
+		r2 += rows[b + 2] * v.weights[i];
+	}
+	glm::vec4 p(v.pos, 1.0f);
+	Skinned s;
+	s.pos = glm::vec3(glm::dot(r0, p), glm::dot(r1, p), glm::dot(r2, p));
+	s.norm = glm::normalize(glm::vec3(glm::dot(glm::vec3(r0), v.norm), glm::dot(glm::vec3(r1), v.norm), glm::dot(glm::vec3(r2), v.norm)));
+	return s;
+}
+
+static glm::vec3 Rotate(const glm::vec4& q, const glm::vec3& v)
+{
+	glm::vec3 u(q);
+	return v + 2.0f * glm::cross(u, glm::cross(u, v) + q.w * v);
+}
+
+// anim_model_dq.vs
+static Skinned SkinDQ(const glm::vec4* dq, const Vertex& v)
+{
+	glm::vec4 pivot = dq[glm::clamp(v.boneIds[0], 0, MAX_BONES - 1) * 2];
+	glm::vec4 real(0.0f), dual(0.0f);
+	for (int i = 0; i < 4; ++i)
+	{
+		int b = glm::clamp(v.boneIds[i], 0, MAX_BONES - 1) * 2;
+		float w = glm::dot(dq[b], pivot) < 0.0f ? -v.weights[i] : v.weights[i];
+		real += dq[b] * w;
+		dual += dq[b + 1] * w;
+	}
+	float len = glm::max(glm::length(real), 1e-6f);
+	real = real / len;
+	dual = dual / len;
+
+	glm::vec3 realV(real), dualV(dual);
+	glm::vec3 translation = 2.0f * (real.w * dualV - dual.w * realV + glm::cross(realV, dualV));
+	Skinned s = { Rotate(real, v.pos) + translation, glm::normalize(Rotate(real, v.norm)) };
+	return s;
+}
+
+int main(int argc, char** argv)
+{
+	int vertexCount = argc > 1 ? atoi(argv[1]) : 100000;
+	unsigned int rng = argc > 2 ? (unsigned int)atoi(argv[2]) : 1;
+	if (rng == 0)
+		rng = 1;
+
+	const int boneCount = 64;
+	std::vector<glm::mat4> poseA(MAX_BONES, glm::mat4(1.0f)), poseB(MAX_BONES, glm::mat4(1.0f)), bones(MAX_BONES);
+	for (int b = 0; b < boneCount; ++b)
+	{
+		poseA[b] = RandomRigidBone(rng);
+		// next sample: a small step away, like two consecutive 60 Hz samples
+		poseB[b] = glm::rotate(poseA[b], RandomFloat(rng, -0.1f, 0.1f), glm::vec3(0.3f, 1.0f, 0.2f));
+	}
+
+	std::vector<glm::vec4> rows(MAX_BONES * 3), dq(MAX_BONES * 2);
+	float err3x4 = 0.0f, errDQSingle = 0.0f, errDQBlend = 0.0f, normal3x4 = 0.0f, normalDQSingle = 0.0f;
+
+	for (int v = 0; v < vertexCount; ++v)
+	{
+		// a fresh in-between pose every 1000 vertices
+		if (v % 1000 == 0)
+		{
+			float t = RandomFloat(rng, 0.0f, 1.0f);
+			for (int b = 0; b < MAX_BONES; ++b)
+				bones[b] = LerpMatrix(poseA[b], poseB[b], t);
+			PackPalette(SKIN_AFFINE3X4, bones.data(), MAX_BONES, rows.data());
+			PackPalette(SKIN_DUALQUAT, bones.data(), MAX_BONES, dq.data());
+		}
+
+		Vertex vertex;
+		vertex.pos = glm::vec3(RandomFloat(rng, -1, 1), RandomFloat(rng, 0, 2), RandomFloat(rng, -1, 1));
+		vertex.norm = glm::normalize(glm::vec3(RandomFloat(rng, -1, 1), RandomFloat(rng, -1, 1), RandomFloat(rng, -1, 1) + 0.01f));
+		int influences = 1 + NextRandom(rng) % 4;
+		float sum = 0.0f;
+		for (int i = 0; i < 4; ++i)
+		{
+			vertex.boneIds[i] = i < influences ? (int)(NextRandom(rng) % boneCount) : -1;
+			vertex.weights[i] = i < influences ? RandomFloat(rng, 0.1f, 1.0f) : 0.0f;
+			sum += vertex.weights[i];
+		}
+		for (int i = 0; i < 4; ++i)
+			vertex.weights[i] /= sum;
+
+		Skinned reference = SkinMat4(bones.data(), vertex);
+		Skinned affine = Skin3x4(rows.data(), vertex);
+		Skinned dual = SkinDQ(dq.data(), vertex);
+
+		err3x4 = glm::max(err3x4, glm::distance(reference.pos, affine.pos));
+		normal3x4 = glm::max(normal3x4, 1.0f - glm::dot(reference.norm, affine.norm));
+		if (influences == 1)
+		{
+			errDQSingle = glm::max(errDQSingle, glm::distance(reference.pos, dual.pos));
+			normalDQSingle = glm::max(normalDQSingle, 1.0f - glm::dot(reference.norm, dual.norm));
+		}
+		else
+		{
+			errDQBlend = glm::max(errDQBlend, glm::distance(reference.pos, dual.pos));
+		}
+	}
+
+	printf("vertices              : %d\n", vertexCount);
+	printf("palette bytes / bone  : mat4 %d, 3x4 %d, dq %d\n",
+		(int)(SkinningVec4sPerBone(SKIN_MAT4) * sizeof(glm::vec4)),
+		(int)(SkinningVec4sPerBone(SKIN_AFFINE3X4) * sizeof(glm::vec4)),
+		(int)(SkinningVec4sPerBone(SKIN_DUALQUAT) * sizeof(glm::vec4)));
+	printf("3x4 max position error: %g (normal 1-cos %g)\n", err3x4, normal3x4);
+	printf("dq  max position error: %g single bone (normal 1-cos %g), %g blended\n", errDQSingle, normalDQSingle, errDQBlend);
+
+	// lerped samples are not exactly rigid, which is where the single-bone dq error comes from
+	bool ok = err3x4 < 1e-4f && errDQSingle < 1e-2f;
+	printf("%s\n", ok ? "OK" : "MISMATCH");
+	return ok ? 0 : 1;
+}
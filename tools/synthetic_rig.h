@@ -0,0 +1,119 @@
+// synthetic_rig.h
+//
+// The random numbers and synthetic rigs the tools run on instead of assets. Each
+// tool seeds its own xorshift state, so the same seed gives the same rigs and input
+// on every platform.
+//
+//   unsigned int rng = seed;   // never 0
+//   MakeRig(65, 31, TreeParent, rng, model, clip);
+//
+// MakeRig builds the regular case: every node keyed evenly and also a bone. Tools
+// that need an odd rig build it node by node with AddRigNode.
+
+#pragma once
+
+#include "../asset_data.h"
+
+#include <string>
+
+inline unsigned int NextRandom(unsigned int& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+inline float RandomFloat(unsigned int& rng, float lo, float hi)
+{
+	return lo + (hi - lo) * (NextRandom(rng) % 100000) / 100000.0f;
+}
+
+// never zero: z is nudged off it
+inline glm::vec3 RandomAxis(unsigned int& rng)
+{
+	return glm::normalize(glm::vec3(RandomFloat(rng, -1, 1), RandomFloat(rng, -1, 1), RandomFloat(rng, -1, 1) + 0.01f));
+}
+
+inline glm::quat RandomRotation(unsigned int& rng, float maxAngle)
+{
+	glm::vec3 axis = RandomAxis(rng);
+	return glm::angleAxis(RandomFloat(rng, -maxAngle, maxAngle), axis);
+}
+
+// ----------------------------------------------------------------------------
+// rigs
+// ----------------------------------------------------------------------------
+
+// tree shapes for MakeRig: the parent of node n
+inline int ChainParent(int n) { return n - 1; }
+inline int TreeParent(int n) { return n == 0 ? -1 : (n - 1) / 2; }
+
+// What MakeRig builds. The defaults are a second of a 65 node binary tree at 30 fps.
+struct RigShape {
+	int nodes = 65;
+	int keys = 31;                        // per channel, spread evenly over the clip
+	int (*parentOf)(int) = TreeParent;
+	float ticksPerSecond = 30.0f;
+	float duration = 30.0f;               // ticks
+	const char* const* names = NULL;      // of the first 'nameCount' nodes; the rest are "node<n>"
+	int nameCount = 0;
+};
+
+// Appends a node to 'clip', named 'name' or "node<index>", and makes it bone 'boneId'
+// of 'model' unless that is negative. Returns the node's index.
+inline int AddRigNode(ClipData& clip, ModelData& model, int parent, const glm::mat4& transformation,
+	int boneId, const glm::mat4& offset = glm::mat4(1.0f), const char* name = NULL)
+{
+	int n = (int)clip.nodes.size();
+	NodeData node;
+	node.name = name ? std::string(name) : "node" + std::to_string(n);
+	node.parent = parent;
+	node.transformation = transformation;
+	clip.nodes.push_back(node);
+	if (boneId >= 0)
+	{
+		BoneData bone = { boneId, offset };
+		model.bones[node.name] = bone;
+	}
+	return n;
+}
+
+// 'shape.nodes' nodes, each bone n and keyed with small random rotations and
+// offsets from its parent, unit scale.
+inline void MakeRig(const RigShape& shape, unsigned int& rng, ModelData& model, ClipData& clip)
+{
+	clip = ClipData();
+	clip.ticksPerSecond = shape.ticksPerSecond;
+	clip.duration = shape.duration;
+	model.bones.clear();
+	for (int n = 0; n < shape.nodes; ++n)
+	{
+		AddRigNode(clip, model, shape.parentOf(n), glm::mat4(1.0f), n, glm::mat4(1.0f), n < shape.nameCount ? shape.names[n] : NULL);
+
+		TrackData track;
+		track.node = n;
+		for (int k = 0; k < shape.keys; ++k)
+		{
+			float t = clip.duration * k / (shape.keys - 1);
+			glm::vec3 axis = glm::normalize(glm::vec3(RandomFloat(rng, -1, 1), RandomFloat(rng, -1, 1), 1.0f));
+			KeyPos p = { t, glm::vec3(0.0f, RandomFloat(rng, 0.05f, 0.2f), 0.0f) };
+			KeyRot r = { t, glm::angleAxis(RandomFloat(rng, -0.5f, 0.5f), axis) };
+			KeyScale s = { t, glm::vec3(1.0f) };
+			track.positions.push_back(p);
+			track.rotations.push_back(r);
+			track.scales.push_back(s);
+		}
+		clip.tracks.push_back(track);
+	}
+}
+
+// 'nodeCount' nodes shaped by parentOf(n), 'keys' keys each, over one second
+inline void MakeRig(int nodeCount, int keys, int (*parentOf)(int), unsigned int& rng, ModelData& model, ClipData& clip)
+{
+	RigShape shape;
+	shape.nodes = nodeCount;
+	shape.keys = keys;
+	shape.parentOf = parentOf;
+	MakeRig(shape, rng, model, clip);
+}
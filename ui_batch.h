@@ -0,0 +1,150 @@
+// ui_batch.h
+//
+// Collects every HUD quad of a frame (HP bars now; timers, combo counters and
+// meter later) and draws them with one glDrawArrays. Vertices carry their own
+// color, so different bars don't need uniform changes between them.
+//
+// The VBO is created once and used as a ring of RING_SEGMENTS segments: each
+// frame writes the next segment through an unsynchronized map and drops a fence
+// behind its draw, and a segment is only rewritten after its fence has signalled.
+// No GL objects are created or deleted after Init().
+
+#pragma once
+
+#include "render_state.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <vector>
+
+struct UIVertex {
+	float x, y;
+	float r, g, b;
+};
+
+// axis aligned rectangle in screen pixels, origin bottom-left
+struct UIQuad {
+	float x, y;
+	float width, height;
+	glm::vec3 color;
+};
+
+// the filled portion of a bar
+inline UIQuad BarQuad(float x, float y, float width, float height, float percent, const glm::vec3& color)
+{
+	UIQuad quad = { x, y, width * percent, height, color };
+	return quad;
+}
+
+class UIBatch
+{
+public:
+	static const int RING_SEGMENTS = 3;
+
+	void Init(int maxQuadsPerFrame)
+	{
+		segmentVertices = maxQuadsPerFrame * 6;
+		vertices.reserve(segmentVertices);
+
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)segmentVertices * RING_SEGMENTS * sizeof(UIVertex), NULL, GL_DYNAMIC_DRAW);
+
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(UIVertex), (void*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(UIVertex), (void*)(2 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+
+		glBindVertexArray(0);
+
+		for (int i = 0; i < RING_SEGMENTS; ++i)
+			fences[i] = 0;
+	}
+
+	void Release()
+	{
+		for (int i = 0; i < RING_SEGMENTS; ++i)
+		{
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+		if (vbo)
+			glDeleteBuffers(1, &vbo);
+		if (vao)
+			glDeleteVertexArrays(1, &vao);
+		vbo = vao = 0;
+	}
+
+	void AddQuad(const UIQuad& quad)
+	{
+		AddQuad(quad.x, quad.y, quad.width, quad.height, quad.color);
+	}
+
+	// axis aligned rectangle in screen pixels, origin bottom-left
+	void AddQuad(float x, float y, float width, float height, const glm::vec3& color)
+	{
+		if ((int)vertices.size() + 6 > segmentVertices)
+			return;   // over budget for this frame; raise maxQuadsPerFrame in Init
+
+		UIVertex v0 = { x,         y,          color.x, color.y, color.z };
+		UIVertex v1 = { x + width, y,          color.x, color.y, color.z };
+		UIVertex v2 = { x + width, y + height, color.x, color.y, color.z };
+		UIVertex v3 = { x,         y + height, color.x, color.y, color.z };
+
+		vertices.push_back(v0);
+		vertices.push_back(v1);
+		vertices.push_back(v2);
+		vertices.push_back(v2);
+		vertices.push_back(v3);
+		vertices.push_back(v0);
+	}
+
+	// Draws everything queued since the last Flush. The caller binds the UI shader
+	// and sets up depth state; the batch only touches its own VAO/VBO.
+	void Flush(RenderState& state)
+	{
+		if (vertices.empty())
+			return;
+
+		// make sure the GPU is done reading this segment from RING_SEGMENTS frames ago
+		if (fences[segment])
+		{
+			glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+			glDeleteSync(fences[segment]);
+			fences[segment] = 0;
+		}
+
+		GLintptr offset = (GLintptr)segment * segmentVertices * sizeof(UIVertex);
+		GLsizeiptr size = (GLsizeiptr)vertices.size() * sizeof(UIVertex);
+
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		void* dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (dst)
+		{
+			memcpy(dst, vertices.data(), size);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+
+			state.BindVertexArray(vao);
+			glDrawArrays(GL_TRIANGLES, segment * segmentVertices, (GLsizei)vertices.size());
+
+			fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		segment = (segment + 1) % RING_SEGMENTS;
+		vertices.clear();
+	}
+
+private:
+	GLuint vao = 0, vbo = 0;
+	int segmentVertices = 0;
+	int segment = 0;
+	GLsync fences[RING_SEGMENTS];
+	std::vector<UIVertex> vertices;
+};
@@ -1,9 +1,13 @@
 #version 330 core
 layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec3 aColor;
 
 uniform mat4 projection; // Should be used to transform aPos
 
+out vec3 barColor;
+
 void main()
 {
+    barColor = aColor;
     gl_Position = projection * vec4(aPos.x, aPos.y, 0.0, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,154 @@
+// work_stealing.h
+//
+// Thread pool for lots of similar CPU-bound tasks (self-play batches, bulk baking).
+// Every worker owns a deque: it pops its own work from the back and, when that
+// runs dry, steals from the front of someone else's. Submit() spreads tasks
+// round-robin, so uneven task lengths even out through stealing instead of one
+// shared queue being hammered by every thread.
+//
+// Unlike JobSystem there is no main-thread queue; Wait() makes the calling thread
+// help until every submitted task has finished.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool
+{
+public:
+	// the argument is the index of the thread running the task, 0..ThreadCount()-1,
+	// so tasks can write per-thread results without locking
+	typedef std::function<void(int)> Task;
+
+	// threadCount 0 = one per hardware thread; the thread calling Wait() is one of them
+	explicit WorkStealingPool(int threadCount = 0)
+	{
+		if (threadCount <= 0)
+			threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int i = 0; i < threadCount; ++i)
+			queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		for (int i = 1; i < threadCount; ++i)
+			threads.push_back(std::thread(&WorkStealingPool::WorkerLoop, this, i));
+	}
+
+	~WorkStealingPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+
+	int ThreadCount() const { return (int)queues.size(); }
+
+	void Submit(Task task)
+	{
+		pending++;
+		Queue& queue = *queues[nextQueue++ % queues.size()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(task);
+		}
+		queued++;
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			wake.notify_one();
+		}
+	}
+
+	// runs tasks on the calling thread (as worker 0) until everything submitted is done
+	void Wait()
+	{
+		while (pending > 0)
+		{
+			Task task;
+			if (Take(0, task))
+				Run(0, task);
+			else
+				std::this_thread::yield();   // the rest is in flight on other threads
+		}
+	}
+
+private:
+	WorkStealingPool(const WorkStealingPool&);
+	WorkStealingPool& operator=(const WorkStealingPool&);
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	bool Take(int self, Task& task)
+	{
+		{
+			Queue& own = *queues[self];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty())
+			{
+				task = own.tasks.back();
+				own.tasks.pop_back();
+				queued--;
+				return true;
+			}
+		}
+		for (size_t i = 1; i < queues.size(); ++i)
+		{
+			Queue& victim = *queues[(self + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				task = victim.tasks.front();
+				victim.tasks.pop_front();
+				queued--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Run(int self, Task& task)
+	{
+		task(self);
+		pending--;
+	}
+
+	void WorkerLoop(int self)
+	{
+		for (;;)
+		{
+			Task task;
+			if (Take(self, task))
+			{
+				Run(self, task);
+				continue;
+			}
+
+			// sleep until something is queued; checked under the lock Submit() notifies
+			// with, so a task submitted right now can't slip past
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this] { return quit || queued > 0; });
+			if (quit)
+				return;
+		}
+	}
+
+	std::vector<std::unique_ptr<Queue> > queues;
+	std::vector<std::thread> threads;
+	std::atomic<int> pending{ 0 };   // submitted and not finished
+	std::atomic<int> queued{ 0 };    // submitted and not picked up yet
+	std::atomic<unsigned int> nextQueue{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	bool quit = false;
+};